@@ -0,0 +1,219 @@
+#pragma once
+
+// Minimal microbenchmark harness in the style of Google Benchmark, without
+// the dependency. A benchmark is a function taking a State, looping while
+// state.keepRunning() and telling the state how many items one iteration
+// processes. The runner picks the iteration count so a run lasts about
+// --min-time, repeats it and reports the median time per item.
+//
+// For perf stat, run a single benchmark with a fixed iteration count so the
+// counters can be divided by the printed item count:
+//   perf stat -e cycles,instructions,cache-misses ./cpu_micro --filter mat4/10000 --iterations 1000
+//
+// The timing and percentile helpers are shared with the standalone benchmarks
+// that run their own loops.
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+    // Keeps the compiler from discarding a result or hoisting work out of the loop.
+    template <typename T>
+    inline void doNotOptimize(T const& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    inline void clobberMemory() {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : : "memory");
+#endif
+    }
+
+    inline double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Nearest rank percentile, p from 0 to 1. 0 for no values.
+    inline double percentile(std::vector<double> values, double p) {
+        if(values.empty()) return 0.0;
+        std::sort(values.begin(), values.end());
+        const size_t index = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+        return values[index];
+    }
+
+    class State {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            State(uint64_t iterations, int64_t arg) : m_Iterations(iterations), m_Arg(arg) {}
+
+            // True until the iteration count is reached. Times everything between
+            // the first and the last call, setup before the loop isn't counted.
+            bool keepRunning() {
+                if(m_Done == 0) {
+                    m_Start = Clock::now();
+                }
+                if(m_Done++ < m_Iterations) {
+                    return true;
+                }
+                m_Elapsed += Clock::now() - m_Start;
+                return false;
+            }
+
+            // Excludes per-iteration setup from the measurement.
+            void pauseTiming() { m_Elapsed += Clock::now() - m_Start; }
+            void resumeTiming() { m_Start = Clock::now(); }
+
+            int64_t arg() const { return m_Arg; }
+            uint64_t iterations() const { return m_Iterations; }
+            void setItemsPerIteration(uint64_t items) { m_ItemsPerIteration = items; }
+            void setBytesPerIteration(uint64_t bytes) { m_BytesPerIteration = bytes; }
+            void skip(std::string reason) { m_SkipReason = std::move(reason); }
+
+            double seconds() const { return std::chrono::duration<double>(m_Elapsed).count(); }
+            uint64_t items() const { return m_Iterations * m_ItemsPerIteration; }
+            uint64_t bytes() const { return m_Iterations * m_BytesPerIteration; }
+            const std::string& skipReason() const { return m_SkipReason; }
+
+        private:
+
+            uint64_t m_Iterations;
+            int64_t m_Arg;
+            uint64_t m_Done{0};
+            uint64_t m_ItemsPerIteration{1};
+            uint64_t m_BytesPerIteration{0};
+            Clock::time_point m_Start{};
+            Clock::duration m_Elapsed{0};
+            std::string m_SkipReason;
+    };
+
+    struct Benchmark {
+        std::string name;
+        std::function<void(State&)> function;
+        std::vector<int64_t> args; // One run per argument, usually the batch size.
+    };
+
+    struct Options {
+        std::string filter;          // Substring of "name/arg".
+        double minTime = 0.5;        // Seconds per repetition.
+        int repetitions = 5;
+        uint64_t iterations = 0;     // Fixed count instead of calibrating, for perf stat.
+        bool csv = false;
+    };
+
+    inline Options parseOptions(int argc, char** argv) {
+        Options options{};
+        auto value = [&](int& i) -> std::string {
+            if(i + 1 >= argc) {
+                throw std::invalid_argument(std::string{"missing value for "} + argv[i]);
+            }
+            return argv[++i];
+        };
+        for(int i = 1; i < argc; i++) {
+            const std::string option = argv[i];
+            if(option == "--filter") {
+                options.filter = value(i);
+            } else if(option == "--min-time") {
+                options.minTime = std::stod(value(i));
+            } else if(option == "--repetitions") {
+                options.repetitions = std::max(1, std::stoi(value(i)));
+            } else if(option == "--iterations") {
+                options.iterations = std::stoull(value(i));
+            } else if(option == "--csv") {
+                options.csv = true;
+            } else {
+                throw std::invalid_argument("unknown option " + option);
+            }
+        }
+        return options;
+    }
+
+    // Runs every benchmark matching the filter and prints one line per argument.
+    inline void runBenchmarks(const std::vector<Benchmark>& benchmarks, const Options& options) {
+        if(options.csv) {
+            std::printf("name,iterations,items,ns_per_item,items_per_second,bytes_per_second\n");
+        } else {
+            std::printf("%-34s %12s %14s %12s %14s %12s\n",
+                        "benchmark", "iterations", "items", "ns/item", "items/s", "MB/s");
+        }
+
+        for(const Benchmark& benchmark : benchmarks) {
+            for(int64_t arg : benchmark.args) {
+                const std::string name = benchmark.name + "/" + std::to_string(arg);
+                if(!options.filter.empty() && name.find(options.filter) == std::string::npos) continue;
+
+                // Grow the count until a run is long enough to extrapolate from.
+                uint64_t iterations = options.iterations;
+                if(iterations == 0) {
+                    iterations = 1;
+                    for(;;) {
+                        State probe{iterations, arg};
+                        benchmark.function(probe);
+                        if(!probe.skipReason().empty()) break;
+                        if(probe.seconds() >= options.minTime / 10.0 || iterations >= (1ull << 40)) {
+                            const double perIteration = probe.seconds() / static_cast<double>(iterations);
+                            iterations = std::max<uint64_t>(1, static_cast<uint64_t>(options.minTime / std::max(perIteration, 1e-12)));
+                            break;
+                        }
+                        iterations *= 10;
+                    }
+                }
+
+                std::vector<double> nsPerItem;
+                uint64_t items = 0;
+                uint64_t bytes = 0;
+                double seconds = 0.0;
+                std::string skipReason;
+                for(int repetition = 0; repetition < options.repetitions; repetition++) {
+                    State state{iterations, arg};
+                    benchmark.function(state);
+                    if(!state.skipReason().empty()) {
+                        skipReason = state.skipReason();
+                        break;
+                    }
+                    nsPerItem.push_back(state.seconds() * 1e9 / static_cast<double>(std::max<uint64_t>(state.items(), 1)));
+                    items = state.items();
+                    bytes = state.bytes();
+                    seconds = state.seconds();
+                }
+
+                if(!skipReason.empty()) {
+                    std::printf("%-34s skipped: %s\n", name.c_str(), skipReason.c_str());
+                    continue;
+                }
+
+                std::sort(nsPerItem.begin(), nsPerItem.end());
+                const double median = nsPerItem[nsPerItem.size() / 2];
+                const double itemsPerSecond = median > 0.0 ? 1e9 / median : 0.0;
+                const double bytesPerSecond = items > 0 && seconds > 0.0
+                    ? static_cast<double>(bytes) / static_cast<double>(items) * itemsPerSecond : 0.0;
+
+                if(options.csv) {
+                    std::printf("%s,%llu,%llu,%.3f,%.1f,%.1f\n", name.c_str(),
+                                static_cast<unsigned long long>(iterations), static_cast<unsigned long long>(items),
+                                median, itemsPerSecond, bytesPerSecond);
+                } else {
+                    std::printf("%-34s %12llu %14llu %12.3f %14.4g %12.1f\n", name.c_str(),
+                                static_cast<unsigned long long>(iterations), static_cast<unsigned long long>(items),
+                                median, itemsPerSecond, bytesPerSecond / (1024.0 * 1024.0));
+                }
+            }
+        }
+    }
+} // namespace bench
@@ -0,0 +1,169 @@
+// Broadphase benchmark.
+//
+// Boxes of random sizes spread evenly through a cube, about one overlap per
+// box, each jittering a little every step like bodies between physics steps.
+// For every body count and method it times the first update, which sorts or
+// hashes from scratch, and the median of the ones after it, and reports the
+// overlapping pairs found per second of update along with how many pairs
+// began and ended per step. The pairs of the last step are checked against
+// testing every pair up to --exact-limit bodies. Updates run on every
+// hardware thread.
+//
+// Usage: broadphase [--bodies N]... [--method sap|grid]... [--steps N] [--exact-limit N]
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+#include "../src/teng_broadphase.hpp"
+#include "../src/teng_thread_pool.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+    using Method = teng::Broadphase::Method;
+
+    // Boxes per unit of volume, with half sizes of .25 to .75 about one overlap each.
+    constexpr float DENSITY = .25f;
+    // How far a box moves per step along each axis, at most.
+    constexpr float JITTER = .05f;
+
+    struct Options {
+        std::vector<uint32_t> bodyCounts;
+        std::vector<Method> methods;
+        int steps = 10;
+        uint32_t exactLimit = 10000;
+    };
+
+    Options parse(int argc, char** argv) {
+        Options options{};
+        for(int i = 1; i < argc; i++) {
+            const std::string option = argv[i];
+            if(i + 1 >= argc) throw std::invalid_argument("missing value for " + option);
+            const std::string value = argv[++i];
+            if(option == "--bodies") {
+                options.bodyCounts.push_back(static_cast<uint32_t>(std::stoul(value)));
+            } else if(option == "--method") {
+                if(value == "sap") {
+                    options.methods.push_back(Method::SweepAndPrune);
+                } else if(value == "grid") {
+                    options.methods.push_back(Method::UniformGrid);
+                } else {
+                    throw std::invalid_argument("unknown method " + value);
+                }
+            } else if(option == "--steps") {
+                options.steps = std::max(2, std::stoi(value));
+            } else if(option == "--exact-limit") {
+                options.exactLimit = static_cast<uint32_t>(std::stoul(value));
+            } else {
+                throw std::invalid_argument("unknown option " + option);
+            }
+        }
+        if(options.bodyCounts.empty()) options.bodyCounts = {10000, 100000, 1000000};
+        if(options.methods.empty()) options.methods = {Method::SweepAndPrune, Method::UniformGrid};
+        return options;
+    }
+
+    std::vector<teng::Aabb> randomBoxes(uint32_t count, std::mt19937& random) {
+        const float side = std::cbrt(static_cast<float>(count) / DENSITY);
+        std::uniform_real_distribution<float> position{0.f, side};
+        std::uniform_real_distribution<float> halfSize{.25f, .75f};
+        std::vector<teng::Aabb> boxes(count);
+        for(teng::Aabb& box : boxes) {
+            const glm::vec3 center{position(random), position(random), position(random)};
+            const glm::vec3 extent{halfSize(random)};
+            box = {center - extent, center + extent};
+        }
+        return boxes;
+    }
+
+    void jitter(std::vector<teng::Aabb>& boxes, std::mt19937& random) {
+        std::uniform_real_distribution<float> offset{-JITTER, JITTER};
+        for(teng::Aabb& box : boxes) {
+            const glm::vec3 move{offset(random), offset(random), offset(random)};
+            box = {box.min + move, box.max + move};
+        }
+    }
+
+    // Whether pairs are exactly the overlapping pairs of boxes.
+    bool matchesAllPairs(const std::vector<teng::Aabb>& boxes, const std::vector<teng::Broadphase::Pair>& pairs) {
+        std::vector<teng::Broadphase::Pair> exact;
+        const uint32_t count = static_cast<uint32_t>(boxes.size());
+        for(uint32_t a = 0; a < count; a++) {
+            for(uint32_t b = a + 1; b < count; b++) {
+                if(boxes[a].overlaps(boxes[b])) exact.push_back({a, b});
+            }
+        }
+        return exact == pairs;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parse(argc, argv);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << "\n"
+                  << "usage: broadphase [--bodies N]... [--method sap|grid]... [--steps N] [--exact-limit N]\n";
+        return EXIT_FAILURE;
+    }
+
+    teng::ThreadPool threadPool;
+    std::printf("%u threads\n", threadPool.getThreadCount());
+    std::printf("%10s %6s %10s %10s %10s %8s %8s %12s %8s\n",
+        "bodies", "method", "first ms", "ms", "pairs", "began", "ended", "Mpairs/s", "check");
+
+    bool allMatched = true;
+    for(uint32_t count : options.bodyCounts) {
+        for(Method method : options.methods) {
+            // The same boxes and moves for every method.
+            std::mt19937 random{1234};
+            std::vector<teng::Aabb> boxes = randomBoxes(count, random);
+
+            teng::Broadphase::Settings settings{};
+            settings.method = method;
+            teng::Broadphase broadphase{settings};
+
+            auto start = Clock::now();
+            broadphase.update(boxes.data(), count, &threadPool);
+            const double firstMs = bench::millisecondsSince(start);
+
+            std::vector<double> times;
+            size_t began = 0;
+            size_t ended = 0;
+            for(int step = 1; step < options.steps; step++) {
+                jitter(boxes, random);
+                start = Clock::now();
+                broadphase.update(boxes.data(), count, &threadPool);
+                times.push_back(bench::millisecondsSince(start));
+                began += broadphase.getBeganPairs().size();
+                ended += broadphase.getEndedPairs().size();
+            }
+
+            const char* check = "-";
+            if(count <= options.exactLimit) {
+                const bool matched = matchesAllPairs(boxes, broadphase.getPairs());
+                allMatched = allMatched && matched;
+                check = matched ? "ok" : "WRONG";
+            }
+
+            const double ms = bench::percentile(times, .5);
+            const size_t pairs = broadphase.getPairs().size();
+            const double updates = static_cast<double>(options.steps - 1);
+            std::printf("%10u %6s %10.2f %10.2f %10zu %8.0f %8.0f %12.2f %8s\n",
+                count, method == Method::SweepAndPrune ? "sap" : "grid", firstMs, ms, pairs,
+                began / updates, ended / updates, static_cast<double>(pairs) / ms / 1e3, check);
+        }
+    }
+    return allMatched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,696 @@
+// CPU microbenchmarks.
+//
+// Measures the per-object and per-vertex hot paths at realistic batch sizes:
+// building model and normal matrices from TransformComponent and with
+// TransformBatch (whose instruction set goes to stderr), hashing
+// Model::Vertex the way loadModel deduplicates them, loading OBJ files,
+// building the camera's view matrix, the gravity and transform passes over a
+// Registry against the same passes over GameObjects, despawning and spawning
+// GameObjects in a GameObjectPool against a vector, the registry's cached
+// matrix update with all or no entities moved and through a moved parent, on
+// one thread and on all of them, and frustum culls and ray picks with the Bvh
+// against linear scans over the same boxes. Reports ns per item and
+// throughput, see bench_harness.hpp for the options and for running under perf stat.
+//
+// Usage: cpu_micro [--filter name] [--min-time s] [--repetitions N] [--iterations N] [--csv]
+//                  [--obj file]...
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+
+#include "../src/teng_game_object.hpp"
+#include "../src/teng_registry.hpp"
+#include "../src/teng_transform_batch.hpp"
+#include "../src/teng_thread_pool.hpp"
+#include "../src/teng_bvh.hpp"
+#include "../src/teng_model.hpp"
+#include "../src/camera.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+    // Same seed every run, so runs compare.
+    std::vector<teng::TransformComponent> randomTransforms(size_t count) {
+        std::mt19937 random{1234};
+        std::uniform_real_distribution<float> position{-10.f, 10.f};
+        std::uniform_real_distribution<float> angle{-3.14159f, 3.14159f};
+        std::uniform_real_distribution<float> scale{.1f, 2.f};
+
+        std::vector<teng::TransformComponent> transforms(count);
+        for(auto& transform : transforms) {
+            transform.translation = {position(random), position(random), position(random)};
+            transform.rotation = {angle(random), angle(random), angle(random)};
+            transform.scale = {scale(random), scale(random), scale(random)};
+        }
+        return transforms;
+    }
+
+    // Vertices of a triangulated grid, each shared by up to six triangles, like a loaded mesh.
+    std::vector<teng::Model::Vertex> gridVertices(size_t count) {
+        std::vector<teng::Model::Vertex> vertices(count);
+        const size_t side = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(count))));
+        for(size_t i = 0; i < count; i++) {
+            const float x = static_cast<float>(i % side);
+            const float z = static_cast<float>(i / side);
+            vertices[i].position = {x * .1f, std::sin(x * .3f) * std::cos(z * .2f), z * .1f};
+            vertices[i].color = {.5f, .5f, .5f};
+            vertices[i].normal = glm::normalize(glm::vec3{-std::cos(x * .3f), 1.f, std::sin(z * .2f)});
+            vertices[i].uv = {x / static_cast<float>(side), z / static_cast<float>(side)};
+        }
+        return vertices;
+    }
+
+    // Writes a grid of quads as OBJ, faces referencing positions, normals and uvs,
+    // so loadModel can be measured without the model files.
+    std::string writeGridObj(size_t quadsPerSide) {
+        const auto path = std::filesystem::temp_directory_path() /
+            ("teng_cpu_micro_grid_" + std::to_string(quadsPerSide) + ".obj");
+        std::ofstream out{path};
+        const size_t side = quadsPerSide + 1;
+        for(size_t z = 0; z < side; z++) {
+            for(size_t x = 0; x < side; x++) {
+                const float fx = static_cast<float>(x), fz = static_cast<float>(z);
+                out << "v " << fx * .1f << ' ' << std::sin(fx * .3f) * std::cos(fz * .2f) << ' ' << fz * .1f << " .5 .5 .5\n";
+                out << "vn 0 1 0\n";
+                out << "vt " << fx / quadsPerSide << ' ' << fz / quadsPerSide << "\n";
+            }
+        }
+        for(size_t z = 0; z < quadsPerSide; z++) {
+            for(size_t x = 0; x < quadsPerSide; x++) {
+                const size_t a = z * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+                out << "f " << a << '/' << a << '/' << a << ' ' << c << '/' << c << '/' << c << ' ' << b << '/' << b << '/' << b << "\n";
+                out << "f " << b << '/' << b << '/' << b << ' ' << c << '/' << c << '/' << c << ' ' << d << '/' << d << '/' << d << "\n";
+            }
+        }
+        return path.string();
+    }
+
+    void transformMat4(bench::State& state) {
+        auto transforms = randomTransforms(static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(transforms.size());
+        state.setBytesPerIteration(transforms.size() * sizeof(glm::mat4));
+        while(state.keepRunning()) {
+            for(auto& transform : transforms) {
+                bench::doNotOptimize(transform.mat4());
+            }
+        }
+    }
+
+    void transformNormalMatrix(bench::State& state) {
+        auto transforms = randomTransforms(static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(transforms.size());
+        state.setBytesPerIteration(transforms.size() * sizeof(glm::mat3));
+        while(state.keepRunning()) {
+            for(auto& transform : transforms) {
+                bench::doNotOptimize(transform.normalMatrix());
+            }
+        }
+    }
+
+    // Both matrices per object, what Registry::updateWorldMatrices does for a dirty entity.
+    void transformBoth(bench::State& state) {
+        auto transforms = randomTransforms(static_cast<size_t>(state.arg()));
+        std::vector<glm::mat4> models(transforms.size());
+        std::vector<glm::mat4> normals(transforms.size());
+        state.setItemsPerIteration(transforms.size());
+        state.setBytesPerIteration(transforms.size() * 2 * sizeof(glm::mat4));
+        while(state.keepRunning()) {
+            for(size_t i = 0; i < transforms.size(); i++) {
+                models[i] = transforms[i].mat4();
+                normals[i] = transforms[i].normalMatrix();
+            }
+            bench::clobberMemory();
+        }
+    }
+
+    // The same transforms as transform_mat4_and_normal through TransformBatch,
+    // with the rotations as Euler angles and as quaternions.
+    struct TransformArrays {
+        std::vector<glm::vec3> translations;
+        std::vector<glm::vec3> rotations;
+        std::vector<glm::quat> orientations;
+        std::vector<glm::vec3> scales;
+        std::vector<glm::mat4> models;
+        std::vector<glm::mat4> normals;
+    };
+
+    TransformArrays transformArrays(size_t count) {
+        TransformArrays arrays;
+        for(const auto& transform : randomTransforms(count)) {
+            arrays.translations.push_back(transform.translation);
+            arrays.rotations.push_back(transform.rotation);
+            arrays.orientations.push_back(teng::TransformComponent::s_Orientation(transform.rotation));
+            arrays.scales.push_back(transform.scale);
+        }
+        arrays.models.resize(count);
+        arrays.normals.resize(count);
+        return arrays;
+    }
+
+    void transformBatchEuler(bench::State& state) {
+        auto arrays = transformArrays(static_cast<size_t>(state.arg()));
+        const uint32_t count = static_cast<uint32_t>(arrays.translations.size());
+        state.setItemsPerIteration(count);
+        state.setBytesPerIteration(count * 2 * sizeof(glm::mat4));
+        while(state.keepRunning()) {
+            teng::TransformBatch::s_EulerMatrices(
+                arrays.translations.data(), arrays.rotations.data(), arrays.scales.data(),
+                nullptr, count, arrays.models.data(), arrays.normals.data());
+            bench::clobberMemory();
+        }
+    }
+
+    void transformBatchQuaternion(bench::State& state) {
+        auto arrays = transformArrays(static_cast<size_t>(state.arg()));
+        const uint32_t count = static_cast<uint32_t>(arrays.translations.size());
+        state.setItemsPerIteration(count);
+        state.setBytesPerIteration(count * 2 * sizeof(glm::mat4));
+        while(state.keepRunning()) {
+            teng::TransformBatch::s_QuaternionMatrices(
+                arrays.translations.data(), arrays.orientations.data(), arrays.scales.data(),
+                nullptr, count, arrays.models.data(), arrays.normals.data());
+            bench::clobberMemory();
+        }
+    }
+
+    std::vector<float> randomAngles(size_t count) {
+        std::mt19937 random{1234};
+        std::uniform_real_distribution<float> angle{-3.14159f, 3.14159f};
+        std::vector<float> angles(count);
+        for(auto& a : angles) a = angle(random);
+        return angles;
+    }
+
+    void sinCosStd(bench::State& state) {
+        const auto angles = randomAngles(static_cast<size_t>(state.arg()));
+        std::vector<float> sines(angles.size());
+        std::vector<float> cosines(angles.size());
+        state.setItemsPerIteration(angles.size());
+        while(state.keepRunning()) {
+            for(size_t i = 0; i < angles.size(); i++) {
+                sines[i] = std::sin(angles[i]);
+                cosines[i] = std::cos(angles[i]);
+            }
+            bench::clobberMemory();
+        }
+    }
+
+    void sinCosBatch(bench::State& state) {
+        const auto angles = randomAngles(static_cast<size_t>(state.arg()));
+        std::vector<float> sines(angles.size());
+        std::vector<float> cosines(angles.size());
+        state.setItemsPerIteration(angles.size());
+        while(state.keepRunning()) {
+            teng::TransformBatch::s_SinCos(angles.data(), static_cast<uint32_t>(angles.size()), sines.data(), cosines.data());
+            bench::clobberMemory();
+        }
+    }
+
+    void vertexHash(bench::State& state) {
+        const auto vertices = gridVertices(static_cast<size_t>(state.arg()));
+        const std::hash<teng::Model::Vertex> hasher{};
+        state.setItemsPerIteration(vertices.size());
+        state.setBytesPerIteration(vertices.size() * sizeof(teng::Model::Vertex));
+        while(state.keepRunning()) {
+            size_t combined = 0;
+            for(const auto& vertex : vertices) {
+                combined ^= hasher(vertex);
+            }
+            bench::doNotOptimize(combined);
+        }
+    }
+
+    // The deduplication loop of loadModel: every vertex is looked up, each
+    // distinct one is inserted once. Input has every vertex six times.
+    void vertexDeduplicate(bench::State& state) {
+        const auto unique = gridVertices(static_cast<size_t>(state.arg()));
+        std::vector<teng::Model::Vertex> input;
+        input.reserve(unique.size() * 6);
+        for(int copy = 0; copy < 6; copy++) {
+            input.insert(input.end(), unique.begin(), unique.end());
+        }
+        state.setItemsPerIteration(input.size());
+
+        while(state.keepRunning()) {
+            std::unordered_map<teng::Model::Vertex, uint32_t> uniqueVertices{};
+            std::vector<uint32_t> indices;
+            indices.reserve(input.size());
+            uint32_t next = 0;
+            for(const auto& vertex : input) {
+                auto [it, inserted] = uniqueVertices.try_emplace(vertex, next);
+                if(inserted) next++;
+                indices.push_back(it->second);
+            }
+            bench::doNotOptimize(indices.data());
+        }
+    }
+
+    void loadModel(bench::State& state, const std::string& path) {
+        if(!std::filesystem::exists(path)) {
+            state.skip(path + " not found");
+            return;
+        }
+        // Items are the vertices loadModel reads, known after one load.
+        teng::Model::Data probe{};
+        probe.loadModel(path);
+        state.setItemsPerIteration(std::max<size_t>(probe.indices.size(), 1));
+        state.setBytesPerIteration(std::filesystem::file_size(path));
+
+        while(state.keepRunning()) {
+            teng::Model::Data data{};
+            data.loadModel(path);
+            bench::doNotOptimize(data.vertices.data());
+        }
+    }
+
+    // Same bodies as both layouts, the Registry and the GameObjects it replaced.
+    void fillRegistry(teng::Registry& registry, size_t count) {
+        std::mt19937 random{1234};
+        std::uniform_real_distribution<float> unit{-1.f, 1.f};
+        registry.reserve(static_cast<uint32_t>(count));
+        for(size_t i = 0; i < count; i++) {
+            const teng::Entity entity = registry.create();
+            registry.translation(entity) = {unit(random), unit(random), unit(random)};
+            registry.setRigidBody(entity, {unit(random), unit(random), unit(random)}, 1.f + unit(random) * .5f);
+        }
+    }
+
+    std::vector<teng::GameObject> makeGameObjects(size_t count) {
+        std::mt19937 random{1234};
+        std::uniform_real_distribution<float> unit{-1.f, 1.f};
+        std::vector<teng::GameObject> objects;
+        objects.reserve(count);
+        for(size_t i = 0; i < count; i++) {
+            auto object = teng::GameObject::CreateGameObject(1.f);
+            object.p_Transform.translation = {unit(random), unit(random), unit(random)};
+            object.p_RigidBody.velocity = {unit(random), unit(random), unit(random)};
+            object.p_RigidBody.mass = 1.f + unit(random) * .5f;
+            objects.push_back(std::move(object));
+        }
+        return objects;
+    }
+
+    constexpr float STEP = 1.f / 60.f;
+    // Rays per raycast batch, and the ones the single ray benchmarks cycle through.
+    constexpr size_t RAY_BATCH = 1024;
+    const glm::vec3 FORCE{0.f, -9.81f, 0.f};
+
+    // velocity += force / mass * dt, reads and writes velocities, reads masses.
+    void gravityRegistry(bench::State& state) {
+        teng::Registry registry;
+        fillRegistry(registry, static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(registry.size());
+        state.setBytesPerIteration(registry.size() * (2 * sizeof(glm::vec3) + sizeof(float)));
+        while(state.keepRunning()) {
+            glm::vec3* velocities = registry.velocities();
+            const float* masses = registry.masses();
+            for(uint32_t i : registry.view(teng::COMPONENT_RIGID_BODY)) {
+                velocities[i] += FORCE * (STEP / masses[i]);
+            }
+            bench::clobberMemory();
+        }
+    }
+
+    void gravityGameObjects(bench::State& state) {
+        auto objects = makeGameObjects(static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(objects.size());
+        state.setBytesPerIteration(objects.size() * (2 * sizeof(glm::vec3) + sizeof(float)));
+        while(state.keepRunning()) {
+            for(auto& object : objects) {
+                object.p_RigidBody.velocity += FORCE * (STEP / object.p_RigidBody.mass);
+            }
+            bench::clobberMemory();
+        }
+    }
+
+    // translation += velocity * dt.
+    void transformPassRegistry(bench::State& state) {
+        teng::Registry registry;
+        fillRegistry(registry, static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(registry.size());
+        state.setBytesPerIteration(registry.size() * 3 * sizeof(glm::vec3));
+        while(state.keepRunning()) {
+            glm::vec3* translations = registry.translations();
+            const glm::vec3* velocities = registry.velocities();
+            for(uint32_t i : registry.view(teng::COMPONENT_RIGID_BODY)) {
+                translations[i] += velocities[i] * STEP;
+            }
+            bench::clobberMemory();
+        }
+    }
+
+    void transformPassGameObjects(bench::State& state) {
+        auto objects = makeGameObjects(static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(objects.size());
+        state.setBytesPerIteration(objects.size() * 3 * sizeof(glm::vec3));
+        while(state.keepRunning()) {
+            for(auto& object : objects) {
+                object.p_Transform.translation += object.p_RigidBody.velocity * STEP;
+            }
+            bench::clobberMemory();
+        }
+    }
+
+    // Objects despawned and spawned again per iteration of the churn benchmarks.
+    constexpr size_t CHURN = 1000;
+
+    // Despawns random objects by handle and spawns as many, from a GameObjectPool
+    // against a vector of GameObjects searched by id and erased from.
+    void churnGameObjectPool(bench::State& state) {
+        std::mt19937 random{1234};
+        teng::GameObjectPool pool;
+        std::vector<teng::GameObjectPool::Handle> live;
+        for(int64_t i = 0; i < state.arg(); i++) {
+            live.push_back(pool.create(teng::GameObject::CreateGameObject(1.f)));
+        }
+        state.setItemsPerIteration(CHURN);
+        while(state.keepRunning()) {
+            for(size_t i = 0; i < CHURN; i++) {
+                const size_t victim = random() % live.size();
+                pool.destroy(live[victim]);
+                live[victim] = pool.create(teng::GameObject::CreateGameObject(1.f));
+            }
+            bench::doNotOptimize(pool.data());
+        }
+    }
+
+    void churnGameObjectVector(bench::State& state) {
+        std::mt19937 random{1234};
+        std::vector<teng::GameObject> objects;
+        std::vector<teng::GameObject::id_t> live;
+        for(int64_t i = 0; i < state.arg(); i++) {
+            objects.push_back(teng::GameObject::CreateGameObject(1.f));
+            live.push_back(objects.back().getId());
+        }
+        state.setItemsPerIteration(CHURN);
+        while(state.keepRunning()) {
+            for(size_t i = 0; i < CHURN; i++) {
+                const size_t victim = random() % live.size();
+                const auto found = std::find_if(objects.begin(), objects.end(),
+                    [&](const teng::GameObject& object) { return object.getId() == live[victim]; });
+                objects.erase(found);
+                objects.push_back(teng::GameObject::CreateGameObject(1.f));
+                live[victim] = objects.back().getId();
+            }
+            bench::doNotOptimize(objects.data());
+        }
+    }
+
+    // Registry::updateWorldMatrices with every entity moved since the last call,
+    // against none moved, where the cached matrices are reused.
+    void worldMatricesDirty(bench::State& state) {
+        teng::Registry registry;
+        fillRegistry(registry, static_cast<size_t>(state.arg()));
+        state.setItemsPerIteration(registry.size());
+        while(state.keepRunning()) {
+            registry.markAllTransformsDirty();
+            bench::doNotOptimize(registry.updateWorldMatrices());
+        }
+    }
+
+    void worldMatricesStatic(bench::State& state) {
+        teng::Registry registry;
+        fillRegistry(registry, static_cast<size_t>(state.arg()));
+        registry.updateWorldMatrices();
+        state.setItemsPerIteration(registry.size());
+        while(state.keepRunning()) {
+            bench::doNotOptimize(registry.updateWorldMatrices());
+        }
+    }
+
+    // One parent with arg() children, moved every iteration, so each update is
+    // the parent and a pass over exactly its children.
+    void hierarchyMoveParent(bench::State& state, teng::ThreadPool* threadPool) {
+        teng::Registry registry;
+        fillRegistry(registry, static_cast<size_t>(state.arg()));
+        const teng::Entity parent = registry.create();
+        for(uint32_t i = 0; i + 1 < registry.size(); i++) {
+            registry.setParent(registry.entityAt(i), parent);
+        }
+        registry.updateWorldMatrices(threadPool);
+        state.setItemsPerIteration(registry.size());
+        while(state.keepRunning()) {
+            registry.translation(parent).x += STEP;
+            bench::doNotOptimize(registry.updateWorldMatrices(threadPool));
+        }
+    }
+
+    void cameraViewYXZ(bench::State& state) {
+        const auto transforms = randomTransforms(static_cast<size_t>(state.arg()));
+        teng::Camera camera{};
+        state.setItemsPerIteration(transforms.size());
+        while(state.keepRunning()) {
+            for(const auto& transform : transforms) {
+                camera.setViewYXZ(transform.translation, transform.rotation);
+                bench::doNotOptimize(camera.getViewMatrix());
+            }
+        }
+    }
+
+    // Unit-ish boxes spread through a cube whose volume grows with their count,
+    // so density and a query's share of the scene stay the same at any size.
+    std::vector<teng::Aabb> randomBoxes(size_t count) {
+        std::mt19937 random{1234};
+        const float side = 4.f * std::cbrt(static_cast<float>(count));
+        std::uniform_real_distribution<float> position{-side / 2.f, side / 2.f};
+        std::uniform_real_distribution<float> size{.25f, 1.f};
+        std::vector<teng::Aabb> boxes(count);
+        for(auto& box : boxes) {
+            const glm::vec3 center{position(random), position(random), position(random)};
+            const glm::vec3 extent{size(random), size(random), size(random)};
+            box = {center - extent, center + extent};
+        }
+        return boxes;
+    }
+
+    teng::Bvh buildBvh(const std::vector<teng::Aabb>& boxes, std::vector<uint32_t>* proxies = nullptr) {
+        teng::Bvh bvh;
+        for(size_t i = 0; i < boxes.size(); i++) {
+            const uint32_t proxy = bvh.insert(boxes[i], static_cast<uint32_t>(i));
+            if(proxies) proxies->push_back(proxy);
+        }
+        bvh.rebuild();
+        return bvh;
+    }
+
+    // A 50 degree view from outside the scene at its center, far enough to see a slice of it.
+    teng::Frustum sceneFrustum(size_t count) {
+        const float side = 4.f * std::cbrt(static_cast<float>(count));
+        teng::Camera camera{};
+        camera.setPerspectiveProjection(glm::radians(50.f), 1.f, .1f, side);
+        camera.setViewTarget(glm::vec3{0.f, 0.f, -side}, glm::vec3{0.f});
+        return teng::Frustum::s_FromMatrix(camera.getProjectionMatrix() * camera.getViewMatrix());
+    }
+
+    // Random rays from the scene's faces towards its inside.
+    std::vector<teng::Ray> randomRays(size_t count, size_t boxCount) {
+        std::mt19937 random{4321};
+        const float side = 4.f * std::cbrt(static_cast<float>(boxCount));
+        std::uniform_real_distribution<float> unit{-1.f, 1.f};
+        std::vector<teng::Ray> rays(count);
+        for(auto& ray : rays) {
+            ray.origin = glm::vec3{unit(random), unit(random), -1.f} * (side / 2.f);
+            ray.direction = glm::normalize(glm::vec3{unit(random), unit(random), 2.f});
+        }
+        return rays;
+    }
+
+    // Per box in the scene, for comparing with the linear scans.
+    void frustumCullLinear(bench::State& state) {
+        const auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        const teng::Frustum frustum = sceneFrustum(boxes.size());
+        std::vector<uint32_t> visible;
+        state.setItemsPerIteration(boxes.size());
+        while(state.keepRunning()) {
+            visible.clear();
+            for(uint32_t i = 0; i < boxes.size(); i++) {
+                if(frustum.classify(boxes[i]) != teng::Frustum::OUTSIDE) visible.push_back(i);
+            }
+            bench::doNotOptimize(visible.data());
+        }
+    }
+
+    void frustumCullBvh(bench::State& state) {
+        const auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        const teng::Bvh bvh = buildBvh(boxes);
+        const teng::Frustum frustum = sceneFrustum(boxes.size());
+        std::vector<uint32_t> visible;
+        state.setItemsPerIteration(boxes.size());
+        while(state.keepRunning()) {
+            visible.clear();
+            bvh.queryFrustum(frustum, visible);
+            bench::doNotOptimize(visible.data());
+        }
+    }
+
+    void raycastLinear(bench::State& state) {
+        const auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        const auto rays = randomRays(RAY_BATCH, boxes.size());
+        state.setItemsPerIteration(boxes.size());
+        size_t next = 0;
+        while(state.keepRunning()) {
+            const teng::Ray& ray = rays[next++ % rays.size()];
+            const glm::vec3 inverseDirection = 1.f / ray.direction;
+            float closest = std::numeric_limits<float>::max();
+            uint32_t hit = UINT32_MAX;
+            for(uint32_t i = 0; i < boxes.size(); i++) {
+                float distance;
+                if(teng::Ray::s_Intersects(boxes[i], ray.origin, inverseDirection, closest, distance)) {
+                    closest = distance;
+                    hit = i;
+                }
+            }
+            bench::doNotOptimize(hit);
+        }
+    }
+
+    void raycastBvh(bench::State& state) {
+        const auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        const teng::Bvh bvh = buildBvh(boxes);
+        const auto rays = randomRays(RAY_BATCH, boxes.size());
+        state.setItemsPerIteration(boxes.size());
+        size_t next = 0;
+        while(state.keepRunning()) {
+            teng::Bvh::RayHit hit;
+            bench::doNotOptimize(bvh.raycast(rays[next++ % rays.size()], std::numeric_limits<float>::max(), hit));
+        }
+    }
+
+    // Per ray.
+    void raycastBvhBatch(bench::State& state, teng::ThreadPool* threadPool) {
+        const auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        const teng::Bvh bvh = buildBvh(boxes);
+        const auto rays = randomRays(RAY_BATCH, boxes.size());
+        std::vector<teng::Bvh::RayHit> hits(rays.size());
+        state.setItemsPerIteration(rays.size());
+        while(state.keepRunning()) {
+            bvh.raycast(rays.data(), static_cast<uint32_t>(rays.size()), std::numeric_limits<float>::max(), hits.data(), threadPool);
+            bench::doNotOptimize(hits.data());
+        }
+    }
+
+    // Per moved box: 1% of them take a step each iteration, with the rebuilds that causes.
+    void bvhMove(bench::State& state) {
+        auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        std::vector<uint32_t> proxies;
+        teng::Bvh bvh = buildBvh(boxes, &proxies);
+        const uint32_t moved = std::max<uint32_t>(static_cast<uint32_t>(boxes.size() / 100), 1);
+        std::mt19937 random{1234};
+        std::uniform_real_distribution<float> step{-.05f, .05f};
+        std::uniform_int_distribution<uint32_t> pick{0, static_cast<uint32_t>(boxes.size() - 1)};
+        state.setItemsPerIteration(moved);
+        while(state.keepRunning()) {
+            for(uint32_t i = 0; i < moved; i++) {
+                const uint32_t index = pick(random);
+                const glm::vec3 offset{step(random), step(random), step(random)};
+                boxes[index] = {boxes[index].min + offset, boxes[index].max + offset};
+                bvh.update(proxies[index], boxes[index]);
+            }
+            bench::doNotOptimize(bvh.rebuildIfDegraded());
+        }
+    }
+
+    void bvhRebuild(bench::State& state) {
+        const auto boxes = randomBoxes(static_cast<size_t>(state.arg()));
+        teng::Bvh bvh = buildBvh(boxes);
+        state.setItemsPerIteration(boxes.size());
+        while(state.keepRunning()) {
+            bvh.rebuild();
+            bench::clobberMemory();
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        // --obj is ours, the rest goes to the harness.
+        std::vector<std::string> objFiles;
+        std::vector<char*> harnessArgs{argv[0]};
+        for(int i = 1; i < argc; i++) {
+            if(std::string{argv[i]} == "--obj" && i + 1 < argc) {
+                objFiles.push_back(argv[++i]);
+            } else {
+                harnessArgs.push_back(argv[i]);
+            }
+        }
+        const bench::Options options = bench::parseOptions(static_cast<int>(harnessArgs.size()), harnessArgs.data());
+
+        if(objFiles.empty()) {
+            objFiles.push_back("models/the-valentini-torso_bronze.obj");
+        }
+        // Quads per side, so 2 * n * n triangles.
+        const std::vector<int64_t> gridSizes{16, 128, 512};
+        std::vector<std::string> gridFiles;
+        for(int64_t size : gridSizes) {
+            gridFiles.push_back(writeGridObj(static_cast<size_t>(size)));
+        }
+
+        teng::ThreadPool threadPool;
+
+        std::vector<bench::Benchmark> benchmarks{
+            {"transform_mat4", transformMat4, {1000, 10000, 100000}},
+            {"transform_normal_matrix", transformNormalMatrix, {1000, 10000, 100000}},
+            {"transform_mat4_and_normal", transformBoth, {1000, 10000, 100000}},
+            {"transform_batch_euler", transformBatchEuler, {1000, 10000, 100000}},
+            {"transform_batch_quaternion", transformBatchQuaternion, {1000, 10000, 100000}},
+            {"sincos_std", sinCosStd, {1000, 100000}},
+            {"sincos_batch", sinCosBatch, {1000, 100000}},
+            {"vertex_hash", vertexHash, {1000, 100000, 1000000}},
+            {"vertex_dedup", vertexDeduplicate, {1000, 100000}},
+            {"camera_view_yxz", cameraViewYXZ, {1000, 100000}},
+            {"gravity_registry", gravityRegistry, {10000, 1000000}},
+            {"gravity_game_objects", gravityGameObjects, {10000, 1000000}},
+            {"transform_pass_registry", transformPassRegistry, {10000, 1000000}},
+            {"transform_pass_game_objects", transformPassGameObjects, {10000, 1000000}},
+            {"churn_game_object_pool", churnGameObjectPool, {10000, 100000}},
+            {"churn_game_object_vector", churnGameObjectVector, {10000, 100000}},
+            {"world_matrices_dirty", worldMatricesDirty, {10000, 1000000}},
+            {"world_matrices_static", worldMatricesStatic, {10000, 1000000}},
+            {"hierarchy_move_parent", [](bench::State& state) { hierarchyMoveParent(state, nullptr); }, {10000, 1000000}},
+            {"hierarchy_move_parent_threads", [&](bench::State& state) { hierarchyMoveParent(state, &threadPool); }, {10000, 1000000}},
+            {"frustum_cull_linear", frustumCullLinear, {10000, 100000}},
+            {"frustum_cull_bvh", frustumCullBvh, {10000, 100000}},
+            {"raycast_linear", raycastLinear, {10000, 100000}},
+            {"raycast_bvh", raycastBvh, {10000, 100000}},
+            {"raycast_bvh_batch", [](bench::State& state) { raycastBvhBatch(state, nullptr); }, {100000}},
+            {"raycast_bvh_batch_threads", [&](bench::State& state) { raycastBvhBatch(state, &threadPool); }, {100000}},
+            {"bvh_move", bvhMove, {10000, 100000}},
+            {"bvh_rebuild", bvhRebuild, {10000, 100000}},
+            {"load_obj_grid", [&](bench::State& state) {
+                const size_t index = static_cast<size_t>(
+                    std::find(gridSizes.begin(), gridSizes.end(), state.arg()) - gridSizes.begin());
+                loadModel(state, gridFiles[index]);
+            }, gridSizes},
+        };
+        for(size_t i = 0; i < objFiles.size(); i++) {
+            const std::string path = objFiles[i];
+            benchmarks.push_back({"load_obj[" + path + "]", [path](bench::State& state) { loadModel(state, path); }, {0}});
+        }
+
+        // On stderr, so --csv output stays a table.
+        std::cerr << "transform batch: " << teng::TransformBatch::s_InstructionSet() << '\n';
+        bench::runBenchmarks(benchmarks, options);
+
+        for(const auto& file : gridFiles) {
+            std::filesystem::remove(file);
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// Headless frame benchmark.
+//
+// Renders cleared frames into an offscreen target, without a window or a
+// surface, and reports frame times. Runs on any Vulkan driver, including
+// lavapipe on machines without a GPU or display. With a capture format,
+// every frame is also read back and written out by FrameCapture.
+//
+// Usage: headless_frames [frames] [width] [height] [frames in flight] [png|raw]
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+#include "../src/teng_device.hpp"
+#include "../src/teng_renderer.hpp"
+#include "../src/teng_frame_capture.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+    const int frameCount = argc > 1 ? std::atoi(argv[1]) : 1000;
+    const uint32_t width = argc > 2 ? static_cast<uint32_t>(std::max(1, std::atoi(argv[2]))) : 1280;
+    const uint32_t height = argc > 3 ? static_cast<uint32_t>(std::max(1, std::atoi(argv[3]))) : 720;
+
+    teng::PresentPolicy policy{};
+    if(argc > 4) {
+        policy.framesInFlight = static_cast<uint32_t>(std::max(1, std::atoi(argv[4])));
+    }
+
+    const std::string captureFormat = argc > 5 ? argv[5] : "";
+
+    try {
+        teng::Device device{};
+        teng::Renderer renderer{device, VkExtent2D{width, height}, policy};
+
+        std::unique_ptr<teng::FrameCapture> capture;
+        if(!captureFormat.empty()) {
+            teng::CaptureSettings settings{};
+            settings.outputPrefix = "headless_frames";
+            if(captureFormat == "png") {
+                settings.format = teng::CaptureFormat::Png;
+            } else if(captureFormat == "raw") {
+                settings.format = teng::CaptureFormat::Raw;
+            } else {
+                throw std::invalid_argument("capture format must be png or raw");
+            }
+            capture = std::make_unique<teng::FrameCapture>(device, renderer, settings);
+        }
+
+        std::vector<double> frameTimes;
+        frameTimes.reserve(frameCount);
+
+        const auto start = std::chrono::steady_clock::now();
+        auto previous = start;
+        for(int frame = 0; frame < frameCount; frame++) {
+            if(auto commandBuffer = renderer.beginFrame()) {
+                renderer.beginSwapChainRenderPass(commandBuffer);
+                renderer.endSwapChainRenderPass(commandBuffer);
+                if(capture) {
+                    capture->captureFrame(commandBuffer);
+                }
+                renderer.endFrame();
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+            previous = now;
+        }
+
+        if(capture) {
+            capture->finish();
+        }
+        vkDeviceWaitIdle(device.device());
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "extent:        " << width << "x" << height << "\n";
+        std::cout << "in flight:     " << renderer.getFramesInFlight() << "\n";
+        std::cout << "frames:        " << frameTimes.size() << "\n";
+        std::cout << "fps:           " << (seconds > 0.0 ? frameTimes.size() / seconds : 0.0) << "\n";
+        std::cout << "p50 ms:        " << bench::percentile(frameTimes, 0.50) << "\n";
+        std::cout << "p99 ms:        " << bench::percentile(frameTimes, 0.99) << "\n";
+        if(capture) {
+            std::cout << "written:       " << capture->framesWritten() << "\n";
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+// N-body gravity benchmark.
+//
+// Times GravitySystem's Barnes-Hut accelerations for a disk galaxy at each
+// body count and opening angle, and compares them with summing every pair:
+// the error of a sample of bodies against their exact accelerations
+// (median, 99th percentile and worst relative error) and the time brute force
+// takes. Brute force is timed in full up to --exact-limit bodies and
+// extrapolated from the sample beyond. Both run on every hardware thread.
+// The root of the tree is checked against the total mass and centre of mass
+// summed directly, and the exit code is non-zero when one doesn't match.
+//
+// --gpu adds a row per body count up to --exact-limit with the time per step
+// of GpuGravitySystem's compute shader, which also sums every pair, on a
+// headless device. Point the loader at lavapipe to run it without a GPU.
+//
+// Usage: nbody [--bodies N]... [--theta X]... [--repetitions N] [--samples N] [--exact-limit N] [--gpu]
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+#include "../src/teng_gravity.hpp"
+#include "../src/teng_gpu_gravity.hpp"
+#include "../src/teng_thread_pool.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::vector<uint32_t> bodyCounts;
+        std::vector<float> thetas;
+        int repetitions = 3;
+        uint32_t samples = 1000;
+        uint32_t exactLimit = 20000;
+        bool gpu = false;
+    };
+
+    // Steps recorded into each timed submission, so submitting and waiting
+    // isn't most of what's measured.
+    constexpr int GPU_STEPS = 10;
+
+    Options parse(int argc, char** argv) {
+        Options options{};
+        for(int i = 1; i < argc; i++) {
+            const std::string option = argv[i];
+            if(option == "--gpu") {
+                options.gpu = true;
+                continue;
+            }
+            if(i + 1 >= argc) throw std::invalid_argument("missing value for " + option);
+            const std::string value = argv[++i];
+            if(option == "--bodies") {
+                options.bodyCounts.push_back(static_cast<uint32_t>(std::stoul(value)));
+            } else if(option == "--theta") {
+                options.thetas.push_back(std::stof(value));
+            } else if(option == "--repetitions") {
+                options.repetitions = std::max(1, std::stoi(value));
+            } else if(option == "--samples") {
+                options.samples = std::max(1u, static_cast<uint32_t>(std::stoul(value)));
+            } else if(option == "--exact-limit") {
+                options.exactLimit = static_cast<uint32_t>(std::stoul(value));
+            } else {
+                throw std::invalid_argument("unknown option " + option);
+            }
+        }
+        if(options.bodyCounts.empty()) options.bodyCounts = {10000, 100000, 1000000};
+        if(options.thetas.empty()) options.thetas = {.3f, .5f, .7f, 1.f};
+        return options;
+    }
+
+    // Exact accelerations of every stride-th body.
+    std::vector<glm::vec3> sampledExact(
+        const std::vector<glm::vec3>& positions,
+        const std::vector<float>& masses,
+        uint32_t stride,
+        const teng::GravitySystem::Settings& settings) {
+        const uint32_t count = static_cast<uint32_t>(positions.size());
+        const float softening2 = settings.softening * settings.softening;
+        std::vector<glm::vec3> exact;
+        for(uint32_t i = 0; i < count; i += stride) {
+            glm::dvec3 acceleration{0.0};
+            for(uint32_t j = 0; j < count; j++) {
+                if(j == i) continue;
+                const glm::dvec3 offset = glm::dvec3{positions[j]} - glm::dvec3{positions[i]};
+                const double distance2 = glm::dot(offset, offset) + softening2;
+                acceleration += offset * (masses[j] / (distance2 * std::sqrt(distance2)));
+            }
+            exact.push_back(glm::vec3{acceleration * static_cast<double>(settings.gravitationalConstant)});
+        }
+        return exact;
+    }
+
+    // Whether the root of gravity's last tree holds the mass and centre of mass
+    // of all the bodies, summed in double precision.
+    bool matchesMoments(const teng::GravitySystem& gravity, const std::vector<glm::vec3>& positions, const std::vector<float>& masses) {
+        double mass = 0.0;
+        glm::dvec3 weighted{0.0};
+        double extent = 1.0;
+        for(size_t i = 0; i < positions.size(); i++) {
+            mass += masses[i];
+            weighted += glm::dvec3{positions[i]} * static_cast<double>(masses[i]);
+            extent = std::max(extent, static_cast<double>(glm::length(positions[i])));
+        }
+        const glm::dvec3 centerOfMass = weighted / mass;
+        return std::abs(gravity.getTotalMass() - mass) <= 1e-4 * mass &&
+               glm::length(glm::dvec3{gravity.getCenterOfMass()} - centerOfMass) <= 1e-4 * extent;
+    }
+
+    // Median milliseconds per step of the compute shader.
+    double gpuStepMs(
+        teng::Device& device,
+        const std::vector<glm::vec3>& positions,
+        const std::vector<glm::vec3>& velocities,
+        const std::vector<float>& masses,
+        const teng::GravitySystem::Settings& settings,
+        int repetitions) {
+        teng::GpuGravitySystem gravity{
+            device, positions.data(), velocities.data(), masses.data(), static_cast<uint32_t>(positions.size()), settings};
+
+        auto run = [&]() {
+            VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+            for(int step = 0; step < GPU_STEPS; step++) gravity.recordStep(commandBuffer, 1e-3f);
+            device.endSingleTimeCommands(commandBuffer);
+        };
+        // Also waits for the upload and lets the driver settle.
+        run();
+
+        std::vector<double> times;
+        for(int repetition = 0; repetition < repetitions; repetition++) {
+            const auto start = Clock::now();
+            run();
+            times.push_back(bench::millisecondsSince(start) / GPU_STEPS);
+        }
+        return bench::percentile(times, .5);
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parse(argc, argv);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << "\n"
+                  << "usage: nbody [--bodies N]... [--theta X]... [--repetitions N] [--samples N] [--exact-limit N] [--gpu]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<teng::Device> device;
+    if(options.gpu) {
+        try {
+            device = std::make_unique<teng::Device>();
+        } catch(const std::exception& e) {
+            std::cerr << "no GPU device: " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    teng::ThreadPool threadPool;
+    std::printf("%u threads\n", threadPool.getThreadCount());
+    std::printf("%10s %6s %10s %12s %12s %12s %12s %8s\n",
+        "bodies", "theta", "ms", "median err", "p99 err", "max err", "brute ms", "moments");
+
+    bool allMatched = true;
+
+    for(uint32_t count : options.bodyCounts) {
+        std::vector<glm::vec3> positions(count);
+        std::vector<glm::vec3> velocities(count);
+        std::vector<float> masses(count);
+        teng::GravitySystem::s_DiskGalaxy(count, 10.f, 1234, positions.data(), velocities.data(), masses.data());
+
+        const teng::GravitySystem::Settings reference{};
+        const uint32_t stride = std::max(1u, count / options.samples);
+        const auto sampleStart = Clock::now();
+        const std::vector<glm::vec3> exact = sampledExact(positions, masses, stride, reference);
+        const double sampleMs = bench::millisecondsSince(sampleStart);
+
+        // Brute force in full where it's affordable, otherwise from the sample,
+        // which ran on one thread in double precision.
+        double bruteMs;
+        std::string bruteNote;
+        if(count <= options.exactLimit) {
+            std::vector<glm::vec3> accelerations(count);
+            const auto start = Clock::now();
+            teng::GravitySystem::s_BruteForceAccelerations(
+                positions.data(), masses.data(), count, reference, accelerations.data(), &threadPool);
+            bruteMs = bench::millisecondsSince(start);
+        } else {
+            bruteMs = sampleMs * static_cast<double>(count) / static_cast<double>(exact.size()) / threadPool.getThreadCount();
+            bruteNote = " (est.)";
+        }
+
+        for(float theta : options.thetas) {
+            teng::GravitySystem::Settings settings = reference;
+            settings.theta = theta;
+            teng::GravitySystem gravity{settings};
+            std::vector<glm::vec3> accelerations(count);
+
+            std::vector<double> times;
+            for(int repetition = 0; repetition < options.repetitions; repetition++) {
+                const auto start = Clock::now();
+                gravity.computeAccelerations(positions.data(), masses.data(), count, accelerations.data(), &threadPool);
+                times.push_back(bench::millisecondsSince(start));
+            }
+
+            std::vector<double> errors;
+            for(size_t s = 0; s < exact.size(); s++) {
+                const glm::vec3 difference = accelerations[s * stride] - exact[s];
+                errors.push_back(glm::length(difference) / std::max(glm::length(exact[s]), 1e-30f));
+            }
+
+            const bool matched = matchesMoments(gravity, positions, masses);
+            allMatched = allMatched && matched;
+
+            std::printf("%10u %6.2f %10.2f %12.2e %12.2e %12.2e %12.2f%s %8s\n",
+                count, theta, bench::percentile(times, .5), bench::percentile(errors, .5), bench::percentile(errors, .99),
+                bench::percentile(errors, 1.), bruteMs, bruteNote.c_str(), matched ? "ok" : "WRONG");
+        }
+
+        if(device && count <= options.exactLimit) {
+            const double ms = gpuStepMs(*device, positions, velocities, masses, reference, options.repetitions);
+            std::printf("%10u %6s %10.2f %12s %12s %12s %12s %8s\n", count, "gpu", ms, "-", "-", "-", "-", "-");
+        }
+    }
+    return allMatched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
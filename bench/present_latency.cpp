@@ -0,0 +1,138 @@
+// Present policy benchmark.
+//
+// Runs the same frames under a set of present policies and reports
+// throughput against input-to-present latency for each of them.
+//
+// Latency runs from the moment input would be sampled to the moment the
+// frame is seen complete on the GPU. Completion is polled once per loop
+// iteration, so the numbers are an upper bound that is off by at most one
+// frame. Time spent waiting in the presentation engine's queue afterwards
+// isn't visible without present timing extensions; with FIFO and a deep
+// image queue the real latency is higher than reported.
+//
+// Usage: present_latency [frames per policy] [simulated cpu ms per frame]
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+#include "../src/teng_window.hpp"
+#include "../src/teng_device.hpp"
+#include "../src/teng_renderer.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    teng::PresentPolicy makePolicy(VkPresentModeKHR mode, uint32_t images, uint32_t framesInFlight, uint32_t latencyLimit) {
+        teng::PresentPolicy policy{};
+        policy.presentMode = mode;
+        policy.imageCount = images;
+        policy.framesInFlight = framesInFlight;
+        policy.frameLatencyLimit = latencyLimit;
+        return policy;
+    }
+
+    // Stands in for game logic, busy so it isn't hidden by a sleep's granularity.
+    void simulateCpuWork(double milliseconds) {
+        const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(milliseconds));
+        while(Clock::now() < end) {}
+    }
+}
+
+int main(int argc, char** argv) {
+    const int framesPerPolicy = argc > 1 ? std::atoi(argv[1]) : 600;
+    const double cpuMilliseconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+    const int warmupFrames = 60;
+
+    const std::vector<teng::PresentPolicy> policies{
+        makePolicy(VK_PRESENT_MODE_FIFO_KHR, 0, 2, 0),
+        makePolicy(VK_PRESENT_MODE_FIFO_KHR, 0, 1, 0),
+        makePolicy(VK_PRESENT_MODE_FIFO_KHR, 0, 2, 1),
+        makePolicy(VK_PRESENT_MODE_FIFO_RELAXED_KHR, 0, 2, 0),
+        makePolicy(VK_PRESENT_MODE_MAILBOX_KHR, 0, 2, 0),
+        makePolicy(VK_PRESENT_MODE_MAILBOX_KHR, 4, 3, 0),
+        makePolicy(VK_PRESENT_MODE_IMMEDIATE_KHR, 0, 2, 0),
+        makePolicy(VK_PRESENT_MODE_IMMEDIATE_KHR, 0, 2, 1),
+        makePolicy(VK_PRESENT_MODE_IMMEDIATE_KHR, 0, 4, 0),
+    };
+
+    try {
+        teng::Window window{900, 900, "present latency"};
+        teng::Device device{window};
+        teng::Renderer renderer{window, device};
+
+        std::printf("%-13s %6s %6s %7s | %9s %9s %9s %9s\n",
+            "mode", "images", "frames", "limit", "fps", "mean ms", "p50 ms", "p99 ms");
+
+        for(const auto& policy : policies) {
+            renderer.setPresentPolicy(policy);
+
+            std::deque<std::pair<uint64_t, Clock::time_point>> pending; // Frame number, input time.
+            std::vector<double> latencies;
+            latencies.reserve(framesPerPolicy);
+
+            auto collect = [&]() {
+                while(!pending.empty() && renderer.isFrameComplete(pending.front().first)) {
+                    latencies.push_back(bench::millisecondsSince(pending.front().second));
+                    pending.pop_front();
+                }
+            };
+
+            Clock::time_point start{};
+            int measured = 0;
+            for(int frame = 0; measured < framesPerPolicy && !window.shouldClose(); frame++) {
+                if(frame == warmupFrames) {
+                    start = Clock::now();
+                    latencies.clear();
+                    pending.clear();
+                }
+
+                renderer.waitForFrameLatency();
+                collect();
+
+                glfwPollEvents();
+                const auto inputTime = Clock::now();
+                simulateCpuWork(cpuMilliseconds);
+
+                if(auto commandBuffer = renderer.beginFrame()) {
+                    renderer.beginSwapChainRenderPass(commandBuffer);
+                    renderer.endSwapChainRenderPass(commandBuffer);
+                    renderer.endFrame();
+                    pending.emplace_back(renderer.getFrameCount() - 1, inputTime);
+                    if(frame >= warmupFrames) measured++;
+                }
+                collect();
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            double total = 0.0;
+            for(double l : latencies) total += l;
+
+            std::printf("%-13s %6u %6u %7u | %9.1f %9.2f %9.2f %9.2f\n",
+                teng::PresentPolicy::s_PresentModeName(renderer.getPresentMode()),
+                renderer.getImageCount(),
+                renderer.getFramesInFlight(),
+                policy.frameLatencyLimit,
+                measured / std::max(seconds, 1e-9),
+                total / std::max<size_t>(latencies.size(), 1),
+                bench::percentile(latencies, 0.50),
+                bench::percentile(latencies, 0.99));
+        }
+
+        vkDeviceWaitIdle(device.device());
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,643 @@
+// Deterministic rendering benchmark.
+//
+// Renders synthetic scenes headless along a scripted camera path for a fixed
+// number of frames and writes p50/p95/p99 of the frame time, CPU time, GPU
+// time, draw calls and memory to a JSON report. Given a baseline report it
+// fails when a percentile got worse by more than the threshold, so it can
+// gate changes in CI.
+//
+// Scenes:
+//   cubes       N cubes in a grid, one draw each
+//   torso       the torso mesh repeated on a grid, needs models/ next to the binary
+//   sierpinski  a Sierpinski tetrahedron as a single mesh
+//
+// Usage: render_bench [--scenes cubes,torso,sierpinski] [--frames N] [--warmup N]
+//                     [--size WxH] [--cubes N] [--torsos N] [--depth N] [--torso-path file]
+//                     [--out report.json] [--baseline report.json] [--threshold 0.1]
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+#include "../src/teng_device.hpp"
+#include "../src/teng_renderer.hpp"
+#include "../src/teng_pipeline_manager.hpp"
+#include "../src/teng_descriptors.hpp"
+#include "../src/teng_game_object.hpp"
+#include "../src/render_system.hpp"
+#include "../src/camera.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::vector<std::string> scenes{"cubes", "torso", "sierpinski"};
+        int frames = 600;
+        int warmup = 60;
+        uint32_t width = 1280;
+        uint32_t height = 720;
+        uint32_t cubes = 10000;
+        uint32_t torsos = 64;
+        uint32_t sierpinskiDepth = 6;
+        std::string torsoPath = "models/the-valentini-torso_bronze.obj";
+        std::string out = "render_bench.json";
+        std::string baseline;
+        double threshold = 0.10;
+    };
+
+    struct Scene {
+        teng::Registry objects;
+        glm::vec3 center{0.f};
+        float radius = 1.f;
+    };
+
+    // Per-frame samples of one scene.
+    struct Samples {
+        std::vector<double> frameMs;
+        std::vector<double> cpuMs;
+        std::vector<double> gpuMs;
+        std::vector<double> drawCalls;
+        std::vector<double> deviceMemoryMb;
+        std::vector<double> hostMemoryMb;
+    };
+
+    std::vector<std::string> split(const std::string& text, char separator) {
+        std::vector<std::string> parts;
+        std::stringstream stream{text};
+        std::string part;
+        while(std::getline(stream, part, separator)) {
+            if(!part.empty()) parts.push_back(part);
+        }
+        return parts;
+    }
+
+    Options parseOptions(int argc, char** argv) {
+        Options options{};
+        auto value = [&](int& i) -> std::string {
+            if(i + 1 >= argc) {
+                throw std::invalid_argument(std::string{"missing value for "} + argv[i]);
+            }
+            return argv[++i];
+        };
+
+        for(int i = 1; i < argc; i++) {
+            const std::string option = argv[i];
+            if(option == "--scenes") {
+                options.scenes = split(value(i), ',');
+            } else if(option == "--frames") {
+                options.frames = std::max(1, std::stoi(value(i)));
+            } else if(option == "--warmup") {
+                options.warmup = std::max(1, std::stoi(value(i)));
+            } else if(option == "--size") {
+                const auto size = split(value(i), 'x');
+                if(size.size() != 2) throw std::invalid_argument("--size expects WxH");
+                options.width = static_cast<uint32_t>(std::max(1, std::stoi(size[0])));
+                options.height = static_cast<uint32_t>(std::max(1, std::stoi(size[1])));
+            } else if(option == "--cubes") {
+                options.cubes = static_cast<uint32_t>(std::stoul(value(i)));
+            } else if(option == "--torsos") {
+                options.torsos = static_cast<uint32_t>(std::stoul(value(i)));
+            } else if(option == "--depth") {
+                options.sierpinskiDepth = static_cast<uint32_t>(std::stoul(value(i)));
+            } else if(option == "--torso-path") {
+                options.torsoPath = value(i);
+            } else if(option == "--out") {
+                options.out = value(i);
+            } else if(option == "--baseline") {
+                options.baseline = value(i);
+            } else if(option == "--threshold") {
+                options.threshold = std::stod(value(i));
+            } else {
+                throw std::invalid_argument("unknown option " + option);
+            }
+        }
+        return options;
+    }
+
+    double hostMemoryMb() {
+#ifdef __linux__
+        // Resident pages are the second field.
+        std::ifstream statm{"/proc/self/statm"};
+        unsigned long size = 0, resident = 0;
+        if(statm >> size >> resident) {
+            return static_cast<double>(resident) * 4096.0 / (1024.0 * 1024.0);
+        }
+#endif
+        return 0.0;
+    }
+
+    // Scenes
+
+    std::shared_ptr<teng::Model> createCubeModel(teng::Device& device) {
+        // One color per face, faces wound the way the other models are.
+        const glm::vec3 corners[8] = {
+            {-.5f, -.5f, -.5f}, {.5f, -.5f, -.5f}, {.5f, .5f, -.5f}, {-.5f, .5f, -.5f},
+            {-.5f, -.5f, .5f}, {.5f, -.5f, .5f}, {.5f, .5f, .5f}, {-.5f, .5f, .5f}};
+        struct Face { int a, b, c, d; glm::vec3 normal; glm::vec3 color; };
+        const Face faces[6] = {
+            {0, 4, 7, 3, {-1.f, 0.f, 0.f}, {.9f, .9f, .9f}},
+            {1, 2, 6, 5, {1.f, 0.f, 0.f}, {.8f, .8f, .1f}},
+            {0, 1, 5, 4, {0.f, -1.f, 0.f}, {.9f, .6f, .1f}},
+            {3, 7, 6, 2, {0.f, 1.f, 0.f}, {.8f, .1f, .1f}},
+            {0, 3, 2, 1, {0.f, 0.f, -1.f}, {.1f, .1f, .8f}},
+            {4, 5, 6, 7, {0.f, 0.f, 1.f}, {.1f, .8f, .1f}}};
+
+        teng::Model::Data data{};
+        for(const Face& face : faces) {
+            const uint32_t base = static_cast<uint32_t>(data.vertices.size());
+            for(int corner : {face.a, face.b, face.c, face.d}) {
+                teng::Model::Vertex vertex{};
+                vertex.position = corners[corner];
+                vertex.color = face.color;
+                vertex.normal = face.normal;
+                data.vertices.push_back(vertex);
+            }
+            for(uint32_t index : {0u, 1u, 2u, 0u, 2u, 3u}) {
+                data.indices.push_back(base + index);
+            }
+        }
+        return std::make_shared<teng::Model>(device, data);
+    }
+
+    void sierpinski(const glm::vec3 (&corners)[4], uint32_t depth, teng::Model::Data& data) {
+        if(depth == 0) {
+            const int faces[4][3] = {{0, 1, 2}, {0, 3, 1}, {1, 3, 2}, {2, 3, 0}};
+            for(const auto& face : faces) {
+                const glm::vec3 normal = glm::normalize(glm::cross(
+                    corners[face[1]] - corners[face[0]], corners[face[2]] - corners[face[0]]));
+                for(int corner : face) {
+                    teng::Model::Vertex vertex{};
+                    vertex.position = corners[corner];
+                    vertex.normal = normal;
+                    vertex.color = glm::abs(normal) * .8f + .2f;
+                    data.vertices.push_back(vertex);
+                }
+            }
+            return;
+        }
+
+        glm::vec3 mid[4][4];
+        for(int i = 0; i < 4; i++) {
+            for(int j = 0; j < 4; j++) {
+                mid[i][j] = (corners[i] + corners[j]) * .5f;
+            }
+        }
+        for(int i = 0; i < 4; i++) {
+            const glm::vec3 child[4] = {mid[i][0], mid[i][1], mid[i][2], mid[i][3]};
+            sierpinski(child, depth - 1, data);
+        }
+    }
+
+    Scene buildCubes(teng::Device& device, uint32_t count) {
+        Scene scene{};
+        auto model = createCubeModel(device);
+        const uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(std::max(count, 1u)))));
+        const float spacing = .3f;
+        const float half = .5f * spacing * static_cast<float>(side - 1);
+
+        const teng::ModelHandle handle = scene.objects.addModel(std::move(model));
+        scene.objects.reserve(count);
+        for(uint32_t i = 0; i < count; i++) {
+            const teng::Entity cube = scene.objects.create();
+            scene.objects.setModel(cube, handle);
+            scene.objects.scale(cube) = glm::vec3{.1f};
+            scene.objects.translation(cube) = glm::vec3{
+                static_cast<float>(i % side) * spacing - half,
+                static_cast<float>((i / side) % side) * spacing - half,
+                static_cast<float>(i / (side * side)) * spacing - half};
+            scene.objects.rotation(cube) = glm::vec3{.1f * static_cast<float>(i % 7), .2f * static_cast<float>(i % 5), 0.f};
+        }
+        scene.radius = std::max(1.f, 2.5f * half);
+        return scene;
+    }
+
+    Scene buildTorsos(teng::Device& device, uint32_t count, const std::string& path) {
+        Scene scene{};
+        std::shared_ptr<teng::Model> model = teng::Model::CreateModelFromFile(device, path);
+        const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(std::max(count, 1u)))));
+        const float spacing = 1.2f;
+        const float half = .5f * spacing * static_cast<float>(side - 1);
+
+        const teng::ModelHandle handle = scene.objects.addModel(std::move(model));
+        for(uint32_t i = 0; i < count; i++) {
+            const teng::Entity torso = scene.objects.create();
+            scene.objects.setModel(torso, handle);
+            scene.objects.scale(torso) = glm::vec3{.5f};
+            scene.objects.rotation(torso) = glm::vec3{0.f, glm::pi<float>(), glm::pi<float>()};
+            scene.objects.translation(torso) = glm::vec3{
+                static_cast<float>(i % side) * spacing - half, 0.f, static_cast<float>(i / side) * spacing - half};
+        }
+        scene.radius = std::max(2.f, 2.f * half);
+        return scene;
+    }
+
+    Scene buildSierpinski(teng::Device& device, uint32_t depth) {
+        Scene scene{};
+        const glm::vec3 corners[4] = {
+            {0.f, -1.f, 0.f}, {-1.f, .6f, -.6f}, {1.f, .6f, -.6f}, {0.f, .6f, 1.f}};
+        teng::Model::Data data{};
+        sierpinski(corners, depth, data);
+
+        const teng::Entity object = scene.objects.create();
+        scene.objects.setModel(object, scene.objects.addModel(std::make_shared<teng::Model>(device, data)));
+        scene.radius = 3.f;
+        return scene;
+    }
+
+    // Orbits the scene once over the measured frames, bobbing up and down.
+    void placeCamera(teng::Camera& camera, const Scene& scene, int frame, int frames) {
+        const float t = glm::two_pi<float>() * static_cast<float>(frame) / static_cast<float>(std::max(frames, 1));
+        const glm::vec3 position = scene.center + scene.radius * glm::vec3{
+            std::cos(t), -.3f + .2f * std::sin(2.f * t), std::sin(t)};
+        camera.setViewTarget(position, scene.center);
+    }
+
+    // Two timestamps per frame slot. A slot's results are read right before
+    // it is reused, when the frame scheduler has already waited for them.
+    // Frames before the first measured one are dropped.
+    class GpuTimer {
+
+        public:
+
+            GpuTimer(teng::Device& device, uint32_t slots)
+                : mr_Device(device),
+                  m_FrameNumbers(slots, 0),
+                  m_Pending(slots, false)
+            {
+                m_Supported = device.properties.limits.timestampComputeAndGraphics == VK_TRUE;
+                m_PeriodNs = device.properties.limits.timestampPeriod;
+                if(!m_Supported) return;
+
+                VkQueryPoolCreateInfo poolInfo{};
+                poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+                poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+                poolInfo.queryCount = 2 * slots;
+                if(vkCreateQueryPool(device.device(), &poolInfo, nullptr, &m_Pool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create timestamp query pool");
+                }
+            }
+
+            ~GpuTimer() {
+                if(m_Pool != VK_NULL_HANDLE) {
+                    vkDestroyQueryPool(mr_Device.device(), m_Pool, nullptr);
+                }
+            }
+
+            bool isSupported() const { return m_Supported; }
+            void setFirstMeasuredFrame(uint64_t frame) { m_FirstMeasured = frame; }
+            const std::vector<double>& samples() const { return m_Samples; }
+
+            void begin(VkCommandBuffer commandBuffer, uint32_t slot, uint64_t frame) {
+                if(!m_Supported) return;
+                m_Read(slot);
+                vkCmdResetQueryPool(commandBuffer, m_Pool, 2 * slot, 2);
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_Pool, 2 * slot);
+                m_FrameNumbers[slot] = frame;
+            }
+
+            void end(VkCommandBuffer commandBuffer, uint32_t slot) {
+                if(!m_Supported) return;
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_Pool, 2 * slot + 1);
+                m_Pending[slot] = true;
+            }
+
+            // After the GPU went idle, collects what begin didn't.
+            void drain() {
+                for(uint32_t slot = 0; slot < m_Pending.size(); slot++) {
+                    m_Read(slot);
+                }
+            }
+
+        private:
+
+            void m_Read(uint32_t slot) {
+                if(!m_Pending[slot]) return;
+                m_Pending[slot] = false;
+                if(m_FrameNumbers[slot] < m_FirstMeasured) return;
+
+                uint64_t timestamps[2] = {0, 0};
+                const VkResult result = vkGetQueryPoolResults(
+                    mr_Device.device(), m_Pool, 2 * slot, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                    VK_QUERY_RESULT_64_BIT);
+                if(result == VK_SUCCESS) {
+                    m_Samples.push_back(static_cast<double>(timestamps[1] - timestamps[0]) * m_PeriodNs / 1e6);
+                }
+            }
+
+            teng::Device& mr_Device;
+            VkQueryPool m_Pool{VK_NULL_HANDLE};
+            std::vector<uint64_t> m_FrameNumbers;
+            std::vector<bool> m_Pending;
+            std::vector<double> m_Samples; // Milliseconds.
+            uint64_t m_FirstMeasured{0};
+            bool m_Supported{false};
+            double m_PeriodNs{1.0};
+    };
+
+    Samples runScene(
+        teng::Device& device,
+        teng::Renderer& renderer,
+        teng::RenderSystem& renderSystem,
+        teng::PipelineManager& pipelineManager,
+        teng::Buffer& globalUbo,
+        const std::vector<VkDescriptorSet>& globalDescriptorSets,
+        Scene& scene,
+        const Options& options)
+    {
+        Samples samples{};
+        teng::Camera camera{};
+        camera.setPerspectiveProjection(glm::radians(50.f), renderer.getAspectRatio(), 0.1f, 100.f);
+        GpuTimer gpuTimer{device, renderer.getFramesInFlight()};
+
+        // Fixed time step, so every run renders the same frames.
+        const float frameTime = 1.f / 60.f;
+        const int totalFrames = options.warmup + options.frames;
+        auto previous = Clock::now();
+
+        for(int frame = 0; frame < totalFrames; frame++) {
+            const bool measured = frame >= options.warmup;
+            placeCamera(camera, scene, frame - options.warmup, options.frames);
+            if(frame == options.warmup) {
+                gpuTimer.setFirstMeasuredFrame(renderer.getFrameCount());
+            }
+
+            auto commandBuffer = renderer.beginFrame();
+            if(commandBuffer == nullptr) continue;
+            const auto cpuStart = Clock::now();
+
+            const uint32_t slot = static_cast<uint32_t>(renderer.getCurrentFrameIndex());
+            gpuTimer.begin(commandBuffer, slot, renderer.getFrameCount());
+
+            teng::FrameInfo frameInfo{static_cast<int>(slot), frameTime, commandBuffer, camera, globalDescriptorSets[slot]};
+            teng::GlobalUBO ubo{};
+            ubo.projectionView = camera.getProjectionMatrix() * camera.getViewMatrix();
+            ubo.time = frameTime * static_cast<float>(frame);
+            globalUbo.writeToIndex(&ubo, frameInfo.backFrame);
+            globalUbo.flushIndex(frameInfo.backFrame);
+
+            renderer.beginSwapChainRenderPass(commandBuffer);
+            renderSystem.m_RenderGameObjects(frameInfo, scene.objects);
+            renderer.endSwapChainRenderPass(commandBuffer);
+            gpuTimer.end(commandBuffer, slot);
+            renderer.endFrame();
+
+            const auto now = Clock::now();
+            if(frame == 0) {
+                // The first frame requested the pipelines, don't measure compilation.
+                pipelineManager.waitIdle();
+            }
+            if(measured) {
+                samples.frameMs.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+                samples.cpuMs.push_back(std::chrono::duration<double, std::milli>(now - cpuStart).count());
+                samples.drawCalls.push_back(renderSystem.getDrawCallCount());
+                samples.deviceMemoryMb.push_back(static_cast<double>(device.deviceLocalMemoryUsage()) / (1024.0 * 1024.0));
+                samples.hostMemoryMb.push_back(hostMemoryMb());
+            }
+            previous = now;
+        }
+
+        // Also keeps the scene's models alive until the GPU is done with them.
+        vkDeviceWaitIdle(device.device());
+        gpuTimer.drain();
+        samples.gpuMs = gpuTimer.samples();
+        return samples;
+    }
+
+    // Report
+
+    using Flat = std::map<std::string, double>; // "scenes.cubes.cpu_ms.p95" -> value
+
+    void writeMetric(std::ostream& out, Flat& flat, const std::string& scene, const char* name,
+                     const std::vector<double>& values, bool last) {
+        const double p50 = bench::percentile(values, .50);
+        const double p95 = bench::percentile(values, .95);
+        const double p99 = bench::percentile(values, .99);
+        const std::string prefix = "scenes." + scene + "." + name;
+        flat[prefix + ".p50"] = p50;
+        flat[prefix + ".p95"] = p95;
+        flat[prefix + ".p99"] = p99;
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "      \"%s\": {\"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f}%s\n",
+                      name, p50, p95, p99, last ? "" : ",");
+        out << line;
+    }
+
+    // Just enough JSON to read a report back: numbers are collected under
+    // their dotted path, everything else is skipped.
+    class JsonReader {
+
+        public:
+
+            explicit JsonReader(std::string text) : m_Text(std::move(text)) {}
+
+            Flat read() {
+                Flat flat;
+                m_Value("", flat);
+                return flat;
+            }
+
+        private:
+
+            void m_SkipSpace() {
+                while(m_Pos < m_Text.size() && std::isspace(static_cast<unsigned char>(m_Text[m_Pos]))) m_Pos++;
+            }
+
+            char m_Peek() {
+                m_SkipSpace();
+                if(m_Pos >= m_Text.size()) throw std::runtime_error("unexpected end of baseline report");
+                return m_Text[m_Pos];
+            }
+
+            void m_Expect(char c) {
+                if(m_Peek() != c) throw std::runtime_error(std::string{"baseline report: expected '"} + c + "'");
+                m_Pos++;
+            }
+
+            std::string m_String() {
+                m_Expect('"');
+                std::string value;
+                while(m_Pos < m_Text.size() && m_Text[m_Pos] != '"') {
+                    if(m_Text[m_Pos] == '\\') m_Pos++;
+                    if(m_Pos < m_Text.size()) value += m_Text[m_Pos++];
+                }
+                m_Pos++;
+                return value;
+            }
+
+            void m_Value(const std::string& path, Flat& flat) {
+                const char c = m_Peek();
+                if(c == '{') {
+                    m_Pos++;
+                    if(m_Peek() == '}') { m_Pos++; return; }
+                    for(;;) {
+                        const std::string key = m_String();
+                        m_Expect(':');
+                        m_Value(path.empty() ? key : path + "." + key, flat);
+                        if(m_Peek() == ',') { m_Pos++; continue; }
+                        m_Expect('}');
+                        return;
+                    }
+                } else if(c == '[') {
+                    m_Pos++;
+                    if(m_Peek() == ']') { m_Pos++; return; }
+                    for(int index = 0;; index++) {
+                        m_Value(path + "." + std::to_string(index), flat);
+                        if(m_Peek() == ',') { m_Pos++; continue; }
+                        m_Expect(']');
+                        return;
+                    }
+                } else if(c == '"') {
+                    m_String();
+                } else if(std::isalpha(static_cast<unsigned char>(c))) {
+                    while(m_Pos < m_Text.size() && std::isalpha(static_cast<unsigned char>(m_Text[m_Pos]))) m_Pos++;
+                } else {
+                    size_t length = 0;
+                    flat[path] = std::stod(m_Text.substr(m_Pos), &length);
+                    m_Pos += length;
+                }
+            }
+
+            std::string m_Text;
+            size_t m_Pos{0};
+    };
+
+    // Returns the number of regressions.
+    int compareWithBaseline(const Flat& current, const std::string& baselinePath, double threshold) {
+        std::ifstream file{baselinePath};
+        if(!file) throw std::runtime_error("failed to open baseline " + baselinePath);
+        std::stringstream text;
+        text << file.rdbuf();
+        const Flat baseline = JsonReader{text.str()}.read();
+
+        int regressions = 0;
+        int compared = 0;
+        for(const auto& [key, value] : current) {
+            auto it = baseline.find(key);
+            if(it == baseline.end() || it->second <= 0.0) continue;
+            compared++;
+
+            const double change = value / it->second - 1.0;
+            if(change > threshold) {
+                std::printf("REGRESSION %-45s %12.4f -> %12.4f (%+.1f%%)\n", key.c_str(), it->second, value, 100.0 * change);
+                regressions++;
+            }
+        }
+        std::printf("compared %d values against %s, threshold %.1f%%: %d regressions\n",
+                    compared, baselinePath.c_str(), 100.0 * threshold, regressions);
+        return regressions;
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options options = parseOptions(argc, argv);
+
+        teng::Device device{};
+        teng::Renderer renderer{device, VkExtent2D{options.width, options.height}};
+        teng::PipelineManager pipelineManager{device};
+
+        auto globalPool = teng::DescriptorPool::Builder(device)
+            .setMaxSets(teng::RenderTarget::MAX_FRAMES_IN_FLIGHT)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, teng::RenderTarget::MAX_FRAMES_IN_FLIGHT)
+            .build();
+        teng::Buffer globalUbo{
+            device,
+            sizeof(teng::GlobalUBO),
+            teng::RenderTarget::MAX_FRAMES_IN_FLIGHT,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            device.properties.limits.minUniformBufferOffsetAlignment};
+        globalUbo.map();
+
+        auto globalSetLayout = teng::DescriptorSetLayout::Builder(device)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+            .build();
+        std::vector<VkDescriptorSet> globalDescriptorSets(teng::RenderTarget::MAX_FRAMES_IN_FLIGHT);
+        for(size_t i = 0; i < globalDescriptorSets.size(); i++) {
+            auto bufferInfo = globalUbo.descriptorInfoForIndex(static_cast<int>(i));
+            teng::DescriptorWriter(*globalSetLayout, *globalPool)
+                .writeBuffer(0, &bufferInfo)
+                .build(globalDescriptorSets[i]);
+        }
+
+        teng::RenderSystem renderSystem{
+            device, pipelineManager, renderer.getPipelineTarget(), globalSetLayout->getDescriptorSetLayout()};
+
+        Flat flat;
+        std::ostringstream report;
+        report << "{\n";
+        report << "  \"frames\": " << options.frames << ",\n";
+        report << "  \"width\": " << options.width << ",\n";
+        report << "  \"height\": " << options.height << ",\n";
+        report << "  \"scenes\": {\n";
+
+        for(size_t s = 0; s < options.scenes.size(); s++) {
+            const std::string& name = options.scenes[s];
+            Scene scene{};
+            if(name == "cubes") {
+                scene = buildCubes(device, options.cubes);
+            } else if(name == "torso") {
+                scene = buildTorsos(device, options.torsos, options.torsoPath);
+            } else if(name == "sierpinski") {
+                scene = buildSierpinski(device, options.sierpinskiDepth);
+            } else {
+                throw std::invalid_argument("unknown scene " + name);
+            }
+
+            const Samples samples = runScene(
+                device, renderer, renderSystem, pipelineManager, globalUbo, globalDescriptorSets, scene, options);
+
+            std::printf("%-12s objects %7zu  frame p50 %8.3f ms  cpu p50 %8.3f ms  gpu p50 %8.3f ms  p99 %8.3f ms\n",
+                        name.c_str(), static_cast<size_t>(scene.objects.size()),
+                        bench::percentile(samples.frameMs, .5), bench::percentile(samples.cpuMs, .5),
+                        bench::percentile(samples.gpuMs, .5), bench::percentile(samples.frameMs, .99));
+
+            report << "    \"" << name << "\": {\n";
+            report << "      \"objects\": " << scene.objects.size() << ",\n";
+            writeMetric(report, flat, name, "frame_ms", samples.frameMs, false);
+            writeMetric(report, flat, name, "cpu_ms", samples.cpuMs, false);
+            if(!samples.gpuMs.empty()) {
+                writeMetric(report, flat, name, "gpu_ms", samples.gpuMs, false);
+            }
+            writeMetric(report, flat, name, "draw_calls", samples.drawCalls, false);
+            writeMetric(report, flat, name, "device_memory_mb", samples.deviceMemoryMb, false);
+            writeMetric(report, flat, name, "host_memory_mb", samples.hostMemoryMb, true);
+            report << "    }" << (s + 1 < options.scenes.size() ? "," : "") << "\n";
+        }
+        report << "  }\n}\n";
+
+        std::ofstream out{options.out};
+        out << report.str();
+        std::printf("report written to %s\n", options.out.c_str());
+
+        if(!options.baseline.empty() && compareWithBaseline(flat, options.baseline, options.threshold) > 0) {
+            return EXIT_FAILURE;
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+// Resize stress benchmark.
+//
+// Resizes the window every few frames while rendering and reports frame
+// times, most importantly the worst one, which is where swap chain
+// recreation hitches show up.
+//
+// Usage: resize_stress [frames] [frames per resize]
+// Build it together with the engine sources in src/, without src/main.cpp.
+
+#include "bench_harness.hpp"
+#include "../src/teng_window.hpp"
+#include "../src/teng_device.hpp"
+#include "../src/teng_renderer.hpp"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+    struct Sizes {
+        int width;
+        int height;
+    };
+
+    // A loop of sizes, so both growing and shrinking get exercised.
+    const Sizes RESIZE_CYCLE[] = {
+        {900, 900}, {1280, 720}, {640, 480}, {1024, 1024}, {800, 600}, {1600, 900}, {480, 800}};
+}
+
+int main(int argc, char** argv) {
+    const int frameCount = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const int framesPerResize = argc > 2 ? std::max(1, std::atoi(argv[2])) : 2;
+
+    try {
+        teng::Window window{900, 900, "resize stress"};
+        teng::Device device{window};
+        teng::Renderer renderer{window, device};
+
+        std::vector<double> frameTimes;
+        frameTimes.reserve(frameCount);
+        size_t resizeIndex = 0;
+
+        auto previous = std::chrono::steady_clock::now();
+        for(int frame = 0; frame < frameCount && !window.shouldClose(); frame++) {
+
+            if(frame % framesPerResize == 0) {
+                const Sizes& size = RESIZE_CYCLE[resizeIndex++ % std::size(RESIZE_CYCLE)];
+                glfwSetWindowSize(window.getWindow(), size.width, size.height);
+            }
+            glfwPollEvents();
+
+            if(auto commandBuffer = renderer.beginFrame()) {
+                renderer.beginSwapChainRenderPass(commandBuffer);
+                renderer.endSwapChainRenderPass(commandBuffer);
+                renderer.endFrame();
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+            previous = now;
+        }
+
+        vkDeviceWaitIdle(device.device());
+
+        double total = 0.0;
+        for(double t : frameTimes) total += t;
+
+        std::cout << "frames:        " << frameTimes.size() << "\n";
+        std::cout << "recreations:   " << renderer.getSwapChainRecreateCount() << "\n";
+        std::cout << "mean ms:       " << total / std::max<size_t>(frameTimes.size(), 1) << "\n";
+        std::cout << "p50 ms:        " << bench::percentile(frameTimes, 0.50) << "\n";
+        std::cout << "p99 ms:        " << bench::percentile(frameTimes, 0.99) << "\n";
+        std::cout << "worst ms:      " << (frameTimes.empty() ? 0.0 : *std::max_element(frameTimes.begin(), frameTimes.end())) << "\n";
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
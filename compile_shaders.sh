@@ -1,3 +1,5 @@
 #!/usr/bin/env sh
 glslc shaders/simple_shader.vert -o shaders/simple_shader.vert.spv
 glslc shaders/simple_shader.frag -o shaders/simple_shader.frag.spv
+glslc shaders/gravity.vert -o shaders/gravity.vert.spv
+glslc shaders/gravity.comp -o shaders/gravity.comp.spv
@@ -0,0 +1,29 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec3 normal;
+layout(location = 3) in vec2 uv;
+
+// This is forwarded to the fragment shader.
+layout(location = 0) out vec3 fragColor;
+
+// Only the leading member of the GlobalUbo is read.
+layout(set = 0, binding = 0) uniform GlobalUbo {
+    mat4 projectionViewTransform;
+} ubo;
+
+// One per body, as the last gravity step wrote them. w is the mass.
+layout(std430, set = 1, binding = 1) readonly buffer Bodies {
+    vec4 bodies[];
+};
+
+layout(push_constant) uniform Draw {
+    float scale; // Of the model drawn for each body.
+} draw;
+
+void main() {
+    vec3 center = bodies[gl_InstanceIndex].xyz;
+    gl_Position = ubo.projectionViewTransform * vec4(center + draw.scale * position, 1.0);
+    fragColor = color;
+}
@@ -12,11 +12,6 @@ layout(location = 0) in vec3 fragColor;
  */
 layout (location = 0) out vec4 outColor;
 
-layout(push_constant) uniform Push {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-} push;
-
 /*
  * main is run per fragment given by the rasterizer.
  */
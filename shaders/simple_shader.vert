@@ -1,5 +1,14 @@
 #version 450
 
+// Specialization constants, set per pipeline through ShaderVariant.
+// Branches on them are resolved when the pipeline is compiled.
+layout(constant_id = 0) const int LIGHT_COUNT = 1;
+layout(constant_id = 1) const int LIGHTING_MODEL = 1; // 0: unlit, 1: lambert
+layout(constant_id = 2) const bool USE_NORMAL_MATRIX = true;
+
+const int MAX_POINT_LIGHTS = 4;
+const int LIGHTING_UNLIT = 0;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec3 normal;
@@ -8,38 +17,60 @@ layout(location = 3) in vec2 uv;
 // This is forwarded to the fragment shader.
 layout(location = 0) out vec3 fragColor;
 
+struct PointLight {
+    vec4 position;
+    vec4 color; // w is intensity
+};
+
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projectionViewTransform;
     vec4 ambientLightColor;
-    vec4 pointLightPosition;
-    vec4 pointLightColor;
+    PointLight pointLights[MAX_POINT_LIGHTS];
     float time;
 } ubo;
 
-layout(push_constant) uniform Push {
+struct Instance {
     mat4 modelTransform; // From model to world space
     mat4 normalMatrix;
-} push;
+};
+
+// One entry per entity, written by RenderSystem.
+layout(std430, set = 1, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
 
 void main() {
-    vec4 vertexWorldPosition = push.modelTransform * vec4(position, 1.0);
+    Instance instance = instances[gl_InstanceIndex];
+    vec4 vertexWorldPosition = instance.modelTransform * vec4(position, 1.0);
     // vertexWorldPosition.y = -1 + vertexWorldPosition.y + cos(ubo.time);
-    vec3 directionToPointLight = ubo.pointLightPosition.xyz - vertexWorldPosition.xyz;
-    vec3 directionToPointLightUnit = normalize(ubo.pointLightPosition.xyz - vertexWorldPosition.xyz);
-    float attenuation = dot(directionToPointLight, directionToPointLight);
 
     // Model -> world -> camera -> view
     gl_Position = ubo.projectionViewTransform * vertexWorldPosition;
 
+    if (LIGHTING_MODEL == LIGHTING_UNLIT) {
+        fragColor = color;
+        return;
+    }
+
     // Move the normals in sync with the model
     // Normals are directional, so they aren't changed by translation.
     // -> Use only the scale and rotation parts of the model transform.
-    vec3 normalWorldSpace = normalize(mat3(push.normalMatrix) * normal);
+    // With uniform scale the model matrix itself is enough, the length is normalized away.
+    vec3 normalWorldSpace = USE_NORMAL_MATRIX
+        ? normalize(mat3(instance.normalMatrix) * normal)
+        : normalize(mat3(instance.modelTransform) * normal);
 
     vec3 ambientLightColor = ubo.ambientLightColor.w * ubo.ambientLightColor.xyz;
-    vec3 pointLightColor = ubo.pointLightColor.w * ubo.pointLightColor.xyz;
-    vec3 diffuseLightColor = max(dot(normalWorldSpace, directionToPointLightUnit), 0) * pointLightColor;
-    diffuseLightColor = diffuseLightColor / attenuation;
+    vec3 diffuseLightColor = vec3(0.0);
+
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+        PointLight light = ubo.pointLights[i];
+        vec3 directionToPointLight = light.position.xyz - vertexWorldPosition.xyz;
+        float attenuation = dot(directionToPointLight, directionToPointLight);
+        vec3 pointLightColor = light.color.w * light.color.xyz;
+        float cosAngle = max(dot(normalWorldSpace, normalize(directionToPointLight)), 0);
+        diffuseLightColor += cosAngle * pointLightColor / attenuation;
+    }
 
     fragColor = (diffuseLightColor + ambientLightColor) * color;
 }
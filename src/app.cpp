@@ -6,8 +6,15 @@
 #include "teng_buffer.hpp"
 #include "keyboard_movement_controller.hpp"
 #include "camera.hpp"
+#include "latency_monitor.hpp"
+#include "teng_profiler.hpp"
+#include "teng_trace.hpp"
+#include <algorithm>
 #include <chrono>
+#include <fstream>
 #include <array>
+#include <cstddef>
+#include <string>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -20,23 +27,141 @@
 
 namespace teng {
 
-    // Global data for shaders
-    struct GlobalUBO {
-        glm::mat4 projectionView{1.f}; // 4*4*4 = 4*16, alignment ok
-        glm::vec4 ambientLightColor{1.0f, 1.0f, 1.0f, 0.1f};
-        glm::vec4 pointLightPosition{-1.f, -1.f, -1.f, 0.f};
-        glm::vec4 pointLightColor{0.8f, 0.8f, 0.8f, 10.0f};
-        glm::float32 time{0.f};
-    };
+    namespace {
+        // The gravity scene's disk, facing the viewer who starts at the origin looking down +z.
+        constexpr float GALAXY_RADIUS = 10.f;
+        const glm::vec3 GALAXY_CENTER{0.f, 0.f, 25.f};
+        constexpr float BODY_SCALE = .02f;
+        // Longest gravity step, so a stalled frame doesn't fling bodies out.
+        constexpr float MAX_GRAVITY_STEP = 1.f / 30.f;
+    }
+
+    AppSettings AppSettings::s_FromArgs(int argc, char** argv) {
+        AppSettings settings{};
+
+        auto value = [&](int& i) -> std::string {
+            if(i + 1 >= argc) {
+                throw std::invalid_argument(std::string{"missing value for "} + argv[i]);
+            }
+            return argv[++i];
+        };
+        auto count = [&](int& i) -> uint32_t {
+            const std::string option = argv[i];
+            const std::string text = value(i);
+            try {
+                return static_cast<uint32_t>(std::stoul(text));
+            } catch(const std::exception&) {
+                throw std::invalid_argument("expected a number for " + option + ", got " + text);
+            }
+        };
+        auto real = [&](int& i) -> float {
+            const std::string option = argv[i];
+            const std::string text = value(i);
+            try {
+                return std::stof(text);
+            } catch(const std::exception&) {
+                throw std::invalid_argument("expected a number for " + option + ", got " + text);
+            }
+        };
+
+        for(int i = 1; i < argc; i++) {
+            const std::string option = argv[i];
+            PresentPolicy& policy = settings.presentPolicy;
+
+            if(option == "--profile") {
+                const std::string profile = value(i);
+                if(profile == "low-latency") {
+                    policy = PresentPolicy::s_LowLatency();
+                } else if(profile == "throughput") {
+                    policy = PresentPolicy::s_Throughput();
+                } else {
+                    throw std::invalid_argument("unknown profile " + profile);
+                }
+            } else if(option == "--present-mode") {
+                const std::string mode = value(i);
+                if(!PresentPolicy::s_ParsePresentMode(mode, policy.presentMode)) {
+                    throw std::invalid_argument("unknown present mode " + mode);
+                }
+            } else if(option == "--images") {
+                policy.imageCount = count(i);
+            } else if(option == "--frames-in-flight") {
+                policy.framesInFlight = count(i);
+                if(policy.framesInFlight < 1 || policy.framesInFlight > static_cast<uint32_t>(SwapChain::MAX_FRAMES_IN_FLIGHT)) {
+                    throw std::invalid_argument("--frames-in-flight must be between 1 and " + std::to_string(SwapChain::MAX_FRAMES_IN_FLIGHT));
+                }
+            } else if(option == "--latency-limit") {
+                policy.frameLatencyLimit = count(i);
+            } else if(option == "--late-latch") {
+                settings.lateLatch = true;
+            } else if(option == "--measure-latency") {
+                settings.measureLatency = true;
+            } else if(option == "--pace") {
+                settings.framePacing = true;
+            } else if(option == "--gpu-profile") {
+                settings.gpuProfile = true;
+            } else if(option == "--trace") {
+                settings.tracePath = value(i);
+            } else if(option == "--gravity") {
+                settings.gravityBodies = count(i);
+            } else if(option == "--theta") {
+                settings.gravityTheta = real(i);
+                if(settings.gravityTheta < 0.f) {
+                    throw std::invalid_argument("--theta must not be negative");
+                }
+            } else if(option == "--gpu-gravity") {
+                settings.gpuGravity = true;
+            } else if(option == "--tick-rate") {
+                settings.tickRate = real(i);
+                if(settings.tickRate < 0.f) {
+                    throw std::invalid_argument("--tick-rate must not be negative");
+                }
+            } else {
+                throw std::invalid_argument("unknown option " + option);
+            }
+        }
+        if(settings.gpuGravity && settings.gravityBodies == 0) {
+            throw std::invalid_argument("--gpu-gravity needs --gravity N");
+        }
+        return settings;
+    }
+
+    const char* AppSettings::s_Usage() {
+        return
+            "options:\n"
+            "  --profile low-latency|throughput  start from a preset, later options override it\n"
+            "  --present-mode fifo|fifo-relaxed|mailbox|immediate\n"
+            "  --images N                        swap chain images, 0 for the surface minimum + 1\n"
+            "  --frames-in-flight N              1 to 4\n"
+            "  --latency-limit N                 start a frame once frame N back has finished, 0 for off\n"
+            "  --late-latch                      update the camera from fresh input right before submitting\n"
+            "  --measure-latency                 report input to GPU completion latency every few seconds\n"
+            "  --pace                            start frames just in time for the next display refresh\n"
+            "  --gpu-profile                     report GPU time per pass every few seconds\n"
+            "  --trace FILE                      record CPU zones and GPU scopes, write a Chrome trace to FILE on exit\n"
+            "  --gravity N                       show N bodies orbiting under their own gravity instead of the cubes\n"
+            "  --theta X                         Barnes-Hut opening angle for --gravity, smaller is more accurate\n"
+            "  --gpu-gravity                     simulate --gravity in a compute shader, summing every pair\n"
+            "  --tick-rate HZ                    simulate --gravity on its own thread HZ times a second, 0 for once per frame\n";
+    }
 
     // Public
-    App::App()
+    App::App(const AppSettings& settings)
+        : m_Settings{settings}
     {
+        m_Renderer.setFramePacing(m_Settings.framePacing);
+        m_Renderer.setGpuProfiling(m_Settings.gpuProfile || !m_Settings.tracePath.empty());
+        TENG_PROFILE_THREAD("main");
+        CpuProfiler::setEnabled(!m_Settings.tracePath.empty());
+
         m_GlobalDescriptorPool = DescriptorPool::Builder(mr_Device)
             .setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
             .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
             .build();
-        m_LoadCubes();
+        if(m_Settings.gravityBodies > 0) {
+            m_LoadGravGameObjects();
+        } else {
+            m_LoadCubes();
+        }
     }
 
     App::~App() {};
@@ -67,7 +192,7 @@ namespace teng {
                 .build(globalDescriptorSets[i]);
         }
 
-        RenderSystem renderSystem{mr_Device, m_Renderer.p_GetSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+        RenderSystem renderSystem{mr_Device, m_PipelineManager, m_Renderer.getPipelineTarget(), globalSetLayout->getDescriptorSetLayout()};
         Camera camera{};
 
         if (glfwRawMouseMotionSupported()) {
@@ -83,203 +208,418 @@ namespace teng {
         auto previousTime = std::chrono::high_resolution_clock::now();
         auto mousePrevious = m_Window.getMousePosition();
         float elapsedTime = 0.f;
+        auto inputTime = LatencyMonitor::Clock::now();
 
-        while (!m_Window.shouldClose()) {
-
-            // This checks for clicks and stuff.
-            glfwPollEvents();
-
+        // Moves the viewer by the input since the last sample. With late latching
+        // this runs twice per frame, each time consuming the input since the last call.
+        auto sampleInput = [&]() {
             auto currentTime = std::chrono::high_resolution_clock::now();
-            float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - previousTime).count();
+            float dt = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - previousTime).count();
             previousTime = currentTime;
-            elapsedTime += glm::mod(frameTime, glm::two_pi<float>());
+            inputTime = LatencyMonitor::Clock::now();
 
             auto mouseCurrent = m_Window.getMousePosition();
             auto mouseDelta = mouseCurrent - mousePrevious;
             mousePrevious = mouseCurrent;
 
-            cameraController.moveInPlaneXZ(m_Window.getWindow(), frameTime, viewerObject);
-            cameraController.rotateWithMouse(m_Window.getWindow(), frameTime, viewerObject, mouseDelta);
+            cameraController.moveInPlaneXZ(m_Window.getWindow(), dt, viewerObject);
+            cameraController.rotateWithMouse(m_Window.getWindow(), dt, viewerObject, mouseDelta);
             camera.setViewYXZ(viewerObject.p_Transform.translation, viewerObject.p_Transform.rotation);
-            float aspectRatio = m_Renderer.getAspectRatio();
-            camera.setPerspectiveProjection(glm::radians(50.f), aspectRatio, 0.1f, 100.f);
+            return dt;
+        };
+
+        // The command buffer only references the UBO slot, so its contents can
+        // still change until the submission.
+        if(m_Settings.lateLatch) {
+            m_Renderer.setPreSubmitHook([&](int frameIndex) {
+                glfwPollEvents();
+                sampleInput();
+
+                glm::mat4 projectionView = camera.getProjectionMatrix() * camera.getViewMatrix();
+                globalUbo.writeToBuffer(
+                    &projectionView,
+                    sizeof(projectionView),
+                    frameIndex * globalUbo.getAlignmentSize() + offsetof(GlobalUBO, projectionView));
+                globalUbo.flushIndex(frameIndex);
+            });
+        }
+
+        std::unique_ptr<LatencyMonitor> latencyMonitor;
+        if(m_Settings.measureLatency) {
+            latencyMonitor = std::make_unique<LatencyMonitor>();
+        }
+        auto lastGpuReport = std::chrono::steady_clock::now();
+        std::vector<uint32_t> visible; // Dense indices in view, reused across frames.
+
+        // CPU zones are drained once a second, the trace keeps the last TRACE_SECONDS of them.
+        constexpr int64_t TRACE_SECONDS = 10;
+        std::vector<TraceEvent> cpuEvents;
+        std::vector<std::pair<uint32_t, std::string>> threadNames;
+        uint64_t droppedZones = 0;
+        auto lastCollect = std::chrono::steady_clock::now();
+        auto collectZones = [&]() {
+            threadNames.clear();
+            const size_t first = cpuEvents.size();
+            droppedZones += CpuProfiler::collect(cpuEvents, &threadNames);
+            if(cpuEvents.size() == first) return;
+            int64_t newestNs = cpuEvents.back().startNs;
+            for(size_t i = first; i < cpuEvents.size(); i++) newestNs = std::max(newestNs, cpuEvents[i].startNs);
+            const int64_t cutoffNs = newestNs - TRACE_SECONDS * 1'000'000'000;
+            cpuEvents.erase(
+                std::remove_if(cpuEvents.begin(), cpuEvents.end(), [&](const TraceEvent& event) { return event.startNs < cutoffNs; }),
+                cpuEvents.end());
+        };
+
+        if(mp_SimulationLoop) {
+            mp_SimulationLoop->start();
+        }
+
+        while (!m_Window.shouldClose()) {
+            TENG_PROFILE_ZONE("App::run frame");
+
+            // Wait out the latency limiter before reading input, not after.
+            {
+                TENG_PROFILE_ZONE("wait for frame");
+                m_Renderer.waitForFrameLatency();
+            }
+
+            float frameTime = 0.f;
+            {
+                TENG_PROFILE_ZONE("input");
+                // This checks for clicks and stuff.
+                glfwPollEvents();
+
+                frameTime = sampleInput();
+                elapsedTime += glm::mod(frameTime, glm::two_pi<float>());
+
+                float aspectRatio = m_Renderer.getAspectRatio();
+                camera.setPerspectiveProjection(glm::radians(50.f), aspectRatio, 0.1f, 100.f);
+            }
 
             if(auto commandBuffer = m_Renderer.beginFrame()) {
                 int backFrame = m_Renderer.getCurrentFrameIndex();
-                FrameInfo frameInfo{backFrame, frameTime, commandBuffer, camera, globalDescriptorSets[backFrame]};
+                FrameInfo frameInfo{backFrame, frameTime, commandBuffer, camera, globalDescriptorSets[backFrame], m_Renderer.getGpuProfiler()};
 
                 // Update
-                GlobalUBO stagingUBO{};
-                stagingUBO.projectionView = camera.getProjectionMatrix() * camera.getViewMatrix();
-                stagingUBO.time = elapsedTime;
-                globalUbo.writeToIndex(&stagingUBO, frameInfo.backFrame);
-                globalUbo.flushIndex(backFrame);
+                {
+                    TENG_PROFILE_ZONE("update");
+                    GlobalUBO stagingUBO{};
+                    stagingUBO.projectionView = camera.getProjectionMatrix() * camera.getViewMatrix();
+                    stagingUBO.time = elapsedTime;
+                    globalUbo.writeToIndex(&stagingUBO, frameInfo.backFrame);
+                    globalUbo.flushIndex(backFrame);
+
+                    if(m_Settings.gravityBodies > 0) {
+                        m_RunGravSystem(frameInfo);
+                    }
+
+                    // Before recording, which reads the cached matrices.
+                    m_Registry.updateWorldMatrices(&m_ThreadPool);
+                    // Culled with the camera as sampled above. Late latching may still turn it
+                    // a little, so things at the edges of the view can appear a frame late.
+                    m_SpatialIndex.update(m_Registry);
+                    m_SpatialIndex.cull(Frustum::s_FromMatrix(stagingUBO.projectionView), visible);
+                }
 
                 // Render
-                m_Renderer.beginSwapChainRenderPass(commandBuffer);
-                renderSystem.m_RenderGameObjects(frameInfo, m_GameObjects);
-                m_Renderer.endSwapChainRenderPass(commandBuffer);
-                m_Renderer.endFrame();
+                {
+                    TENG_PROFILE_ZONE("record");
+                    m_Renderer.beginSwapChainRenderPass(commandBuffer);
+                    renderSystem.m_RenderGameObjects(frameInfo, m_Registry, &visible);
+                    if(mp_GpuGravity) {
+                        renderSystem.m_RenderGrav(frameInfo, *mp_GpuGravity, *mp_BodyModel, BODY_SCALE);
+                    }
+                    m_Renderer.endSwapChainRenderPass(commandBuffer);
+                }
+                {
+                    TENG_PROFILE_ZONE("submit");
+                    m_Renderer.endFrame();
+                }
+
+                if(latencyMonitor) {
+                    latencyMonitor->frameSubmitted(m_Renderer.getFrameCount() - 1, inputTime);
+                }
             };
+
+            if(latencyMonitor) {
+                latencyMonitor->update(m_Renderer);
+            }
+
+            if(m_Settings.gpuProfile && m_Renderer.getGpuProfiler() &&
+               std::chrono::steady_clock::now() - lastGpuReport >= std::chrono::seconds{5}) {
+                lastGpuReport = std::chrono::steady_clock::now();
+                m_Renderer.getGpuProfiler()->printSummary(std::cout);
+            }
+
+            if(CpuProfiler::isEnabled() && std::chrono::steady_clock::now() - lastCollect >= std::chrono::seconds{1}) {
+                lastCollect = std::chrono::steady_clock::now();
+                collectZones();
+            }
+        }
+
+        if(mp_SimulationLoop) {
+            mp_SimulationLoop->stop();
         }
+        m_Renderer.setPreSubmitHook(nullptr);
 
         // Block until GPU finishes execution.
         vkDeviceWaitIdle(mr_Device.device());
+
+        if(!m_Settings.tracePath.empty()) {
+            collectZones();
+            std::vector<TraceEvent> events = std::move(cpuEvents);
+            // Null when the device can't write timestamps, the trace is CPU only then.
+            if(GpuProfiler* profiler = m_Renderer.getGpuProfiler()) {
+                profiler->resolveAll();
+                profiler->appendTraceEvents(events);
+                threadNames.emplace_back(GPU_TRACE_THREAD_ID, "GPU");
+            }
+
+            std::ofstream out{m_Settings.tracePath};
+            writeChromeTrace(out, events, threadNames);
+            std::cout << "wrote " << events.size() << " trace events to " << m_Settings.tracePath;
+            if(droppedZones > 0) std::cout << ", " << droppedZones << " CPU zones dropped";
+            std::cout << "\n";
+        }
     };
 
 
+    void App::m_RunGravSystem(FrameInfo& frameInfo) {
+        TENG_PROFILE_ZONE("App::m_RunGravSystem");
+        const float dt = std::min(frameInfo.frameTime, MAX_GRAVITY_STEP);
+        if(mp_GpuGravity) {
+            mp_GpuGravity->recordStep(frameInfo.commandBuffer, dt, frameInfo.gpuProfiler);
+            return;
+        }
+        if(mp_SimulationLoop) {
+            // Drawn where the bodies are now rather than at the last tick, so
+            // they move smoothly whatever the tick and frame rates.
+            if(mp_SimulationLoop->interpolate(m_Registry.translations(), m_Registry.size())) {
+                m_Registry.markAllTransformsDirty();
+            }
+            return;
+        }
+
+        // Every entity is a body, so the registry's arrays are the bodies'.
+        m_GravitySystem.step(
+            m_Registry.translations(),
+            m_Registry.velocities(),
+            m_Registry.masses(),
+            m_Registry.size(),
+            dt,
+            &m_ThreadPool);
+        m_Registry.markAllTransformsDirty();
+    };
+
+    void App::m_LoadGravGameObjects() {
+        GravitySystem::Settings settings{};
+        settings.theta = m_Settings.gravityTheta;
+        m_GravitySystem.setSettings(settings);
+
+        const uint32_t count = m_Settings.gravityBodies;
+        std::vector<glm::vec3> positions(count);
+        std::vector<glm::vec3> velocities(count);
+        std::vector<float> masses(count);
+        GravitySystem::s_DiskGalaxy(count, GALAXY_RADIUS, 1234, positions.data(), velocities.data(), masses.data());
+        for(glm::vec3& position : positions) position += GALAXY_CENTER;
+
+        if(m_Settings.gpuGravity) {
+            mp_GpuGravity = std::make_unique<GpuGravitySystem>(
+                mr_Device, positions.data(), velocities.data(), masses.data(), count, settings);
+            mp_BodyModel = Model::CreateModelFromFile(mr_Device, "models/colored_cube.obj");
+            return;
+        }
+
+        const ModelHandle model = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/colored_cube.obj"));
+        m_Registry.reserve(count);
+        for(uint32_t i = 0; i < count; i++) {
+            const Entity body = m_Registry.create();
+            m_Registry.setModel(body, model);
+            m_Registry.setRigidBody(body, velocities[i], masses[i]);
+            m_Registry.translation(body) = positions[i];
+            // The central mass stands out.
+            m_Registry.scale(body) = glm::vec3{i == 0 ? 10.f * BODY_SCALE : BODY_SCALE};
+        }
+
+        if(m_Settings.tickRate > 0.f) {
+            // The simulation keeps its own copy of the bodies, the registry
+            // only gets the interpolated positions.
+            m_BodyPositions = std::move(positions);
+            m_BodyVelocities = std::move(velocities);
+            m_BodyMasses = std::move(masses);
+            mp_SimulationThreadPool = std::make_unique<ThreadPool>();
+            mp_SimulationLoop = std::make_unique<SimulationLoop>(
+                m_Settings.tickRate,
+                [this](float dt) {
+                    m_GravitySystem.step(
+                        m_BodyPositions.data(),
+                        m_BodyVelocities.data(),
+                        m_BodyMasses.data(),
+                        static_cast<uint32_t>(m_BodyPositions.size()),
+                        dt,
+                        mp_SimulationThreadPool.get());
+                },
+                [this](std::vector<glm::vec3>& translations) { translations = m_BodyPositions; });
+        }
+    };
+
     void App::m_LoadCubes() {
-        std::shared_ptr<Model> whiteModel = Model::CreateModelFromFile(mr_Device, "models/white_cube.obj");
-        std::shared_ptr<Model> blueModel = Model::CreateModelFromFile(mr_Device, "models/blue_cube.obj");
-        std::shared_ptr<Model> quadModel = Model::CreateModelFromFile(mr_Device, "models/quad.obj");
+        const ModelHandle whiteModel = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/white_cube.obj"));
+        const ModelHandle blueModel = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/blue_cube.obj"));
+        const ModelHandle quadModel = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/quad.obj"));
 
-        std::vector<GameObject> whiteCubes;
-        std::vector<GameObject> blueCubes;
+        std::vector<Entity> whiteCubes;
+        std::vector<Entity> blueCubes;
         const std::size_t count = 42;
         for (int i = 0; i < count; i++) {
-            auto cube = GameObject::CreateGameObject();
-            cube.model = whiteModel;
-            cube.p_Transform.scale = {.05f, .05f, .05f};
-            whiteCubes.push_back(std::move(cube));
-
-            cube = GameObject::CreateGameObject();
-            cube.model = blueModel;
-            cube.p_Transform.scale = {.05f, .05f, .05f};
-            blueCubes.push_back(std::move(cube));
+            Entity cube = m_Registry.create();
+            m_Registry.setModel(cube, whiteModel);
+            m_Registry.scale(cube) = {.05f, .05f, .05f};
+            whiteCubes.push_back(cube);
+
+            cube = m_Registry.create();
+            m_Registry.setModel(cube, blueModel);
+            m_Registry.scale(cube) = {.05f, .05f, .05f};
+            blueCubes.push_back(cube);
         }
 
+        // Each letter is an entity of its own, its cubes are placed relative to it.
+        Entity letter{};
+        auto newLetter = [&](const glm::vec3& translation) {
+            letter = m_Registry.create();
+            m_Registry.translation(letter) = translation;
+        };
+        auto place = [&](Entity cube, const glm::vec3& translation) {
+            m_Registry.setParent(cube, letter);
+            m_Registry.translation(cube) = translation;
+        };
+
         // A
-        glm::vec3 offset = {-1.75f, 0.f, 0.f};
+        newLetter({-1.75f, 0.f, 0.f});
         std::size_t i = 0;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.15f, .0f, 0.00f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.15f, .0f, 0.15f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.15f, .0f, 0.30f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.40f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{-.15f, .0f, 0.00f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{-.15f, .0f, 0.15f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{-.15f, .0f, 0.30f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.15f} + offset;
+        place(whiteCubes[i++], {.15f, .0f, 0.00f});
+        place(whiteCubes[i++], {.15f, .0f, 0.15f});
+        place(whiteCubes[i++], {.15f, .0f, 0.30f});
+        place(whiteCubes[i++], {.0f, .0f, 0.40f});
+        place(whiteCubes[i++], {-.15f, .0f, 0.00f});
+        place(whiteCubes[i++], {-.15f, .0f, 0.15f});
+        place(whiteCubes[i++], {-.15f, .0f, 0.30f});
+        place(whiteCubes[i++], {.0f, .0f, 0.15f});
 
         // I
-        offset = {-1.25f, 0.f, 0.f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.00f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.20f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.40f} + offset;
+        newLetter({-1.25f, 0.f, 0.f});
+        place(whiteCubes[i++], {.0f, .0f, 0.00f});
+        place(whiteCubes[i++], {.0f, .0f, 0.20f});
+        place(whiteCubes[i++], {.0f, .0f, 0.40f});
 
         std::size_t n = 0;
         // L
-        offset = {-.75f, 0.f, 0.f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.40f} + offset;
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.20f} + offset;
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.00f} + offset;
-        blueCubes[n++].p_Transform.translation = glm::vec3{.2f, .0f, 0.00f} + offset;
+        newLetter({-.75f, 0.f, 0.f});
+        place(blueCubes[n++], {.0f, .0f, 0.40f});
+        place(blueCubes[n++], {.0f, .0f, 0.20f});
+        place(blueCubes[n++], {.0f, .0f, 0.00f});
+        place(blueCubes[n++], {.2f, .0f, 0.00f});
 
         // i
-        offset = {-0.3f, 0.f, 0.f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.15f} + offset;
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.00f} + offset;
+        newLetter({-0.3f, 0.f, 0.f});
+        place(blueCubes[n++], {.0f, .0f, 0.15f});
+        place(blueCubes[n++], {.0f, .0f, 0.00f});
 
         // v
-        offset = {-0.0f, 0.f, 0.f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{-.1f, .0f, 0.150f} + offset;
-        blueCubes[n++].p_Transform.translation = glm::vec3{.1f, .0f, 0.15f} + offset;
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.00f} + offset;
+        newLetter({-0.0f, 0.f, 0.f});
+        place(blueCubes[n++], {-.1f, .0f, 0.150f});
+        place(blueCubes[n++], {.1f, .0f, 0.15f});
+        place(blueCubes[n++], {.0f, .0f, 0.00f});
 
         // e
-        offset = {.2f, 0.f, 0.f};
-        blueCubes[n].p_Transform.scale = {.03f, .03f, .03f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.20f} + offset;
-        blueCubes[n].p_Transform.scale = {.03f, .03f, .03f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.10f} + offset;
-        blueCubes[n].p_Transform.scale = {.03f, .03f, .03f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.0f, .0f, 0.00f} + offset;
-        blueCubes[n].p_Transform.scale = {.025f, .025f, .025};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.075f, .0f, 0.10f} + offset;
-        blueCubes[n].p_Transform.scale = {.03f, .03f, .03f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.1f, .0f, 0.20f} + offset;
-        blueCubes[n].p_Transform.scale = {.03f, .03f, .03f};
-        blueCubes[n++].p_Transform.translation = glm::vec3{.1f, .0f, 0.00f} + offset;
+        newLetter({.2f, 0.f, 0.f});
+        m_Registry.scale(blueCubes[n]) = {.03f, .03f, .03f};
+        place(blueCubes[n++], {.0f, .0f, 0.20f});
+        m_Registry.scale(blueCubes[n]) = {.03f, .03f, .03f};
+        place(blueCubes[n++], {.0f, .0f, 0.10f});
+        m_Registry.scale(blueCubes[n]) = {.03f, .03f, .03f};
+        place(blueCubes[n++], {.0f, .0f, 0.00f});
+        m_Registry.scale(blueCubes[n]) = {.025f, .025f, .025};
+        place(blueCubes[n++], {.075f, .0f, 0.10f});
+        m_Registry.scale(blueCubes[n]) = {.03f, .03f, .03f};
+        place(blueCubes[n++], {.1f, .0f, 0.20f});
+        m_Registry.scale(blueCubes[n]) = {.03f, .03f, .03f};
+        place(blueCubes[n++], {.1f, .0f, 0.00f});
 
         // S
-        offset = {0.7f, 0.f, 0.f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.15f, .0f, 0.4f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{0.f, .0f, 0.4f} + offset;
-        whiteCubes[i].p_Transform.scale = {.03f, .03f, .03f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.025f, .0f, 0.3f} + offset;
-        whiteCubes[i].p_Transform.scale = {.03f, .03f, .03f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.05f, .0f, 0.25f} + offset;
-        whiteCubes[i].p_Transform.scale = {.03f, .03f, .03f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.10f, .0f, 0.20f} + offset;
-        whiteCubes[i].p_Transform.scale = {.03f, .03f, .03f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.125f, .0f, 0.15f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.15f, .0f, 0.0f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.0f} + offset;
+        newLetter({0.7f, 0.f, 0.f});
+        place(whiteCubes[i++], {.15f, .0f, 0.4f});
+        place(whiteCubes[i++], {0.f, .0f, 0.4f});
+        m_Registry.scale(whiteCubes[i]) = {.03f, .03f, .03f};
+        place(whiteCubes[i++], {.025f, .0f, 0.3f});
+        m_Registry.scale(whiteCubes[i]) = {.03f, .03f, .03f};
+        place(whiteCubes[i++], {.05f, .0f, 0.25f});
+        m_Registry.scale(whiteCubes[i]) = {.03f, .03f, .03f};
+        place(whiteCubes[i++], {.10f, .0f, 0.20f});
+        m_Registry.scale(whiteCubes[i]) = {.03f, .03f, .03f};
+        place(whiteCubes[i++], {.125f, .0f, 0.15f});
+        place(whiteCubes[i++], {.15f, .0f, 0.0f});
+        place(whiteCubes[i++], {.0f, .0f, 0.0f});
 
         // i
-        offset = {1.2f, 0.f, 0.f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.15f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.00f} + offset;
+        newLetter({1.2f, 0.f, 0.f});
+        place(whiteCubes[i++], {.0f, .0f, 0.15f});
+        place(whiteCubes[i++], {.0f, .0f, 0.00f});
 
         // m
-        offset = {1.5f, 0.f, 0.f};
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.0f, .0f, 0.0f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.1f, .0f, 0.1f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.2f, .0f, 0.05f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.3f, .0f, 0.1f} + offset;
-        whiteCubes[i++].p_Transform.translation = glm::vec3{.4f, .0f, 0.0f} + offset;
-
-        for (int j = 0; j < i; j++) {
-            m_GameObjects.push_back(std::move(whiteCubes[j]));
+        newLetter({1.5f, 0.f, 0.f});
+        place(whiteCubes[i++], {.0f, .0f, 0.0f});
+        place(whiteCubes[i++], {.1f, .0f, 0.1f});
+        place(whiteCubes[i++], {.2f, .0f, 0.05f});
+        place(whiteCubes[i++], {.3f, .0f, 0.1f});
+        place(whiteCubes[i++], {.4f, .0f, 0.0f});
+
+        // The letters didn't need all of them.
+        for (std::size_t j = i; j < count; j++) {
+            m_Registry.destroy(whiteCubes[j]);
         }
-        for (int j = 0; j < n; j++) {
-            m_GameObjects.push_back(std::move(blueCubes[j]));
+        for (std::size_t j = n; j < count; j++) {
+            m_Registry.destroy(blueCubes[j]);
         }
 
-        auto quad = GameObject::CreateGameObject();
-        quad.model = quadModel;
-        quad.p_Transform.translation = {0.f, 0.2f, 0.f};
-        quad.p_Transform.scale = {10.f, 1.f, 10.f};
-        m_GameObjects.push_back(std::move(quad));
+        Entity quad = m_Registry.create();
+        m_Registry.setModel(quad, quadModel);
+        m_Registry.translation(quad) = {0.f, 0.2f, 0.f};
+        m_Registry.scale(quad) = {10.f, 1.f, 10.f};
     }
 
 
     // Private
     void App::m_LoadGameObjects() {
-        std::shared_ptr<Model> model = Model::CreateModelFromFile(mr_Device, "models/colored_cube.obj");
-        std::shared_ptr<Model> another_model = Model::CreateModelFromFile(mr_Device, "models/smooth_vase.obj");
-        std::shared_ptr<Model> flat_model = Model::CreateModelFromFile(mr_Device, "models/flat_vase.obj");
-        std::shared_ptr<Model> torso_model = Model::CreateModelFromFile(mr_Device, "models/the-valentini-torso_bronze.obj");
-        std::shared_ptr<Model> quad_model = Model::CreateModelFromFile(mr_Device, "models/quad.obj");
-
-        auto cube = GameObject::CreateGameObject();
-        auto another_cube = GameObject::CreateGameObject();
-        auto flat_vase = GameObject::CreateGameObject();
-        auto torso = GameObject::CreateGameObject();
-        auto quad = GameObject::CreateGameObject();
-
-        cube.model = model;
-        another_cube.model = another_model;
-        flat_vase.model = flat_model;
-        torso.model = torso_model;
-        quad.model = quad_model;
-
-        cube.p_Transform.translation = {.25f, .0f, 2.5f};
-        cube.p_Transform.scale = {.2f, .2f, .2f};
-        another_cube.p_Transform.translation = {-.25f, .2f, 4.f};
-        another_cube.p_Transform.scale = {1.f, 1.f, 1.f};
-        flat_vase.p_Transform.translation = {-1.f, .2f, 2.5f};
-        flat_vase.p_Transform.scale = {1.f, 1.f, 1.f};
-        torso.p_Transform.translation = {0.f, 0.2f, 5.f};
-        torso.p_Transform.scale = 0.5f * glm::vec3{1.f, 1.f, 1.f};
-        torso.p_Transform.rotation = glm::vec3{0.f, glm::pi<float>(), glm::pi<float>()};
-        quad.p_Transform.translation = {0.f, 0.2f, 0.f};
-        quad.p_Transform.scale = {10.f, 1.f, 10.f};
-
-        m_GameObjects.push_back(std::move(cube));
-        m_GameObjects.push_back(std::move(another_cube));
-        m_GameObjects.push_back(std::move(flat_vase));
-        m_GameObjects.push_back(std::move(torso));
-        m_GameObjects.push_back(std::move(quad));
+        const ModelHandle model = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/colored_cube.obj"));
+        const ModelHandle another_model = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/smooth_vase.obj"));
+        const ModelHandle flat_model = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/flat_vase.obj"));
+        const ModelHandle torso_model = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/the-valentini-torso_bronze.obj"));
+        const ModelHandle quad_model = m_Registry.addModel(Model::CreateModelFromFile(mr_Device, "models/quad.obj"));
+
+        Entity cube = m_Registry.create();
+        Entity another_cube = m_Registry.create();
+        Entity flat_vase = m_Registry.create();
+        Entity torso = m_Registry.create();
+        Entity quad = m_Registry.create();
+
+        m_Registry.setModel(cube, model);
+        m_Registry.setModel(another_cube, another_model);
+        m_Registry.setModel(flat_vase, flat_model);
+        m_Registry.setModel(torso, torso_model);
+        m_Registry.setModel(quad, quad_model);
+
+        m_Registry.translation(cube) = {.25f, .0f, 2.5f};
+        m_Registry.scale(cube) = {.2f, .2f, .2f};
+        m_Registry.translation(another_cube) = {-.25f, .2f, 4.f};
+        m_Registry.scale(another_cube) = {1.f, 1.f, 1.f};
+        m_Registry.translation(flat_vase) = {-1.f, .2f, 2.5f};
+        m_Registry.scale(flat_vase) = {1.f, 1.f, 1.f};
+        m_Registry.translation(torso) = {0.f, 0.2f, 5.f};
+        m_Registry.scale(torso) = 0.5f * glm::vec3{1.f, 1.f, 1.f};
+        m_Registry.rotation(torso) = glm::vec3{0.f, glm::pi<float>(), glm::pi<float>()};
+        m_Registry.translation(quad) = {0.f, 0.2f, 0.f};
+        m_Registry.scale(quad) = {10.f, 1.f, 10.f};
     };
 
 
@@ -1,14 +1,23 @@
 #pragma once
 
 #include "teng_pipeline.hpp"
+#include "teng_pipeline_manager.hpp"
 #include "teng_descriptors.hpp"
 #include "teng_window.hpp"
 #include "teng_model.hpp"
 #include "teng_game_object.hpp"
+#include "teng_registry.hpp"
 #include "teng_renderer.hpp"
+#include "teng_spatial_index.hpp"
+#include "teng_gravity.hpp"
+#include "teng_gpu_gravity.hpp"
+#include "teng_simulation_loop.hpp"
+#include "teng_frame_info.hpp"
+#include "teng_thread_pool.hpp"
 
 // std
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace teng {
@@ -18,6 +27,34 @@ namespace teng {
     const glm::vec3 BLUE{0.0f, 0.f, 1.f};
     const glm::vec3 WHITE{1.0f, 1.f, 1.f};
 
+    // Runtime configuration, filled in from the command line by main.
+    struct AppSettings {
+        PresentPolicy presentPolicy{};
+        // Re-read input and rewrite the camera right before the frame is submitted.
+        bool lateLatch = false;
+        // Print how old input is once the frames built from it have finished.
+        bool measureLatency = false;
+        // Start frames just in time for the next refresh, see FramePacer.
+        bool framePacing = false;
+        // Print GPU time per scope every few seconds, see GpuProfiler.
+        bool gpuProfile = false;
+        // Record CPU zones and GPU scopes and write them here as a Chrome trace on exit, empty for none.
+        std::string tracePath;
+        // Bodies of the gravity scene shown instead of the cubes, 0 for the cubes.
+        uint32_t gravityBodies = 0;
+        // Barnes-Hut opening angle of the gravity scene, see GravitySystem::Settings.
+        float gravityTheta = GravitySystem::Settings{}.theta;
+        // Simulate and draw the gravity scene on the GPU, see GpuGravitySystem.
+        bool gpuGravity = false;
+        // Ticks per second of the CPU gravity scene on its own thread, see
+        // SimulationLoop. 0 steps it on the main thread once per frame instead.
+        float tickRate = 120.f;
+
+        // Throws std::invalid_argument on unknown options or bad values.
+        static AppSettings s_FromArgs(int argc, char** argv);
+        static const char* s_Usage();
+    };
+
     class App {
 
         public:
@@ -25,14 +62,19 @@ namespace teng {
             static constexpr int WIDTH = 900;
             static constexpr int HEIGHT = 900;
 
-            App();
+            App(const AppSettings& settings = {});
             ~App();
 
             App(const App&) = delete;
             App &operator=(const App&) = delete;
 
             void run();
-            void m_RunGravSystem();
+            // Advances the gravity scene's bodies by the frame time. On the CPU
+            // they are every entity of the registry, on the GPU the step is
+            // recorded into the frame's command buffer, outside the render pass.
+            // With a simulation thread it only places the entities between its
+            // last two ticks.
+            void m_RunGravSystem(FrameInfo& frameInfo);
 
         private:
 
@@ -51,10 +93,24 @@ namespace teng {
             void createTextureImage();
             void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
 
+            AppSettings m_Settings; // Set first, the members below are created from it.
             Window m_Window{WIDTH, HEIGHT, "Vulkan"}; // Creates a window when App is contructed.
             Device mr_Device{m_Window}; // Creates a device after window.
-            Renderer m_Renderer{m_Window, mr_Device}; // Creates renderer after device.
+            Renderer m_Renderer{m_Window, mr_Device, m_Settings.presentPolicy}; // Creates renderer after device.
+            PipelineManager m_PipelineManager{mr_Device}; // Compiles pipelines off the main thread.
             std::unique_ptr<DescriptorPool> m_GlobalDescriptorPool{};
-            std::vector<GameObject> m_GameObjects;
+            ThreadPool m_ThreadPool; // Splits passes over the scene across cores.
+            Registry m_Registry; // The scene, the viewer is a separate GameObject.
+            SpatialIndex m_SpatialIndex; // Bounds of m_Registry's entities, for culling.
+            GravitySystem m_GravitySystem;
+            // The gravity scene's bodies with --gpu-gravity, instead of entities.
+            std::unique_ptr<GpuGravitySystem> mp_GpuGravity;
+            std::unique_ptr<Model> mp_BodyModel;
+            // The gravity scene's bodies with a tick rate, owned by the simulation thread while it runs.
+            std::vector<glm::vec3> m_BodyPositions;
+            std::vector<glm::vec3> m_BodyVelocities;
+            std::vector<float> m_BodyMasses;
+            std::unique_ptr<ThreadPool> mp_SimulationThreadPool; // So ticks don't queue behind frames.
+            std::unique_ptr<SimulationLoop> mp_SimulationLoop; // Last, it steps the members above.
 };
 } // namespace teng
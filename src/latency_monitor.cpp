@@ -0,0 +1,49 @@
+#include "latency_monitor.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace teng {
+
+    LatencyMonitor::LatencyMonitor(std::chrono::seconds reportInterval)
+        : m_ReportInterval(reportInterval),
+          m_LastReport(Clock::now())
+    {
+    }
+
+    void LatencyMonitor::frameSubmitted(uint64_t frame, Clock::time_point inputTime) {
+        m_Pending.emplace_back(frame, inputTime);
+    };
+
+    void LatencyMonitor::update(const Renderer& renderer) {
+        const auto now = Clock::now();
+        while(!m_Pending.empty() && renderer.isFrameComplete(m_Pending.front().first)) {
+            m_Samples.push_back(std::chrono::duration<double, std::milli>(now - m_Pending.front().second).count());
+            m_Pending.pop_front();
+        }
+
+        if(now - m_LastReport >= m_ReportInterval) {
+            m_Report(now);
+        }
+    };
+
+    void LatencyMonitor::m_Report(Clock::time_point now) {
+        m_LastReport = now;
+        if(m_Samples.empty()) return;
+
+        std::sort(m_Samples.begin(), m_Samples.end());
+        auto percentile = [this](double p) {
+            return m_Samples[static_cast<size_t>(p * static_cast<double>(m_Samples.size() - 1) + 0.5)];
+        };
+
+        double total = 0.0;
+        for(double sample : m_Samples) total += sample;
+
+        std::cout << "input to GPU done ms: mean " << total / static_cast<double>(m_Samples.size())
+                  << " p50 " << percentile(0.50)
+                  << " p99 " << percentile(0.99)
+                  << " max " << m_Samples.back()
+                  << " (" << m_Samples.size() << " frames)\n";
+        m_Samples.clear();
+    };
+} // namespace teng
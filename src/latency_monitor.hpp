@@ -0,0 +1,41 @@
+#pragma once
+
+#include "teng_renderer.hpp"
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace teng {
+
+    // Measures how old the input a frame was built from is once the frame has
+    // finished on the GPU, and prints percentiles every reportInterval.
+    // Without present timing from the driver, GPU completion is the last point
+    // of a frame's life the CPU can observe, so this is a lower bound on
+    // input-to-photon latency. Completion is polled once per frame.
+    class LatencyMonitor {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            explicit LatencyMonitor(std::chrono::seconds reportInterval = std::chrono::seconds{5});
+
+            // inputTime is when the input the frame's camera was built from was sampled.
+            void frameSubmitted(uint64_t frame, Clock::time_point inputTime);
+            // Collects the frames that have retired since the last call.
+            void update(const Renderer& renderer);
+
+        private:
+
+            void m_Report(Clock::time_point now);
+
+            std::chrono::seconds m_ReportInterval;
+            Clock::time_point m_LastReport;
+            std::deque<std::pair<uint64_t, Clock::time_point>> m_Pending; // Frame number, input time.
+            std::vector<double> m_Samples; // Milliseconds, since the last report.
+    };
+} // namespace teng
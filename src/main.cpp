@@ -27,10 +27,17 @@
 //   - The swap chain provides the next framebuffer to write to.
 //   - The swap chain might have to be recreated thus the pipeline as well.
 //   - Command buffer is recorded.
-int main() {
-  teng::App app{}; // This creates a window
-
+int main(int argc, char **argv) {
   try {
+    teng::AppSettings settings;
+    try {
+      settings = teng::AppSettings::s_FromArgs(argc, argv);
+    } catch (const std::invalid_argument &e) {
+      std::cerr << e.what() << '\n' << teng::AppSettings::s_Usage();
+      return EXIT_FAILURE;
+    }
+
+    teng::App app{settings}; // This creates a window
     app.run();
   } catch (const std::exception &e) {
     std::cerr << e.what() << '\n';
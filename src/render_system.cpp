@@ -1,10 +1,12 @@
 #include "render_system.hpp"
+#include "teng_gpu_profiler.hpp"
 
 #include <iostream>
 #include <stdexcept>
 
 #include <chrono>
 #include <array>
+#include <cstring>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -13,38 +15,56 @@
 
 namespace teng {
 
-    struct SimplePushConstantData {
-        glm::mat4 modelMatrix{1.f};
-        glm::mat4 normalMatrix{1.f};
-    };
+    namespace {
+        // Smallest instance buffer, so a scene growing one entity at a time
+        // doesn't reallocate every frame.
+        constexpr uint32_t MIN_INSTANCE_CAPACITY = 64;
+    }
 
     // Public
-    RenderSystem::RenderSystem(Device& r_Device, VkRenderPass a_RenderPass, VkDescriptorSetLayout globalSetLayout)
-        : mr_Device{r_Device}
+    RenderSystem::RenderSystem(
+        Device& r_Device,
+        PipelineManager& r_PipelineManager,
+        const PipelineTarget& target,
+        VkDescriptorSetLayout globalSetLayout,
+        const ShaderVariant& variant)
+        : mr_Device{r_Device}, mr_PipelineManager{r_PipelineManager}, m_Target{target}, mp_GlobalSetLayout{globalSetLayout}
     {
+        m_CreateInstanceDescriptors();
         m_CreatePipelineLayout(globalSetLayout);
-        m_CreatePipeline(a_RenderPass);
+        m_RequestPipeline(target, variant);
     }
 
     RenderSystem::~RenderSystem() {
+        // The layout is referenced by the pipeline while it compiles.
+        mr_PipelineManager.waitIdle();
         vkDestroyPipelineLayout(mr_Device.device(), mp_PipelineLayout, nullptr);
+        vkDestroyPipelineLayout(mr_Device.device(), mp_GravPipelineLayout, nullptr);
     };
 
-    void RenderSystem::m_CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    void RenderSystem::m_CreateInstanceDescriptors() {
+        mp_InstanceSetLayout = DescriptorSetLayout::Builder(mr_Device)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+            .build();
+        mp_InstancePool = DescriptorPool::Builder(mr_Device)
+            .setMaxSets(RenderTarget::MAX_FRAMES_IN_FLIGHT)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, RenderTarget::MAX_FRAMES_IN_FLIGHT)
+            .build();
+    };
 
-        VkPushConstantRange pushConstantRange{};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(SimplePushConstantData);
+    void RenderSystem::m_CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout) {
 
-        std::vector<VkDescriptorSetLayout> descriptorSetLayout{globalSetLayout};
+        // Set 0 is per frame, set 1 holds the instance matrices.
+        std::vector<VkDescriptorSetLayout> descriptorSetLayout{
+            globalSetLayout,
+            mp_InstanceSetLayout->getDescriptorSetLayout()};
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
         pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
         if(vkCreatePipelineLayout(mr_Device.device(), &pipelineLayoutInfo, nullptr, &mp_PipelineLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create pipeline layout");
@@ -52,56 +72,198 @@ namespace teng {
     };
 
 
-    void RenderSystem::m_CreatePipeline(VkRenderPass a_RenderPass) {
+    void RenderSystem::m_RequestPipeline(const PipelineTarget& target, const ShaderVariant& variant) {
         assert(mp_PipelineLayout != nullptr && "swap chain not initialized");
 
         PipelineConfigInfo pipelineInfo{};
         Pipeline::s_DefaultPipelineConfigInfo(pipelineInfo);
-        pipelineInfo.renderPass = a_RenderPass;
+        target.applyTo(pipelineInfo);
         pipelineInfo.pipelineLayout = mp_PipelineLayout;
-        m_Pipeline = std::make_unique<Pipeline>(
+        m_Pipelines = RasterStatePipelines(
             mr_Device,
+            mr_PipelineManager,
             "shaders/simple_shader.vert.spv",
             "shaders/simple_shader.frag.spv",
+            pipelineInfo,
+            variant);
+    };
+
+    void RenderSystem::m_RequestGravPipeline(VkDescriptorSetLayout bodiesSetLayout) {
+
+        // Set 0 is per frame, set 1 holds the bodies.
+        std::vector<VkDescriptorSetLayout> descriptorSetLayout{mp_GlobalSetLayout, bodiesSetLayout};
+
+        // The scale of the body model.
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(float);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayout.size());
+        pipelineLayoutInfo.pSetLayouts = descriptorSetLayout.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        if(vkCreatePipelineLayout(mr_Device.device(), &pipelineLayoutInfo, nullptr, &mp_GravPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gravity pipeline layout");
+        };
+
+        PipelineConfigInfo pipelineInfo{};
+        Pipeline::s_DefaultPipelineConfigInfo(pipelineInfo);
+        m_Target.applyTo(pipelineInfo);
+        pipelineInfo.pipelineLayout = mp_GravPipelineLayout;
+        m_GravPipelines = RasterStatePipelines(
+            mr_Device,
+            mr_PipelineManager,
+            "shaders/gravity.vert.spv",
+            "shaders/simple_shader.frag.spv",
             pipelineInfo);
     };
 
-    void RenderSystem::m_RenderGameObjects(FrameInfo& frameInfo, std::vector<GameObject>& gameObjects) {
-        m_Pipeline->bind(frameInfo.commandBuffer);
+    void RenderSystem::m_RenderGameObjects(FrameInfo& frameInfo, Registry& registry, const std::vector<uint32_t>* visible) {
+        m_DrawCallCount = 0;
+        m_InstanceUploadCount = 0;
+        GpuProfiler::Scope gpuScope{frameInfo.gpuProfiler, frameInfo.commandBuffer, "game objects"};
 
+        // Still compiling, skip instead of stalling the frame.
+        m_Pipelines.reset();
+        if(!m_Pipelines.bind(frameInfo.commandBuffer, m_RasterState)) return;
+
+        registry.updateWorldMatrices();
+        if(registry.size() == 0) return;
+
+        // The slot's previous frame has retired by the time this one records.
+        InstanceSlot& slot = m_InstanceSlots[frameInfo.backFrame];
+        m_UploadInstances(slot, registry);
+
+        const std::array<VkDescriptorSet, 2> descriptorSets{frameInfo.globalDescriptorSet, slot.descriptorSet};
         vkCmdBindDescriptorSets(
             frameInfo.commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             mp_PipelineLayout,
             0,
-            1,
-            &frameInfo.globalDescriptorSet,
+            static_cast<uint32_t>(descriptorSets.size()),
+            descriptorSets.data(),
             0,
             nullptr);
 
-        for (auto& obj : gameObjects) {
-
-            SimplePushConstantData push{};
-            push.modelMatrix = obj.p_Transform.mat4();
-            push.normalMatrix = obj.p_Transform.normalMatrix();
+        // Instances are indexed by dense index, so a run of consecutive entities
+        // sharing a model is a single instanced draw.
+        const ModelHandle* models = registry.modelHandles();
+        ModelHandle boundModel = NO_MODEL;
+        uint32_t runStart = 0;
+        uint32_t runCount = 0;
 
-            vkCmdPushConstants(
-                frameInfo.commandBuffer,
-                mp_PipelineLayout,
-                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                0,
-                sizeof(SimplePushConstantData),
-                &push);
+        auto drawRun = [&]() {
+            if(runCount == 0) return;
+            Model* model = registry.getModel(models[runStart]);
+            if(models[runStart] != boundModel) {
+                model->bind(frameInfo.commandBuffer);
+                boundModel = models[runStart];
+            }
+            model->draw(frameInfo.commandBuffer, runCount, runStart);
+            m_DrawCallCount++;
+        };
 
-            if(!obj.model) {
-                throw std::runtime_error("Tried to render a GameObject without a model.");
-            };
+        auto add = [&](uint32_t i) {
+            if(runCount > 0 && i == runStart + runCount && models[i] == models[runStart]) {
+                runCount++;
+                return;
+            }
+            drawRun();
+            runStart = i;
+            runCount = 1;
+        };
 
-            obj.model->bind(frameInfo.commandBuffer);
-            obj.model->draw(frameInfo.commandBuffer);
+        if(visible) {
+            for(uint32_t i : *visible) add(i);
+        } else {
+            for(uint32_t i : registry.view(COMPONENT_MODEL)) add(i);
         }
+        drawRun();
     }
 
+    void RenderSystem::m_RenderGrav(FrameInfo& frameInfo, const GpuGravitySystem& gravity, Model& model, float scale) {
+        GpuProfiler::Scope gpuScope{frameInfo.gpuProfiler, frameInfo.commandBuffer, "gravity bodies"};
+
+        if(mp_GravPipelineLayout == VK_NULL_HANDLE) {
+            m_RequestGravPipeline(gravity.getDescriptorSetLayout());
+        }
+        // Still compiling, skip instead of stalling the frame.
+        m_GravPipelines.reset();
+        if(!m_GravPipelines.bind(frameInfo.commandBuffer, m_RasterState)) return;
+
+        const std::array<VkDescriptorSet, 2> descriptorSets{frameInfo.globalDescriptorSet, gravity.getDrawDescriptorSet()};
+        vkCmdBindDescriptorSets(
+            frameInfo.commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            mp_GravPipelineLayout,
+            0,
+            static_cast<uint32_t>(descriptorSets.size()),
+            descriptorSets.data(),
+            0,
+            nullptr);
+        vkCmdPushConstants(frameInfo.commandBuffer, mp_GravPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(scale), &scale);
+
+        // One instance per body, the vertex shader reads its position by instance index.
+        model.bind(frameInfo.commandBuffer);
+        model.draw(frameInfo.commandBuffer, gravity.getBodyCount(), 0);
+        m_DrawCallCount++;
+    };
+
+    void RenderSystem::m_UploadInstances(InstanceSlot& slot, const Registry& registry) {
+        const uint32_t count = registry.size();
+
+        if(!slot.buffer || slot.buffer->getInstanceCount() < count) {
+            uint32_t capacity = MIN_INSTANCE_CAPACITY;
+            while(capacity < count) capacity *= 2;
+
+            if(slot.buffer) {
+                // The slot's last frame has retired, the queue keeps this safe
+                // regardless of how frames map to slots.
+                mr_Device.deferDeletion(
+                    mr_Device.lastSubmittedValue(),
+                    [retired = std::shared_ptr<Buffer>(std::move(slot.buffer))]() mutable { retired.reset(); });
+            }
+            slot.buffer = std::make_unique<Buffer>(
+                mr_Device,
+                sizeof(InstanceData),
+                capacity,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            slot.buffer->map();
+
+            auto bufferInfo = slot.buffer->descriptorInfo();
+            DescriptorWriter writer{*mp_InstanceSetLayout, *mp_InstancePool};
+            writer.writeBuffer(0, &bufferInfo);
+            if(slot.descriptorSet == VK_NULL_HANDLE) {
+                if(!writer.build(slot.descriptorSet)) {
+                    throw std::runtime_error("failed to allocate instance descriptor set");
+                }
+            } else {
+                writer.overwrite(slot.descriptorSet);
+            }
+
+            // The new buffer holds nothing yet.
+            slot.uploadedVersions.assign(capacity, 0);
+        }
+
+        const glm::mat4* worldMatrices = registry.worldMatrices();
+        const glm::mat4* normalMatrices = registry.normalMatrices();
+        const uint64_t* versions = registry.matrixVersions();
+        auto* instances = static_cast<InstanceData*>(slot.buffer->getMappedMemory());
+
+        for(uint32_t i = 0; i < count; i++) {
+            if(slot.uploadedVersions[i] == versions[i]) continue;
+            std::memcpy(&instances[i].modelMatrix, &worldMatrices[i], sizeof(glm::mat4));
+            std::memcpy(&instances[i].normalMatrix, &normalMatrices[i], sizeof(glm::mat4));
+            slot.uploadedVersions[i] = versions[i];
+            m_InstanceUploadCount++;
+        }
+    };
+
     // Angle between two 2D vectors.
     float RenderSystem::angle(const glm::vec2& a, glm::vec2& b) {
         return glm::acos(glm::dot<2,float>(a, b)/(glm::length(a)*glm::length(b)));
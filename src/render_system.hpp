@@ -1,12 +1,19 @@
 #pragma once
 
 #include "teng_pipeline.hpp"
+#include "teng_pipeline_manager.hpp"
 #include "teng_model.hpp"
 #include "teng_game_object.hpp"
+#include "teng_registry.hpp"
 #include "teng_frame_info.hpp"
+#include "teng_buffer.hpp"
+#include "teng_descriptors.hpp"
+#include "teng_render_target.hpp"
+#include "teng_gpu_gravity.hpp"
 #include "camera.hpp"
 
 // std
+#include <array>
 #include <memory>
 #include <vector>
 
@@ -16,24 +23,79 @@ namespace teng {
 
         public:
 
-            RenderSystem(Device& r_Device, VkRenderPass p_RenderPass, VkDescriptorSetLayout globalSetLayout);
+            RenderSystem(
+                Device& r_Device,
+                PipelineManager& r_PipelineManager,
+                const PipelineTarget& target,
+                VkDescriptorSetLayout globalSetLayout,
+                const ShaderVariant& variant = {});
             ~RenderSystem();
 
             RenderSystem(const RenderSystem&) = delete;
             RenderSystem &operator=(const RenderSystem&) = delete;
+            // Draws every entity with a model. Matrices come from the registry's
+            // cache and are read by the shaders from a per-frame storage buffer,
+            // entities whose matrices didn't change since the frame slot was last
+            // used aren't copied again. With visible, only those dense indices are
+            // drawn, ascending as SpatialIndex::cull gives them.
             void m_RenderGameObjects(
                 FrameInfo& frameInfo,
-                std::vector<GameObject> &r_GameObjects);
-            void m_RenderGrav(VkCommandBuffer p_CommandBuffer, std::vector<GameObject> &r_GameObjects);
+                Registry &r_Registry,
+                const std::vector<uint32_t>* visible = nullptr);
+
+            // Fixed-function state used for the game objects.
+            void setRasterState(const RasterState& state) { m_RasterState = state; };
+            // Draws recorded by the last m_RenderGameObjects, 0 while the pipelines are compiling.
+            uint32_t getDrawCallCount() const { return m_DrawCallCount; };
+            // Instances copied to the GPU by the last m_RenderGameObjects.
+            uint32_t getInstanceUploadCount() const { return m_InstanceUploadCount; };
+            // Draws model at every body of gravity, scaled by scale, straight
+            // from the positions its last recorded step wrote. Call it inside
+            // the render pass, after the step. Nothing is drawn while the
+            // pipeline compiles. The first call creates it for gravity's
+            // descriptor set layout, later ones must pass the same system.
+            void m_RenderGrav(FrameInfo& frameInfo, const GpuGravitySystem& gravity, Model& model, float scale);
 
         private:
 
+            // What the vertex shader reads per instance, see simple_shader.vert.
+            struct InstanceData {
+                glm::mat4 modelMatrix{1.f};
+                glm::mat4 normalMatrix{1.f};
+            };
+
+            // One per frame in flight, a slot is only written once its last frame
+            // has retired. uploadedVersions is the registry's matrix version of
+            // each entry as last copied into this slot's buffer.
+            struct InstanceSlot {
+                std::unique_ptr<Buffer> buffer;
+                VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+                std::vector<uint64_t> uploadedVersions;
+            };
+
+            void m_CreateInstanceDescriptors();
+            void m_UploadInstances(InstanceSlot& slot, const Registry& registry);
             void m_CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout);
-            void m_CreatePipeline(VkRenderPass p_RenderPass);
+            void m_RequestPipeline(const PipelineTarget& target, const ShaderVariant& variant);
+            void m_RequestGravPipeline(VkDescriptorSetLayout bodiesSetLayout);
             float angle(const glm::vec2& a, glm::vec2& b);
 
             Device &mr_Device; // Creates a device when RenderSystem is constructed.
-            std::unique_ptr<Pipeline> m_Pipeline;
+            PipelineManager &mr_PipelineManager;
+            RasterStatePipelines m_Pipelines; // Compiled in the background, nothing is drawn until they are ready.
             VkPipelineLayout mp_PipelineLayout;
+            RasterState m_RasterState{};
+            uint32_t m_DrawCallCount{0};
+            uint32_t m_InstanceUploadCount{0};
+
+            std::unique_ptr<DescriptorSetLayout> mp_InstanceSetLayout;
+            std::unique_ptr<DescriptorPool> mp_InstancePool;
+            std::array<InstanceSlot, RenderTarget::MAX_FRAMES_IN_FLIGHT> m_InstanceSlots;
+
+            // For the gravity pipeline, created by the first m_RenderGrav.
+            PipelineTarget m_Target;
+            VkDescriptorSetLayout mp_GlobalSetLayout;
+            RasterStatePipelines m_GravPipelines;
+            VkPipelineLayout mp_GravPipelineLayout{VK_NULL_HANDLE};
 };
 } // namespace teng
@@ -0,0 +1,128 @@
+#pragma once
+
+// libs
+// Frustum::s_FromMatrix assumes 0..1 depth, and glm has to be configured the
+// same way in every translation unit, whichever header reaches it first.
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// std
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace teng {
+
+    // Axis-aligned bounding box. A default constructed box is empty, min lies
+    // above max, so extending it by anything gives exactly that.
+    struct Aabb {
+        glm::vec3 min{std::numeric_limits<float>::max()};
+        glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+        bool isEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; };
+        glm::vec3 center() const { return (min + max) * .5f; };
+        // Half the size along each axis.
+        glm::vec3 extent() const { return (max - min) * .5f; };
+        // 0 for empty boxes.
+        float surfaceArea() const {
+            if(isEmpty()) return 0.f;
+            const glm::vec3 size = max - min;
+            return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        };
+
+        void extend(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        };
+        void extend(const Aabb& other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        };
+        bool contains(const Aabb& other) const {
+            return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+        };
+        bool overlaps(const Aabb& other) const {
+            return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+        };
+        Aabb expanded(float margin) const { return {min - glm::vec3{margin}, max + glm::vec3{margin}}; };
+
+        // Bounds of this box transformed by an affine matrix, which are tighter
+        // than those of its eight transformed corners.
+        Aabb transformed(const glm::mat4& matrix) const {
+            const glm::vec3 center = glm::vec3{matrix * glm::vec4{this->center(), 1.f}};
+            const glm::mat3 absolute{glm::abs(glm::vec3{matrix[0]}), glm::abs(glm::vec3{matrix[1]}), glm::abs(glm::vec3{matrix[2]})};
+            const glm::vec3 extent = absolute * this->extent();
+            return {center - extent, center + extent};
+        };
+
+        static Aabb s_Union(const Aabb& a, const Aabb& b) { return {glm::min(a.min, b.min), glm::max(a.max, b.max)}; };
+    };
+
+    struct Ray {
+        glm::vec3 origin{0.f};
+        // Needn't be normalized, distances along the ray are in multiples of it.
+        glm::vec3 direction{0.f, 0.f, 1.f};
+
+        // Where the ray enters box, or 0 when it starts inside, if that is at most
+        // maxDistance. inverseDirection is 1 / direction, hoisted out of traversals.
+        static bool s_Intersects(
+            const Aabb& box,
+            const glm::vec3& origin,
+            const glm::vec3& inverseDirection,
+            float maxDistance,
+            float& distance) {
+            const glm::vec3 t0 = (box.min - origin) * inverseDirection;
+            const glm::vec3 t1 = (box.max - origin) * inverseDirection;
+            const glm::vec3 near = glm::min(t0, t1);
+            const glm::vec3 far = glm::max(t0, t1);
+            const float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+            const float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+            distance = enter;
+            return enter <= exit;
+        };
+    };
+
+    // The volume a projection view matrix maps into clip space, depth 0 to 1 as
+    // with GLM_FORCE_DEPTH_ZERO_TO_ONE. Planes point inwards.
+    struct Frustum {
+        enum Containment { OUTSIDE, INTERSECTS, INSIDE };
+
+        // xyz is the unit normal, w the distance, so points p with
+        // dot(xyz, p) + w >= 0 are on the inside.
+        std::array<glm::vec4, 6> planes{};
+
+        static Frustum s_FromMatrix(const glm::mat4& projectionView) {
+            const glm::mat4 rows = glm::transpose(projectionView);
+            Frustum frustum;
+            frustum.planes = {
+                rows[3] + rows[0], // Left.
+                rows[3] - rows[0], // Right.
+                rows[3] + rows[1], // Bottom or top, depending on the projection's y flip.
+                rows[3] - rows[1],
+                rows[2],           // Near.
+                rows[3] - rows[2]  // Far.
+            };
+            for(glm::vec4& plane : frustum.planes) {
+                plane /= glm::length(glm::vec3{plane});
+            }
+            return frustum;
+        };
+
+        // Conservative: boxes near the corners outside of two planes but inside
+        // each one are reported as intersecting.
+        Containment classify(const Aabb& box) const {
+            const glm::vec3 center = box.center();
+            const glm::vec3 extent = box.extent();
+            Containment result = INSIDE;
+            for(const glm::vec4& plane : planes) {
+                const glm::vec3 normal{plane};
+                const float distance = glm::dot(normal, center) + plane.w;
+                const float radius = glm::dot(glm::abs(normal), extent);
+                if(distance < -radius) return OUTSIDE;
+                if(distance < radius) result = INTERSECTS;
+            }
+            return result;
+        };
+    };
+} // namespace teng
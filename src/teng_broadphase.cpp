@@ -0,0 +1,265 @@
+#include "teng_broadphase.hpp"
+#include "teng_registry.hpp"
+#include "teng_thread_pool.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace teng {
+
+    namespace {
+        uint32_t s_ChunkCount(uint32_t count, uint32_t grain) {
+            return (count + grain - 1) / grain;
+        }
+
+        glm::ivec3 s_Cell(const glm::vec3& point, float inverseCellSize) {
+            return glm::ivec3{glm::floor(point * inverseCellSize)};
+        }
+
+        uint32_t s_CellHash(const glm::ivec3& cell, uint32_t mask) {
+            const uint32_t hash =
+                static_cast<uint32_t>(cell.x) * 73856093u ^
+                static_cast<uint32_t>(cell.y) * 19349663u ^
+                static_cast<uint32_t>(cell.z) * 83492791u;
+            return hash & mask;
+        }
+
+        Broadphase::Pair s_MakePair(uint32_t a, uint32_t b) {
+            return a < b ? Broadphase::Pair{a, b} : Broadphase::Pair{b, a};
+        }
+    }
+
+    // Public
+    void Broadphase::update(const Aabb* boxes, uint32_t count, ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("Broadphase::update");
+        if(m_Settings.method == Method::UniformGrid) {
+            m_UniformGrid(boxes, count, threadPool);
+        } else {
+            m_SweepAndPrune(boxes, count, threadPool);
+        }
+        m_UpdatePairs();
+    };
+
+    void Broadphase::reset() {
+        m_Sweep.clear();
+        m_Pairs.clear();
+        m_BeganPairs.clear();
+        m_EndedPairs.clear();
+    };
+
+    void Broadphase::s_RigidBodyBoxes(const Registry& registry, std::vector<Aabb>& boxes) {
+        const uint32_t count = registry.size();
+        const glm::mat4* worldMatrices = registry.worldMatrices();
+        const ModelHandle* models = registry.modelHandles();
+
+        boxes.assign(count, Aabb{});
+        for(uint32_t dense : registry.view(COMPONENT_RIGID_BODY)) {
+            if(const Model* model = registry.getModel(models[dense])) {
+                boxes[dense] = model->getBounds().transformed(worldMatrices[dense]);
+            } else {
+                const glm::vec3 position{worldMatrices[dense][3]};
+                boxes[dense] = {position, position};
+            }
+        }
+    };
+
+    // Private
+    void Broadphase::m_SweepAndPrune(const Aabb* boxes, uint32_t count, ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("Broadphase::m_SweepAndPrune");
+
+        // The axis the centres spread the most on leaves the fewest overlapping intervals.
+        glm::vec3 sum{0.f};
+        glm::vec3 sumOfSquares{0.f};
+        uint32_t nonEmpty = 0;
+        for(uint32_t i = 0; i < count; i++) {
+            if(boxes[i].isEmpty()) continue;
+            const glm::vec3 center = boxes[i].center();
+            sum += center;
+            sumOfSquares += center * center;
+            nonEmpty++;
+        }
+        bool sorted = m_Sweep.size() == count;
+        if(nonEmpty > 0) {
+            const glm::vec3 mean = sum / static_cast<float>(nonEmpty);
+            const glm::vec3 variance = sumOfSquares / static_cast<float>(nonEmpty) - mean * mean;
+            uint32_t widest = 0;
+            if(variance.y > variance[widest]) widest = 1;
+            if(variance.z > variance[widest]) widest = 2;
+            if(variance[widest] > AXIS_SWITCH_RATIO * variance[m_Axis]) {
+                m_Axis = widest;
+                sorted = false;
+            }
+        }
+
+        if(!sorted) {
+            m_Sweep.resize(count);
+            for(uint32_t i = 0; i < count; i++) m_Sweep[i] = {boxes[i].min[m_Axis], i};
+        } else {
+            // Last update's order, with the new mins.
+            SweepEntry* sweep = m_Sweep.data();
+            const uint32_t axis = m_Axis;
+            ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+                for(uint32_t i = begin; i < end; i++) sweep[i].min = boxes[sweep[i].body].min[axis];
+            });
+        }
+        if(!sorted || !m_InsertionSort()) {
+            std::sort(m_Sweep.begin(), m_Sweep.end(), [](const SweepEntry& a, const SweepEntry& b) { return a.min < b.min; });
+        }
+
+        // Boxes in sweep order, so the sweep streams through them.
+        m_SweepBoxes.resize(count);
+        const SweepEntry* sweep = m_Sweep.data();
+        Aabb* sweepBoxes = m_SweepBoxes.data();
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) sweepBoxes[i] = boxes[sweep[i].body];
+        });
+
+        // Each box is tested against the ones after it that start before it
+        // ends, so every pair is found once, by the box starting first.
+        m_ChunkPairs.resize(s_ChunkCount(count, BODY_GRAIN));
+        const uint32_t axis = m_Axis;
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            std::vector<Pair>& pairs = m_ChunkPairs[begin / BODY_GRAIN];
+            pairs.clear();
+            for(uint32_t i = begin; i < end; i++) {
+                const Aabb& box = sweepBoxes[i];
+                if(box.isEmpty()) continue;
+                const float max = box.max[axis];
+                for(uint32_t j = i + 1; j < count && sweep[j].min <= max; j++) {
+                    if(box.overlaps(sweepBoxes[j])) pairs.push_back(s_MakePair(sweep[i].body, sweep[j].body));
+                }
+            }
+        });
+    };
+
+    bool Broadphase::m_InsertionSort() {
+        const uint32_t count = static_cast<uint32_t>(m_Sweep.size());
+        uint64_t budget = static_cast<uint64_t>(INSERTION_SORT_BUDGET) * count;
+        for(uint32_t i = 1; i < count; i++) {
+            const SweepEntry entry = m_Sweep[i];
+            uint32_t j = i;
+            while(j > 0 && m_Sweep[j - 1].min > entry.min) {
+                m_Sweep[j] = m_Sweep[j - 1];
+                j--;
+            }
+            m_Sweep[j] = entry;
+            const uint32_t moves = i - j;
+            if(moves > budget) return false;
+            budget -= moves;
+        }
+        return true;
+    };
+
+    void Broadphase::m_UniformGrid(const Aabb* boxes, uint32_t count, ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("Broadphase::m_UniformGrid");
+
+        // Cells as wide as the largest box put every box in at most 8 of them.
+        float cellSize = m_Settings.cellSize;
+        if(cellSize <= 0.f) {
+            for(uint32_t i = 0; i < count; i++) {
+                if(boxes[i].isEmpty()) continue;
+                const glm::vec3 size = boxes[i].max - boxes[i].min;
+                cellSize = std::max(cellSize, std::max(size.x, std::max(size.y, size.z)));
+            }
+            // Only points, any size finds those at the same spot.
+            if(cellSize <= 0.f) cellSize = 1.f;
+        }
+        const float inverseCellSize = 1.f / cellSize;
+
+        // How many cells each box covers, then where its entries go.
+        m_CellOffsets.resize(count + 1);
+        uint32_t* offsets = m_CellOffsets.data();
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                if(boxes[i].isEmpty()) {
+                    offsets[i] = 0;
+                    continue;
+                }
+                const glm::ivec3 cells = s_Cell(boxes[i].max, inverseCellSize) - s_Cell(boxes[i].min, inverseCellSize) + 1;
+                offsets[i] = static_cast<uint32_t>(cells.x * cells.y * cells.z);
+            }
+        });
+        uint32_t entryCount = 0;
+        for(uint32_t i = 0; i < count; i++) {
+            const uint32_t cells = offsets[i];
+            offsets[i] = entryCount;
+            entryCount += cells;
+        }
+        offsets[count] = entryCount;
+
+        m_CellEntries.resize(entryCount);
+        CellEntry* entries = m_CellEntries.data();
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                if(boxes[i].isEmpty()) continue;
+                const glm::ivec3 low = s_Cell(boxes[i].min, inverseCellSize);
+                const glm::ivec3 high = s_Cell(boxes[i].max, inverseCellSize);
+                uint32_t entry = offsets[i];
+                for(int z = low.z; z <= high.z; z++) {
+                    for(int y = low.y; y <= high.y; y++) {
+                        for(int x = low.x; x <= high.x; x++) {
+                            entries[entry++] = {{x, y, z}, i};
+                        }
+                    }
+                }
+            }
+        });
+
+        // Counting sort into buckets of hashed cells. Cells sharing a bucket
+        // are told apart by their coordinates.
+        uint32_t bucketCount = 1;
+        while(bucketCount < 2 * entryCount) bucketCount *= 2;
+        const uint32_t mask = bucketCount - 1;
+        m_BucketStarts.assign(bucketCount + 1, 0);
+        uint32_t* starts = m_BucketStarts.data();
+        for(uint32_t e = 0; e < entryCount; e++) starts[s_CellHash(entries[e].cell, mask) + 1]++;
+        for(uint32_t b = 0; b < bucketCount; b++) starts[b + 1] += starts[b];
+        m_SortedCellEntries.resize(entryCount);
+        CellEntry* sorted = m_SortedCellEntries.data();
+        {
+            std::vector<uint32_t> cursors(starts, starts + bucketCount);
+            for(uint32_t e = 0; e < entryCount; e++) sorted[cursors[s_CellHash(entries[e].cell, mask)]++] = entries[e];
+        }
+
+        // Boxes sharing several cells would be found in each of them, the pair
+        // is only reported by the cell holding the low corner of their overlap.
+        m_ChunkPairs.resize(s_ChunkCount(bucketCount, BODY_GRAIN));
+        ThreadPool::s_ForChunks(threadPool, bucketCount, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            std::vector<Pair>& pairs = m_ChunkPairs[begin / BODY_GRAIN];
+            pairs.clear();
+            for(uint32_t bucket = begin; bucket < end; bucket++) {
+                for(uint32_t e = starts[bucket]; e < starts[bucket + 1]; e++) {
+                    const CellEntry& first = sorted[e];
+                    const Aabb& box = boxes[first.body];
+                    for(uint32_t f = e + 1; f < starts[bucket + 1]; f++) {
+                        const CellEntry& second = sorted[f];
+                        if(second.cell != first.cell) continue;
+                        const Aabb& other = boxes[second.body];
+                        if(!box.overlaps(other)) continue;
+                        if(s_Cell(glm::max(box.min, other.min), inverseCellSize) != first.cell) continue;
+                        pairs.push_back(s_MakePair(first.body, second.body));
+                    }
+                }
+            }
+        });
+    };
+
+    void Broadphase::m_UpdatePairs() {
+        TENG_PROFILE_ZONE("Broadphase::m_UpdatePairs");
+        std::swap(m_Pairs, m_PreviousPairs);
+        m_Pairs.clear();
+        for(const std::vector<Pair>& pairs : m_ChunkPairs) m_Pairs.insert(m_Pairs.end(), pairs.begin(), pairs.end());
+        std::sort(m_Pairs.begin(), m_Pairs.end());
+
+        // Both are ascending, one merge finds what is only in either.
+        m_BeganPairs.clear();
+        m_EndedPairs.clear();
+        std::set_difference(
+            m_Pairs.begin(), m_Pairs.end(), m_PreviousPairs.begin(), m_PreviousPairs.end(), std::back_inserter(m_BeganPairs));
+        std::set_difference(
+            m_PreviousPairs.begin(), m_PreviousPairs.end(), m_Pairs.begin(), m_Pairs.end(), std::back_inserter(m_EndedPairs));
+    };
+} // namespace teng
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "teng_bounds.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace teng {
+
+    class Registry;
+    class ThreadPool;
+
+    // Finds which of many boxes overlap, the first step of detecting contacts
+    // between bodies, without testing every pair.
+    //
+    // Sweep and prune sorts the boxes along the axis their centres spread the
+    // most on and only tests those whose intervals on it overlap. The order is
+    // kept between updates and fixed up with an insertion sort, which is
+    // close to linear while bodies move little per step. The uniform grid
+    // hashes boxes into cells and only tests boxes sharing one, which suits
+    // bodies of similar size spread evenly, where sweep and prune sees many
+    // overlapping intervals. Both test their share of the boxes on every
+    // thread of a ThreadPool.
+    //
+    // Overlapping pairs are cached between updates, so besides all of them
+    // the ones that began and ended overlapping with the last update are known.
+    // Bodies are identified by their index in the boxes passed to update.
+    class Broadphase {
+
+        public:
+
+            enum class Method : uint32_t {
+                SweepAndPrune = 0,
+                UniformGrid = 1,
+            };
+
+            struct Settings {
+                Method method{Method::SweepAndPrune};
+                // Width of the grid's cells, 0 for the largest box size of each update.
+                float cellSize{0.f};
+            };
+
+            // Two overlapping bodies, a < b.
+            struct Pair {
+                uint32_t a;
+                uint32_t b;
+
+                bool operator==(const Pair& other) const { return a == other.a && b == other.b; };
+                bool operator!=(const Pair& other) const { return !(*this == other); };
+                bool operator<(const Pair& other) const { return a < other.a || (a == other.a && b < other.b); };
+            };
+
+            // Sorted positions or grid cells per chunk of the parallel passes.
+            static constexpr uint32_t BODY_GRAIN = 1024;
+
+            Broadphase() = default;
+            explicit Broadphase(const Settings& settings) : m_Settings{settings} {};
+
+            const Settings& getSettings() const { return m_Settings; };
+            void setSettings(const Settings& settings) { m_Settings = settings; };
+
+            // Finds the pairs among count boxes that overlap or touch. Empty
+            // boxes overlap nothing.
+            void update(const Aabb* boxes, uint32_t count, ThreadPool* threadPool = nullptr);
+            // Forgets the cached pairs and the sort order, for when bodies were
+            // reordered, like a Registry's after destroying entities. The next
+            // update reports every pair as begun.
+            void reset();
+
+            // Every pair overlapping at the last update, ascending.
+            const std::vector<Pair>& getPairs() const { return m_Pairs; };
+            // Pairs that started overlapping with the last update, ascending.
+            const std::vector<Pair>& getBeganPairs() const { return m_BeganPairs; };
+            // Pairs that stopped overlapping with the last update, ascending.
+            const std::vector<Pair>& getEndedPairs() const { return m_EndedPairs; };
+
+            // World bounds of the registry's rigid bodies by dense index: their
+            // model's bounds, or a point at their translation without one.
+            // Entities that aren't rigid bodies get empty boxes.
+            static void s_RigidBodyBoxes(const Registry& registry, std::vector<Aabb>& boxes);
+
+        private:
+
+            // A box along the sweep axis, sorted by min.
+            struct SweepEntry {
+                float min;
+                uint32_t body;
+            };
+
+            // A box's share of a grid cell.
+            struct CellEntry {
+                glm::ivec3 cell;
+                uint32_t body;
+            };
+
+            void m_SweepAndPrune(const Aabb* boxes, uint32_t count, ThreadPool* threadPool);
+            // Restores m_Sweep's order after the mins changed, returns false when
+            // that took too many moves and it should be sorted from scratch instead.
+            bool m_InsertionSort();
+            void m_UniformGrid(const Aabb* boxes, uint32_t count, ThreadPool* threadPool);
+            // Sorts what the chunks found into m_Pairs and compares it with the last update's.
+            void m_UpdatePairs();
+
+            // An axis has to spread the centres this much more than the current
+            // one to become the sweep axis, so the order isn't thrown away for
+            // every small change.
+            static constexpr float AXIS_SWITCH_RATIO = 2.f;
+            // Moves per box the insertion sort may make before giving up.
+            static constexpr uint32_t INSERTION_SORT_BUDGET = 8;
+
+            Settings m_Settings;
+
+            uint32_t m_Axis{0};
+            std::vector<SweepEntry> m_Sweep;  // Kept between updates.
+            std::vector<Aabb> m_SweepBoxes;   // Boxes in m_Sweep's order.
+
+            std::vector<uint32_t> m_CellOffsets; // First entry of each body.
+            std::vector<CellEntry> m_CellEntries;
+            std::vector<CellEntry> m_SortedCellEntries; // By bucket.
+            std::vector<uint32_t> m_BucketStarts;
+
+            std::vector<std::vector<Pair>> m_ChunkPairs; // Found by each chunk.
+            std::vector<Pair> m_Pairs;
+            std::vector<Pair> m_PreviousPairs;
+            std::vector<Pair> m_BeganPairs;
+            std::vector<Pair> m_EndedPairs;
+    };
+} // namespace teng
@@ -36,7 +36,7 @@ namespace teng {
             void* getMappedMemory() const { return mapped; }
             uint32_t getInstanceCount() const { return m_InstanceCount; }
             VkDeviceSize getInstanceSize() const { return m_InstanceSize; }
-            VkDeviceSize getAlignmentSize() const { return m_InstanceSize; }
+            VkDeviceSize getAlignmentSize() const { return m_AlignmentSize; }
             VkBufferUsageFlags getUsageFlags() const { return m_UsageFlags; }
             VkMemoryPropertyFlags getMemoryPropertyFlags() const { return m_MemoryPropertyFlags; }
             VkDeviceSize getBufferSize() const { return m_BufferSize; }
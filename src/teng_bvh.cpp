@@ -0,0 +1,461 @@
+#include "teng_bvh.hpp"
+#include "teng_thread_pool.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace teng {
+
+    namespace {
+        // Traversal stack, on the call stack unless the tree is unusually deep.
+        template <typename T>
+        class TraversalStack {
+
+            public:
+
+                bool empty() const { return m_Size == 0; };
+                void push(const T& entry) {
+                    if(m_Size < LOCAL_SIZE) {
+                        m_Local[m_Size] = entry;
+                    } else {
+                        m_Overflow.push_back(entry);
+                    }
+                    m_Size++;
+                };
+                T pop() {
+                    m_Size--;
+                    if(m_Size < LOCAL_SIZE) return m_Local[m_Size];
+                    T entry = m_Overflow.back();
+                    m_Overflow.pop_back();
+                    return entry;
+                };
+
+            private:
+                static constexpr uint32_t LOCAL_SIZE = 64;
+
+                T m_Local[LOCAL_SIZE];
+                std::vector<T> m_Overflow;
+                uint32_t m_Size{0};
+        };
+
+        struct RayEntry {
+            uint32_t node;
+            float distance;
+        };
+
+        bool s_SameBounds(const Aabb& a, const Aabb& b) {
+            return a.min == b.min && a.max == b.max;
+        }
+    }
+
+    // Public
+    uint32_t Bvh::insert(const Aabb& box, uint32_t userData) {
+        const uint32_t leaf = m_AllocateNode();
+        m_Nodes[leaf].bounds = box.expanded(m_Margin);
+        m_Nodes[leaf].userData = userData;
+        m_Boxes[leaf] = box;
+        m_InsertLeaf(leaf);
+        m_LeafCount++;
+        return leaf;
+    };
+
+    void Bvh::remove(uint32_t proxy) {
+        assert(proxy < m_Nodes.size() && m_Nodes[proxy].isLeaf() && "not a proxy");
+        m_RemoveLeaf(proxy);
+        m_FreeNode(proxy);
+        m_LeafCount--;
+    };
+
+    bool Bvh::update(uint32_t proxy, const Aabb& box) {
+        assert(proxy < m_Nodes.size() && m_Nodes[proxy].isLeaf() && "not a proxy");
+        m_Boxes[proxy] = box;
+        if(m_Nodes[proxy].bounds.contains(box)) return false;
+
+        m_Nodes[proxy].bounds = box.expanded(m_Margin);
+        m_Refit(m_Nodes[proxy].parent);
+        return true;
+    };
+
+    void Bvh::clear() {
+        m_Nodes.clear();
+        m_Boxes.clear();
+        m_FreeNodes.clear();
+        m_Root = NO_NODE;
+        m_LeafCount = 0;
+        m_InternalArea = 0.;
+        m_RebuildCost = -1.f;
+    };
+
+    void Bvh::rebuild() {
+        TENG_PROFILE_ZONE("Bvh::rebuild");
+        if(m_Root == NO_NODE) return;
+
+        std::vector<BuildLeaf> leaves;
+        leaves.reserve(m_LeafCount);
+        TraversalStack<uint32_t> stack;
+        stack.push(m_Root);
+        while(!stack.empty()) {
+            const uint32_t node = stack.pop();
+            const Aabb& bounds = m_Nodes[node].bounds;
+            if(m_Nodes[node].isLeaf()) {
+                leaves.push_back({bounds, bounds.center(), node});
+                continue;
+            }
+            stack.push(m_Nodes[node].children[0]);
+            stack.push(m_Nodes[node].children[1]);
+            m_FreeNode(node);
+        }
+        // Drop what rounding accumulated.
+        m_InternalArea = 0.;
+
+        m_Root = m_Build(leaves.data(), static_cast<uint32_t>(leaves.size()));
+        m_Nodes[m_Root].parent = NO_NODE;
+        m_RebuildCost = getCost();
+    };
+
+    bool Bvh::rebuildIfDegraded() {
+        if(m_LeafCount < 2) return false;
+        // Built by insertions only so far.
+        if(m_RebuildCost < 0.f || getCost() > m_RebuildCost * REBUILD_COST_RATIO) {
+            rebuild();
+            return true;
+        }
+        return false;
+    };
+
+    float Bvh::getCost() const {
+        if(m_Root == NO_NODE) return 0.f;
+        const float rootArea = m_Nodes[m_Root].bounds.surfaceArea();
+        if(rootArea <= 0.f) return 0.f;
+        return static_cast<float>(m_InternalArea / rootArea);
+    };
+
+    uint32_t Bvh::getHeight() const {
+        if(m_Root == NO_NODE) return 0;
+        uint32_t height = 0;
+        TraversalStack<std::pair<uint32_t, uint32_t>> stack;
+        stack.push({m_Root, 1});
+        while(!stack.empty()) {
+            const auto [node, depth] = stack.pop();
+            height = std::max(height, depth);
+            if(m_Nodes[node].isLeaf()) continue;
+            stack.push({m_Nodes[node].children[0], depth + 1});
+            stack.push({m_Nodes[node].children[1], depth + 1});
+        }
+        return height;
+    };
+
+    void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const {
+        if(m_Root == NO_NODE) return;
+
+        TraversalStack<uint32_t> stack;
+        TraversalStack<uint32_t> inside;
+        stack.push(m_Root);
+        while(!stack.empty()) {
+            const uint32_t node = stack.pop();
+            if(m_Nodes[node].isLeaf()) {
+                if(frustum.classify(m_Boxes[node]) != Frustum::OUTSIDE) out.push_back(m_Nodes[node].userData);
+                continue;
+            }
+
+            const Frustum::Containment containment = frustum.classify(m_Nodes[node].bounds);
+            if(containment == Frustum::OUTSIDE) continue;
+            if(containment == Frustum::INTERSECTS) {
+                stack.push(m_Nodes[node].children[0]);
+                stack.push(m_Nodes[node].children[1]);
+                continue;
+            }
+
+            // Every leaf below is inside as well, take them without testing.
+            inside.push(node);
+            while(!inside.empty()) {
+                const Node& below = m_Nodes[inside.pop()];
+                if(below.isLeaf()) {
+                    out.push_back(below.userData);
+                } else {
+                    inside.push(below.children[0]);
+                    inside.push(below.children[1]);
+                }
+            }
+        }
+    };
+
+    void Bvh::queryOverlaps(const Aabb& box, std::vector<uint32_t>& out) const {
+        if(m_Root == NO_NODE) return;
+
+        TraversalStack<uint32_t> stack;
+        stack.push(m_Root);
+        while(!stack.empty()) {
+            const uint32_t node = stack.pop();
+            if(!m_Nodes[node].bounds.overlaps(box)) continue;
+            if(m_Nodes[node].isLeaf()) {
+                if(m_Boxes[node].overlaps(box)) out.push_back(m_Nodes[node].userData);
+                continue;
+            }
+            stack.push(m_Nodes[node].children[0]);
+            stack.push(m_Nodes[node].children[1]);
+        }
+    };
+
+    bool Bvh::raycast(const Ray& ray, float maxDistance, RayHit& hit) const {
+        if(m_Root == NO_NODE) return false;
+
+        const glm::vec3 inverseDirection = 1.f / ray.direction;
+        float closest = maxDistance;
+        bool found = false;
+
+        float distance;
+        if(!Ray::s_Intersects(m_Nodes[m_Root].bounds, ray.origin, inverseDirection, closest, distance)) return false;
+
+        TraversalStack<RayEntry> stack;
+        stack.push({m_Root, distance});
+        while(!stack.empty()) {
+            const RayEntry entry = stack.pop();
+            // A closer hit was found since it was pushed.
+            if(entry.distance > closest) continue;
+
+            const Node& node = m_Nodes[entry.node];
+            if(node.isLeaf()) {
+                if(Ray::s_Intersects(m_Boxes[entry.node], ray.origin, inverseDirection, closest, distance)) {
+                    closest = distance;
+                    hit = {node.userData, distance};
+                    found = true;
+                }
+                continue;
+            }
+
+            // Nearer child on top, so it's searched first and prunes the other.
+            float distances[2];
+            bool hits[2];
+            for(int i = 0; i < 2; i++) {
+                hits[i] = Ray::s_Intersects(m_Nodes[node.children[i]].bounds, ray.origin, inverseDirection, closest, distances[i]);
+            }
+            const int nearer = (hits[0] && hits[1] && distances[1] < distances[0]) || !hits[0] ? 1 : 0;
+            const int farther = 1 - nearer;
+            if(hits[farther]) stack.push({node.children[farther], distances[farther]});
+            if(hits[nearer]) stack.push({node.children[nearer], distances[nearer]});
+        }
+        return found;
+    };
+
+    void Bvh::queryOverlaps(
+        const Aabb* boxes,
+        uint32_t count,
+        std::vector<std::vector<uint32_t>>& results,
+        ThreadPool* threadPool) const {
+        TENG_PROFILE_ZONE("Bvh::queryOverlaps batch");
+        results.resize(count);
+        auto queryRange = [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                results[i].clear();
+                queryOverlaps(boxes[i], results[i]);
+            }
+        };
+        ThreadPool::s_ForChunks(threadPool, count, QUERY_GRAIN, queryRange);
+    };
+
+    void Bvh::raycast(
+        const Ray* rays,
+        uint32_t count,
+        float maxDistance,
+        RayHit* hits,
+        ThreadPool* threadPool) const {
+        TENG_PROFILE_ZONE("Bvh::raycast batch");
+        auto queryRange = [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                if(!raycast(rays[i], maxDistance, hits[i])) hits[i] = RayHit{};
+            }
+        };
+        ThreadPool::s_ForChunks(threadPool, count, QUERY_GRAIN, queryRange);
+    };
+
+    // Private
+    uint32_t Bvh::m_AllocateNode() {
+        if(!m_FreeNodes.empty()) {
+            const uint32_t node = m_FreeNodes.back();
+            m_FreeNodes.pop_back();
+            return node;
+        }
+        m_Nodes.emplace_back();
+        m_Boxes.emplace_back();
+        return static_cast<uint32_t>(m_Nodes.size() - 1);
+    };
+
+    void Bvh::m_FreeNode(uint32_t node) {
+        if(!m_Nodes[node].isLeaf()) m_InternalArea -= m_Nodes[node].bounds.surfaceArea();
+        m_Nodes[node] = Node{};
+        m_Boxes[node] = Aabb{};
+        m_FreeNodes.push_back(node);
+    };
+
+    void Bvh::m_SetBounds(uint32_t node, const Aabb& bounds) {
+        if(!m_Nodes[node].isLeaf()) {
+            m_InternalArea += static_cast<double>(bounds.surfaceArea()) - m_Nodes[node].bounds.surfaceArea();
+        }
+        m_Nodes[node].bounds = bounds;
+    };
+
+    void Bvh::m_InsertLeaf(uint32_t leaf) {
+        if(m_Root == NO_NODE) {
+            m_Root = leaf;
+            m_Nodes[leaf].parent = NO_NODE;
+            return;
+        }
+
+        // Walk down to the cheapest sibling by the SAH: pairing with a node costs
+        // the area of the new parent, descending adds the growth of this node.
+        const Aabb box = m_Nodes[leaf].bounds;
+        uint32_t sibling = m_Root;
+        while(!m_Nodes[sibling].isLeaf()) {
+            const Node& node = m_Nodes[sibling];
+            const float area = node.bounds.surfaceArea();
+            const float combinedArea = Aabb::s_Union(node.bounds, box).surfaceArea();
+            const float pairCost = 2.f * combinedArea;
+            const float inheritedCost = 2.f * (combinedArea - area);
+
+            float childCosts[2];
+            for(int i = 0; i < 2; i++) {
+                const Node& child = m_Nodes[node.children[i]];
+                const float grownArea = Aabb::s_Union(child.bounds, box).surfaceArea();
+                childCosts[i] = inheritedCost + (child.isLeaf() ? grownArea : grownArea - child.bounds.surfaceArea());
+            }
+
+            if(pairCost < childCosts[0] && pairCost < childCosts[1]) break;
+            sibling = node.children[childCosts[1] < childCosts[0] ? 1 : 0];
+        }
+
+        const uint32_t oldParent = m_Nodes[sibling].parent;
+        const uint32_t newParent = m_AllocateNode();
+        m_Nodes[newParent].parent = oldParent;
+        m_Nodes[newParent].children[0] = sibling;
+        m_Nodes[newParent].children[1] = leaf;
+        m_SetBounds(newParent, Aabb::s_Union(m_Nodes[sibling].bounds, box));
+        m_Nodes[sibling].parent = newParent;
+        m_Nodes[leaf].parent = newParent;
+
+        if(oldParent == NO_NODE) {
+            m_Root = newParent;
+        } else {
+            Node& parent = m_Nodes[oldParent];
+            parent.children[parent.children[0] == sibling ? 0 : 1] = newParent;
+            m_Refit(oldParent);
+        }
+    };
+
+    void Bvh::m_RemoveLeaf(uint32_t leaf) {
+        if(leaf == m_Root) {
+            m_Root = NO_NODE;
+            return;
+        }
+
+        // The sibling takes the parent's place.
+        const uint32_t parent = m_Nodes[leaf].parent;
+        const uint32_t grandParent = m_Nodes[parent].parent;
+        const uint32_t sibling = m_Nodes[parent].children[m_Nodes[parent].children[0] == leaf ? 1 : 0];
+
+        m_Nodes[sibling].parent = grandParent;
+        if(grandParent == NO_NODE) {
+            m_Root = sibling;
+        } else {
+            Node& node = m_Nodes[grandParent];
+            node.children[node.children[0] == parent ? 0 : 1] = sibling;
+        }
+        m_FreeNode(parent);
+        m_Nodes[leaf].parent = NO_NODE;
+        if(grandParent != NO_NODE) m_Refit(grandParent);
+    };
+
+    void Bvh::m_Refit(uint32_t node) {
+        while(node != NO_NODE) {
+            const Node& current = m_Nodes[node];
+            const Aabb bounds = Aabb::s_Union(m_Nodes[current.children[0]].bounds, m_Nodes[current.children[1]].bounds);
+            // Nothing above depends on this node otherwise.
+            if(s_SameBounds(bounds, current.bounds)) return;
+            m_SetBounds(node, bounds);
+            node = m_Nodes[node].parent;
+        }
+    };
+
+    uint32_t Bvh::m_Build(BuildLeaf* leaves, uint32_t count) {
+        if(count == 1) return leaves[0].node;
+
+        Aabb centroids;
+        for(uint32_t i = 0; i < count; i++) {
+            centroids.extend(leaves[i].center);
+        }
+        const glm::vec3 extent = centroids.max - centroids.min;
+
+        // Binned SAH over all three axes: bins hold the bounds and count of the
+        // leaves whose centroids fall in them, a split between two bins costs
+        // each side's area times its count.
+        struct Bin {
+            Aabb bounds;
+            uint32_t count{0};
+        };
+        // Small subtrees don't need the resolution, their sweeps would dominate.
+        const uint32_t binCount = std::min(count, SAH_BINS);
+        auto binOf = [&](const BuildLeaf& leaf, int axis, float scale) {
+            return std::min(static_cast<uint32_t>((leaf.center[axis] - centroids.min[axis]) * scale), binCount - 1);
+        };
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        for(int axis = 0; axis < 3; axis++) {
+            if(extent[axis] <= 0.f) continue;
+            const float scale = binCount / extent[axis];
+            Bin bins[SAH_BINS];
+            for(uint32_t i = 0; i < count; i++) {
+                Bin& bin = bins[binOf(leaves[i], axis, scale)];
+                bin.bounds.extend(leaves[i].bounds);
+                bin.count++;
+            }
+
+            // rightCosts[i] is the cost of bins i + 1 onwards.
+            float rightCosts[SAH_BINS - 1];
+            Aabb right;
+            uint32_t rightCount = 0;
+            for(uint32_t i = binCount - 1; i > 0; i--) {
+                right.extend(bins[i].bounds);
+                rightCount += bins[i].count;
+                rightCosts[i - 1] = right.surfaceArea() * rightCount;
+            }
+            Aabb left;
+            uint32_t leftCount = 0;
+            for(uint32_t i = 0; i < binCount - 1; i++) {
+                left.extend(bins[i].bounds);
+                leftCount += bins[i].count;
+                if(leftCount == 0 || leftCount == count) continue;
+                const float cost = left.surfaceArea() * leftCount + rightCosts[i];
+                if(cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        uint32_t middle = count / 2;
+        if(bestAxis >= 0) {
+            const float scale = binCount / extent[bestAxis];
+            BuildLeaf* split = std::partition(leaves, leaves + count, [&](const BuildLeaf& leaf) {
+                return binOf(leaf, bestAxis, scale) <= bestSplit;
+            });
+            middle = static_cast<uint32_t>(split - leaves);
+        }
+        // All centroids coincide, any even split is as good.
+        if(middle == 0 || middle == count) middle = count / 2;
+
+        const uint32_t left = m_Build(leaves, middle);
+        const uint32_t right = m_Build(leaves + middle, count - middle);
+        const uint32_t node = m_AllocateNode();
+        m_Nodes[node].children[0] = left;
+        m_Nodes[node].children[1] = right;
+        m_Nodes[left].parent = node;
+        m_Nodes[right].parent = node;
+        m_SetBounds(node, Aabb::s_Union(m_Nodes[left].bounds, m_Nodes[right].bounds));
+        return node;
+    };
+} // namespace teng
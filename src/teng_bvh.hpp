@@ -0,0 +1,132 @@
+#pragma once
+
+#include "teng_bounds.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace teng {
+
+    class ThreadPool;
+
+    // Dynamic bounding volume hierarchy over boxes that move, appear and
+    // disappear. Every box is a leaf, identified by the proxy insert returns,
+    // and carries a user value queries report.
+    //
+    // Leaves hold a fattened copy of their box, so boxes moving within the
+    // margin change nothing. One that leaves it is refitted: its leaf gets a
+    // new fat box and its ancestors are recomputed up to the first one that
+    // didn't change. Refits keep the topology, which degrades as things move
+    // apart from where they were inserted, so the tree tracks its SAH cost and
+    // rebuildIfDegraded rebuilds it top down with binned SAH once that grew
+    // by REBUILD_COST_RATIO. Proxies stay valid across rebuilds.
+    //
+    // Queries test the exact boxes at the leaves, the fat ones only to prune.
+    // Queries are const and may run concurrently, the batch versions split
+    // their queries across a ThreadPool.
+    class Bvh {
+
+        public:
+
+            static constexpr uint32_t NO_PROXY = UINT32_MAX;
+            static constexpr float REBUILD_COST_RATIO = 1.5f;
+            // Queries per chunk of a batch.
+            static constexpr uint32_t QUERY_GRAIN = 64;
+
+            struct RayHit {
+                uint32_t userData{UINT32_MAX};
+                float distance{0.f};
+            };
+
+            // margin is how far leaves' boxes are fattened, in world units.
+            explicit Bvh(float margin = .1f) : m_Margin{margin} {};
+
+            uint32_t insert(const Aabb& box, uint32_t userData);
+            void remove(uint32_t proxy);
+            // Moves proxy's box, returns whether that needed a refit.
+            bool update(uint32_t proxy, const Aabb& box);
+            void setUserData(uint32_t proxy, uint32_t userData) { m_Nodes[proxy].userData = userData; };
+            uint32_t getUserData(uint32_t proxy) const { return m_Nodes[proxy].userData; };
+            const Aabb& getBox(uint32_t proxy) const { return m_Boxes[proxy]; };
+            void clear();
+
+            // Rebuilds from scratch with binned SAH.
+            void rebuild();
+            // Rebuilds if the cost grew by REBUILD_COST_RATIO since the last
+            // rebuild, returns whether it did.
+            bool rebuildIfDegraded();
+
+            uint32_t getLeafCount() const { return m_LeafCount; };
+            // Expected node visits per point query, the sum of the internal
+            // nodes' surface areas over the root's.
+            float getCost() const;
+            // Longest root to leaf path, walks the whole tree.
+            uint32_t getHeight() const;
+
+            // Appends the user data of boxes overlapping the frustum, in no particular order.
+            void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+            // Appends the user data of boxes overlapping box, in no particular order.
+            void queryOverlaps(const Aabb& box, std::vector<uint32_t>& out) const;
+            // Closest box the ray enters within maxDistance.
+            bool raycast(const Ray& ray, float maxDistance, RayHit& hit) const;
+
+            // results[i] gets the overlaps of boxes[i], on threadPool's threads when there is one.
+            void queryOverlaps(
+                const Aabb* boxes,
+                uint32_t count,
+                std::vector<std::vector<uint32_t>>& results,
+                ThreadPool* threadPool = nullptr) const;
+            // hits[i] gets rays[i]'s closest hit, userData is UINT32_MAX for misses.
+            void raycast(
+                const Ray* rays,
+                uint32_t count,
+                float maxDistance,
+                RayHit* hits,
+                ThreadPool* threadPool = nullptr) const;
+
+        private:
+
+            static constexpr uint32_t NO_NODE = UINT32_MAX;
+            // Bins per axis for the SAH rebuild.
+            static constexpr uint32_t SAH_BINS = 16;
+
+            // Leaves and internal nodes share the array, leaves are the proxies.
+            struct Node {
+                Aabb bounds;               // Fat for leaves.
+                uint32_t parent{NO_NODE};
+                uint32_t children[2]{NO_NODE, NO_NODE};
+                uint32_t userData{0};
+
+                bool isLeaf() const { return children[0] == NO_NODE; };
+            };
+
+            uint32_t m_AllocateNode();
+            void m_FreeNode(uint32_t node);
+            void m_SetBounds(uint32_t node, const Aabb& bounds);
+            void m_InsertLeaf(uint32_t leaf);
+            void m_RemoveLeaf(uint32_t leaf);
+            // Recomputes node's and its ancestors' bounds, stopping at the first that stays the same.
+            void m_Refit(uint32_t node);
+            // A leaf as the rebuild sees it, copied out so the build streams
+            // through one array instead of chasing indices into m_Nodes.
+            struct BuildLeaf {
+                Aabb bounds;
+                glm::vec3 center;
+                uint32_t node;
+            };
+            // Builds a subtree over leaves, which it reorders, and returns its root.
+            uint32_t m_Build(BuildLeaf* leaves, uint32_t count);
+
+            float m_Margin;
+            std::vector<Node> m_Nodes;
+            std::vector<Aabb> m_Boxes; // Exact box per leaf, by node index.
+            std::vector<uint32_t> m_FreeNodes;
+            uint32_t m_Root{NO_NODE};
+            uint32_t m_LeafCount{0};
+
+            // Sum of the internal nodes' surface areas, kept up to date by m_SetBounds.
+            double m_InternalArea{0.};
+            float m_RebuildCost{-1.f}; // Negative until the first rebuild.
+    };
+} // namespace teng
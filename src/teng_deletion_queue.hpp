@@ -0,0 +1,54 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+
+namespace teng {
+
+    // Defers destruction of GPU resources until the last submission that used
+    // them has completed, so nothing has to wait for the device to go idle.
+    // Keyed by graphics timeline value, see Device::submitGraphics.
+    class DeletionQueue {
+
+        public:
+
+            DeletionQueue() = default;
+            ~DeletionQueue() { flushAll(); };
+
+            DeletionQueue(const DeletionQueue&) = delete;
+            DeletionQueue &operator=(const DeletionQueue&) = delete;
+
+            // deleter runs once lastUse has completed on the GPU.
+            // Values must be pushed in non-decreasing order.
+            void push(uint64_t lastUse, std::function<void()> deleter) {
+                m_Pending.emplace_back(lastUse, std::move(deleter));
+            };
+
+            // Runs every deleter whose value is at or before completed.
+            void flush(uint64_t completed) {
+                while(!m_Pending.empty() && m_Pending.front().first <= completed) {
+                    auto deleter = std::move(m_Pending.front().second);
+                    m_Pending.pop_front();
+                    deleter();
+                }
+            };
+
+            // Only safe once the device is idle.
+            void flushAll() {
+                while(!m_Pending.empty()) {
+                    auto deleter = std::move(m_Pending.front().second);
+                    m_Pending.pop_front();
+                    deleter();
+                }
+            };
+
+            bool empty() const { return m_Pending.empty(); };
+
+        private:
+
+            std::deque<std::pair<uint64_t, std::function<void()>>> m_Pending;
+    };
+} // namespace teng
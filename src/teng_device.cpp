@@ -1,6 +1,8 @@
 #include "teng_device.hpp"
+#include "teng_profiler.hpp"
 
 // std headers
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -43,7 +45,7 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 }
 
 // class member functions
-Device::Device(Window &window) : window{window} {
+Device::Device(Window &window) : window{&window} {
   createInstance();      // Initializes the Vulcan library, and establishes the
                          // connection between it and my app
   setupDebugMessenger(); // Validation layer for errors, that are otherwise very
@@ -51,10 +53,29 @@ Device::Device(Window &window) : window{window} {
   createSurface();       // Connects Vulcan and GLFW window
   pickPhysicalDevice();  // Chooses the GPU to use for rendering
   createLogicalDevice(); // Chooses which features the GPU uses
+  loadDeviceFunctions(); // Entry points of the optional features
   createCommandPool();   // Helps with Command Buffer allocation
+  createGraphicsTimeline(); // Tells when submitted work has completed
+}
+
+Device::Device() {
+  deviceExtensions.clear();
+
+  createInstance();
+  setupDebugMessenger();
+  pickPhysicalDevice();
+  createLogicalDevice();
+  loadDeviceFunctions();
+  createCommandPool();
+  createGraphicsTimeline();
 }
 
 Device::~Device() {
+  // Deferred deleters may still reference work in flight.
+  vkDeviceWaitIdle(device_);
+  deletionQueue_.flushAll();
+
+  vkDestroySemaphore(device_, graphicsTimeline_, nullptr);
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -62,7 +83,9 @@ Device::~Device() {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -71,13 +94,22 @@ void Device::createInstance() {
     throw std::runtime_error("validation layers requested, but not available!");
   }
 
+  // Ask for the newest version we make use of, as long as the loader knows it.
+  // A 1.0 loader doesn't export vkEnumerateInstanceVersion.
+  auto enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+      vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+  if (enumerateInstanceVersion != nullptr) {
+    enumerateInstanceVersion(&instanceApiVersion);
+  }
+  instanceApiVersion = std::min(instanceApiVersion, static_cast<uint32_t>(VK_API_VERSION_1_3));
+
   VkApplicationInfo appInfo = {};
   appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
   appInfo.pApplicationName = "LittleVulkanEngine App";
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = instanceApiVersion;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -136,8 +168,10 @@ void Device::createLogicalDevice() {
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily,
-                                            indices.presentFamily};
+  std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily};
+  if (!isHeadless()) {
+    uniqueQueueFamilies.insert(indices.presentFamily);
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -149,9 +183,151 @@ void Device::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  if (properties.limits.timestampComputeAndGraphics) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    features_.timestampValidBits = families[indices.graphicsFamily].timestampValidBits;
+  }
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  VkPhysicalDeviceFeatures supportedCoreFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedCoreFeatures);
+  if (supportedCoreFeatures.pipelineStatisticsQuery) {
+    features_.pipelineStatistics = true;
+    deviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+  }
+
+  std::vector<const char *> enabledExtensions(deviceExtensions.begin(),
+                                              deviceExtensions.end());
+
+  // Optional features are chained onto VkPhysicalDeviceFeatures2, which needs 1.1.
+  VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+  deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  deviceFeatures2.features = deviceFeatures;
+  void **pNextChain = &deviceFeatures2.pNext;
+
+  const uint32_t deviceApiVersion =
+      std::min(properties.apiVersion, instanceApiVersion);
+
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {};
+  extendedDynamicStateFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+
+  if (deviceApiVersion >= VK_API_VERSION_1_3) {
+    // Core and always supported in 1.3.
+    features_.extendedDynamicState = true;
+  } else if (deviceApiVersion >= VK_API_VERSION_1_1 &&
+             hasDeviceExtension(physicalDevice,
+                                VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &extendedDynamicStateFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+    if (extendedDynamicStateFeatures.extendedDynamicState) {
+      features_.extendedDynamicState = true;
+      enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+      *pNextChain = &extendedDynamicStateFeatures;
+      pNextChain = &extendedDynamicStateFeatures.pNext;
+    }
+  }
+
+  VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {};
+  dynamicRenderingFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+  // Core in 1.3. Before that the extension needs 1.2 for its own dependencies.
+  const bool dynamicRenderingCore = deviceApiVersion >= VK_API_VERSION_1_3;
+  if (dynamicRenderingCore ||
+      (deviceApiVersion >= VK_API_VERSION_1_2 &&
+       hasDeviceExtension(physicalDevice,
+                          VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))) {
+    VkPhysicalDeviceFeatures2 supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &dynamicRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+    if (dynamicRenderingFeatures.dynamicRendering) {
+      features_.dynamicRendering = true;
+      if (!dynamicRenderingCore) {
+        enabledExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+      }
+      *pNextChain = &dynamicRenderingFeatures;
+      pNextChain = &dynamicRenderingFeatures.pNext;
+    }
+  }
+
+  // Both extensions or neither, an id is only useful with something to wait on.
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+  presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+  presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+  if (!isHeadless() &&
+      hasDeviceExtension(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+      hasDeviceExtension(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    VkPhysicalDeviceFeatures2 supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &presentIdFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+    if (presentIdFeatures.presentId && presentWaitFeatures.presentWait) {
+      features_.presentWait = true;
+      enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+      enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+      *pNextChain = &presentIdFeatures;
+      pNextChain = &presentWaitFeatures.pNext;
+    } else {
+      presentIdFeatures.pNext = nullptr;
+    }
+  }
+
+  // Needs no feature bits, enabling the extension is enough.
+  if (hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    features_.memoryBudget = true;
+    enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
+  // Only useful when the CPU side is the clock steady_clock reads.
+#ifdef __linux__
+  if (hasDeviceExtension(physicalDevice, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+    auto getTimeDomains =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    uint32_t domainCount = 0;
+    std::vector<VkTimeDomainEXT> domains;
+    if (getTimeDomains != nullptr) {
+      getTimeDomains(physicalDevice, &domainCount, nullptr);
+      domains.resize(domainCount);
+      getTimeDomains(physicalDevice, &domainCount, domains.data());
+    }
+    const bool hasDevice = std::find(domains.begin(), domains.end(),
+                                     VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+    const bool hasMonotonic = std::find(domains.begin(), domains.end(),
+                                        VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) != domains.end();
+    if (hasDevice && hasMonotonic) {
+      features_.calibratedTimestamps = true;
+      enabledExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    }
+  }
+#endif
+
+  // Required, isDeviceSuitable checked for it. Core in 1.2, an extension on 1.1.
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+  timelineSemaphoreFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+  if (deviceApiVersion < VK_API_VERSION_1_2) {
+    enabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+  }
+  *pNextChain = &timelineSemaphoreFeatures;
+  pNextChain = &timelineSemaphoreFeatures.pNext;
+
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -159,10 +335,11 @@ void Device::createLogicalDevice() {
       static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-  createInfo.pEnabledFeatures = &deviceFeatures;
+  createInfo.pNext = &deviceFeatures2;
+  createInfo.pEnabledFeatures = nullptr;
   createInfo.enabledExtensionCount =
-      static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+      static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation
   // layers have been deprecated
@@ -180,7 +357,9 @@ void Device::createLogicalDevice() {
   }
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
-  vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  if (!isHeadless()) {
+    vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+  }
 }
 
 void Device::createCommandPool() {
@@ -198,8 +377,188 @@ void Device::createCommandPool() {
   }
 }
 
+void Device::loadDeviceFunctions() {
+  // Vulkan 1.3 exports the core names, the extension only the EXT ones.
+  auto load = [this](const char *core, const char *ext) {
+    PFN_vkVoidFunction fn = vkGetDeviceProcAddr(device_, core);
+    return fn != nullptr ? fn : vkGetDeviceProcAddr(device_, ext);
+  };
+
+  if (features_.extendedDynamicState) {
+    functions_.cmdSetCullMode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(
+        load("vkCmdSetCullMode", "vkCmdSetCullModeEXT"));
+    functions_.cmdSetFrontFace = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(
+        load("vkCmdSetFrontFace", "vkCmdSetFrontFaceEXT"));
+    functions_.cmdSetPrimitiveTopology =
+        reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(
+            load("vkCmdSetPrimitiveTopology", "vkCmdSetPrimitiveTopologyEXT"));
+    functions_.cmdSetDepthTestEnable =
+        reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(
+            load("vkCmdSetDepthTestEnable", "vkCmdSetDepthTestEnableEXT"));
+    functions_.cmdSetDepthWriteEnable =
+        reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(
+            load("vkCmdSetDepthWriteEnable", "vkCmdSetDepthWriteEnableEXT"));
+    functions_.cmdSetDepthCompareOp =
+        reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(
+            load("vkCmdSetDepthCompareOp", "vkCmdSetDepthCompareOpEXT"));
+
+    if (!functions_.cmdSetCullMode || !functions_.cmdSetFrontFace ||
+        !functions_.cmdSetPrimitiveTopology || !functions_.cmdSetDepthTestEnable ||
+        !functions_.cmdSetDepthWriteEnable || !functions_.cmdSetDepthCompareOp) {
+      features_.extendedDynamicState = false;
+    }
+  }
+
+  if (features_.dynamicRendering) {
+    functions_.cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(
+        load("vkCmdBeginRendering", "vkCmdBeginRenderingKHR"));
+    functions_.cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(
+        load("vkCmdEndRendering", "vkCmdEndRenderingKHR"));
+
+    if (!functions_.cmdBeginRendering || !functions_.cmdEndRendering) {
+      features_.dynamicRendering = false;
+    }
+  }
+
+  if (features_.presentWait) {
+    functions_.waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+        vkGetDeviceProcAddr(device_, "vkWaitForPresentKHR"));
+    if (!functions_.waitForPresent) {
+      features_.presentWait = false;
+    }
+  }
+
+  if (features_.calibratedTimestamps) {
+    functions_.getCalibratedTimestamps =
+        reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+            vkGetDeviceProcAddr(device_, "vkGetCalibratedTimestampsEXT"));
+    if (!functions_.getCalibratedTimestamps) {
+      features_.calibratedTimestamps = false;
+    }
+  }
+
+  functions_.waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+      load("vkWaitSemaphores", "vkWaitSemaphoresKHR"));
+  functions_.getSemaphoreCounterValue =
+      reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+          load("vkGetSemaphoreCounterValue", "vkGetSemaphoreCounterValueKHR"));
+  if (!functions_.waitSemaphores || !functions_.getSemaphoreCounterValue) {
+    throw std::runtime_error("failed to load the timeline semaphore functions!");
+  }
+
+  std::cout << "extended dynamic state: "
+            << (features_.extendedDynamicState ? "yes" : "no") << std::endl;
+  std::cout << "dynamic rendering: "
+            << (features_.dynamicRendering ? "yes" : "no") << std::endl;
+  std::cout << "present wait: "
+            << (features_.presentWait ? "yes" : "no") << std::endl;
+  std::cout << "memory budget: "
+            << (features_.memoryBudget ? "yes" : "no") << std::endl;
+  std::cout << "pipeline statistics: "
+            << (features_.pipelineStatistics ? "yes" : "no") << std::endl;
+  std::cout << "calibrated timestamps: "
+            << (features_.calibratedTimestamps ? "yes" : "no") << std::endl;
+  std::cout << "timestamp valid bits: " << features_.timestampValidBits << std::endl;
+}
+
+void Device::createGraphicsTimeline() {
+  VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+  typeInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+
+  if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &graphicsTimeline_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create the graphics timeline semaphore!");
+  }
+}
+
+uint64_t Device::submitGraphics(const VkSubmitInfo &submitInfo) {
+  const uint64_t value = graphicsTimelineValue_ + 1;
+
+  // Binary semaphores ignore their entry in the value arrays.
+  std::vector<VkSemaphore> waitSemaphores(
+      submitInfo.pWaitSemaphores,
+      submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+  std::vector<VkPipelineStageFlags> waitStages(
+      submitInfo.pWaitDstStageMask,
+      submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+  std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+
+  // Uploads went on the same queue, but without a dependency on them nothing
+  // makes their writes visible. Waiting on a value that was reached is cheap.
+  if (uploadValue_ > 0) {
+    waitSemaphores.push_back(graphicsTimeline_);
+    waitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    waitValues.push_back(uploadValue_);
+  }
+
+  std::vector<VkSemaphore> signalSemaphores(
+      submitInfo.pSignalSemaphores,
+      submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+  signalSemaphores.push_back(graphicsTimeline_);
+  std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+  signalValues.back() = value;
+
+  VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+  timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+  timelineInfo.pWaitSemaphoreValues = waitValues.data();
+  timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+  timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+  VkSubmitInfo timelineSubmit = submitInfo;
+  timelineSubmit.pNext = &timelineInfo;
+  timelineSubmit.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+  timelineSubmit.pWaitSemaphores = waitSemaphores.data();
+  timelineSubmit.pWaitDstStageMask = waitStages.data();
+  timelineSubmit.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+  timelineSubmit.pSignalSemaphores = signalSemaphores.data();
+
+  if (vkQueueSubmit(graphicsQueue_, 1, &timelineSubmit, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit to the graphics queue!");
+  }
+
+  graphicsTimelineValue_ = value;
+  return value;
+}
+
+uint64_t Device::completedValue() {
+  if (completedValue_ < graphicsTimelineValue_) {
+    functions_.getSemaphoreCounterValue(device_, graphicsTimeline_, &completedValue_);
+  }
+  return completedValue_;
+}
+
+void Device::waitForValue(uint64_t value) {
+  if (value <= completedValue_) return;
+
+  VkSemaphoreWaitInfoKHR waitInfo = {};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &graphicsTimeline_;
+  waitInfo.pValues = &value;
+  functions_.waitSemaphores(device_, &waitInfo, UINT64_MAX);
+
+  completedValue_ = std::max(completedValue_, value);
+}
+
+void Device::deferDeletion(uint64_t value, std::function<void()> deleter) {
+  deletionQueue_.push(value, std::move(deleter));
+}
+
+void Device::flushDeletions() {
+  if (!deletionQueue_.empty()) {
+    deletionQueue_.flush(completedValue());
+  }
+}
+
 void Device::createSurface() {
-  window.createWindowSurface(instance, &surface_);
+  window->createWindowSurface(instance, &surface_);
 }
 
 bool Device::isDeviceSuitable(VkPhysicalDevice device) {
@@ -207,8 +566,8 @@ bool Device::isDeviceSuitable(VkPhysicalDevice device) {
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() &&
                         !swapChainSupport.presentModes.empty();
@@ -217,8 +576,32 @@ bool Device::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-  return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+  return indices.isComplete(isHeadless()) && extensionsSupported && swapChainAdequate &&
+         supportedFeatures.samplerAnisotropy &&
+         supportsTimelineSemaphore(device);
+}
+
+bool Device::supportsTimelineSemaphore(VkPhysicalDevice device) {
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(device, &deviceProperties);
+  const uint32_t deviceApiVersion =
+      std::min(deviceProperties.apiVersion, instanceApiVersion);
+
+  if (deviceApiVersion < VK_API_VERSION_1_1 ||
+      (deviceApiVersion < VK_API_VERSION_1_2 &&
+       !hasDeviceExtension(device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))) {
+    return false;
+  }
+
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+  timelineSemaphoreFeatures.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  VkPhysicalDeviceFeatures2 supported = {};
+  supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  supported.pNext = &timelineSemaphoreFeatures;
+  vkGetPhysicalDeviceFeatures2(device, &supported);
+
+  return timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
 }
 
 void Device::populateDebugMessengerCreateInfo(
@@ -271,12 +654,13 @@ bool Device::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> Device::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions,
-                                       glfwExtensions + glfwExtensionCount);
+  std::vector<const char *> extensions;
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -328,6 +712,23 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool Device::hasDeviceExtension(VkPhysicalDevice device, const char *extension) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                       nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                       availableExtensions.data());
+
+  for (const auto &available : availableExtensions) {
+    if (strcmp(available.extensionName, extension) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -345,13 +746,15 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-    if (queueFamily.queueCount > 0 && presentSupport) {
-      indices.presentFamily = i;
-      indices.presentFamilyHasValue = true;
+    if (!isHeadless()) {
+      VkBool32 presentSupport = false;
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+      if (queueFamily.queueCount > 0 && presentSupport) {
+        indices.presentFamily = i;
+        indices.presentFamilyHasValue = true;
+      }
     }
-    if (indices.isComplete()) {
+    if (indices.isComplete(isHeadless())) {
       break;
     }
 
@@ -388,6 +791,28 @@ Device::querySwapChainSupport(VkPhysicalDevice device) {
   return details;
 }
 
+VkDeviceSize Device::deviceLocalMemoryUsage() {
+  if (!features_.memoryBudget) {
+    return 0;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+  budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 memoryProperties = {};
+  memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  memoryProperties.pNext = &budget;
+  vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+  VkDeviceSize usage = 0;
+  for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++) {
+    if (memoryProperties.memoryProperties.memoryHeaps[i].flags &
+        VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      usage += budget.heapUsage[i];
+    }
+  }
+  return usage;
+}
+
 VkFormat
 Device::findSupportedFormat(const std::vector<VkFormat> &candidates,
                                 VkImageTiling tiling,
@@ -470,6 +895,12 @@ VkCommandBuffer Device::beginSingleTimeCommands() {
 }
 
 void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+  // Waits for this submission only, not for the frames in flight like vkQueueWaitIdle would.
+  waitForValue(submitSingleTimeCommands(commandBuffer));
+  flushDeletions();
+}
+
+uint64_t Device::submitSingleTimeCommands(VkCommandBuffer commandBuffer) {
   vkEndCommandBuffer(commandBuffer);
 
   VkSubmitInfo submitInfo{};
@@ -477,14 +908,26 @@ void Device::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue_);
+  const uint64_t value = submitGraphics(submitInfo);
+  uploadValue_ = value;
 
-  vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
+  VkCommandPool pool = commandPool;
+  deferDeletion(value, [this, pool, commandBuffer]() {
+    vkFreeCommandBuffers(device_, pool, 1, &commandBuffer);
+  });
+  return value;
 }
 
 void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
                             VkDeviceSize size) {
+  TENG_PROFILE_ZONE("Device::copyBuffer");
+  waitForValue(copyBufferAsync(srcBuffer, dstBuffer, size));
+  flushDeletions();
+}
+
+uint64_t Device::copyBufferAsync(VkBuffer srcBuffer, VkBuffer dstBuffer,
+                                 VkDeviceSize size) {
+  flushDeletions();
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
   VkBufferCopy copyRegion{};
@@ -493,7 +936,7 @@ void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer,
   copyRegion.size = size;
   vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-  endSingleTimeCommands(commandBuffer);
+  return submitSingleTimeCommands(commandBuffer);
 }
 
 void Device::copyBufferToImage(VkBuffer buffer, VkImage image,
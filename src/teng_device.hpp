@@ -1,8 +1,10 @@
 #pragma once
 
 #include "teng_window.hpp"
+#include "teng_deletion_queue.hpp"
 
 // std lib headers
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -20,6 +22,51 @@ struct QueueFamilyIndices {
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+  // A headless device only needs the graphics queue.
+  bool isComplete(bool headless) { return headless ? graphicsFamilyHasValue : isComplete(); }
+};
+
+// Optional capabilities, detected when the device is picked.
+struct DeviceFeatures {
+  // Cull mode, front face, topology and depth test state can be set on the
+  // command buffer (VK_EXT_extended_dynamic_state or Vulkan 1.3).
+  bool extendedDynamicState = false;
+  // Render without VkRenderPass/VkFramebuffer objects (VK_KHR_dynamic_rendering or Vulkan 1.3).
+  bool dynamicRendering = false;
+  // Tag presents with ids and wait for them to reach the display (VK_KHR_present_id and VK_KHR_present_wait).
+  bool presentWait = false;
+  // Per-heap usage and budget can be queried (VK_EXT_memory_budget).
+  bool memoryBudget = false;
+  // Pipeline statistics queries, shader invocation counts for the GPU profiler.
+  bool pipelineStatistics = false;
+  // GPU timestamps can be read together with CLOCK_MONOTONIC, which
+  // std::chrono::steady_clock uses on Linux (VK_EXT_calibrated_timestamps).
+  bool calibratedTimestamps = false;
+  // Valid bits of timestamps written on the graphics queue, 0 when it can't
+  // write them (limits.timestampComputeAndGraphics or the family's timestampValidBits).
+  uint32_t timestampValidBits = 0;
+};
+
+// Entry points that are not exported by the loader on every platform.
+// Null when the matching feature is unavailable.
+struct DeviceFunctions {
+  PFN_vkCmdSetCullModeEXT cmdSetCullMode = nullptr;
+  PFN_vkCmdSetFrontFaceEXT cmdSetFrontFace = nullptr;
+  PFN_vkCmdSetPrimitiveTopologyEXT cmdSetPrimitiveTopology = nullptr;
+  PFN_vkCmdSetDepthTestEnableEXT cmdSetDepthTestEnable = nullptr;
+  PFN_vkCmdSetDepthWriteEnableEXT cmdSetDepthWriteEnable = nullptr;
+  PFN_vkCmdSetDepthCompareOpEXT cmdSetDepthCompareOp = nullptr;
+
+  PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+  PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+
+  PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+
+  PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+
+  // Timeline semaphores are required, these are never null.
+  PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+  PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
 };
 
 class Device {
@@ -31,6 +78,9 @@ public:
 #endif
 
     Device(Window &window);
+    // Headless: no surface, no present queue and no swap chain extension.
+    // Render into an OffscreenTarget instead.
+    Device();
     ~Device();
 
     // Not copyable or movable
@@ -41,9 +91,12 @@ public:
 
     VkCommandPool getCommandPool() { return commandPool; }
     VkDevice device() { return device_; }
+    bool isHeadless() const { return window == nullptr; }
     VkSurfaceKHR surface() { return surface_; }
     VkQueue graphicsQueue() { return graphicsQueue_; }
     VkQueue presentQueue() { return presentQueue_; }
+    const DeviceFeatures &features() const { return features_; }
+    const DeviceFunctions &functions() const { return functions_; }
 
     SwapChainSupportDetails getSwapChainSupport() {
       return querySwapChainSupport(physicalDevice);
@@ -53,17 +106,40 @@ public:
     QueueFamilyIndices findPhysicalQueueFamilies() {
       return findQueueFamilies(physicalDevice);
     }
+    // Device-local memory in use by this process, from VK_EXT_memory_budget.
+    // 0 when the extension is unavailable.
+    VkDeviceSize deviceLocalMemoryUsage();
     VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates,
                                  VkImageTiling tiling,
                                  VkFormatFeatureFlags features);
 
+    // Graphics queue timeline. Every submission through submitGraphics signals
+    // the next value of one timeline semaphore, so a value stands for that
+    // submission and everything submitted before it.
+    uint64_t submitGraphics(const VkSubmitInfo &submitInfo);
+    uint64_t lastSubmittedValue() const { return graphicsTimelineValue_; }
+    uint64_t completedValue();
+    bool hasCompleted(uint64_t value) { return value <= completedValue(); }
+    void waitForValue(uint64_t value);
+
+    // Runs deleter once the timeline has reached value. Values must not
+    // decrease between calls. flushDeletions runs the ones that are due.
+    void deferDeletion(uint64_t value, std::function<void()> deleter);
+    void flushDeletions();
+
     // Buffer Helper Functions
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties, VkBuffer &buffer,
                       VkDeviceMemory &bufferMemory);
     VkCommandBuffer beginSingleTimeCommands();
+    // Blocks until the commands have executed.
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+    // Doesn't block. Returns the timeline value to wait for, later graphics
+    // submissions wait for it on the GPU by themselves.
+    uint64_t submitSingleTimeCommands(VkCommandBuffer commandBuffer);
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    // The source buffer has to stay alive until the returned value has completed.
+    uint64_t copyBufferAsync(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
     void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
                            uint32_t height, uint32_t layerCount);
 
@@ -81,6 +157,8 @@ private:
     void pickPhysicalDevice();
     void createLogicalDevice();
     void createCommandPool();
+    void loadDeviceFunctions();
+    void createGraphicsTimeline();
 
     // helper functions
     bool isDeviceSuitable(VkPhysicalDevice device);
@@ -91,22 +169,34 @@ private:
         VkDebugUtilsMessengerCreateInfoEXT &createInfo);
     void hasGflwRequiredInstanceExtensions();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool hasDeviceExtension(VkPhysicalDevice device, const char *extension);
+    bool supportsTimelineSemaphore(VkPhysicalDevice device);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
     VkInstance instance;
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    Window &window;
+    Window *window = nullptr; // Null when headless.
     VkCommandPool commandPool;
 
     VkDevice device_; // The "logical" GPU
-    VkSurfaceKHR surface_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_;
-    VkQueue presentQueue_;
+    VkQueue presentQueue_ = VK_NULL_HANDLE;
+    DeviceFeatures features_;
+    DeviceFunctions functions_;
+
+    VkSemaphore graphicsTimeline_ = VK_NULL_HANDLE;
+    uint64_t graphicsTimelineValue_ = 0; // Last value a submission will signal.
+    uint64_t completedValue_ = 0;        // Last value seen completed, saves queries.
+    uint64_t uploadValue_ = 0;           // Last upload, frames wait for it on the GPU.
+    DeletionQueue deletionQueue_;
 
     const std::vector<const char *> validationLayers = {
         "VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char *> deviceExtensions = {
+    // Required ones, empty when headless.
+    std::vector<const char *> deviceExtensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 };
 
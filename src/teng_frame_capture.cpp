@@ -0,0 +1,274 @@
+#include "teng_frame_capture.hpp"
+#include "teng_profiler.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace teng {
+
+    FrameCapture::FrameCapture(Device& device, Renderer& renderer, CaptureSettings settings)
+        : mr_Device(device),
+          mr_Renderer(renderer),
+          m_Settings(std::move(settings))
+    {
+        if(renderer.getOffscreenTarget() == nullptr) {
+            throw std::runtime_error("FrameCapture: needs a headless renderer");
+        }
+
+        m_Extent = renderer.getExtent();
+        const VkDeviceSize pixels = static_cast<VkDeviceSize>(m_Extent.width) * m_Extent.height;
+        m_ColorSize = pixels * 4; // OffscreenTarget::COLOR_FORMAT is RGBA8.
+        m_DepthSize = m_Settings.depth ? pixels * 4 : 0;
+        m_Settings.maxQueuedFrames = std::max(m_Settings.maxQueuedFrames, 1u);
+
+        if(m_Settings.format == CaptureFormat::Raw) {
+            m_RawColor.open(m_Settings.outputPrefix + ".rgba", std::ios::binary | std::ios::trunc);
+            if(!m_RawColor) {
+                throw std::runtime_error("FrameCapture: failed to open " + m_Settings.outputPrefix + ".rgba");
+            }
+        }
+        if(m_Settings.depth) {
+            m_RawDepth.open(m_Settings.outputPrefix + "_depth.raw", std::ios::binary | std::ios::trunc);
+            if(!m_RawDepth) {
+                throw std::runtime_error("FrameCapture: failed to open " + m_Settings.outputPrefix + "_depth.raw");
+            }
+        }
+
+        m_CreateSlots(renderer.getFramesInFlight());
+        m_Writer = std::thread([this]() { m_WriterLoop(); });
+    }
+
+    FrameCapture::~FrameCapture() {
+        finish();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_QueueChanged.notify_all();
+        m_Writer.join();
+    }
+
+    void FrameCapture::m_CreateSlots(uint32_t count) {
+        m_Slots.clear();
+        m_Slots.resize(count);
+        for(auto& slot : m_Slots) {
+            slot.color = std::make_unique<Buffer>(
+                mr_Device, m_ColorSize, 1,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            slot.color->map();
+            if(m_DepthSize > 0) {
+                slot.depth = std::make_unique<Buffer>(
+                    mr_Device, m_DepthSize, 1,
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                slot.depth->map();
+            }
+        }
+    }
+
+    void FrameCapture::captureFrame(VkCommandBuffer commandBuffer) {
+        assert(mr_Renderer.isFrameInProgress() && "captureFrame needs a frame in progress");
+        assert(mr_Renderer.getExtent().width == m_Extent.width && mr_Renderer.getExtent().height == m_Extent.height);
+
+        // A new present policy may have changed the frames in flight. The renderer
+        // drained the GPU for it, so everything pending has retired by now.
+        if(m_Slots.size() != mr_Renderer.getFramesInFlight()) {
+            collect();
+            m_CreateSlots(mr_Renderer.getFramesInFlight());
+        }
+
+        collect();
+
+        // The scheduler waited for the slot's previous frame before this one
+        // started, so collect has freed the slot.
+        Slot& slot = m_Slots[mr_Renderer.getCurrentFrameIndex()];
+        assert(!slot.pending && "capture slot still holds an uncollected frame");
+
+        m_RecordCopies(commandBuffer, slot);
+        slot.frame = mr_Renderer.getFrameCount();
+        slot.index = m_FramesCaptured++;
+        slot.pending = true;
+    }
+
+    void FrameCapture::m_RecordCopies(VkCommandBuffer commandBuffer, Slot& slot) {
+        OffscreenTarget& target = *mr_Renderer.getOffscreenTarget();
+        const uint32_t imageIndex = mr_Renderer.getCurrentImageIndex();
+
+        // The color image is already a transfer source at the end of the frame.
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0; // Tightly packed.
+        region.bufferImageHeight = 0;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {m_Extent.width, m_Extent.height, 1};
+        vkCmdCopyImageToBuffer(
+            commandBuffer,
+            target.getImage(imageIndex),
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            slot.color->getBuffer(),
+            1, &region);
+
+        if(slot.depth) {
+            // Depth stays an attachment after the pass. Its next use starts from
+            // an undefined layout, so it can be left a transfer source.
+            VkImageMemoryBarrier depthBarrier{};
+            depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            depthBarrier.image = target.getDepthImage(imageIndex);
+            depthBarrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+            depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            depthBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            depthBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            const VkFormat depthFormat = target.getDepthFormat();
+            if(depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+                depthBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+            }
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+            region.imageSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+            vkCmdCopyImageToBuffer(
+                commandBuffer,
+                target.getDepthImage(imageIndex),
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                slot.depth->getBuffer(),
+                1, &region);
+        }
+
+        // Make the copies visible to the host once the frame's timeline value is reached.
+        VkMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void FrameCapture::collect() {
+        // Frames retire in submission order, so collect oldest first and stop at
+        // the first one still in flight.
+        for(;;) {
+            Slot* oldest = nullptr;
+            for(auto& slot : m_Slots) {
+                if(slot.pending && (oldest == nullptr || slot.frame < oldest->frame)) {
+                    oldest = &slot;
+                }
+            }
+            if(oldest == nullptr || !mr_Renderer.isFrameComplete(oldest->frame)) {
+                return;
+            }
+            m_CollectSlot(*oldest);
+        }
+    }
+
+    void FrameCapture::m_CollectSlot(Slot& slot) {
+        Image image;
+        {
+            // Back-pressure: wait for the writer rather than drop frames.
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_QueueChanged.wait(lock, [this]() { return m_Queue.size() < m_Settings.maxQueuedFrames; });
+            if(!m_FreeImages.empty()) {
+                image = std::move(m_FreeImages.back());
+                m_FreeImages.pop_back();
+            }
+        }
+
+        image.index = slot.index;
+        image.color.resize(m_ColorSize);
+        std::memcpy(image.color.data(), slot.color->getMappedMemory(), m_ColorSize);
+        if(slot.depth) {
+            image.depth.resize(m_DepthSize);
+            std::memcpy(image.depth.data(), slot.depth->getMappedMemory(), m_DepthSize);
+        }
+        slot.pending = false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Queue.push_back(std::move(image));
+        }
+        m_QueueChanged.notify_all();
+    }
+
+    void FrameCapture::finish() {
+        for(auto& slot : m_Slots) {
+            if(slot.pending) {
+                mr_Renderer.waitForFrame(slot.frame);
+            }
+        }
+        collect();
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_QueueChanged.wait(lock, [this]() { return m_Queue.empty() && !m_Writing; });
+    }
+
+    uint64_t FrameCapture::framesWritten() const {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_FramesWritten;
+    }
+
+    void FrameCapture::m_WriterLoop() {
+        TENG_PROFILE_THREAD("capture writer");
+        for(;;) {
+            Image image;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_QueueChanged.wait(lock, [this]() { return m_Stop || !m_Queue.empty(); });
+                if(m_Queue.empty()) {
+                    return;
+                }
+                image = std::move(m_Queue.front());
+                m_Queue.pop_front();
+                m_Writing = true;
+            }
+            m_QueueChanged.notify_all();
+
+            m_Write(image);
+
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_FreeImages.push_back(std::move(image));
+                m_FramesWritten++;
+                m_Writing = false;
+            }
+            m_QueueChanged.notify_all();
+        }
+    }
+
+    void FrameCapture::m_Write(const Image& image) {
+        TENG_PROFILE_ZONE("FrameCapture::write");
+        const int width = static_cast<int>(m_Extent.width);
+        const int height = static_cast<int>(m_Extent.height);
+
+        if(m_Settings.format == CaptureFormat::Png) {
+            char suffix[32];
+            std::snprintf(suffix, sizeof(suffix), "_%06llu.png", static_cast<unsigned long long>(image.index));
+            const std::string path = m_Settings.outputPrefix + suffix;
+            if(!stbi_write_png(path.c_str(), width, height, 4, image.color.data(), width * 4)) {
+                std::cerr << "FrameCapture: failed to write " << path << std::endl;
+            }
+        } else {
+            m_RawColor.write(reinterpret_cast<const char*>(image.color.data()), static_cast<std::streamsize>(image.color.size()));
+        }
+
+        if(m_Settings.depth) {
+            m_RawDepth.write(reinterpret_cast<const char*>(image.depth.data()), static_cast<std::streamsize>(image.depth.size()));
+        }
+    }
+} // namespace teng
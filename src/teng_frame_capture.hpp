@@ -0,0 +1,108 @@
+#pragma once
+
+#include "teng_renderer.hpp"
+#include "teng_buffer.hpp"
+
+// std
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace teng {
+
+    enum class CaptureFormat {
+        Png, // One <prefix>_<index>.png per frame.
+        Raw, // All frames appended to <prefix>.rgba, tightly packed RGBA8 rows.
+    };
+
+    struct CaptureSettings {
+        std::string outputPrefix{"capture"};
+        CaptureFormat format{CaptureFormat::Png};
+        // Also write the depth attachment, as 32-bit floats (or D24 in the low
+        // bits of 32) appended to <prefix>_depth.raw.
+        bool depth{false};
+        // Frames read back but not yet written. When the encoder falls this far
+        // behind, captureFrame blocks instead of dropping frames.
+        uint32_t maxQueuedFrames{8};
+    };
+
+    // Reads rendered frames back without stalling. Each frame in flight has a
+    // host-visible buffer the frame's images are copied into at the end of
+    // its command buffer. The copy is collected once the frame has retired,
+    // which happens on its own frames in flight later, and handed to a thread
+    // that encodes and writes it. Needs a headless Renderer, swap chain
+    // images can't be copied from.
+    class FrameCapture {
+
+        public:
+
+            FrameCapture(Device& device, Renderer& renderer, CaptureSettings settings = {});
+            ~FrameCapture();
+
+            FrameCapture(const FrameCapture&) = delete;
+            FrameCapture &operator=(const FrameCapture&) = delete;
+
+            // Records the copies of the frame being rendered. Call after
+            // endSwapChainRenderPass and before endFrame.
+            void captureFrame(VkCommandBuffer commandBuffer);
+            // Hands retired frames to the writer without waiting on the GPU. captureFrame does this too.
+            void collect();
+            // Waits for every captured frame to be read back and written. Not
+            // while a frame is in progress, its copies haven't been submitted.
+            void finish();
+
+            uint64_t framesCaptured() const { return m_FramesCaptured; };
+            uint64_t framesWritten() const;
+
+        private:
+
+            struct Slot {
+                std::unique_ptr<Buffer> color;
+                std::unique_ptr<Buffer> depth;
+                uint64_t frame{0};    // Renderer frame number the copy belongs to.
+                uint64_t index{0};    // Capture sequence number.
+                bool pending{false};
+            };
+
+            struct Image {
+                uint64_t index{0};
+                std::vector<uint8_t> color;
+                std::vector<uint8_t> depth;
+            };
+
+            void m_CreateSlots(uint32_t count);
+            void m_CollectSlot(Slot& slot);
+            void m_RecordCopies(VkCommandBuffer commandBuffer, Slot& slot);
+            void m_WriterLoop();
+            void m_Write(const Image& image);
+
+            Device& mr_Device;
+            Renderer& mr_Renderer;
+            CaptureSettings m_Settings;
+            VkExtent2D m_Extent{};
+            VkDeviceSize m_ColorSize{0};
+            VkDeviceSize m_DepthSize{0};
+            std::vector<Slot> m_Slots; // Indexed by frame slot.
+            uint64_t m_FramesCaptured{0};
+
+            // Shared with the writer thread.
+            mutable std::mutex m_Mutex;
+            std::condition_variable m_QueueChanged;
+            std::deque<Image> m_Queue;
+            std::vector<Image> m_FreeImages; // Recycled so steady capture doesn't allocate.
+            uint64_t m_FramesWritten{0};
+            bool m_Writing{false};
+            bool m_Stop{false};
+            std::thread m_Writer;
+
+            // Only used by the writer thread.
+            std::ofstream m_RawColor;
+            std::ofstream m_RawDepth;
+    };
+} // namespace teng
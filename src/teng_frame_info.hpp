@@ -1,16 +1,35 @@
 #pragma once
 
 #include "camera.hpp"
+#include "teng_pipeline.hpp"
 
 #include <vulkan/vulkan.h>
 
 namespace teng {
 
+    class GpuProfiler;
+
+    struct PointLight {
+        glm::vec4 position{0.f};
+        glm::vec4 color{0.f}; // w is intensity, zero leaves the light off.
+    };
+
+    // Global data for shaders
+    struct GlobalUBO {
+        glm::mat4 projectionView{1.f}; // 4*4*4 = 4*16, alignment ok
+        glm::vec4 ambientLightColor{1.0f, 1.0f, 1.0f, 0.1f};
+        // How many of these are read is baked into the pipeline, see ShaderVariant::lightCount.
+        PointLight pointLights[ShaderVariant::MAX_POINT_LIGHTS]{
+            {{-1.f, -1.f, -1.f, 0.f}, {0.8f, 0.8f, 0.8f, 10.0f}}};
+        glm::float32 time{0.f};
+    };
+
     struct FrameInfo {
         int             backFrame;
         float           frameTime;
         VkCommandBuffer commandBuffer;
         Camera&         camera;
         VkDescriptorSet globalDescriptorSet;
+        GpuProfiler*    gpuProfiler{nullptr}; // Null unless GPU profiling is on.
     };
 }
@@ -0,0 +1,120 @@
+#include "teng_frame_pacer.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace teng {
+
+    namespace {
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+
+        // sleep_until overshoots by up to a scheduler tick, so the tail is spun.
+        void sleepUntil(FramePacer::Clock::time_point time) {
+            const auto spinFrom = time - std::chrono::milliseconds{1};
+            if(FramePacer::Clock::now() < spinFrom) {
+                std::this_thread::sleep_until(spinFrom);
+            }
+            while(FramePacer::Clock::now() < time) {
+                std::this_thread::yield();
+            }
+        }
+
+        double percentile(std::vector<double>& sorted, double p) {
+            return sorted[static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5)];
+        }
+    }
+
+    FramePacer::FramePacer(double refreshPeriodMs, bool enabled)
+        : m_Enabled(enabled),
+          m_RefreshPeriodMs(refreshPeriodMs),
+          m_LastReport(Clock::now())
+    {
+        m_WorkMs.reserve(HISTORY);
+    }
+
+    double FramePacer::m_FrameWorkEstimateMs() const {
+        if(m_WorkMs.empty()) return m_RefreshPeriodMs / 2.0;
+
+        // The slow end of recent frames, the average would miss every other vblank.
+        std::vector<double> sorted = m_WorkMs;
+        std::sort(sorted.begin(), sorted.end());
+        return percentile(sorted, 0.9);
+    };
+
+    void FramePacer::waitForFrameStart(SwapChain& swapChain) {
+        if(m_WaitedThisFrame) return;
+        m_WaitedThisFrame = true;
+
+        // Unpaced frames must not block on the display.
+        const bool presentWait = m_Enabled && m_PreviousPresentId != 0 &&
+            swapChain.waitForPresent(m_PreviousPresentId, 100'000'000); // 100ms, don't hang on a hidden window.
+
+        if(presentWait) {
+            const auto displayed = Clock::now();
+            m_DeltasFromDisplay = true;
+            m_RecordDelta(displayed);
+
+            const double budget = m_FrameWorkEstimateMs() + m_MarginMs;
+            if(budget < m_RefreshPeriodMs) {
+                sleepUntil(displayed + std::chrono::duration_cast<Clock::duration>(Milliseconds{m_RefreshPeriodMs - budget}));
+            }
+        } else if(m_Enabled && m_HasLastTick) {
+            sleepUntil(m_LastTick + std::chrono::duration_cast<Clock::duration>(Milliseconds{m_RefreshPeriodMs}));
+        }
+
+        m_FrameStart = Clock::now();
+        if(!presentWait) {
+            m_DeltasFromDisplay = false;
+            m_RecordDelta(m_FrameStart);
+        }
+
+        if(m_FrameStart - m_LastReport >= std::chrono::seconds{5}) {
+            m_Report(m_FrameStart);
+        }
+    };
+
+    void FramePacer::frameSubmitted(uint64_t presentId) {
+        const double workMs = Milliseconds(Clock::now() - m_FrameStart).count();
+        if(m_WorkMs.size() < HISTORY) {
+            m_WorkMs.push_back(workMs);
+        } else {
+            m_WorkMs[m_WorkNext] = workMs;
+        }
+        m_WorkNext = (m_WorkNext + 1) % HISTORY;
+
+        m_PreviousPresentId = presentId;
+        m_WaitedThisFrame = false;
+    };
+
+    void FramePacer::m_RecordDelta(Clock::time_point time) {
+        if(m_HasLastTick) {
+            const double deltaMs = Milliseconds(time - m_LastTick).count();
+            m_Deltas.push_back(deltaMs);
+
+            // A delta well over one period means a vblank was missed.
+            if(deltaMs > 1.5 * m_RefreshPeriodMs) {
+                m_MarginMs = std::min(m_MarginMs + 0.5, m_RefreshPeriodMs);
+            } else {
+                m_MarginMs = std::max(m_MarginMs - 0.01, MIN_MARGIN_MS);
+            }
+        }
+        m_LastTick = time;
+        m_HasLastTick = true;
+    };
+
+    void FramePacer::m_Report(Clock::time_point now) {
+        m_LastReport = now;
+        if(m_Deltas.empty()) return;
+
+        std::sort(m_Deltas.begin(), m_Deltas.end());
+        const double p50 = percentile(m_Deltas, 0.50);
+        const double p99 = percentile(m_Deltas, 0.99);
+        std::cout << "frame delta ms (" << (m_DeltasFromDisplay ? "display" : "frame start") << "):"
+                  << " p50 " << p50
+                  << " p99 " << p99
+                  << " jitter " << p99 - p50
+                  << (m_Enabled ? " paced" : "") << "\n";
+        m_Deltas.clear();
+    };
+} // namespace teng
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "teng_swap_chain.hpp"
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace teng {
+
+    // Starts CPU work just in time for the next vblank, so frames reach the
+    // display at an even cadence instead of whenever the queue lets them.
+    //
+    // With VK_KHR_present_wait it waits for the previous frame to reach the
+    // display, which gives the vblank time, and sleeps until the vblank after
+    // that minus the expected frame time. Without it, a predictor keeps starting
+    // frames one refresh period apart. The safety margin grows when a frame
+    // misses its vblank and slowly shrinks again otherwise.
+    //
+    // Paced or not, it reports p50/p99 frame-to-frame deltas every few seconds.
+    // Paced with present wait they are measured at the display, otherwise at
+    // frame start, since unpaced frames don't wait for the display.
+    class FramePacer {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+
+            FramePacer(double refreshPeriodMs, bool enabled = false);
+
+            void setEnabled(bool enabled) { m_Enabled = enabled; };
+            bool isEnabled() const { return m_Enabled; };
+
+            // Waits and sleeps as described above, once per frame. Later calls for the same frame return right away.
+            void waitForFrameStart(SwapChain& swapChain);
+            // Present ids restart with a new swap chain, the next frame can't wait on the last one.
+            // The frame that found the old one out of date ends here without frameSubmitted, so the
+            // next one is paced and timed afresh.
+            void swapChainRecreated() {
+                m_PreviousPresentId = 0;
+                m_WaitedThisFrame = false;
+            };
+            void frameSubmitted(uint64_t presentId);
+
+        private:
+
+            void m_RecordDelta(Clock::time_point time);
+            void m_Report(Clock::time_point now);
+            double m_FrameWorkEstimateMs() const;
+
+            static constexpr size_t HISTORY = 64;
+            static constexpr double MIN_MARGIN_MS = 0.5;
+
+            bool m_Enabled;
+            bool m_WaitedThisFrame{false};
+            double m_RefreshPeriodMs;
+            double m_MarginMs{2.0};
+
+            uint64_t m_PreviousPresentId{0};
+            Clock::time_point m_FrameStart{};
+            Clock::time_point m_LastTick{}; // Last display time with present wait, last frame start otherwise.
+            bool m_HasLastTick{false};
+
+            std::vector<double> m_WorkMs;  // Frame start to submit, the last HISTORY frames.
+            size_t m_WorkNext{0};
+            std::vector<double> m_Deltas;  // Frame-to-frame deltas since the last report.
+            Clock::time_point m_LastReport;
+            bool m_DeltasFromDisplay{false};
+    };
+} // namespace teng
@@ -0,0 +1,55 @@
+#include "teng_frame_scheduler.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace teng {
+
+    FrameScheduler::FrameScheduler(Device& device, uint32_t framesInFlight, uint32_t latencyLimit)
+        : mr_Device(device),
+          m_FrameValues(std::max(framesInFlight, 1u), 0),
+          m_LatencyLimit(latencyLimit)
+    {
+    }
+
+    void FrameScheduler::setFramesInFlight(uint32_t framesInFlight) {
+        assert(mr_Device.hasCompleted(mr_Device.lastSubmittedValue()) && "frames in flight can only change while the GPU is idle");
+
+        m_FrameValues.assign(std::max(framesInFlight, 1u), 0);
+        m_RetiredBefore = m_SubmittedFrames;
+    };
+
+    uint32_t FrameScheduler::framesAhead() const {
+        if(m_LatencyLimit == 0) return framesInFlight();
+        return std::min(m_LatencyLimit, framesInFlight());
+    };
+
+    void FrameScheduler::waitForFrameStart() {
+        const uint32_t ahead = framesAhead();
+        if(m_SubmittedFrames >= ahead) {
+            waitForFrame(m_SubmittedFrames - ahead);
+        }
+    };
+
+    void FrameScheduler::frameSubmitted(uint64_t timelineValue) {
+        m_FrameValues[frameSlot()] = timelineValue;
+        m_SubmittedFrames++;
+    };
+
+    bool FrameScheduler::hasRetired(uint64_t frame) const {
+        if(frame >= m_SubmittedFrames) return false;
+        if(frame < m_RetiredBefore) return true;
+
+        // Its slot was reused, and frame + framesInFlight only started after waiting for it.
+        if(m_SubmittedFrames - frame > framesInFlight()) return true;
+
+        return mr_Device.hasCompleted(m_FrameValues[frame % framesInFlight()]);
+    };
+
+    void FrameScheduler::waitForFrame(uint64_t frame) {
+        assert(frame < m_SubmittedFrames && "waiting for a frame that was never submitted");
+        if(hasRetired(frame)) return;
+
+        mr_Device.waitForValue(m_FrameValues[frame % framesInFlight()]);
+    };
+} // namespace teng
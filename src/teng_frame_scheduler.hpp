@@ -0,0 +1,53 @@
+#pragma once
+
+#include "teng_device.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace teng {
+
+    // Paces frames on the graphics queue timeline. Frames are numbered from 0
+    // in submission order and frame N may only start once frame N - k has
+    // retired, where k is the frames in flight or the tighter latency limit.
+    // Other subsystems ask hasRetired instead of holding on to fences.
+    class FrameScheduler {
+
+        public:
+
+            FrameScheduler(Device& device, uint32_t framesInFlight, uint32_t latencyLimit = 0);
+
+            FrameScheduler(const FrameScheduler&) = delete;
+            FrameScheduler &operator=(const FrameScheduler&) = delete;
+
+            // Only while nothing is in flight, per-frame resources have to be resized to match.
+            void setFramesInFlight(uint32_t framesInFlight);
+            // Any time. 0 or anything >= framesInFlight only keeps the frames in flight limit.
+            void setLatencyLimit(uint32_t latencyLimit) { m_LatencyLimit = latencyLimit; };
+
+            uint32_t framesInFlight() const { return static_cast<uint32_t>(m_FrameValues.size()); };
+            // How many frames the GPU may be behind when a frame starts.
+            uint32_t framesAhead() const;
+
+            // Number of the frame being recorded, which is also the number of frames submitted.
+            uint64_t currentFrame() const { return m_SubmittedFrames; };
+            // Index of the per-frame resources of the current frame.
+            uint32_t frameSlot() const { return static_cast<uint32_t>(m_SubmittedFrames % framesInFlight()); };
+
+            // Blocks until the current frame may start. Cheap when it already may.
+            void waitForFrameStart();
+            void frameSubmitted(uint64_t timelineValue);
+
+            bool hasRetired(uint64_t frame) const;
+            void waitForFrame(uint64_t frame);
+
+        private:
+
+            Device& mr_Device;
+            std::vector<uint64_t> m_FrameValues; // Timeline value of each slot's last frame.
+            uint64_t m_SubmittedFrames{0};
+            uint64_t m_RetiredBefore{0}; // Frames before this retired before a setFramesInFlight.
+            uint32_t m_LatencyLimit{0};
+    };
+} // namespace teng
@@ -1,8 +1,24 @@
 #include "teng_game_object.hpp"
 
+// std
+#include <atomic>
+
 namespace teng {
 
+        GameObject::id_t GameObject::s_NextId() {
+            static std::atomic<id_t> nextId{0};
+            return nextId.fetch_add(1, std::memory_order_relaxed);
+        }
+
         glm::mat4 TransformComponent::mat4() {
+            return s_Mat4(translation, rotation, scale);
+        }
+
+        glm::mat3 TransformComponent::normalMatrix() {
+            return s_NormalMatrix(rotation, scale);
+        }
+
+        glm::mat4 TransformComponent::s_Mat4(const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale) {
             const float c3 = glm::cos(rotation.z);
             const float s3 = glm::sin(rotation.z);
             const float c2 = glm::cos(rotation.x);
@@ -37,7 +53,7 @@ namespace teng {
      * Normals cannot simply be transformed using the model matrix, see: https://paroj.github.io/gltut/Illumination/Tut09%20Normal%20Transformation.html
      * Note: This can be avoided if the engine only allows for uniform scaling.
      */
-        glm::mat3 TransformComponent::normalMatrix() {
+        glm::mat3 TransformComponent::s_NormalMatrix(const glm::vec3& rotation, const glm::vec3& scale) {
 
             const float c3 = glm::cos(rotation.z);
             const float s3 = glm::sin(rotation.z);
@@ -65,4 +81,10 @@ namespace teng {
                 },
             };
         }
+
+        glm::quat TransformComponent::s_Orientation(const glm::vec3& rotation) {
+            return glm::angleAxis(rotation.y, glm::vec3{0.f, 1.f, 0.f}) *
+                   glm::angleAxis(rotation.x, glm::vec3{1.f, 0.f, 0.f}) *
+                   glm::angleAxis(rotation.z, glm::vec3{0.f, 0.f, 1.f});
+        }
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include "teng_model.hpp"
+#include "teng_slot_map.hpp"
 #include <memory>
 
 namespace teng {
@@ -21,21 +23,28 @@ namespace teng {
         // Uses Tait-Bryan angles
         glm::mat4 mat4();
         glm::mat3 normalMatrix();
+
+        // The same, for transforms kept in separate arrays, see Registry.
+        static glm::mat4 s_Mat4(const glm::vec3& translation, const glm::vec3& rotation, const glm::vec3& scale);
+        static glm::mat3 s_NormalMatrix(const glm::vec3& rotation, const glm::vec3& scale);
+        // The same rotation as a quaternion, for Registry::setOrientation.
+        static glm::quat s_Orientation(const glm::vec3& rotation);
     };
 
+    // Keep many in a GameObjectPool, whose handles stay valid while the
+    // objects move around in it.
     class GameObject {
 
         public:
             using id_t = unsigned int;
 
+            // Both draw from one counter, so ids are unique, also across threads.
             static GameObject CreateGameObject() {
-                static id_t id = 0;
-                return GameObject{id++};
+                return GameObject{s_NextId()};
             };
 
             static GameObject CreateGameObject(float mass) {
-                static id_t id = 0;
-                return GameObject{id++, mass};
+                return GameObject{s_NextId(), mass};
             };
 
             // Delete copy constructor.
@@ -62,6 +71,8 @@ namespace teng {
 
         private:
 
+            static id_t s_NextId();
+
             // Private constructor so that we can control the id's of game objects.
             GameObject(id_t objId) : id{objId} {};
 
@@ -71,4 +82,7 @@ namespace teng {
 
             id_t id;
     };
+
+    // GameObjects by handle, e.g. pool.create(GameObject::CreateGameObject()).
+    using GameObjectPool = SlotMap<GameObject>;
 }
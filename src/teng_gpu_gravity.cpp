@@ -0,0 +1,217 @@
+#include "teng_gpu_gravity.hpp"
+#include "teng_gpu_profiler.hpp"
+#include "teng_pipeline.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <vector>
+
+namespace teng {
+
+    // Public
+    GpuGravitySystem::GpuGravitySystem(
+        Device& r_Device,
+        const glm::vec3* positions,
+        const glm::vec3* velocities,
+        const float* masses,
+        uint32_t count,
+        const GravitySystem::Settings& settings)
+        : mr_Device{r_Device}, m_Settings{settings}, m_BodyCount{count}
+    {
+        assert(count > 0 && "GpuGravitySystem needs at least one body.");
+        assert(settings.softening > 0.f && "GpuGravitySystem needs a positive softening.");
+
+        const VkPhysicalDeviceLimits& limits = mr_Device.properties.limits;
+        m_WorkgroupSize = std::min({WORKGROUP_SIZE, limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations});
+
+        m_CreateBuffers(positions, velocities, masses);
+        m_CreateDescriptors();
+        m_CreatePipeline();
+    }
+
+    GpuGravitySystem::~GpuGravitySystem() {
+        vkDestroyPipeline(mr_Device.device(), mp_Pipeline, nullptr);
+        vkDestroyPipelineLayout(mr_Device.device(), mp_PipelineLayout, nullptr);
+    };
+
+    void GpuGravitySystem::recordStep(VkCommandBuffer commandBuffer, float dt, GpuProfiler* profiler) {
+        GpuProfiler::Scope gpuScope{profiler, commandBuffer, "gravity", false};
+
+        // The step reads what the previous one wrote and overwrites what the
+        // draws after it read, both earlier on the queue.
+        VkMemoryBarrier before{};
+        before.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        before.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        before.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            1, &before,
+            0, nullptr,
+            0, nullptr);
+
+        const StepConstants constants{
+            m_BodyCount,
+            dt,
+            .5f * (m_PreviousDt + dt),
+            m_Settings.gravitationalConstant,
+            m_Settings.softening * m_Settings.softening};
+        m_PreviousDt = dt;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mp_Pipeline);
+        vkCmdBindDescriptorSets(
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_COMPUTE,
+            mp_PipelineLayout,
+            0,
+            1,
+            &m_DescriptorSets[m_Latest],
+            0,
+            nullptr);
+        vkCmdPushConstants(commandBuffer, mp_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (m_BodyCount + m_WorkgroupSize - 1) / m_WorkgroupSize, 1, 1);
+        m_Latest = 1 - m_Latest;
+
+        // This frame's draws read the new positions.
+        VkMemoryBarrier after{};
+        after.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        after.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        after.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            0,
+            1, &after,
+            0, nullptr,
+            0, nullptr);
+    };
+
+    // Private
+    void GpuGravitySystem::m_CreateBuffers(const glm::vec3* positions, const glm::vec3* velocities, const float* masses) {
+        TENG_PROFILE_ZONE("GpuGravitySystem::m_CreateBuffers");
+
+        std::vector<glm::vec4> packedPositions(m_BodyCount);
+        std::vector<glm::vec4> packedVelocities(m_BodyCount);
+        for(uint32_t i = 0; i < m_BodyCount; i++) {
+            packedPositions[i] = glm::vec4{positions[i], masses[i]};
+            packedVelocities[i] = glm::vec4{velocities[i], 0.f};
+        }
+
+        // Shared so that it can outlive this call until the copies have completed.
+        auto stagingBuffer = std::make_shared<Buffer>(
+            mr_Device,
+            sizeof(glm::vec4),
+            2 * m_BodyCount,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        const VkDeviceSize size = sizeof(glm::vec4) * m_BodyCount;
+        stagingBuffer->map();
+        stagingBuffer->writeToBuffer(packedPositions.data(), size, 0);
+        stagingBuffer->writeToBuffer(packedVelocities.data(), size, size);
+
+        auto deviceBuffer = [&]() {
+            return std::make_unique<Buffer>(
+                mr_Device,
+                sizeof(glm::vec4),
+                m_BodyCount,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        };
+        m_Positions[0] = deviceBuffer();
+        m_Positions[1] = deviceBuffer();
+        mp_Velocities = deviceBuffer();
+
+        // Both positions buffers start out the same, whichever one is drawn
+        // before the first step. Frames wait for the copies on the GPU.
+        VkCommandBuffer commandBuffer = mr_Device.beginSingleTimeCommands();
+        VkBufferCopy region{0, 0, size};
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer->getBuffer(), m_Positions[0]->getBuffer(), 1, &region);
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer->getBuffer(), m_Positions[1]->getBuffer(), 1, &region);
+        region.srcOffset = size;
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer->getBuffer(), mp_Velocities->getBuffer(), 1, &region);
+        const uint64_t uploadValue = mr_Device.submitSingleTimeCommands(commandBuffer);
+        mr_Device.deferDeletion(uploadValue, [stagingBuffer]() mutable { stagingBuffer.reset(); });
+    };
+
+    void GpuGravitySystem::m_CreateDescriptors() {
+        // 0: positions read, 1: positions written and drawn, 2: velocities.
+        mp_SetLayout = DescriptorSetLayout::Builder(mr_Device)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT)
+            .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .build();
+        mp_DescriptorPool = DescriptorPool::Builder(mr_Device)
+            .setMaxSets(2)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6)
+            .build();
+
+        for(uint32_t i = 0; i < 2; i++) {
+            auto sourceInfo = m_Positions[i]->descriptorInfo();
+            auto destinationInfo = m_Positions[1 - i]->descriptorInfo();
+            auto velocityInfo = mp_Velocities->descriptorInfo();
+            const bool built = DescriptorWriter(*mp_SetLayout, *mp_DescriptorPool)
+                .writeBuffer(0, &sourceInfo)
+                .writeBuffer(1, &destinationInfo)
+                .writeBuffer(2, &velocityInfo)
+                .build(m_DescriptorSets[i]);
+            if(!built) {
+                throw std::runtime_error("failed to allocate gravity descriptor set");
+            }
+        }
+    };
+
+    void GpuGravitySystem::m_CreatePipeline() {
+        TENG_PROFILE_ZONE("GpuGravitySystem::m_CreatePipeline");
+
+        const VkDescriptorSetLayout setLayout = mp_SetLayout->getDescriptorSetLayout();
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(StepConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &setLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if(vkCreatePipelineLayout(mr_Device.device(), &pipelineLayoutInfo, nullptr, &mp_PipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gravity pipeline layout");
+        }
+
+        // A single small shader, compiled here rather than through the
+        // PipelineManager, which only makes graphics pipelines.
+        VkShaderModule shaderModule;
+        Pipeline::s_CreateShaderModule(mr_Device, Pipeline::s_ReadFile("shaders/gravity.comp.spv"), &shaderModule);
+
+        // constant_id 0 is the workgroup size, which also sizes the shared tile.
+        const VkSpecializationMapEntry specializationEntry{0, 0, sizeof(uint32_t)};
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = 1;
+        specializationInfo.pMapEntries = &specializationEntry;
+        specializationInfo.dataSize = sizeof(m_WorkgroupSize);
+        specializationInfo.pData = &m_WorkgroupSize;
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+        pipelineInfo.layout = mp_PipelineLayout;
+        pipelineInfo.basePipelineIndex = -1;
+
+        const VkResult result = vkCreateComputePipelines(mr_Device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mp_Pipeline);
+        vkDestroyShaderModule(mr_Device.device(), shaderModule, nullptr);
+        if(result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gravity compute pipeline");
+        }
+    };
+} // namespace teng
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "teng_device.hpp"
+#include "teng_buffer.hpp"
+#include "teng_descriptors.hpp"
+#include "teng_gravity.hpp"
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace teng {
+
+    class GpuProfiler;
+
+    // Newtonian gravity between bodies that live on the GPU. Positions, with the
+    // mass in w, and velocities are storage buffers that a compute shader
+    // (shaders/gravity.comp) integrates in place, and that RenderSystem::m_RenderGrav
+    // draws from directly: after the upload nothing about the bodies goes
+    // through the CPU again.
+    //
+    // Every pair is summed. Each workgroup streams all bodies through shared
+    // memory one tile of WORKGROUP_SIZE at a time, so a body is read from
+    // memory once per workgroup instead of once per invocation. That is
+    // O(n^2), but with n^2 / WORKGROUP_SIZE reads it keeps a GPU busy up to
+    // hundreds of thousands of bodies; the CPU GravitySystem's tree is what
+    // scales beyond.
+    //
+    // Steps are recorded into a frame's command buffer, on the graphics queue
+    // the renderer submits to, before its render pass. Barriers order them
+    // after the previous step and the draws reading it, and before this
+    // frame's draws, so frames in flight need nothing else.
+    class GpuGravitySystem {
+
+        public:
+
+            // Invocations per workgroup and bodies per tile, lowered to what the device allows.
+            static constexpr uint32_t WORKGROUP_SIZE = 256;
+
+            // Uploads count bodies. Only settings' gravitationalConstant and
+            // softening apply, which has to be positive: it also cancels each
+            // body's pull on itself.
+            GpuGravitySystem(
+                Device& r_Device,
+                const glm::vec3* positions,
+                const glm::vec3* velocities,
+                const float* masses,
+                uint32_t count,
+                const GravitySystem::Settings& settings);
+            ~GpuGravitySystem();
+
+            GpuGravitySystem(const GpuGravitySystem&) = delete;
+            GpuGravitySystem &operator=(const GpuGravitySystem&) = delete;
+
+            // Records a step of dt outside of a render pass. It is the same
+            // kick-drift-kick leapfrog as GravitySystem, with one force
+            // evaluation per step: the closing half kick of a step is merged
+            // into the opening one of the next, as both use the same
+            // positions. So velocities are half a step behind the positions,
+            // and the first step only kicks by half of its dt. A GPU profiler
+            // scope is added when profiler isn't null.
+            void recordStep(VkCommandBuffer commandBuffer, float dt, GpuProfiler* profiler = nullptr);
+
+            uint32_t getBodyCount() const { return m_BodyCount; };
+            uint32_t getWorkgroupSize() const { return m_WorkgroupSize; };
+            // Set layout of the bodies, binding 1 holds the latest positions for the vertex stage.
+            VkDescriptorSetLayout getDescriptorSetLayout() const { return mp_SetLayout->getDescriptorSetLayout(); };
+            // The set whose binding 1 is where the last recorded step wrote the positions.
+            VkDescriptorSet getDrawDescriptorSet() const { return m_DescriptorSets[1 - m_Latest]; };
+
+        private:
+
+            // What gravity.comp reads as push constants.
+            struct StepConstants {
+                uint32_t bodyCount;
+                float dt;
+                float kick;
+                float gravitationalConstant;
+                float softening2;
+            };
+
+            void m_CreateBuffers(const glm::vec3* positions, const glm::vec3* velocities, const float* masses);
+            void m_CreateDescriptors();
+            void m_CreatePipeline();
+
+            Device& mr_Device;
+            GravitySystem::Settings m_Settings;
+            uint32_t m_BodyCount;
+            uint32_t m_WorkgroupSize{WORKGROUP_SIZE};
+
+            // Steps read one positions buffer and write the other, set i reads
+            // buffer i. Velocities are per body and updated in place.
+            std::array<std::unique_ptr<Buffer>, 2> m_Positions;
+            std::unique_ptr<Buffer> mp_Velocities;
+            uint32_t m_Latest{0}; // Positions buffer the last step wrote.
+            float m_PreviousDt{0.f}; // 0 before the first step, whose velocities are the uploaded ones.
+
+            std::unique_ptr<DescriptorSetLayout> mp_SetLayout;
+            std::unique_ptr<DescriptorPool> mp_DescriptorPool;
+            std::array<VkDescriptorSet, 2> m_DescriptorSets{VK_NULL_HANDLE, VK_NULL_HANDLE};
+            VkPipelineLayout mp_PipelineLayout{VK_NULL_HANDLE};
+            VkPipeline mp_Pipeline{VK_NULL_HANDLE};
+    };
+} // namespace teng
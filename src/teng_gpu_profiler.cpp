@@ -0,0 +1,313 @@
+#include "teng_gpu_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+namespace teng {
+
+    namespace {
+        int64_t steadyNowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    GpuProfiler::GpuProfiler(Device& device, uint32_t framesInFlight) : mr_Device{device} {
+        assert(framesInFlight > 0 && "GpuProfiler needs at least one frame slot.");
+        assert(s_IsSupported(device) && "GpuProfiler needs timestamps on the graphics queue.");
+
+        m_TimestampPools.resize(framesInFlight, VK_NULL_HANDLE);
+        m_StatisticsPools.resize(framesInFlight, VK_NULL_HANDLE);
+        m_Slots.resize(framesInFlight);
+
+        for(uint32_t i = 0; i < framesInFlight; i++) {
+            VkQueryPoolCreateInfo timestampInfo{};
+            timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            timestampInfo.queryCount = 2 * MAX_SCOPES;
+            if(vkCreateQueryPool(mr_Device.device(), &timestampInfo, nullptr, &m_TimestampPools[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
+
+            if(mr_Device.features().pipelineStatistics) {
+                VkQueryPoolCreateInfo statisticsInfo{};
+                statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+                statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+                statisticsInfo.queryCount = MAX_SCOPES;
+                statisticsInfo.pipelineStatistics =
+                    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+                if(vkCreateQueryPool(mr_Device.device(), &statisticsInfo, nullptr, &m_StatisticsPools[i]) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create pipeline statistics query pool!");
+                }
+            }
+        }
+
+        const uint32_t validBits = mr_Device.features().timestampValidBits;
+        m_TimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        m_TimestampPeriodNs = static_cast<double>(mr_Device.properties.limits.timestampPeriod);
+        m_Calibrate();
+    }
+
+    GpuProfiler::~GpuProfiler() {
+        for(VkQueryPool pool : m_TimestampPools) {
+            if(pool != VK_NULL_HANDLE) vkDestroyQueryPool(mr_Device.device(), pool, nullptr);
+        }
+        for(VkQueryPool pool : m_StatisticsPools) {
+            if(pool != VK_NULL_HANDLE) vkDestroyQueryPool(mr_Device.device(), pool, nullptr);
+        }
+    }
+
+    // Finds the offset from GPU ticks to steady_clock. With calibrated timestamps
+    // both clocks are read together. Otherwise a timestamp is written on its own
+    // and assumed to have run halfway through the submission, which is off by
+    // the submission's latency at most. Neither corrects for drift later on.
+    void GpuProfiler::m_Calibrate() {
+        if(mr_Device.features().calibratedTimestamps) {
+            VkCalibratedTimestampInfoEXT infos[2]{};
+            infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+            infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+            infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+            infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+            uint64_t timestamps[2]{};
+            uint64_t maxDeviation = 0;
+            if(mr_Device.functions().getCalibratedTimestamps(mr_Device.device(), 2, infos, timestamps, &maxDeviation) == VK_SUCCESS) {
+                m_GpuToSteadyOffsetNs = static_cast<int64_t>(timestamps[1]) -
+                    static_cast<int64_t>(static_cast<double>(timestamps[0] & m_TimestampMask) * m_TimestampPeriodNs);
+                return;
+            }
+        }
+
+        VkCommandBuffer commandBuffer = mr_Device.beginSingleTimeCommands();
+        vkCmdResetQueryPool(commandBuffer, m_TimestampPools[0], 0, 1);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_TimestampPools[0], 0);
+        const int64_t beforeNs = steadyNowNs();
+        mr_Device.endSingleTimeCommands(commandBuffer);
+        const int64_t afterNs = steadyNowNs();
+
+        uint64_t timestamp = 0;
+        if(vkGetQueryPoolResults(mr_Device.device(), m_TimestampPools[0], 0, 1, sizeof(timestamp), &timestamp,
+                                 sizeof(timestamp), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS) {
+            m_GpuToSteadyOffsetNs = beforeNs + (afterNs - beforeNs) / 2 -
+                static_cast<int64_t>(static_cast<double>(timestamp & m_TimestampMask) * m_TimestampPeriodNs);
+        }
+    }
+
+    int64_t GpuProfiler::m_ToSteadyNs(uint64_t ticks) const {
+        return m_GpuToSteadyOffsetNs + static_cast<int64_t>(static_cast<double>(ticks) * m_TimestampPeriodNs);
+    }
+
+    void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot, uint64_t frame) {
+        assert(!m_InFrame && "Can't begin a GPU profiler frame while one is being recorded.");
+        assert(frameSlot < m_Slots.size() && "Frame slot out of range for the GPU profiler.");
+
+        m_Resolve(frameSlot);
+
+        Slot& slot = m_Slots[frameSlot];
+        slot.frame = frame;
+        slot.recorded = false;
+        slot.scopes.clear();
+        slot.statisticsCount = 0;
+
+        vkCmdResetQueryPool(commandBuffer, m_TimestampPools[frameSlot], 0, 2 * MAX_SCOPES);
+        if(m_StatisticsPools[frameSlot] != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, m_StatisticsPools[frameSlot], 0, MAX_SCOPES);
+        }
+
+        m_CurrentSlot = frameSlot;
+        m_InFrame = true;
+        m_Depth = 0;
+        m_OpenStatisticsScope = NO_SCOPE;
+        // The frame itself is scope 0. No statistics, so scopes inside can have them.
+        beginScope(commandBuffer, "frame", false);
+    }
+
+    void GpuProfiler::endFrame(VkCommandBuffer commandBuffer) {
+        assert(m_InFrame && "Can't end a GPU profiler frame that hasn't begun.");
+
+        Slot& slot = m_Slots[m_CurrentSlot];
+        for(uint32_t scope = static_cast<uint32_t>(slot.scopes.size()); scope-- > 0;) {
+            if(slot.scopes[scope].open) endScope(commandBuffer, scope);
+        }
+        slot.recorded = true;
+        m_InFrame = false;
+    }
+
+    uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name, bool withStatistics) {
+        if(!m_InFrame) return NO_SCOPE;
+
+        Slot& slot = m_Slots[m_CurrentSlot];
+        if(slot.scopes.size() >= MAX_SCOPES) return NO_SCOPE;
+
+        const uint32_t scope = static_cast<uint32_t>(slot.scopes.size());
+        PendingScope& pending = slot.scopes.emplace_back();
+        pending.name = name;
+        pending.depth = m_Depth++;
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_TimestampPools[m_CurrentSlot], 2 * scope);
+
+        if(withStatistics && m_StatisticsPools[m_CurrentSlot] != VK_NULL_HANDLE && m_OpenStatisticsScope == NO_SCOPE) {
+            pending.statisticsQuery = slot.statisticsCount++;
+            vkCmdBeginQuery(commandBuffer, m_StatisticsPools[m_CurrentSlot], pending.statisticsQuery, 0);
+            m_OpenStatisticsScope = scope;
+        }
+        return scope;
+    }
+
+    void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+        if(!m_InFrame || scope == NO_SCOPE) return;
+
+        Slot& slot = m_Slots[m_CurrentSlot];
+        assert(scope < slot.scopes.size() && slot.scopes[scope].open && "GPU profiler scope ended twice.");
+        PendingScope& pending = slot.scopes[scope];
+
+        if(pending.statisticsQuery != NO_SCOPE) {
+            vkCmdEndQuery(commandBuffer, m_StatisticsPools[m_CurrentSlot], pending.statisticsQuery);
+            m_OpenStatisticsScope = NO_SCOPE;
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_TimestampPools[m_CurrentSlot], 2 * scope + 1);
+
+        pending.open = false;
+        m_Depth--;
+    }
+
+    void GpuProfiler::resolveAll() {
+        assert(!m_InFrame && "Can't resolve while a frame is being recorded.");
+
+        // Oldest first, so the history stays in frame order.
+        std::vector<uint32_t> order;
+        for(uint32_t i = 0; i < m_Slots.size(); i++) {
+            if(m_Slots[i].recorded) order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return m_Slots[a].frame < m_Slots[b].frame;
+        });
+        for(uint32_t slot : order) {
+            m_Resolve(slot);
+        }
+    }
+
+    // Reads a retired slot's queries into the history. Results that aren't
+    // available, which only happens if the slot hasn't retired, are dropped.
+    void GpuProfiler::m_Resolve(uint32_t slotIndex) {
+        Slot& slot = m_Slots[slotIndex];
+        if(!slot.recorded || slot.scopes.empty()) return;
+        slot.recorded = false;
+
+        const uint32_t scopeCount = static_cast<uint32_t>(slot.scopes.size());
+        std::vector<uint64_t> timestamps(2 * scopeCount);
+        if(vkGetQueryPoolResults(mr_Device.device(), m_TimestampPools[slotIndex], 0, 2 * scopeCount,
+                                 timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+                                 VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            return;
+        }
+
+        // Counters come in bit order: vertex, then fragment invocations.
+        std::vector<uint64_t> statistics(2 * slot.statisticsCount);
+        bool hasStatistics = false;
+        if(slot.statisticsCount > 0) {
+            hasStatistics = vkGetQueryPoolResults(mr_Device.device(), m_StatisticsPools[slotIndex], 0, slot.statisticsCount,
+                                                  statistics.size() * sizeof(uint64_t), statistics.data(), 2 * sizeof(uint64_t),
+                                                  VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+        }
+
+        FrameResult result{};
+        result.frame = slot.frame;
+        result.scopes.reserve(scopeCount);
+        for(uint32_t i = 0; i < scopeCount; i++) {
+            const PendingScope& pending = slot.scopes[i];
+            ScopeResult& scope = result.scopes.emplace_back();
+            scope.name = pending.name;
+            scope.depth = pending.depth;
+            const uint64_t start = timestamps[2 * i] & m_TimestampMask;
+            const uint64_t end = timestamps[2 * i + 1] & m_TimestampMask;
+            scope.startNs = m_ToSteadyNs(start);
+            // Masked again, so a counter that wrapped inside the scope still gives its length.
+            const uint64_t ticks = (end - start) & m_TimestampMask;
+            scope.durationMs = static_cast<double>(ticks) * m_TimestampPeriodNs / 1e6;
+            if(hasStatistics && pending.statisticsQuery != NO_SCOPE) {
+                scope.hasStatistics = true;
+                scope.vertexInvocations = statistics[2 * pending.statisticsQuery];
+                scope.fragmentInvocations = statistics[2 * pending.statisticsQuery + 1];
+            }
+        }
+
+        m_History.push_back(std::move(result));
+        while(m_History.size() > HISTORY_FRAMES) {
+            m_History.pop_front();
+        }
+    }
+
+    void GpuProfiler::printSummary(std::ostream& out) const {
+        if(m_History.empty()) return;
+
+        // First appearance order, which is recording order.
+        struct Total {
+            std::string name;
+            uint32_t depth{0};
+            uint32_t count{0};
+            double milliseconds{0.0};
+            uint64_t vertexInvocations{0};
+            uint64_t fragmentInvocations{0};
+            bool hasStatistics{false};
+        };
+        std::vector<Total> totals;
+        for(const FrameResult& frame : m_History) {
+            for(const ScopeResult& scope : frame.scopes) {
+                auto it = std::find_if(totals.begin(), totals.end(), [&](const Total& total) { return total.name == scope.name; });
+                if(it == totals.end()) {
+                    it = totals.insert(totals.end(), Total{scope.name, scope.depth});
+                }
+                it->count++;
+                it->milliseconds += scope.durationMs;
+                it->vertexInvocations += scope.vertexInvocations;
+                it->fragmentInvocations += scope.fragmentInvocations;
+                it->hasStatistics = it->hasStatistics || scope.hasStatistics;
+            }
+        }
+
+        char line[160];
+        out << "GPU ms over " << m_History.size() << " frames:\n";
+        for(const Total& total : totals) {
+            const double count = static_cast<double>(total.count);
+            const std::string name = std::string(2 * total.depth, ' ') + total.name;
+            if(total.hasStatistics) {
+                std::snprintf(line, sizeof(line), "  %-24s %8.3f  vs %10.0f  fs %12.0f\n", name.c_str(),
+                              total.milliseconds / count,
+                              static_cast<double>(total.vertexInvocations) / count,
+                              static_cast<double>(total.fragmentInvocations) / count);
+            } else {
+                std::snprintf(line, sizeof(line), "  %-24s %8.3f\n", name.c_str(), total.milliseconds / count);
+            }
+            out << line;
+        }
+    }
+
+    void GpuProfiler::appendTraceEvents(std::vector<TraceEvent>& events) const {
+        char args[128];
+        for(const FrameResult& frame : m_History) {
+            for(const ScopeResult& scope : frame.scopes) {
+                TraceEvent& event = events.emplace_back();
+                event.name = scope.name;
+                event.category = "gpu";
+                event.startNs = scope.startNs;
+                event.durationNs = static_cast<int64_t>(scope.durationMs * 1e6);
+                event.threadId = GPU_TRACE_THREAD_ID;
+                if(scope.hasStatistics) {
+                    std::snprintf(args, sizeof(args), "\"frame\":%llu,\"vertex_invocations\":%llu,\"fragment_invocations\":%llu",
+                                  static_cast<unsigned long long>(frame.frame),
+                                  static_cast<unsigned long long>(scope.vertexInvocations),
+                                  static_cast<unsigned long long>(scope.fragmentInvocations));
+                } else {
+                    std::snprintf(args, sizeof(args), "\"frame\":%llu", static_cast<unsigned long long>(frame.frame));
+                }
+                event.args = args;
+            }
+        }
+    }
+} // namespace teng
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "teng_device.hpp"
+#include "teng_trace.hpp"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace teng {
+
+    // Measures named scopes of a frame's command buffer on the GPU. Every frame
+    // slot has its own timestamp and pipeline statistics query pools. A slot's
+    // results are read when it is reused, after the frame scheduler has waited
+    // for its last frame, so reading them never stalls; results arrive frames
+    // in flight frames late.
+    //
+    // Pipeline statistics queries of one kind can't nest, so a scope only gets
+    // vertex and fragment invocation counts when no enclosing scope has them.
+    // A scope begun inside a render pass has to end in it, and one begun
+    // outside has to end outside. Only create one where s_IsSupported.
+    class GpuProfiler {
+
+        public:
+
+            static constexpr uint32_t MAX_SCOPES = 64;      // Per frame, including the frame itself.
+            static constexpr uint32_t HISTORY_FRAMES = 240; // Resolved frames kept.
+            static constexpr uint32_t NO_SCOPE = UINT32_MAX;
+
+            struct ScopeResult {
+                std::string name;
+                uint32_t depth{0};         // 0 for the frame, 1 for scopes directly in it.
+                int64_t startNs{0};        // steady_clock time.
+                double durationMs{0.0};
+                bool hasStatistics{false};
+                uint64_t vertexInvocations{0};
+                uint64_t fragmentInvocations{0};
+            };
+
+            struct FrameResult {
+                uint64_t frame{0};
+                std::vector<ScopeResult> scopes; // In begin order, the first one is the whole frame.
+                double durationMs() const { return scopes.empty() ? 0.0 : scopes.front().durationMs; }
+            };
+
+            // Opens a scope for its lifetime. Does nothing when profiler is null.
+            class Scope {
+                public:
+                    Scope(GpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name, bool withStatistics = true)
+                        : mp_Profiler(profiler),
+                          mp_CommandBuffer(commandBuffer)
+                    {
+                        if(mp_Profiler) m_Scope = mp_Profiler->beginScope(commandBuffer, name, withStatistics);
+                    }
+                    ~Scope() {
+                        if(mp_Profiler) mp_Profiler->endScope(mp_CommandBuffer, m_Scope);
+                    }
+
+                    Scope(const Scope&) = delete;
+                    Scope &operator=(const Scope&) = delete;
+
+                private:
+                    GpuProfiler* mp_Profiler;
+                    VkCommandBuffer mp_CommandBuffer;
+                    uint32_t m_Scope{NO_SCOPE};
+            };
+
+            // Whether the device's graphics queue can write timestamps.
+            static bool s_IsSupported(const Device& device) { return device.features().timestampValidBits > 0; };
+
+            GpuProfiler(Device& device, uint32_t framesInFlight);
+            ~GpuProfiler();
+
+            GpuProfiler(const GpuProfiler&) = delete;
+            GpuProfiler &operator=(const GpuProfiler&) = delete;
+
+            bool hasStatistics() const { return m_StatisticsPools.front() != VK_NULL_HANDLE; };
+
+            // Resolves the frame that last used the slot, which must have retired,
+            // and opens the frame's scope. Right after vkBeginCommandBuffer.
+            void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameSlot, uint64_t frame);
+            // Closes scopes left open and the frame's scope. Right before vkEndCommandBuffer.
+            void endFrame(VkCommandBuffer commandBuffer);
+
+            // Returns NO_SCOPE once the frame's MAX_SCOPES are used up, endScope ignores it.
+            uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name, bool withStatistics = true);
+            void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+            // Resolves every recorded frame. Only once the GPU is idle.
+            void resolveAll();
+
+            // Null until the first frame has been resolved.
+            const FrameResult* latestFrame() const { return m_History.empty() ? nullptr : &m_History.back(); };
+            const std::deque<FrameResult>& history() const { return m_History; };
+
+            // Mean time and invocation counts per scope name over the history.
+            void printSummary(std::ostream& out) const;
+
+            // One event per scope of every frame in the history, on the GPU track.
+            void appendTraceEvents(std::vector<TraceEvent>& events) const;
+
+        private:
+
+            struct PendingScope {
+                std::string name;
+                uint32_t depth{0};
+                uint32_t statisticsQuery{NO_SCOPE};
+                bool open{true};
+            };
+
+            struct Slot {
+                uint64_t frame{0};
+                bool recorded{false};
+                std::vector<PendingScope> scopes;
+                uint32_t statisticsCount{0};
+            };
+
+            void m_Calibrate();
+            void m_Resolve(uint32_t slot);
+            int64_t m_ToSteadyNs(uint64_t ticks) const;
+
+            Device& mr_Device;
+            std::vector<VkQueryPool> m_TimestampPools;  // Per slot, two queries per scope.
+            std::vector<VkQueryPool> m_StatisticsPools; // Per slot, null without pipeline statistics.
+            std::vector<Slot> m_Slots;
+            std::deque<FrameResult> m_History;
+
+            uint32_t m_CurrentSlot{0};
+            bool m_InFrame{false};
+            uint32_t m_Depth{0};
+            uint32_t m_OpenStatisticsScope{NO_SCOPE}; // The scope with an active statistics query.
+
+            uint64_t m_TimestampMask{~0ull}; // Bits above the valid ones are undefined.
+            double m_TimestampPeriodNs{1.0};
+            int64_t m_GpuToSteadyOffsetNs{0};
+    };
+} // namespace teng
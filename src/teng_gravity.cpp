@@ -0,0 +1,394 @@
+#include "teng_gravity.hpp"
+#include "teng_bounds.hpp"
+#include "teng_thread_pool.hpp"
+#include "teng_profiler.hpp"
+
+// libs
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace teng {
+
+    namespace {
+        // Bodies per chunk of the radix sort, each chunk has a histogram.
+        constexpr uint32_t SORT_GRAIN = 16384;
+        constexpr uint32_t RADIX_BITS = 11;
+        constexpr uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+        // The 21 low bits of value with two zero bits after each.
+        uint64_t s_SpreadBits(uint64_t value) {
+            value &= 0x1fffff;
+            value = (value | value << 32) & 0x1f00000000ffff;
+            value = (value | value << 16) & 0x1f0000ff0000ff;
+            value = (value | value << 8) & 0x100f00f00f00f00f;
+            value = (value | value << 4) & 0x10c30c30c30c30c3;
+            value = (value | value << 2) & 0x1249249249249249;
+            return value;
+        }
+
+        // Which of a cell's eight children the code falls in, at level.
+        uint32_t s_Octant(uint64_t code, uint32_t level) {
+            return static_cast<uint32_t>(code >> (3 * (GravitySystem::MAX_LEVEL - 1 - level))) & 7;
+        }
+
+        glm::vec3 s_PairAcceleration(const glm::vec3& position, const glm::vec3& other, float mass, float softening2) {
+            const glm::vec3 offset = other - position;
+            const float distance2 = glm::dot(offset, offset) + softening2;
+            const float inverse = 1.f / std::sqrt(distance2);
+            return offset * (mass * inverse * inverse * inverse);
+        }
+    }
+
+    // Public
+    void GravitySystem::step(
+        glm::vec3* positions,
+        glm::vec3* velocities,
+        const float* masses,
+        uint32_t count,
+        float dt,
+        ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("GravitySystem::step");
+        if(count == 0) return;
+
+        if(m_Accelerations.size() != count) {
+            m_Accelerations.resize(count);
+            computeAccelerations(positions, masses, count, m_Accelerations.data(), threadPool);
+        }
+
+        const float halfStep = .5f * dt;
+        const glm::vec3* accelerations = m_Accelerations.data();
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                velocities[i] += accelerations[i] * halfStep;
+                positions[i] += velocities[i] * dt;
+            }
+        });
+
+        computeAccelerations(positions, masses, count, m_Accelerations.data(), threadPool);
+
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                velocities[i] += accelerations[i] * halfStep;
+            }
+        });
+    };
+
+    void GravitySystem::computeAccelerations(
+        const glm::vec3* positions,
+        const float* masses,
+        uint32_t count,
+        glm::vec3* accelerations,
+        ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("GravitySystem::computeAccelerations");
+        m_Nodes.clear();
+        if(count == 0) return;
+
+        m_SortBodies(positions, masses, count, threadPool);
+        m_BuildTree(threadPool);
+
+        TENG_PROFILE_ZONE("traverse");
+        // Neighbours in the sorted order take much the same path through the tree.
+        const float gravitationalConstant = m_Settings.gravitationalConstant;
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                accelerations[m_Order[i]] = gravitationalConstant * m_Acceleration(i);
+            }
+        });
+    };
+
+    void GravitySystem::s_BruteForceAccelerations(
+        const glm::vec3* positions,
+        const float* masses,
+        uint32_t count,
+        const Settings& settings,
+        glm::vec3* accelerations,
+        ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("GravitySystem::s_BruteForceAccelerations");
+        const float softening2 = settings.softening * settings.softening;
+        ThreadPool::s_ForChunks(threadPool, count, BODY_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                glm::vec3 acceleration{0.f};
+                for(uint32_t j = 0; j < count; j++) {
+                    if(j == i) continue;
+                    acceleration += s_PairAcceleration(positions[i], positions[j], masses[j], softening2);
+                }
+                accelerations[i] = settings.gravitationalConstant * acceleration;
+            }
+        });
+    };
+
+    void GravitySystem::s_DiskGalaxy(
+        uint32_t count,
+        float radius,
+        uint32_t seed,
+        glm::vec3* positions,
+        glm::vec3* velocities,
+        float* masses) {
+        constexpr float CENTRAL_MASS = 1.f;
+        std::mt19937 random{seed};
+        std::uniform_real_distribution<float> unit{0.f, 1.f};
+        std::normal_distribution<float> thickness{0.f, .02f * radius};
+
+        // Exponential disk, scale length a quarter of the radius, cut off at the radius.
+        const float scale = .25f * radius;
+        const float cutoff = 1.f - std::exp(-radius / scale);
+        std::vector<float> radii(count);
+        for(float& r : radii) {
+            r = -scale * std::log(1.f - unit(random) * cutoff);
+        }
+        // Bodies by radius, so the mass inside each orbit is a count.
+        std::sort(radii.begin(), radii.end());
+
+        const float mass = 1.f / static_cast<float>(std::max(count, 1u));
+        for(uint32_t i = 0; i < count; i++) {
+            const float angle = unit(random) * glm::two_pi<float>();
+            const float r = std::max(radii[i], 1e-3f * radius);
+            const glm::vec3 direction{std::cos(angle), std::sin(angle), 0.f};
+            const float enclosed = CENTRAL_MASS + mass * static_cast<float>(i);
+            const float speed = std::sqrt(enclosed / r);
+
+            positions[i] = direction * r + glm::vec3{0.f, 0.f, thickness(random)};
+            velocities[i] = glm::vec3{-direction.y, direction.x, 0.f} * speed;
+            masses[i] = mass;
+        }
+        // The central mass is the first body.
+        if(count > 0) {
+            positions[0] = glm::vec3{0.f};
+            velocities[0] = glm::vec3{0.f};
+            masses[0] = CENTRAL_MASS;
+        }
+    };
+
+    // Private
+    void GravitySystem::m_SortBodies(const glm::vec3* positions, const float* masses, uint32_t count, ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("sort");
+        const uint32_t chunkCount = (count - 1) / SORT_GRAIN + 1;
+
+        // Root cell, a cube around every body.
+        std::vector<Aabb> chunkBounds(chunkCount);
+        ThreadPool::s_ForChunks(threadPool, count, SORT_GRAIN, [&](uint32_t begin, uint32_t end) {
+            Aabb& bounds = chunkBounds[begin / SORT_GRAIN];
+            for(uint32_t i = begin; i < end; i++) bounds.extend(positions[i]);
+        });
+        Aabb bounds;
+        for(const Aabb& chunk : chunkBounds) bounds.extend(chunk);
+        const glm::vec3 size = bounds.max - bounds.min;
+        // Padded so the far faces quantize inside the grid.
+        m_RootWidth = std::max(std::max(size.x, size.y), std::max(size.z, 1e-6f)) * 1.0001f;
+        m_RootMin = bounds.min;
+
+        m_Codes.resize(count);
+        m_Order.resize(count);
+        m_CodesScratch.resize(count);
+        m_OrderScratch.resize(count);
+        const float cellsPerUnit = static_cast<float>(1u << MAX_LEVEL) / m_RootWidth;
+        ThreadPool::s_ForChunks(threadPool, count, SORT_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                const glm::vec3 cell = (positions[i] - m_RootMin) * cellsPerUnit;
+                m_Codes[i] =
+                    s_SpreadBits(static_cast<uint64_t>(cell.x)) << 2 |
+                    s_SpreadBits(static_cast<uint64_t>(cell.y)) << 1 |
+                    s_SpreadBits(static_cast<uint64_t>(cell.z));
+                m_Order[i] = i;
+            }
+        });
+
+        // Least significant digit first, each pass counting digits per chunk,
+        // turning the counts into per chunk offsets and scattering stably.
+        m_Histograms.resize(static_cast<size_t>(chunkCount) * RADIX_SIZE);
+        for(uint32_t shift = 0; shift < 3 * MAX_LEVEL; shift += RADIX_BITS) {
+            std::fill(m_Histograms.begin(), m_Histograms.end(), 0);
+            ThreadPool::s_ForChunks(threadPool, count, SORT_GRAIN, [&](uint32_t begin, uint32_t end) {
+                uint32_t* histogram = &m_Histograms[static_cast<size_t>(begin / SORT_GRAIN) * RADIX_SIZE];
+                for(uint32_t i = begin; i < end; i++) {
+                    histogram[(m_Codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+                }
+            });
+
+            uint32_t offset = 0;
+            bool unchanged = false;
+            for(uint32_t digit = 0; digit < RADIX_SIZE; digit++) {
+                const uint32_t digitStart = offset;
+                for(uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                    uint32_t& entry = m_Histograms[static_cast<size_t>(chunk) * RADIX_SIZE + digit];
+                    const uint32_t digitCount = entry;
+                    entry = offset;
+                    offset += digitCount;
+                }
+                // Every body has this digit, the pass would move nothing.
+                if(offset - digitStart == count) unchanged = true;
+            }
+            if(unchanged) continue;
+
+            ThreadPool::s_ForChunks(threadPool, count, SORT_GRAIN, [&](uint32_t begin, uint32_t end) {
+                uint32_t* offsets = &m_Histograms[static_cast<size_t>(begin / SORT_GRAIN) * RADIX_SIZE];
+                for(uint32_t i = begin; i < end; i++) {
+                    const uint32_t target = offsets[(m_Codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+                    m_CodesScratch[target] = m_Codes[i];
+                    m_OrderScratch[target] = m_Order[i];
+                }
+            });
+            m_Codes.swap(m_CodesScratch);
+            m_Order.swap(m_OrderScratch);
+        }
+
+        m_Bodies.resize(count);
+        ThreadPool::s_ForChunks(threadPool, count, SORT_GRAIN, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                m_Bodies[i] = glm::vec4{positions[m_Order[i]], masses[m_Order[i]]};
+            }
+        });
+    };
+
+    void GravitySystem::m_BuildTree(ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("build");
+        const uint32_t count = static_cast<uint32_t>(m_Bodies.size());
+
+        // The top levels serially, leaving their cells at SUBTREE_LEVEL as subtrees.
+        m_Subtrees.clear();
+        m_TopNodes.clear();
+        m_Nodes.resize(1);
+        m_BuildNode(m_Nodes, 0, 0, count, 0, true);
+
+        // The subtrees in parallel, each into its own array with its root first.
+        const uint32_t subtreeCount = static_cast<uint32_t>(m_Subtrees.size());
+        if(m_SubtreeNodes.size() < subtreeCount) m_SubtreeNodes.resize(subtreeCount);
+        ThreadPool::s_ForChunks(threadPool, subtreeCount, 1, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++) {
+                const Subtree& subtree = m_Subtrees[i];
+                std::vector<Node>& nodes = m_SubtreeNodes[i];
+                nodes.resize(1);
+                m_BuildNode(nodes, 0, subtree.begin, subtree.end, SUBTREE_LEVEL, false);
+            }
+        });
+
+        // Spliced in behind the top levels. A subtree's root replaces the
+        // placeholder its parent points to, the rest moves by the same offset.
+        for(uint32_t i = 0; i < subtreeCount; i++) {
+            const std::vector<Node>& nodes = m_SubtreeNodes[i];
+            const uint32_t offset = static_cast<uint32_t>(m_Nodes.size()) - 1;
+            m_Nodes[m_Subtrees[i].node] = nodes[0];
+            m_Nodes.insert(m_Nodes.end(), nodes.begin() + 1, nodes.end());
+            if(nodes[0].childCount > 0) m_Nodes[m_Subtrees[i].node].firstChild += offset;
+            for(size_t node = offset + 1; node < m_Nodes.size(); node++) {
+                if(m_Nodes[node].childCount > 0) m_Nodes[node].firstChild += offset;
+            }
+        }
+
+        // Nodes were added after their children, so children are done first.
+        for(uint32_t index : m_TopNodes) {
+            Node& node = m_Nodes[index];
+            s_SetInternalMoments(node, &m_Nodes[node.firstChild]);
+        }
+    };
+
+    void GravitySystem::m_BuildNode(std::vector<Node>& nodes, uint32_t index, uint32_t begin, uint32_t end, uint32_t level, bool top) {
+        Node node;
+        node.begin = begin;
+        node.count = end - begin;
+        node.width = std::ldexp(m_RootWidth, -static_cast<int>(level));
+
+        if(node.count <= LEAF_SIZE || level == MAX_LEVEL) {
+            m_SetLeafMoments(node);
+            nodes[index] = node;
+            return;
+        }
+        if(top && level == SUBTREE_LEVEL) {
+            nodes[index] = node;
+            m_Subtrees.push_back({index, begin, end});
+            return;
+        }
+
+        // The codes in the cell share everything above level, so the octant at
+        // level rises through the range.
+        uint32_t bounds[9];
+        bounds[0] = begin;
+        for(uint32_t octant = 1; octant < 8; octant++) {
+            bounds[octant] = static_cast<uint32_t>(std::partition_point(
+                m_Codes.begin() + bounds[octant - 1], m_Codes.begin() + end,
+                [&](uint64_t code) { return s_Octant(code, level) < octant; }) - m_Codes.begin());
+        }
+        bounds[8] = end;
+
+        node.firstChild = static_cast<uint32_t>(nodes.size());
+        for(uint32_t octant = 0; octant < 8; octant++) {
+            if(bounds[octant + 1] > bounds[octant]) node.childCount++;
+        }
+        nodes.resize(nodes.size() + node.childCount);
+
+        uint32_t child = node.firstChild;
+        for(uint32_t octant = 0; octant < 8; octant++) {
+            if(bounds[octant + 1] == bounds[octant]) continue;
+            m_BuildNode(nodes, child++, bounds[octant], bounds[octant + 1], level + 1, top);
+        }
+
+        if(top) {
+            // Subtrees aren't built yet, this waits for them.
+            m_TopNodes.push_back(index);
+        } else {
+            s_SetInternalMoments(node, &nodes[node.firstChild]);
+        }
+        nodes[index] = node;
+    };
+
+    void GravitySystem::m_SetLeafMoments(Node& node) const {
+        glm::vec3 weighted{0.f};
+        float mass = 0.f;
+        for(uint32_t i = node.begin; i < node.begin + node.count; i++) {
+            weighted += glm::vec3{m_Bodies[i]} * m_Bodies[i].w;
+            mass += m_Bodies[i].w;
+        }
+        node.mass = mass;
+        node.centerOfMass = mass > 0.f ? weighted / mass : glm::vec3{m_Bodies[node.begin]};
+    };
+
+    void GravitySystem::s_SetInternalMoments(Node& node, const Node* children) {
+        glm::vec3 weighted{0.f};
+        float mass = 0.f;
+        for(uint32_t i = 0; i < node.childCount; i++) {
+            weighted += children[i].centerOfMass * children[i].mass;
+            mass += children[i].mass;
+        }
+        node.mass = mass;
+        node.centerOfMass = mass > 0.f ? weighted / mass : children[0].centerOfMass;
+    };
+
+    glm::vec3 GravitySystem::m_Acceleration(uint32_t body) const {
+        const glm::vec3 position{m_Bodies[body]};
+        const float theta2 = m_Settings.theta * m_Settings.theta;
+        const float softening2 = m_Settings.softening * m_Settings.softening;
+        glm::vec3 acceleration{0.f};
+
+        // At most seven siblings wait per level.
+        uint32_t stack[7 * MAX_LEVEL + 8];
+        uint32_t size = 0;
+        stack[size++] = 0;
+        while(size > 0) {
+            const Node& node = m_Nodes[stack[--size]];
+
+            // Cells holding the body itself are always opened.
+            const glm::vec3 offset = node.centerOfMass - position;
+            const bool holdsBody = body - node.begin < node.count;
+            if(!holdsBody && node.width * node.width < theta2 * glm::dot(offset, offset)) {
+                acceleration += s_PairAcceleration(position, node.centerOfMass, node.mass, softening2);
+                continue;
+            }
+
+            if(node.childCount == 0) {
+                for(uint32_t i = node.begin; i < node.begin + node.count; i++) {
+                    if(i == body) continue;
+                    acceleration += s_PairAcceleration(position, glm::vec3{m_Bodies[i]}, m_Bodies[i].w, softening2);
+                }
+                continue;
+            }
+            for(uint32_t i = 0; i < node.childCount; i++) {
+                stack[size++] = node.firstChild + i;
+            }
+        }
+        return acceleration;
+    };
+} // namespace teng
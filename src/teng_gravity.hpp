@@ -0,0 +1,151 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace teng {
+
+    class ThreadPool;
+
+    // Newtonian gravity between many bodies. Accelerations come from a
+    // Barnes-Hut octree, rebuilt every step: bodies are sorted along a Morton
+    // curve with a parallel radix sort, which makes every cell a contiguous
+    // range of them, and the cells below the top levels are built in parallel.
+    // Distant cells act as point masses at their centre of mass, so a step is
+    // O(n log n) instead of the O(n^2) of summing every pair.
+    //
+    // Bodies are passed as separate position, velocity and mass arrays, such as
+    // a Registry's translations, velocities and masses, and are identified by
+    // their index in them.
+    class GravitySystem {
+
+        public:
+
+            struct Settings {
+                // Opening angle: a cell of width w at distance d is taken as a
+                // point mass when w / d < theta. Smaller is more accurate and
+                // slower, 0 sums every pair.
+                float theta{.7f};
+                float gravitationalConstant{1.f};
+                // Plummer softening length, keeps close encounters finite.
+                float softening{.01f};
+            };
+
+            // Bodies a cell holds before it's split.
+            static constexpr uint32_t LEAF_SIZE = 8;
+            // Levels below the root, 21 bits of each coordinate in a 63-bit Morton code.
+            static constexpr uint32_t MAX_LEVEL = 21;
+            // Bodies per chunk of the parallel passes.
+            static constexpr uint32_t BODY_GRAIN = 512;
+
+            GravitySystem() = default;
+            explicit GravitySystem(const Settings& settings) : m_Settings{settings} {};
+
+            const Settings& getSettings() const { return m_Settings; };
+            void setSettings(const Settings& settings) { m_Settings = settings; };
+
+            // Advances count bodies by dt with kick-drift-kick leapfrog, which is
+            // symplectic: energy errors oscillate instead of drifting. The
+            // accelerations at the end of a step are kept for the first kick of
+            // the next, so there is one tree per step.
+            void step(
+                glm::vec3* positions,
+                glm::vec3* velocities,
+                const float* masses,
+                uint32_t count,
+                float dt,
+                ThreadPool* threadPool = nullptr);
+            // Drops the kept accelerations, for when bodies were added, removed,
+            // reordered or moved by anything but step. A change in count is noticed.
+            void reset() { m_Accelerations.clear(); };
+
+            // Barnes-Hut accelerations of count bodies.
+            void computeAccelerations(
+                const glm::vec3* positions,
+                const float* masses,
+                uint32_t count,
+                glm::vec3* accelerations,
+                ThreadPool* threadPool = nullptr);
+
+            // Cells in the tree of the last computeAccelerations.
+            uint32_t getNodeCount() const { return static_cast<uint32_t>(m_Nodes.size()); };
+            // Total mass and centre of mass of the bodies, from the root of that tree.
+            float getTotalMass() const { return m_Nodes.empty() ? 0.f : m_Nodes[0].mass; };
+            glm::vec3 getCenterOfMass() const { return m_Nodes.empty() ? glm::vec3{0.f} : m_Nodes[0].centerOfMass; };
+
+            // Exact accelerations, summing every pair with the same constant and
+            // softening, as the reference for computeAccelerations.
+            static void s_BruteForceAccelerations(
+                const glm::vec3* positions,
+                const float* masses,
+                uint32_t count,
+                const Settings& settings,
+                glm::vec3* accelerations,
+                ThreadPool* threadPool = nullptr);
+
+            // A thin disk of count bodies with total mass 1 around a central mass
+            // of 1, in the xy plane around the origin, on roughly circular orbits
+            // for gravitationalConstant 1.
+            static void s_DiskGalaxy(
+                uint32_t count,
+                float radius,
+                uint32_t seed,
+                glm::vec3* positions,
+                glm::vec3* velocities,
+                float* masses);
+
+        private:
+
+            // A cell of the octree. Children are contiguous, and the bodies in a
+            // cell are a range of the Morton sorted order.
+            struct Node {
+                glm::vec3 centerOfMass{0.f};
+                float mass{0.f};
+                float width{0.f};
+                uint32_t firstChild{0};
+                uint32_t childCount{0}; // 0 for leaves.
+                uint32_t begin{0};
+                uint32_t count{0};
+            };
+
+            // A subtree the top levels left to be built in parallel.
+            struct Subtree {
+                uint32_t node;
+                uint32_t begin;
+                uint32_t end;
+            };
+
+            void m_SortBodies(const glm::vec3* positions, const float* masses, uint32_t count, ThreadPool* threadPool);
+            void m_BuildTree(ThreadPool* threadPool);
+            // Fills nodes[index] with the cell of bodies [begin, end) at level and
+            // appends its descendants. Top levels stop at SUBTREE_LEVEL.
+            void m_BuildNode(std::vector<Node>& nodes, uint32_t index, uint32_t begin, uint32_t end, uint32_t level, bool top);
+            void m_SetLeafMoments(Node& node) const;
+            static void s_SetInternalMoments(Node& node, const Node* children);
+            glm::vec3 m_Acceleration(uint32_t body) const;
+
+            // Levels built serially before the rest is split into subtrees.
+            static constexpr uint32_t SUBTREE_LEVEL = 2;
+
+            Settings m_Settings;
+            std::vector<glm::vec3> m_Accelerations; // Kept between steps, by body index.
+
+            // Rebuilt by computeAccelerations, kept to reuse their memory.
+            std::vector<uint64_t> m_Codes;
+            std::vector<uint32_t> m_Order;        // Body index per sorted position.
+            std::vector<uint64_t> m_CodesScratch;
+            std::vector<uint32_t> m_OrderScratch;
+            std::vector<uint32_t> m_Histograms;
+            std::vector<glm::vec4> m_Bodies;      // Sorted positions, mass in w.
+            std::vector<Node> m_Nodes;
+            std::vector<Subtree> m_Subtrees;
+            std::vector<uint32_t> m_TopNodes;     // Internal nodes above the subtrees, children first.
+            std::vector<std::vector<Node>> m_SubtreeNodes;
+            glm::vec3 m_RootMin{0.f};
+            float m_RootWidth{0.f};
+    };
+} // namespace teng
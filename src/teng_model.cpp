@@ -1,26 +1,13 @@
 #include "teng_model.hpp"
+#include "teng_profiler.hpp"
 #include <cassert>
 #include <cstring>
 #include <iostream>
-#include "utils.hpp"
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
 #include <unordered_map>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
-namespace std {
-    template <>
-    struct hash<teng::Model::Vertex> {
-        size_t operator()(teng::Model::Vertex const& vertex) const {
-            size_t seed = 0;
-            teng::hashCombine(seed, vertex.color, vertex.normal, vertex.position, vertex.uv);
-            return seed;
-        }
-    };
-}
-
 namespace teng {
 
     // VERTEX
@@ -53,6 +40,9 @@ namespace teng {
 
     // Public
     Model::Model(Device &device, const Data& data) : m_Device{device} {
+        for(const Vertex& vertex : data.vertices) {
+            m_Bounds.extend(vertex.position);
+        }
         m_CreateVertexBuffers(data.vertices);
         m_CreateIndexBuffers(data.indices);
     };
@@ -76,15 +66,16 @@ namespace teng {
         VkDeviceSize bufferSize = sizeof(vertices[0]) * m_VertexCount;
         uint32_t vertexSize = sizeof(vertices[0]);
 
-        Buffer stagingBuffer{
+        // Shared so that it can outlive this call until the copy has completed.
+        auto stagingBuffer = std::make_shared<Buffer>(
         m_Device,
         vertexSize,
         m_VertexCount,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void*)vertices.data());
+        stagingBuffer->map();
+        stagingBuffer->writeToBuffer((void*)vertices.data());
 
         ma_VertexBuffer = std::make_unique<Buffer>(
         m_Device,
@@ -93,7 +84,9 @@ namespace teng {
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        m_Device.copyBuffer(stagingBuffer.getBuffer(), ma_VertexBuffer->getBuffer(), bufferSize);
+        // Frames submitted later wait for the copy on the GPU, no need to block here.
+        const uint64_t uploadValue = m_Device.copyBufferAsync(stagingBuffer->getBuffer(), ma_VertexBuffer->getBuffer(), bufferSize);
+        m_Device.deferDeletion(uploadValue, [stagingBuffer]() mutable { stagingBuffer.reset(); });
     };
 
     void Model::bind(VkCommandBuffer pCommandBuffer) {
@@ -106,11 +99,11 @@ namespace teng {
         };
     };
 
-    void Model::draw(VkCommandBuffer pCommandBuffer) {
+    void Model::draw(VkCommandBuffer pCommandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
         if(hasIndexBuffer) {
-            vkCmdDrawIndexed(pCommandBuffer, m_IndexCount, 1, 0, 0, 0);
+            vkCmdDrawIndexed(pCommandBuffer, m_IndexCount, instanceCount, 0, 0, firstInstance);
         } else {
-            vkCmdDraw(pCommandBuffer, m_VertexCount, 1, 0, 0);
+            vkCmdDraw(pCommandBuffer, m_VertexCount, instanceCount, 0, firstInstance);
         };
     };
 
@@ -125,15 +118,16 @@ namespace teng {
         VkDeviceSize bufferSize = sizeof(indices[0]) * m_IndexCount;
         uint32_t indexSize = sizeof(indices[0]);
 
-        Buffer stagingBuffer{
+        // Shared so that it can outlive this call until the copy has completed.
+        auto stagingBuffer = std::make_shared<Buffer>(
         m_Device,
         indexSize,
         m_IndexCount,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer((void*)indices.data());
+        stagingBuffer->map();
+        stagingBuffer->writeToBuffer((void*)indices.data());
 
         ma_IndexBuffer = std::make_unique<Buffer>(
         m_Device,
@@ -142,10 +136,13 @@ namespace teng {
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-        m_Device.copyBuffer(stagingBuffer.getBuffer(), ma_IndexBuffer->getBuffer(), bufferSize);
+        // Frames submitted later wait for the copy on the GPU, no need to block here.
+        const uint64_t uploadValue = m_Device.copyBufferAsync(stagingBuffer->getBuffer(), ma_IndexBuffer->getBuffer(), bufferSize);
+        m_Device.deferDeletion(uploadValue, [stagingBuffer]() mutable { stagingBuffer.reset(); });
     };
 
     void Model::Data::loadModel(const std::string& objFile) {
+        TENG_PROFILE_ZONE("Model::Data::loadModel");
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> materials;
@@ -2,10 +2,14 @@
 
 #include "teng_device.hpp"
 #include "teng_buffer.hpp"
+#include "utils.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
+#include "teng_bounds.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
 #include <vector>
 #include <memory>
 
@@ -47,7 +51,10 @@ namespace teng {
             Model &operator=(const Model&) = delete;
 
             void bind(VkCommandBuffer commandBuffer);
-            void draw(VkCommandBuffer commandBuffer);
+            // Instances read their data at gl_InstanceIndex, firstInstance onwards.
+            void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+            // Of the vertex positions, in model space.
+            const Aabb& getBounds() const { return m_Bounds; };
 
             static std::unique_ptr<Model> CreateModelFromFile(Device& r_Device, const std::string& objFile);
 
@@ -55,6 +62,7 @@ namespace teng {
 
         private:
             Device& m_Device;
+            Aabb m_Bounds;
 
             void m_CreateVertexBuffers(const std::vector<Vertex> &vertices);
             std::unique_ptr<Buffer> ma_VertexBuffer;
@@ -67,3 +75,15 @@ namespace teng {
     };
 
 }
+
+// In the header so the deduplication hash can be measured and reused outside of loadModel.
+namespace std {
+    template <>
+    struct hash<teng::Model::Vertex> {
+        size_t operator()(teng::Model::Vertex const& vertex) const {
+            size_t seed = 0;
+            teng::hashCombine(seed, vertex.color, vertex.normal, vertex.position, vertex.uv);
+            return seed;
+        }
+    };
+}
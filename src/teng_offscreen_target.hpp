@@ -0,0 +1,71 @@
+#pragma once
+
+#include "teng_render_target.hpp"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <vector>
+
+namespace teng {
+
+  // Stands in for the swap chain when there is no window. Owns one color and
+  // one depth image per frame in flight, frame slot i always renders into
+  // image i. Frames end with the color image in TRANSFER_SRC_OPTIMAL, ready
+  // to be copied out. Depth is stored too, so it can be read back.
+  class OffscreenTarget : public RenderTarget {
+
+    public:
+
+      static constexpr VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+      OffscreenTarget(Device &deviceRef, VkExtent2D extent, uint32_t framesInFlight, bool useDynamicRendering = false);
+      ~OffscreenTarget() override;
+
+      OffscreenTarget(const OffscreenTarget &) = delete;
+      OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+      bool usesDynamicRendering() const override { return useDynamicRendering; }
+      uint32_t framesInFlight() const override { return static_cast<uint32_t>(colorImages.size()); }
+      size_t imageCount() override { return colorImages.size(); }
+      VkExtent2D getExtent() override { return extent; }
+      VkFormat getColorFormat() override { return COLOR_FORMAT; }
+      VkFormat getDepthFormat() override { return depthFormat; }
+      VkImageLayout getFinalColorLayout() const override { return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL; }
+
+      VkRenderPass getRenderPass() override { return renderPass; }
+      VkFramebuffer getFrameBuffer(int index) override { return framebuffers[index]; }
+      VkImage getImage(int index) override { return colorImages[index]; }
+      VkImageView getImageView(int index) override { return colorImageViews[index]; }
+      VkImage getDepthImage(int index) override { return depthImages[index]; }
+      VkImageView getDepthImageView(int index) override { return depthImageViews[index]; }
+
+      VkResult acquireNextImage(uint32_t frameSlot, uint32_t *imageIndex) override;
+      VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex, uint32_t frameSlot, uint64_t *timelineValue,
+                                    const std::function<void()> &beforeSubmit) override;
+
+    private:
+
+      void createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                       VkImage &image, VkDeviceMemory &memory, VkImageView &view);
+      void createRenderPass();
+      void createFramebuffers();
+
+      Device &device;
+      VkExtent2D extent;
+      VkFormat depthFormat;
+      bool useDynamicRendering = false;
+
+      std::vector<VkImage> colorImages;
+      std::vector<VkDeviceMemory> colorImageMemorys;
+      std::vector<VkImageView> colorImageViews;
+      std::vector<VkImage> depthImages;
+      std::vector<VkDeviceMemory> depthImageMemorys;
+      std::vector<VkImageView> depthImageViews;
+
+      VkRenderPass renderPass = VK_NULL_HANDLE;
+      std::vector<VkFramebuffer> framebuffers;
+  };
+
+}  // namespace teng
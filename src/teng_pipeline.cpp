@@ -1,29 +1,70 @@
 #include "teng_pipeline.hpp"
 #include "teng_device.hpp"
 #include "teng_model.hpp"
+#include "teng_profiler.hpp"
 
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <cassert>
+#include <cstddef>
 
 namespace teng {
 
+  PipelineConfigInfo::PipelineConfigInfo(const PipelineConfigInfo &other) {
+    *this = other;
+  }
+
+  PipelineConfigInfo &PipelineConfigInfo::operator=(const PipelineConfigInfo &other) {
+    viewportInfo = other.viewportInfo;
+    inputAssemblyInfo = other.inputAssemblyInfo;
+    rasterizationInfo = other.rasterizationInfo;
+    multisampleInfo = other.multisampleInfo;
+    colorBlendAttachment = other.colorBlendAttachment;
+    colorBlendInfo = other.colorBlendInfo;
+    depthStencilInfo = other.depthStencilInfo;
+    dynamicStateEnables = other.dynamicStateEnables;
+    dynamicStateInfo = other.dynamicStateInfo;
+    pipelineLayout = other.pipelineLayout;
+    renderPass = other.renderPass;
+    subpass = other.subpass;
+    colorAttachmentFormat = other.colorAttachmentFormat;
+    depthAttachmentFormat = other.depthAttachmentFormat;
+
+    // Don't keep pointing into other, it may be gone by the time the pipeline is created.
+    if (other.colorBlendInfo.pAttachments == &other.colorBlendAttachment) {
+      colorBlendInfo.pAttachments = &colorBlendAttachment;
+    }
+    if (other.dynamicStateInfo.pDynamicStates == other.dynamicStateEnables.data()) {
+      dynamicStateInfo.pDynamicStates = dynamicStateEnables.data();
+    }
+    return *this;
+  }
+
   Pipeline::Pipeline(Device &device, const std::string &vertFilepath,
                              const std::string &fragFilepath,
-                             const PipelineConfigInfo &config)
+                             const PipelineConfigInfo &config,
+                             const ShaderVariant &variant)
     : m_Device{device} {
+    TENG_PROFILE_ZONE("Pipeline::Pipeline");
 
-    m_CreateGraphicsPipeline(vertFilepath, fragFilepath, config);
+    m_CreateGraphicsPipeline(vertFilepath, fragFilepath, config, variant);
   }
 
+  Pipeline::Pipeline(Device &device, VkPipeline pipeline,
+                     VkShaderModule vertModule, VkShaderModule fragModule)
+    : m_Device{device},
+      m_VkPipeline{pipeline},
+      m_VkShaderModule{vertModule},
+      m_VkFragModule{fragModule} {}
+
   Pipeline::~Pipeline() {
     vkDestroyShaderModule(m_Device.device(), m_VkShaderModule, nullptr);
     vkDestroyShaderModule(m_Device.device(), m_VkFragModule, nullptr);
     vkDestroyPipeline(m_Device.device(), m_VkPipeline, nullptr);
   }
 
-  std::vector<char> Pipeline::m_ReadFile(const std::string &filePath) {
+  std::vector<char> Pipeline::s_ReadFile(const std::string &filePath) {
 
     /*
     ** ios::ate: reader goes to the end of the file
@@ -55,44 +96,87 @@ namespace teng {
 
 void Pipeline::m_CreateGraphicsPipeline(const std::string &vertFilepath,
                                             const std::string &fragFilepath,
-                                            const PipelineConfigInfo &config) {
+                                            const PipelineConfigInfo &config,
+                                            const ShaderVariant &variant) {
+
+  auto vertData = s_ReadFile(vertFilepath);
+  auto fragData = s_ReadFile(fragFilepath);
+
+  s_CreateShaderModule(m_Device, vertData, &m_VkShaderModule);
+  s_CreateShaderModule(m_Device, fragData, &m_VkFragModule);
+
+  CreateState state{};
+  s_FillCreateState(m_VkShaderModule, m_VkFragModule, config, variant, state);
+
+  if(vkCreateGraphicsPipelines(
+       m_Device.device(),
+       VK_NULL_HANDLE,
+       1,
+       &state.pipelineInfo,
+       nullptr,
+       &m_VkPipeline) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create graphics pipeline");
+  }
+
+}
+
+void Pipeline::s_FillCreateState(VkShaderModule vertModule,
+                                 VkShaderModule fragModule,
+                                 const PipelineConfigInfo &config,
+                                 const ShaderVariant &variant,
+                                 CreateState &state) {
 
   assert(config.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: No pipelineLayout provided in config.");
-  assert(config.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: No renderPass provided in config.");
-  auto vertData = m_ReadFile(vertFilepath);
-  auto fragData = m_ReadFile(fragFilepath);
+  assert((config.renderPass != VK_NULL_HANDLE || config.colorAttachmentFormat != VK_FORMAT_UNDEFINED) &&
+         "Cannot create graphics pipeline: No renderPass or attachment formats provided in config.");
+
+  assert(variant.lightCount <= ShaderVariant::MAX_POINT_LIGHTS && "Shader variant has more lights than the GlobalUbo holds.");
+
+  // Both stages get the same constants, entries a stage doesn't declare are ignored.
+  using SpecializationData = CreateState::SpecializationData;
+  state.specializationData.lightCount = variant.lightCount;
+  state.specializationData.lightingModel = static_cast<uint32_t>(variant.lightingModel);
+  state.specializationData.useNormalMatrix = variant.useNormalMatrix ? VK_TRUE : VK_FALSE;
 
-  m_CreateShaderModule(vertData, &m_VkShaderModule);
-  m_CreateShaderModule(fragData, &m_VkFragModule);
+  state.specializationEntries[0] = {0, offsetof(SpecializationData, lightCount), sizeof(uint32_t)};
+  state.specializationEntries[1] = {1, offsetof(SpecializationData, lightingModel), sizeof(uint32_t)};
+  state.specializationEntries[2] = {2, offsetof(SpecializationData, useNormalMatrix), sizeof(VkBool32)};
 
-  VkPipelineShaderStageCreateInfo shaderStages[2];
+  state.specializationInfo.mapEntryCount = 3;
+  state.specializationInfo.pMapEntries = state.specializationEntries;
+  state.specializationInfo.dataSize = sizeof(SpecializationData);
+  state.specializationInfo.pData = &state.specializationData;
+
+  auto &shaderStages = state.shaderStages;
 
   shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  shaderStages[0].module = m_VkShaderModule;
+  shaderStages[0].module = vertModule;
   shaderStages[0].pName = "main";
   shaderStages[0].flags = 0;
   shaderStages[0].pNext = nullptr;
-  shaderStages[0].pSpecializationInfo = nullptr;
+  shaderStages[0].pSpecializationInfo = &state.specializationInfo;
 
   shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  shaderStages[1].module = m_VkFragModule;
+  shaderStages[1].module = fragModule;
   shaderStages[1].pName = "main";
   shaderStages[1].flags = 0;
   shaderStages[1].pNext = nullptr;
-  shaderStages[1].pSpecializationInfo = nullptr;
+  shaderStages[1].pSpecializationInfo = &state.specializationInfo;
 
-  auto bindingDescriptions = Model::Vertex::getBindingDescriptions();
-  auto attributeDescriptions = Model::Vertex::getAttributeDescriptions();
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  state.bindingDescriptions = Model::Vertex::getBindingDescriptions();
+  state.attributeDescriptions = Model::Vertex::getAttributeDescriptions();
+  auto &vertexInputInfo = state.vertexInputInfo;
+  vertexInputInfo = {};
   vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-  vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.attributeDescriptions.size());
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(state.bindingDescriptions.size());
+  vertexInputInfo.pVertexAttributeDescriptions = state.attributeDescriptions.data();
+  vertexInputInfo.pVertexBindingDescriptions = state.bindingDescriptions.data();
 
-  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  auto &pipelineInfo = state.pipelineInfo;
+  pipelineInfo = {};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
   pipelineInfo.pStages = shaderStages;
@@ -109,23 +193,24 @@ void Pipeline::m_CreateGraphicsPipeline(const std::string &vertFilepath,
   pipelineInfo.renderPass = config.renderPass;
   pipelineInfo.subpass = config.subpass;
 
-  pipelineInfo.basePipelineIndex = -1;
-  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-  if(vkCreateGraphicsPipelines(
-       m_Device.device(),
-       VK_NULL_HANDLE,
-       1,
-       &pipelineInfo,
-       nullptr,
-       &m_VkPipeline) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create graphics pipeline");
+  // Without a render pass the pipeline only needs to know the attachment formats.
+  if (config.renderPass == VK_NULL_HANDLE) {
+    auto &renderingInfo = state.renderingInfo;
+    renderingInfo = {};
+    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &config.colorAttachmentFormat;
+    renderingInfo.depthAttachmentFormat = config.depthAttachmentFormat;
+    pipelineInfo.pNext = &renderingInfo;
   }
 
+  pipelineInfo.basePipelineIndex = -1;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 }
 
-void Pipeline::m_CreateShaderModule(const std::vector<char> &code,
-                                        VkShaderModule *shaderModule) {
+void Pipeline::s_CreateShaderModule(Device &device,
+                                    const std::vector<char> &code,
+                                    VkShaderModule *shaderModule) {
 
   // Create a struct to contain our configurations
   VkShaderModuleCreateInfo createInfo{};
@@ -136,12 +221,51 @@ void Pipeline::m_CreateShaderModule(const std::vector<char> &code,
   createInfo.pCode = reinterpret_cast<const uint32_t *>(
       code.data()); // Cast is OK, since data is in a std::Vector
 
-  if (vkCreateShaderModule(m_Device.device(), &createInfo, nullptr,
+  if (vkCreateShaderModule(device.device(), &createInfo, nullptr,
                            shaderModule) != VK_SUCCESS) {
     throw std::runtime_error("failed to create shader module");
   }
 }
 
+void Pipeline::s_ApplyRasterState(PipelineConfigInfo& configInfo, const RasterState& state) {
+  configInfo.rasterizationInfo.cullMode = state.cullMode;
+  configInfo.rasterizationInfo.frontFace = state.frontFace;
+  configInfo.inputAssemblyInfo.topology = state.topology;
+  configInfo.depthStencilInfo.depthTestEnable = state.depthTestEnable ? VK_TRUE : VK_FALSE;
+  configInfo.depthStencilInfo.depthWriteEnable = state.depthWriteEnable ? VK_TRUE : VK_FALSE;
+  configInfo.depthStencilInfo.depthCompareOp = state.depthCompareOp;
+}
+
+void Pipeline::s_EnableDynamicRasterState(PipelineConfigInfo& configInfo) {
+  // The baked values are ignored, keep them at the defaults so that every
+  // RasterState maps to the same pipeline.
+  s_ApplyRasterState(configInfo, RasterState{});
+
+  configInfo.dynamicStateEnables.insert(
+      configInfo.dynamicStateEnables.end(),
+      {VK_DYNAMIC_STATE_CULL_MODE_EXT,
+       VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+       VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT,
+       VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+       VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+       VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT});
+  configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+  configInfo.dynamicStateInfo.dynamicStateCount =
+      static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
+}
+
+void Pipeline::s_SetRasterState(Device& device, VkCommandBuffer commandBuffer, const RasterState& state) {
+  assert(device.features().extendedDynamicState && "Raster state can only be set dynamically with extended dynamic state.");
+
+  const DeviceFunctions& fn = device.functions();
+  fn.cmdSetCullMode(commandBuffer, state.cullMode);
+  fn.cmdSetFrontFace(commandBuffer, state.frontFace);
+  fn.cmdSetPrimitiveTopology(commandBuffer, state.topology);
+  fn.cmdSetDepthTestEnable(commandBuffer, state.depthTestEnable ? VK_TRUE : VK_FALSE);
+  fn.cmdSetDepthWriteEnable(commandBuffer, state.depthWriteEnable ? VK_TRUE : VK_FALSE);
+  fn.cmdSetDepthCompareOp(commandBuffer, state.depthCompareOp);
+}
+
 void Pipeline::s_DefaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
 
   configInfo.inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -8,6 +8,13 @@ namespace teng {
 
 struct PipelineConfigInfo {
 
+  PipelineConfigInfo() = default;
+
+  // Copies re-point colorBlendInfo and dynamicStateInfo at their own members,
+  // so a config can be handed to another thread by value.
+  PipelineConfigInfo(const PipelineConfigInfo &other);
+  PipelineConfigInfo &operator=(const PipelineConfigInfo &other);
+
   VkPipelineViewportStateCreateInfo viewportInfo;
   VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
   VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -20,13 +27,102 @@ struct PipelineConfigInfo {
   VkPipelineLayout pipelineLayout = nullptr;
   VkRenderPass renderPass = nullptr;
   uint32_t subpass = 0;
+
+  // Attachment formats for dynamic rendering, used when renderPass is null.
+  VkFormat colorAttachmentFormat = VK_FORMAT_UNDEFINED;
+  VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
+};
+
+// What a pipeline renders into. Either a render pass, or with dynamic
+// rendering only the attachment formats, which survive swap chain recreation.
+struct PipelineTarget {
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+  VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+  void applyTo(PipelineConfigInfo &config) const {
+    config.renderPass = renderPass;
+    config.colorAttachmentFormat = colorFormat;
+    config.depthAttachmentFormat = depthFormat;
+  }
+};
+
+// Fixed-function state that changes between draws. Set on the command buffer
+// when the device has extended dynamic state, baked into the pipeline otherwise.
+struct RasterState {
+  VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+  VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  bool depthTestEnable = true;
+  bool depthWriteEnable = true;
+  VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+  bool operator==(const RasterState &other) const {
+    return cullMode == other.cullMode && frontFace == other.frontFace &&
+           topology == other.topology && depthTestEnable == other.depthTestEnable &&
+           depthWriteEnable == other.depthWriteEnable && depthCompareOp == other.depthCompareOp;
+  }
+  bool operator!=(const RasterState &other) const { return !(*this == other); }
+
+  uint32_t key() const {
+    return cullMode | frontFace << 2 | topology << 3 | depthTestEnable << 7 |
+           depthWriteEnable << 8 | depthCompareOp << 9;
+  }
+};
+
+// Values for the specialization constants declared in simple_shader.vert.
+// Each distinct variant is compiled into its own pipeline, so a cheap material
+// gets a shader with the unused lighting paths stripped out.
+struct ShaderVariant {
+  static constexpr uint32_t MAX_POINT_LIGHTS = 4; // Must match the GlobalUbo array size.
+
+  enum class LightingModel : uint32_t {
+    Unlit = 0,   // Vertex color only.
+    Lambert = 1, // Ambient plus per-vertex diffuse from the point lights.
+  };
+
+  uint32_t lightCount = 1;
+  LightingModel lightingModel = LightingModel::Lambert;
+  bool useNormalMatrix = true; // False when every model has uniform scale.
+
+  // Packs the variant into a single value, used as part of the pipeline cache key.
+  uint32_t key() const {
+    return lightCount | static_cast<uint32_t>(lightingModel) << 8 | static_cast<uint32_t>(useNormalMatrix) << 16;
+  }
 };
 
 class Pipeline {
 public:
+    // Every structure vkCreateGraphicsPipelines reads, kept in one place so
+    // the create info stays valid until the (possibly batched) call returns.
+    // Not copyable: pipelineInfo points into the other members.
+    struct CreateState {
+      CreateState() = default;
+      CreateState(const CreateState &) = delete;
+      CreateState &operator=(const CreateState &) = delete;
+
+      // Layout of the specialization data, constant_id i is member i.
+      struct SpecializationData {
+        uint32_t lightCount;
+        uint32_t lightingModel;
+        VkBool32 useNormalMatrix;
+      };
+
+      SpecializationData specializationData;
+      VkSpecializationMapEntry specializationEntries[3];
+      VkSpecializationInfo specializationInfo;
+      VkPipelineShaderStageCreateInfo shaderStages[2];
+      std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+      std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+      VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+      VkPipelineRenderingCreateInfoKHR renderingInfo;
+      VkGraphicsPipelineCreateInfo pipelineInfo;
+    };
+
     Pipeline(Device &device, const std::string &vertFilepath,
                const std::string &fragFilepath,
-               const PipelineConfigInfo &config);
+               const PipelineConfigInfo &config,
+               const ShaderVariant &variant = {});
 
     ~Pipeline();
 
@@ -39,18 +135,40 @@ public:
 
     static void s_DefaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 
+    // Bakes state into configInfo, for devices without extended dynamic state.
+    static void s_ApplyRasterState(PipelineConfigInfo& configInfo, const RasterState& state);
+    // Marks the RasterState members as dynamic, they must then be set with s_SetRasterState.
+    static void s_EnableDynamicRasterState(PipelineConfigInfo& configInfo);
+    static void s_SetRasterState(Device& device, VkCommandBuffer commandBuffer, const RasterState& state);
+
+    // Fills state so that state.pipelineInfo describes a pipeline built from
+    // the two shader modules, config and variant. config must outlive the create call.
+    static void s_FillCreateState(VkShaderModule vertModule,
+                                  VkShaderModule fragModule,
+                                  const PipelineConfigInfo &config,
+                                  const ShaderVariant &variant,
+                                  CreateState &state);
+
+    static std::vector<char> s_ReadFile(const std::string &filePath);
+    static void s_CreateShaderModule(Device &device,
+                                     const std::vector<char> &code,
+                                     VkShaderModule *shaderModule);
+
 private:
-  static std::vector<char> m_ReadFile(const std::string &filePath);
+  friend class PipelineManager;
+
+  // Takes ownership of an already compiled pipeline, see PipelineManager.
+  Pipeline(Device &device, VkPipeline pipeline, VkShaderModule vertModule,
+           VkShaderModule fragModule);
+
   void m_CreateGraphicsPipeline(const std::string &vertFilepath,
                                 const std::string &fragFilepath,
-                                const PipelineConfigInfo &config);
-
-  void m_CreateShaderModule(const std::vector<char> &code,
-                            VkShaderModule *shaderModule);
+                                const PipelineConfigInfo &config,
+                                const ShaderVariant &variant);
 
   Device &m_Device;
-  VkPipeline m_VkPipeline;         // NOTE VkPipeline contains an address
-  VkShaderModule m_VkShaderModule; // NOTE VkShaderModule contains an address
-  VkShaderModule m_VkFragModule;   // NOTE VkShaderModule contains an address
+  VkPipeline m_VkPipeline = VK_NULL_HANDLE;         // NOTE VkPipeline contains an address
+  VkShaderModule m_VkShaderModule = VK_NULL_HANDLE; // NOTE VkShaderModule contains an address
+  VkShaderModule m_VkFragModule = VK_NULL_HANDLE;   // NOTE VkShaderModule contains an address
 };
 } // namespace teng
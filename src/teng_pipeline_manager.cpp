@@ -0,0 +1,338 @@
+#include "teng_pipeline_manager.hpp"
+#include "utils.hpp"
+#include "teng_profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <stdexcept>
+#include <tuple>
+
+namespace teng {
+
+  // HANDLE
+
+  bool PipelineHandle::isReady() const {
+    return m_Entry && m_Entry->state.load(std::memory_order_acquire) == State::Ready;
+  }
+
+  bool PipelineHandle::hasFailed() const {
+    return m_Entry && m_Entry->state.load(std::memory_order_acquire) == State::Failed;
+  }
+
+  std::size_t PipelineHandle::key() const {
+    assert(m_Entry && "key() called on an empty PipelineHandle");
+    return m_Entry->key;
+  }
+
+  Pipeline *PipelineHandle::get() const {
+    if (!m_Entry) return nullptr;
+
+    switch (m_Entry->state.load(std::memory_order_acquire)) {
+      case State::Ready:
+        return m_Entry->pipeline.get();
+      case State::Failed:
+        throw std::runtime_error("pipeline compilation failed: " + m_Entry->error);
+      default:
+        return nullptr;
+    }
+  }
+
+  // MANAGER
+
+  PipelineManager::PipelineManager(Device &device, uint32_t workerCount)
+    : mr_Device{device} {
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(mr_Device.device(), &cacheInfo, nullptr, &mp_PipelineCache) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline cache");
+    }
+
+    // Leave a core for the render loop.
+    if (workerCount == 0) {
+      workerCount = std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+    }
+    for (uint32_t i = 0; i < workerCount; i++) {
+      m_Workers.emplace_back(&PipelineManager::m_WorkerLoop, this);
+    }
+  }
+
+  PipelineManager::~PipelineManager() {
+    {
+      std::lock_guard<std::mutex> lock{m_Mutex};
+      m_Stop = true;
+      m_Queue.clear();
+    }
+    m_WorkAvailable.notify_all();
+    for (auto &worker : m_Workers) {
+      worker.join();
+    }
+
+    // Pipelines still referenced by handles are destroyed with their last handle.
+    m_Entries.clear();
+    vkDestroyPipelineCache(mr_Device.device(), mp_PipelineCache, nullptr);
+  }
+
+  PipelineHandle PipelineManager::request(const std::string &vertFilepath,
+                                          const std::string &fragFilepath,
+                                          const PipelineConfigInfo &config,
+                                          const ShaderVariant &variant) {
+
+    const std::size_t key = s_HashPipelineDescription(vertFilepath, fragFilepath, config, variant);
+
+    {
+      std::lock_guard<std::mutex> lock{m_Mutex};
+      // The hash only narrows the search, a collision must not hand out another description's pipeline.
+      auto range = m_Entries.equal_range(key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (s_SameDescription(*it->second, vertFilepath, fragFilepath, config, variant)) {
+          return PipelineHandle{it->second};
+        }
+      }
+
+      auto entry = std::make_shared<Entry>();
+      entry->key = key;
+      entry->vertFilepath = vertFilepath;
+      entry->fragFilepath = fragFilepath;
+      entry->config = config;
+      entry->variant = variant;
+
+      m_Entries.emplace(key, entry);
+      m_Queue.push_back(entry);
+      m_WorkAvailable.notify_one();
+      return PipelineHandle{entry};
+    }
+  }
+
+  void PipelineManager::waitIdle() {
+    std::unique_lock<std::mutex> lock{m_Mutex};
+    m_WorkDone.wait(lock, [this] { return m_Queue.empty() && m_InFlight == 0; });
+  }
+
+  void PipelineManager::m_WorkerLoop() {
+    TENG_PROFILE_THREAD("pipeline compiler");
+    std::vector<std::shared_ptr<Entry>> batch;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock{m_Mutex};
+        m_WorkAvailable.wait(lock, [this] { return m_Stop || !m_Queue.empty(); });
+        if (m_Stop) return;
+
+        // Take everything that piled up, so that it goes to the driver in one call.
+        while (!m_Queue.empty() && batch.size() < MAX_BATCH_SIZE) {
+          batch.push_back(std::move(m_Queue.front()));
+          m_Queue.pop_front();
+        }
+        m_InFlight += static_cast<uint32_t>(batch.size());
+      }
+
+      m_CompileBatch(batch);
+
+      {
+        std::lock_guard<std::mutex> lock{m_Mutex};
+        m_InFlight -= static_cast<uint32_t>(batch.size());
+      }
+      m_WorkDone.notify_all();
+      batch.clear();
+    }
+  }
+
+  void PipelineManager::m_CompileBatch(std::vector<std::shared_ptr<Entry>> &batch) {
+    TENG_PROFILE_ZONE("PipelineManager::compileBatch");
+
+    auto fail = [](Entry &entry, const std::string &error) {
+      entry.error = error;
+      entry.state.store(PipelineHandle::State::Failed, std::memory_order_release);
+    };
+
+    // Shader modules first. A missing file only fails its own request.
+    std::vector<std::shared_ptr<Entry>> entries;
+    std::vector<std::pair<VkShaderModule, VkShaderModule>> modules;
+    for (auto &entry : batch) {
+      VkShaderModule vertModule = VK_NULL_HANDLE;
+      VkShaderModule fragModule = VK_NULL_HANDLE;
+      try {
+        Pipeline::s_CreateShaderModule(mr_Device, Pipeline::s_ReadFile(entry->vertFilepath), &vertModule);
+        Pipeline::s_CreateShaderModule(mr_Device, Pipeline::s_ReadFile(entry->fragFilepath), &fragModule);
+      } catch (const std::exception &e) {
+        vkDestroyShaderModule(mr_Device.device(), vertModule, nullptr);
+        vkDestroyShaderModule(mr_Device.device(), fragModule, nullptr);
+        fail(*entry, e.what());
+        continue;
+      }
+      entries.push_back(entry);
+      modules.emplace_back(vertModule, fragModule);
+    }
+
+    if (entries.empty()) return;
+
+    std::vector<std::unique_ptr<Pipeline::CreateState>> states;
+    std::vector<VkGraphicsPipelineCreateInfo> createInfos;
+    for (size_t i = 0; i < entries.size(); i++) {
+      states.push_back(std::make_unique<Pipeline::CreateState>());
+      Pipeline::s_FillCreateState(modules[i].first, modules[i].second, entries[i]->config, entries[i]->variant, *states.back());
+      createInfos.push_back(states.back()->pipelineInfo);
+    }
+
+    std::vector<VkPipeline> pipelines(entries.size(), VK_NULL_HANDLE);
+    TENG_PROFILE_ZONE("vkCreateGraphicsPipelines");
+    VkResult result = vkCreateGraphicsPipelines(
+        mr_Device.device(),
+        mp_PipelineCache,
+        static_cast<uint32_t>(createInfos.size()),
+        createInfos.data(),
+        nullptr,
+        pipelines.data());
+
+    // A failed batch doesn't tell which create info was at fault, so retry
+    // the ones that didn't come back one at a time.
+    if (result != VK_SUCCESS && entries.size() > 1) {
+      for (size_t i = 0; i < entries.size(); i++) {
+        if (pipelines[i] != VK_NULL_HANDLE) continue;
+        vkCreateGraphicsPipelines(mr_Device.device(), mp_PipelineCache, 1, &createInfos[i], nullptr, &pipelines[i]);
+      }
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (pipelines[i] == VK_NULL_HANDLE) {
+        vkDestroyShaderModule(mr_Device.device(), modules[i].first, nullptr);
+        vkDestroyShaderModule(mr_Device.device(), modules[i].second, nullptr);
+        fail(*entries[i], "failed to create graphics pipeline");
+        continue;
+      }
+
+      entries[i]->pipeline = std::unique_ptr<Pipeline>(
+          new Pipeline(mr_Device, pipelines[i], modules[i].first, modules[i].second));
+      entries[i]->state.store(PipelineHandle::State::Ready, std::memory_order_release);
+    }
+  }
+
+  namespace {
+
+    // Everything a pipeline is built from but its dynamic states, for hashing
+    // and for comparing descriptions, so the two can't disagree.
+    auto s_DescriptionFields(const std::string &vertFilepath,
+                             const std::string &fragFilepath,
+                             const PipelineConfigInfo &config,
+                             const ShaderVariant &variant) {
+      const auto &ia = config.inputAssemblyInfo;
+      const auto &vp = config.viewportInfo;
+      const auto &rs = config.rasterizationInfo;
+      const auto &ms = config.multisampleInfo;
+      const auto &cb = config.colorBlendAttachment;
+      const auto &cbi = config.colorBlendInfo;
+      const auto &ds = config.depthStencilInfo;
+      return std::make_tuple(
+          vertFilepath, fragFilepath, variant.key(),
+          ia.topology, ia.primitiveRestartEnable,
+          vp.viewportCount, vp.scissorCount,
+          rs.depthClampEnable, rs.rasterizerDiscardEnable, rs.polygonMode,
+          rs.lineWidth, rs.cullMode, rs.frontFace, rs.depthBiasEnable,
+          rs.depthBiasConstantFactor, rs.depthBiasClamp, rs.depthBiasSlopeFactor,
+          ms.rasterizationSamples, ms.sampleShadingEnable, ms.minSampleShading,
+          ms.alphaToCoverageEnable, ms.alphaToOneEnable,
+          cb.blendEnable, cb.srcColorBlendFactor, cb.dstColorBlendFactor,
+          cb.colorBlendOp, cb.srcAlphaBlendFactor, cb.dstAlphaBlendFactor,
+          cb.alphaBlendOp, cb.colorWriteMask,
+          cbi.logicOpEnable, cbi.logicOp, cbi.attachmentCount,
+          cbi.blendConstants[0], cbi.blendConstants[1],
+          cbi.blendConstants[2], cbi.blendConstants[3],
+          ds.depthTestEnable, ds.depthWriteEnable, ds.depthCompareOp,
+          ds.depthBoundsTestEnable, ds.minDepthBounds, ds.maxDepthBounds,
+          ds.stencilTestEnable,
+          config.pipelineLayout, config.renderPass, config.subpass,
+          config.colorAttachmentFormat, config.depthAttachmentFormat);
+    }
+  }
+
+  std::size_t PipelineManager::s_HashPipelineDescription(const std::string &vertFilepath,
+                                                         const std::string &fragFilepath,
+                                                         const PipelineConfigInfo &config,
+                                                         const ShaderVariant &variant) {
+    std::size_t seed = 0;
+    std::apply([&seed](const auto &...fields) { hashCombine(seed, fields...); },
+               s_DescriptionFields(vertFilepath, fragFilepath, config, variant));
+    for (auto dynamicState : config.dynamicStateEnables) {
+      hashCombine(seed, dynamicState);
+    }
+    return seed;
+  }
+
+  bool PipelineManager::s_SameDescription(const Entry &entry,
+                                          const std::string &vertFilepath,
+                                          const std::string &fragFilepath,
+                                          const PipelineConfigInfo &config,
+                                          const ShaderVariant &variant) {
+    return entry.config.dynamicStateEnables == config.dynamicStateEnables &&
+           s_DescriptionFields(entry.vertFilepath, entry.fragFilepath, entry.config, entry.variant) ==
+               s_DescriptionFields(vertFilepath, fragFilepath, config, variant);
+  }
+
+  // RASTER STATE PIPELINES
+
+  RasterStatePipelines::RasterStatePipelines(Device &device,
+                                             PipelineManager &pipelineManager,
+                                             const std::string &vertFilepath,
+                                             const std::string &fragFilepath,
+                                             const PipelineConfigInfo &baseConfig,
+                                             const ShaderVariant &variant)
+    : mp_Device{&device},
+      mp_PipelineManager{&pipelineManager},
+      m_VertFilepath{vertFilepath},
+      m_FragFilepath{fragFilepath},
+      m_BaseConfig{baseConfig},
+      m_Variant{variant},
+      m_Dynamic{device.features().extendedDynamicState} {
+
+    if (m_Dynamic) {
+      Pipeline::s_EnableDynamicRasterState(m_BaseConfig);
+    }
+
+    // Start compiling the common case right away.
+    m_HandleFor(RasterState{});
+  }
+
+  void RasterStatePipelines::reset() {
+    mp_BoundPipeline = nullptr;
+    m_HasBoundState = false;
+    m_BindCount = 0;
+  }
+
+  bool RasterStatePipelines::bind(VkCommandBuffer commandBuffer, const RasterState &state) {
+    Pipeline *pipeline = m_HandleFor(state).get();
+    if (!pipeline) return false;
+
+    if (pipeline != mp_BoundPipeline) {
+      pipeline->bind(commandBuffer);
+      mp_BoundPipeline = pipeline;
+      m_BindCount++;
+    }
+
+    if (m_Dynamic && (!m_HasBoundState || state != m_BoundState)) {
+      Pipeline::s_SetRasterState(*mp_Device, commandBuffer, state);
+      m_BoundState = state;
+      m_HasBoundState = true;
+    }
+    return true;
+  }
+
+  PipelineHandle &RasterStatePipelines::m_HandleFor(const RasterState &state) {
+    assert(mp_PipelineManager && "RasterStatePipelines used before being set up");
+
+    const uint32_t key = m_Dynamic ? 0 : state.key();
+    auto it = m_Handles.find(key);
+    if (it != m_Handles.end()) {
+      return it->second;
+    }
+
+    PipelineConfigInfo config = m_BaseConfig;
+    if (!m_Dynamic) {
+      Pipeline::s_ApplyRasterState(config, state);
+    }
+    auto handle = mp_PipelineManager->request(m_VertFilepath, m_FragFilepath, config, m_Variant);
+    return m_Handles.emplace(key, handle).first->second;
+  }
+
+} // namespace teng
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "teng_pipeline.hpp"
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace teng {
+
+class PipelineManager;
+
+// Non-blocking reference to a pipeline that may still be compiling.
+// Copies share the same underlying pipeline.
+class PipelineHandle {
+public:
+  PipelineHandle() = default;
+
+  bool isValid() const { return m_Entry != nullptr; }
+  bool isReady() const;
+  bool hasFailed() const;
+  std::size_t key() const;
+
+  // Returns nullptr while the pipeline is being compiled. Throws if compilation failed.
+  Pipeline *get() const;
+
+private:
+  friend class PipelineManager;
+
+  enum class State { Pending, Ready, Failed };
+
+  struct Entry {
+    std::size_t key;
+    std::string vertFilepath;
+    std::string fragFilepath;
+    PipelineConfigInfo config;
+    ShaderVariant variant;
+
+    std::atomic<State> state{State::Pending};
+    std::unique_ptr<Pipeline> pipeline;
+    std::string error;
+  };
+
+  explicit PipelineHandle(std::shared_ptr<Entry> entry) : m_Entry{std::move(entry)} {}
+
+  std::shared_ptr<Entry> m_Entry;
+};
+
+// Compiles pipelines on worker threads so that the render loop never waits on
+// the driver's shader compiler. Requests are deduplicated by the shader paths,
+// the variant and the PipelineConfigInfo, looked up by their hash, and
+// whatever is queued when a worker wakes up is created with a single
+// vkCreateGraphicsPipelines call.
+class PipelineManager {
+public:
+  static constexpr uint32_t MAX_BATCH_SIZE = 16;
+
+  // workerCount = 0 picks a count based on the hardware concurrency.
+  PipelineManager(Device &device, uint32_t workerCount = 0);
+  ~PipelineManager();
+
+  PipelineManager(const PipelineManager &) = delete;
+  PipelineManager &operator=(const PipelineManager &) = delete;
+
+  // Returns immediately. Requesting an already known description returns a
+  // handle to the existing pipeline, so every shader variant is compiled once.
+  PipelineHandle request(const std::string &vertFilepath,
+                         const std::string &fragFilepath,
+                         const PipelineConfigInfo &config,
+                         const ShaderVariant &variant = {});
+
+  // Blocks until every request made so far has been compiled. Meant for
+  // loading screens and shutdown, not for the frame loop.
+  void waitIdle();
+
+  static std::size_t s_HashPipelineDescription(const std::string &vertFilepath,
+                                               const std::string &fragFilepath,
+                                               const PipelineConfigInfo &config,
+                                               const ShaderVariant &variant);
+
+private:
+  using Entry = PipelineHandle::Entry;
+
+  static bool s_SameDescription(const Entry &entry,
+                                const std::string &vertFilepath,
+                                const std::string &fragFilepath,
+                                const PipelineConfigInfo &config,
+                                const ShaderVariant &variant);
+
+  void m_WorkerLoop();
+  void m_CompileBatch(std::vector<std::shared_ptr<Entry>> &batch);
+
+  Device &mr_Device;
+  VkPipelineCache mp_PipelineCache = VK_NULL_HANDLE;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_WorkAvailable;
+  std::condition_variable m_WorkDone;
+  std::unordered_multimap<std::size_t, std::shared_ptr<Entry>> m_Entries; // By description hash.
+  std::deque<std::shared_ptr<Entry>> m_Queue;
+  uint32_t m_InFlight{0};
+  bool m_Stop{false};
+
+  std::vector<std::thread> m_Workers;
+};
+
+// The pipelines one shader variant needs across RasterStates. With extended
+// dynamic state that is a single pipeline and the state goes on the command
+// buffer, otherwise each RasterState in use gets its own baked pipeline.
+class RasterStatePipelines {
+public:
+  RasterStatePipelines() = default;
+  RasterStatePipelines(Device &device,
+                       PipelineManager &pipelineManager,
+                       const std::string &vertFilepath,
+                       const std::string &fragFilepath,
+                       const PipelineConfigInfo &baseConfig,
+                       const ShaderVariant &variant = {});
+
+  // Call once per command buffer before the first bind, bound state isn't
+  // carried over between recordings.
+  void reset();
+
+  // Binds the pipeline for state unless it is already bound. Returns false,
+  // binding nothing, while that pipeline is still compiling.
+  bool bind(VkCommandBuffer commandBuffer, const RasterState &state);
+
+  // Number of vkCmdBindPipeline calls since the last reset.
+  uint32_t bindCount() const { return m_BindCount; }
+
+private:
+  PipelineHandle &m_HandleFor(const RasterState &state);
+
+  Device *mp_Device = nullptr;
+  PipelineManager *mp_PipelineManager = nullptr;
+  std::string m_VertFilepath;
+  std::string m_FragFilepath;
+  PipelineConfigInfo m_BaseConfig;
+  ShaderVariant m_Variant;
+  bool m_Dynamic = false;
+
+  std::unordered_map<uint32_t, PipelineHandle> m_Handles; // By RasterState::key(), a single entry when dynamic.
+
+  Pipeline *mp_BoundPipeline = nullptr;
+  RasterState m_BoundState;
+  bool m_HasBoundState = false;
+  uint32_t m_BindCount = 0;
+};
+
+} // namespace teng
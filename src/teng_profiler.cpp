@@ -0,0 +1,144 @@
+#include "teng_profiler.hpp"
+
+// std
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace teng {
+
+    std::atomic<bool> CpuProfiler::s_Enabled{false};
+
+    namespace {
+
+        struct Zone {
+            const char* name;
+            uint64_t start;
+            uint64_t end;
+        };
+
+        // Single producer, single consumer. head is only written by the owning
+        // thread, tail only by collect, which holds the registry lock.
+        struct Ring {
+            std::vector<Zone> zones = std::vector<Zone>(CpuProfiler::RING_CAPACITY);
+            std::atomic<uint64_t> head{0};
+            std::atomic<uint64_t> tail{0};
+            std::atomic<uint64_t> dropped{0};
+            uint32_t threadId{0};
+            std::string threadName;
+        };
+
+        // Rings outlive their threads, zones recorded right before a thread exits are still collected.
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<Ring>> rings;
+        };
+
+        Registry& s_Registry() {
+            static Registry registry;
+            return registry;
+        }
+
+        Ring& s_ThreadRing() {
+            thread_local std::shared_ptr<Ring> ring = []() {
+                auto created = std::make_shared<Ring>();
+                Registry& registry = s_Registry();
+                std::lock_guard<std::mutex> lock{registry.mutex};
+                created->threadId = static_cast<uint32_t>(registry.rings.size()) + 1;
+                created->threadName = "thread " + std::to_string(created->threadId);
+                registry.rings.push_back(created);
+                return created;
+            }();
+            return *ring;
+        }
+
+        int64_t steadyNowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Maps timestamps to steady_clock nanoseconds from two reference points,
+        // one taken when recording is first enabled and one at every collect, so
+        // the rate gets more accurate the longer the program runs.
+        struct Clock {
+            uint64_t startTicks{CpuProfiler::now()};
+            int64_t startNs{steadyNowNs()};
+        };
+
+        Clock& s_Clock() {
+            static Clock clock;
+            return clock;
+        }
+    }
+
+    void CpuProfiler::setEnabled(bool enabled) {
+        if(enabled) s_Clock();
+        s_Enabled.store(enabled, std::memory_order_relaxed);
+    };
+
+    void CpuProfiler::setThreadName(std::string name) {
+        Ring& ring = s_ThreadRing();
+        std::lock_guard<std::mutex> lock{s_Registry().mutex};
+        ring.threadName = std::move(name);
+    };
+
+    void CpuProfiler::record(const char* name, uint64_t start, uint64_t end) {
+        Ring& ring = s_ThreadRing();
+        const uint64_t head = ring.head.load(std::memory_order_relaxed);
+        if(head - ring.tail.load(std::memory_order_acquire) >= RING_CAPACITY) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring.zones[head % RING_CAPACITY] = Zone{name, start, end};
+        ring.head.store(head + 1, std::memory_order_release);
+    };
+
+    uint64_t CpuProfiler::collect(
+        std::vector<TraceEvent>& events,
+        std::vector<std::pair<uint32_t, std::string>>* threadNames)
+    {
+#if TENG_PROFILE_HAS_TSC
+        // Too close to the first reference point, the rate would be noise.
+        const Clock& start = s_Clock();
+        const int64_t minimumNs = 10'000'000;
+        if(steadyNowNs() - start.startNs < minimumNs) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds{minimumNs - (steadyNowNs() - start.startNs)});
+        }
+        const uint64_t nowTicks = now();
+        const int64_t nowNs = steadyNowNs();
+        const double nsPerTick = nowTicks > start.startTicks
+            ? static_cast<double>(nowNs - start.startNs) / static_cast<double>(nowTicks - start.startTicks)
+            : 1.0;
+        auto toNs = [&](uint64_t ticks) {
+            return start.startNs + static_cast<int64_t>(static_cast<double>(static_cast<int64_t>(ticks - start.startTicks)) * nsPerTick);
+        };
+#else
+        const double nsPerTick = 1.0;
+        auto toNs = [](uint64_t ticks) { return static_cast<int64_t>(ticks); };
+#endif
+
+        uint64_t dropped = 0;
+        Registry& registry = s_Registry();
+        std::lock_guard<std::mutex> lock{registry.mutex};
+        for(const auto& ring : registry.rings) {
+            const uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            for(; tail < head; tail++) {
+                const Zone& zone = ring->zones[tail % RING_CAPACITY];
+                TraceEvent& event = events.emplace_back();
+                event.name = zone.name;
+                event.startNs = toNs(zone.start);
+                event.durationNs = static_cast<int64_t>(static_cast<double>(zone.end - zone.start) * nsPerTick);
+                event.threadId = ring->threadId;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+
+            if(threadNames) {
+                threadNames->emplace_back(ring->threadId, ring->threadName);
+            }
+        }
+        return dropped;
+    };
+} // namespace teng
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "teng_trace.hpp"
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <x86intrin.h>
+#define TENG_PROFILE_HAS_TSC 1
+#else
+#include <chrono>
+#define TENG_PROFILE_HAS_TSC 0
+#endif
+
+// Zones are compiled in unless TENG_PROFILE is defined to 0, in which case the
+// macros below expand to nothing. Compiled in, a zone costs a relaxed load and
+// a branch while recording is off, and two timestamp reads and a store into
+// the thread's ring while it's on.
+#ifndef TENG_PROFILE
+#define TENG_PROFILE 1
+#endif
+
+namespace teng {
+
+    // Records scoped CPU zones into one ring buffer per thread. Only the owning
+    // thread writes a ring and only collect() reads it, so recording takes no
+    // locks. A full ring drops new zones until the next collect().
+    //
+    // Timestamps are the TSC where there is one, converted to steady_clock
+    // nanoseconds when collected, which assumes an invariant TSC like every
+    // x86 CPU of the last decade has.
+    class CpuProfiler {
+
+        public:
+
+            static constexpr uint32_t RING_CAPACITY = 1 << 14; // Zones per thread between collects.
+
+            static void setEnabled(bool enabled);
+            static bool isEnabled() { return s_Enabled.load(std::memory_order_relaxed); };
+
+            // Names the calling thread's track in traces.
+            static void setThreadName(std::string name);
+
+            static uint64_t now() {
+#if TENG_PROFILE_HAS_TSC
+                return __rdtsc();
+#else
+                return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+            };
+
+            // Appends the zone to the calling thread's ring. name must outlive the
+            // profiler, zones take string literals.
+            static void record(const char* name, uint64_t start, uint64_t end);
+
+            // Moves every thread's recorded zones into events and returns the number
+            // dropped because a ring was full. threadNames gets every thread seen.
+            static uint64_t collect(
+                std::vector<TraceEvent>& events,
+                std::vector<std::pair<uint32_t, std::string>>* threadNames = nullptr);
+
+        private:
+
+            static std::atomic<bool> s_Enabled;
+    };
+
+    class ProfileZone {
+
+        public:
+
+            explicit ProfileZone(const char* name) : mp_Name(name) {
+                if(CpuProfiler::isEnabled()) m_Start = CpuProfiler::now();
+            };
+            ~ProfileZone() {
+                if(m_Start != 0) CpuProfiler::record(mp_Name, m_Start, CpuProfiler::now());
+            };
+
+            ProfileZone(const ProfileZone&) = delete;
+            ProfileZone &operator=(const ProfileZone&) = delete;
+
+        private:
+
+            const char* mp_Name;
+            uint64_t m_Start{0};
+    };
+} // namespace teng
+
+#define TENG_PROFILE_CONCAT_INNER(a, b) a##b
+#define TENG_PROFILE_CONCAT(a, b) TENG_PROFILE_CONCAT_INNER(a, b)
+
+#if TENG_PROFILE
+// Times the rest of the enclosing scope. name must be a string literal.
+#define TENG_PROFILE_ZONE(name) ::teng::ProfileZone TENG_PROFILE_CONCAT(tengProfileZone, __LINE__){name}
+#define TENG_PROFILE_FUNCTION() TENG_PROFILE_ZONE(__func__)
+#define TENG_PROFILE_THREAD(name) ::teng::CpuProfiler::setThreadName(name)
+#else
+#define TENG_PROFILE_ZONE(name) ((void)0)
+#define TENG_PROFILE_FUNCTION() ((void)0)
+#define TENG_PROFILE_THREAD(name) ((void)0)
+#endif
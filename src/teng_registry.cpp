@@ -0,0 +1,351 @@
+#include "teng_registry.hpp"
+#include "teng_transform_batch.hpp"
+#include "teng_thread_pool.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <atomic>
+
+namespace teng {
+
+    uint64_t Registry::s_NextVersions(uint64_t count) {
+        static std::atomic<uint64_t> version{0};
+        return version.fetch_add(count, std::memory_order_relaxed) + 1;
+    };
+
+    Entity Registry::create() {
+        uint32_t slot;
+        if(!m_FreeSlots.empty()) {
+            slot = m_FreeSlots.back();
+            m_FreeSlots.pop_back();
+        } else {
+            slot = static_cast<uint32_t>(m_Slots.size());
+            m_Slots.emplace_back();
+        }
+
+        const Entity entity{slot, m_Slots[slot].generation};
+        m_Slots[slot].dense = size();
+
+        m_Entities.push_back(entity);
+        m_Components.push_back(COMPONENT_TRANSFORM);
+        m_Translations.emplace_back(0.f);
+        m_Rotations.emplace_back(0.f);
+        m_Scales.emplace_back(1.f);
+        m_Orientations.emplace_back(1.f, 0.f, 0.f, 0.f);
+        m_Velocities.emplace_back(0.f);
+        m_Masses.push_back(1.f);
+        m_Colors.emplace_back(0.f);
+        m_ModelHandles.push_back(NO_MODEL);
+        m_Nodes.emplace_back();
+        m_Dirty.push_back(CLEAN);
+        m_WorldMatrices.emplace_back(1.f);
+        m_NormalMatrices.emplace_back(1.f);
+        m_MatrixVersions.push_back(s_NextVersions(1));
+        m_QueueUpdate(size() - 1);
+        return entity;
+    };
+
+    void Registry::destroy(Entity entity) {
+        if(!isAlive(entity)) return;
+
+        // Children first, each unlinks itself from this entity.
+        for(uint32_t child = m_Nodes[denseIndex(entity)].firstChild; child != Entity::INVALID_INDEX;
+            child = m_Nodes[denseIndex(entity)].firstChild) {
+            destroy(m_EntityAt(child));
+        }
+
+        // The last entity moves into the hole.
+        const uint32_t dense = m_Slots[entity.index].dense;
+        m_Unlink(dense);
+        const uint32_t last = size() - 1;
+        if(dense != last) {
+            const Entity moved = m_Entities[last];
+            m_Entities[dense] = moved;
+            m_Components[dense] = m_Components[last];
+            m_Translations[dense] = m_Translations[last];
+            m_Rotations[dense] = m_Rotations[last];
+            m_Scales[dense] = m_Scales[last];
+            m_Orientations[dense] = m_Orientations[last];
+            m_Velocities[dense] = m_Velocities[last];
+            m_Masses[dense] = m_Masses[last];
+            m_Colors[dense] = m_Colors[last];
+            m_ModelHandles[dense] = m_ModelHandles[last];
+            m_Nodes[dense] = m_Nodes[last];
+            m_Dirty[dense] = m_Dirty[last];
+            m_WorldMatrices[dense] = m_WorldMatrices[last];
+            m_NormalMatrices[dense] = m_NormalMatrices[last];
+            // Same matrices at a new index, copies indexed by dense index are stale.
+            m_MatrixVersions[dense] = s_NextVersions(1);
+            m_Slots[moved.index].dense = dense;
+        }
+
+        m_Entities.pop_back();
+        m_Components.pop_back();
+        m_Translations.pop_back();
+        m_Rotations.pop_back();
+        m_Scales.pop_back();
+        m_Orientations.pop_back();
+        m_Velocities.pop_back();
+        m_Masses.pop_back();
+        m_Colors.pop_back();
+        m_ModelHandles.pop_back();
+        m_Nodes.pop_back();
+        m_Dirty.pop_back();
+        m_WorldMatrices.pop_back();
+        m_NormalMatrices.pop_back();
+        m_MatrixVersions.pop_back();
+
+        m_Slots[entity.index].dense = Entity::INVALID_INDEX;
+        m_Slots[entity.index].generation++;
+        m_FreeSlots.push_back(entity.index);
+    };
+
+    void Registry::clear() {
+        for(const Entity& entity : m_Entities) {
+            m_Slots[entity.index].dense = Entity::INVALID_INDEX;
+            m_Slots[entity.index].generation++;
+            m_FreeSlots.push_back(entity.index);
+        }
+        m_Entities.clear();
+        m_Components.clear();
+        m_Translations.clear();
+        m_Rotations.clear();
+        m_Scales.clear();
+        m_Orientations.clear();
+        m_Velocities.clear();
+        m_Masses.clear();
+        m_Colors.clear();
+        m_ModelHandles.clear();
+        m_Nodes.clear();
+        m_Dirty.clear();
+        m_WorldMatrices.clear();
+        m_NormalMatrices.clear();
+        m_MatrixVersions.clear();
+        m_DirtySlots.clear();
+    };
+
+    void Registry::reserve(uint32_t count) {
+        m_Slots.reserve(count);
+        m_Entities.reserve(count);
+        m_Components.reserve(count);
+        m_Translations.reserve(count);
+        m_Rotations.reserve(count);
+        m_Scales.reserve(count);
+        m_Orientations.reserve(count);
+        m_Velocities.reserve(count);
+        m_Masses.reserve(count);
+        m_Colors.reserve(count);
+        m_ModelHandles.reserve(count);
+        m_Nodes.reserve(count);
+        m_Dirty.reserve(count);
+        m_WorldMatrices.reserve(count);
+        m_NormalMatrices.reserve(count);
+        m_MatrixVersions.reserve(count);
+    };
+
+    uint32_t Registry::updateWorldMatrices(ThreadPool* threadPool) {
+        TENG_PROFILE_ZONE("Registry::updateWorldMatrices");
+        if(m_DirtySlots.empty()) return 0;
+
+        // Changed entities by depth.
+        for(auto& level : m_Levels) level.clear();
+        for(uint32_t slot : m_DirtySlots) {
+            const uint32_t dense = m_Slots[slot].dense;
+            // Destroyed since, or queued again after its slot was reused.
+            if(dense == Entity::INVALID_INDEX || m_Dirty[dense] != QUEUED) continue;
+            m_Dirty[dense] = SCHEDULED;
+            const uint32_t depth = m_Nodes[dense].depth;
+            if(m_Levels.size() <= depth) m_Levels.resize(depth + 1);
+            m_Levels[depth].push_back(dense);
+        }
+        m_DirtySlots.clear();
+
+        // A level's world matrices are final before the next one reads them as
+        // parents, and each level adds the children of what it updated to the next.
+        uint32_t updated = 0;
+        for(size_t depth = 0; depth < m_Levels.size(); depth++) {
+            const uint32_t count = static_cast<uint32_t>(m_Levels[depth].size());
+            if(count == 0) continue;
+
+            const uint32_t* level = m_Levels[depth].data();
+            const uint64_t firstVersion = s_NextVersions(count);
+            const uint32_t chunkCount = (count - 1) / UPDATE_GRAIN + 1;
+            if(m_ChunkChildren.size() < chunkCount) m_ChunkChildren.resize(chunkCount);
+
+            auto updateChunk = [&](uint32_t begin, uint32_t end) {
+                std::vector<uint32_t>& children = m_ChunkChildren[begin / UPDATE_GRAIN];
+                children.clear();
+                m_UpdateEntities(level + begin, end - begin, firstVersion + begin, children);
+            };
+            ThreadPool::s_ForChunks(threadPool, count, UPDATE_GRAIN, updateChunk);
+            updated += count;
+
+            for(uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                const std::vector<uint32_t>& children = m_ChunkChildren[chunk];
+                if(children.empty()) continue;
+                if(m_Levels.size() <= depth + 1) m_Levels.resize(depth + 2);
+                m_Levels[depth + 1].insert(m_Levels[depth + 1].end(), children.begin(), children.end());
+            }
+        }
+        return updated;
+    };
+
+    void Registry::m_UpdateEntities(const uint32_t* dense, uint32_t count, uint64_t firstVersion, std::vector<uint32_t>& children) {
+        // A block at a time, so the two kinds of rotation can be split up without allocating.
+        constexpr uint32_t BLOCK = 256;
+        uint32_t euler[BLOCK];
+        uint32_t oriented[BLOCK];
+
+        for(uint32_t base = 0; base < count; base += BLOCK) {
+            const uint32_t blockCount = std::min(BLOCK, count - base);
+            uint32_t eulerCount = 0;
+            uint32_t orientedCount = 0;
+            for(uint32_t i = base; i < base + blockCount; i++) {
+                if(m_Components[dense[i]] & COMPONENT_ORIENTATION) {
+                    oriented[orientedCount++] = dense[i];
+                } else {
+                    euler[eulerCount++] = dense[i];
+                }
+            }
+
+            // Local matrices first, written where the world matrices go.
+            TransformBatch::s_EulerMatrices(
+                m_Translations.data(), m_Rotations.data(), m_Scales.data(),
+                euler, eulerCount, m_WorldMatrices.data(), m_NormalMatrices.data());
+            TransformBatch::s_QuaternionMatrices(
+                m_Translations.data(), m_Orientations.data(), m_Scales.data(),
+                oriented, orientedCount, m_WorldMatrices.data(), m_NormalMatrices.data());
+
+            for(uint32_t i = base; i < base + blockCount; i++) {
+                const uint32_t d = dense[i];
+                const Node& node = m_Nodes[d];
+                if(node.parent != Entity::INVALID_INDEX) {
+                    // The normal matrix of a product is the product of the normal matrices.
+                    const uint32_t parent = m_Slots[node.parent].dense;
+                    m_WorldMatrices[d] = m_WorldMatrices[parent] * m_WorldMatrices[d];
+                    m_NormalMatrices[d] = m_NormalMatrices[parent] * m_NormalMatrices[d];
+                }
+                m_MatrixVersions[d] = firstVersion + i;
+                m_Dirty[d] = CLEAN;
+
+                // Children that changed themselves are already scheduled.
+                for(uint32_t child = node.firstChild; child != Entity::INVALID_INDEX;) {
+                    const uint32_t c = m_Slots[child].dense;
+                    if(m_Dirty[c] == CLEAN) {
+                        m_Dirty[c] = SCHEDULED;
+                        children.push_back(c);
+                    }
+                    child = m_Nodes[c].nextSibling;
+                }
+            }
+        }
+    };
+
+    void Registry::markAllTransformsDirty() {
+        for(uint32_t i = 0; i < size(); i++) {
+            m_QueueUpdate(i);
+        }
+    };
+
+    void Registry::setParent(Entity child, Entity parent) {
+        const uint32_t dense = denseIndex(child);
+        m_Unlink(dense);
+
+        uint32_t depth = 0;
+        if(parent.index != Entity::INVALID_INDEX) {
+            assert(!m_IsDescendant(parent.index, child.index) && "parent is child or one of its descendants");
+            Node& parentNode = m_Nodes[denseIndex(parent)];
+            Node& node = m_Nodes[dense];
+            node.parent = parent.index;
+            node.nextSibling = parentNode.firstChild;
+            if(parentNode.firstChild != Entity::INVALID_INDEX) {
+                m_Nodes[m_Slots[parentNode.firstChild].dense].previousSibling = child.index;
+            }
+            parentNode.firstChild = child.index;
+            depth = parentNode.depth + 1;
+        }
+        m_SetDepth(dense, depth);
+        m_QueueUpdate(dense);
+    };
+
+    void Registry::m_Unlink(uint32_t dense) {
+        Node& node = m_Nodes[dense];
+        if(node.previousSibling != Entity::INVALID_INDEX) {
+            m_Nodes[m_Slots[node.previousSibling].dense].nextSibling = node.nextSibling;
+        } else if(node.parent != Entity::INVALID_INDEX) {
+            m_Nodes[m_Slots[node.parent].dense].firstChild = node.nextSibling;
+        }
+        if(node.nextSibling != Entity::INVALID_INDEX) {
+            m_Nodes[m_Slots[node.nextSibling].dense].previousSibling = node.previousSibling;
+        }
+        node.parent = Entity::INVALID_INDEX;
+        node.nextSibling = Entity::INVALID_INDEX;
+        node.previousSibling = Entity::INVALID_INDEX;
+    };
+
+    void Registry::m_SetDepth(uint32_t dense, uint32_t depth) {
+        m_Nodes[dense].depth = depth;
+        for(uint32_t child = m_Nodes[dense].firstChild; child != Entity::INVALID_INDEX;) {
+            const uint32_t c = m_Slots[child].dense;
+            m_SetDepth(c, depth + 1);
+            child = m_Nodes[c].nextSibling;
+        }
+    };
+
+    bool Registry::m_IsDescendant(uint32_t slot, uint32_t ancestorSlot) const {
+        for(; slot != Entity::INVALID_INDEX; slot = m_Nodes[m_Slots[slot].dense].parent) {
+            if(slot == ancestorSlot) return true;
+        }
+        return false;
+    };
+
+    ModelHandle Registry::addModel(std::shared_ptr<Model> model) {
+        auto it = m_ModelLookup.find(model.get());
+        if(it != m_ModelLookup.end()) return it->second;
+
+        const ModelHandle handle = static_cast<ModelHandle>(m_Models.size());
+        m_ModelLookup.emplace(model.get(), handle);
+        m_Models.push_back(std::move(model));
+        return handle;
+    };
+
+    void Registry::setRigidBody(Entity entity, const glm::vec3& velocity, float mass) {
+        const uint32_t dense = denseIndex(entity);
+        m_Velocities[dense] = velocity;
+        m_Masses[dense] = mass;
+        m_Components[dense] |= COMPONENT_RIGID_BODY;
+    };
+
+    void Registry::setModel(Entity entity, ModelHandle model) {
+        const uint32_t dense = denseIndex(entity);
+        m_ModelHandles[dense] = model;
+        if(model == NO_MODEL) {
+            m_Components[dense] &= static_cast<uint8_t>(~COMPONENT_MODEL);
+        } else {
+            m_Components[dense] |= COMPONENT_MODEL;
+        }
+    };
+
+    void Registry::setOrientation(Entity entity, const glm::quat& orientation) {
+        const uint32_t dense = m_MarkDirty(entity);
+        m_Orientations[dense] = orientation;
+        m_Components[dense] |= COMPONENT_ORIENTATION;
+    };
+
+    void Registry::removeComponents(Entity entity, uint8_t components) {
+        assert((components & COMPONENT_TRANSFORM) == 0 && "every entity has a transform");
+        const uint32_t dense = denseIndex(entity);
+        m_Components[dense] &= static_cast<uint8_t>(~components);
+        if(components & COMPONENT_ORIENTATION) {
+            // Back to the Euler angles, which were kept.
+            m_Orientations[dense] = glm::quat{1.f, 0.f, 0.f, 0.f};
+            m_QueueUpdate(dense);
+        }
+        if(components & COMPONENT_MODEL) m_ModelHandles[dense] = NO_MODEL;
+        if(components & COMPONENT_RIGID_BODY) {
+            m_Velocities[dense] = glm::vec3{0.f};
+            m_Masses[dense] = 1.f;
+        }
+    };
+} // namespace teng
@@ -0,0 +1,272 @@
+#pragma once
+
+#include "teng_model.hpp"
+
+// libs
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace teng {
+
+    class ThreadPool;
+
+    // Handle to an entity of a Registry. The generation tells a handle to a
+    // destroyed entity apart from one to the entity that reused its slot.
+    struct Entity {
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        uint32_t index{INVALID_INDEX};
+        uint32_t generation{0};
+
+        bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; };
+        bool operator!=(const Entity& other) const { return !(*this == other); };
+    };
+
+    // Index into the registry's model table, so entities don't each hold a shared_ptr.
+    using ModelHandle = uint32_t;
+    constexpr ModelHandle NO_MODEL = UINT32_MAX;
+
+    // Which components an entity has, every entity has a transform.
+    enum Component : uint8_t {
+        COMPONENT_TRANSFORM = 1 << 0,
+        COMPONENT_RIGID_BODY = 1 << 1,
+        COMPONENT_MODEL = 1 << 2,
+        // Rotation is the quaternion orientation() instead of the Euler angles of
+        // rotation(), so updating its matrices needs no trig.
+        COMPONENT_ORIENTATION = 1 << 3,
+    };
+
+    // Entity storage with each component field in its own dense array, all
+    // indexed by the same dense index. A pass that only reads translations and
+    // velocities streams through exactly those two arrays. Destroying an entity
+    // moves the last one into its place, so the arrays stay packed but dense
+    // indices change; hold Entity handles, not indices, across frames.
+    //
+    // Entities form a hierarchy: translation, rotation and scale are relative to
+    // the parent, and an entity's world matrix is its parent's times its own.
+    //
+    // World and normal matrices are cached and only recomputed, by
+    // updateWorldMatrices with TransformBatch, for entities whose transform
+    // changed and for their descendants. Every change
+    // of an entity's cached matrices, or of its dense index, stamps it with a
+    // new version, which is what renderers compare to skip unchanged uploads.
+    class Registry {
+
+        public:
+
+            // Dense indices of the entities that have all of the required components.
+            class View {
+
+                public:
+
+                    class Iterator {
+                        public:
+                            Iterator(const uint8_t* components, uint32_t index, uint32_t count, uint8_t required)
+                                : mp_Components(components), m_Index(index), m_Count(count), m_Required(required) { m_Skip(); };
+
+                            uint32_t operator*() const { return m_Index; };
+                            Iterator& operator++() { m_Index++; m_Skip(); return *this; };
+                            bool operator!=(const Iterator& other) const { return m_Index != other.m_Index; };
+
+                        private:
+                            void m_Skip() {
+                                while(m_Index < m_Count && (mp_Components[m_Index] & m_Required) != m_Required) m_Index++;
+                            };
+
+                            const uint8_t* mp_Components;
+                            uint32_t m_Index;
+                            uint32_t m_Count;
+                            uint8_t m_Required;
+                    };
+
+                    View(const uint8_t* components, uint32_t count, uint8_t required)
+                        : mp_Components(components), m_Count(count), m_Required(required) {};
+
+                    Iterator begin() const { return {mp_Components, 0, m_Count, m_Required}; };
+                    Iterator end() const { return {mp_Components, m_Count, m_Count, m_Required}; };
+
+                private:
+                    const uint8_t* mp_Components;
+                    uint32_t m_Count;
+                    uint8_t m_Required;
+            };
+
+            Registry() = default;
+
+            Registry(const Registry&) = delete;
+            Registry &operator=(const Registry&) = delete;
+            Registry(Registry&&) = default;
+            Registry &operator=(Registry&&) = default;
+
+            // A new entity with an identity transform and no other components.
+            Entity create();
+            // Destroys the entity and its descendants. Does nothing for handles that aren't alive.
+            void destroy(Entity entity);
+            bool isAlive(Entity entity) const {
+                return entity.index < m_Slots.size() && m_Slots[entity.index].generation == entity.generation &&
+                       m_Slots[entity.index].dense != Entity::INVALID_INDEX;
+            };
+            void clear();
+            void reserve(uint32_t count);
+
+            uint32_t size() const { return static_cast<uint32_t>(m_Entities.size()); };
+            uint32_t denseIndex(Entity entity) const {
+                assert(isAlive(entity) && "entity isn't alive");
+                return m_Slots[entity.index].dense;
+            };
+            Entity entityAt(uint32_t dense) const { return m_Entities[dense]; };
+            bool has(Entity entity, uint8_t components) const {
+                return (m_Components[denseIndex(entity)] & components) == components;
+            };
+
+            View view(uint8_t required) const { return {m_Components.data(), size(), required}; };
+
+            // Registers a model, once per pointer.
+            ModelHandle addModel(std::shared_ptr<Model> model);
+            Model* getModel(ModelHandle handle) const { return handle == NO_MODEL ? nullptr : m_Models[handle].get(); };
+
+            // Per-entity access.
+            // Returning a mutable reference marks the transform dirty.
+            glm::vec3& translation(Entity entity) { return m_Translations[m_MarkDirty(entity)]; };
+            glm::vec3& rotation(Entity entity) { return m_Rotations[m_MarkDirty(entity)]; };
+            glm::vec3& scale(Entity entity) { return m_Scales[m_MarkDirty(entity)]; };
+            glm::quat& orientation(Entity entity) {
+                assert(has(entity, COMPONENT_ORIENTATION) && "entity rotates with Euler angles");
+                return m_Orientations[m_MarkDirty(entity)];
+            };
+            glm::vec3& velocity(Entity entity) { return m_Velocities[denseIndex(entity)]; };
+            float& mass(Entity entity) { return m_Masses[denseIndex(entity)]; };
+            glm::vec3& color(Entity entity) { return m_Colors[denseIndex(entity)]; };
+            ModelHandle modelOf(Entity entity) const { return m_ModelHandles[denseIndex(entity)]; };
+
+            void setRigidBody(Entity entity, const glm::vec3& velocity, float mass);
+            void setModel(Entity entity, ModelHandle model);
+            // Switches the entity to a quaternion rotation, see COMPONENT_ORIENTATION.
+            void setOrientation(Entity entity, const glm::quat& orientation);
+            void removeComponents(Entity entity, uint8_t components);
+
+            // Makes child a child of parent, or a root for Entity{}. Its local
+            // transform is kept, so its world transform changes.
+            void setParent(Entity child, Entity parent);
+            // Entity{} where there is none. Children are in no particular order.
+            Entity parentOf(Entity entity) const { return m_EntityAt(m_Nodes[denseIndex(entity)].parent); };
+            Entity firstChild(Entity entity) const { return m_EntityAt(m_Nodes[denseIndex(entity)].firstChild); };
+            Entity nextSibling(Entity entity) const { return m_EntityAt(m_Nodes[denseIndex(entity)].nextSibling); };
+            // 0 for roots.
+            uint32_t depthOf(Entity entity) const { return m_Nodes[denseIndex(entity)].depth; };
+
+            // Recomputes the cached matrices of every entity whose transform changed
+            // since the last call and of all their descendants, and returns how many
+            // that were. Runs one depth level at a time, parents before children,
+            // each level split across threadPool's threads when there is one.
+            // Entities nothing changed for aren't visited.
+            uint32_t updateWorldMatrices(ThreadPool* threadPool = nullptr);
+            // Passes writing translations, rotations or scales through the arrays
+            // below have to mark what they changed.
+            void markTransformDirty(uint32_t dense) { m_QueueUpdate(dense); };
+            void markAllTransformsDirty();
+
+            // Valid for entities that weren't changed since updateWorldMatrices.
+            const glm::mat4& worldMatrix(Entity entity) const { return m_WorldMatrices[denseIndex(entity)]; };
+            const glm::mat4* worldMatrices() const { return m_WorldMatrices.data(); };
+            const glm::mat4* normalMatrices() const { return m_NormalMatrices.data(); };
+            // Version of each entity's cached matrices and dense index. Versions are
+            // unique across registries, so a copy is current if its version is equal.
+            const uint64_t* matrixVersions() const { return m_MatrixVersions.data(); };
+
+            // Dense arrays, for passes. Sized size(), entries of entities without the
+            // component hold defaults.
+            glm::vec3* translations() { return m_Translations.data(); };
+            glm::vec3* rotations() { return m_Rotations.data(); };
+            glm::vec3* scales() { return m_Scales.data(); };
+            glm::quat* orientations() { return m_Orientations.data(); };
+            glm::vec3* velocities() { return m_Velocities.data(); };
+            float* masses() { return m_Masses.data(); };
+            glm::vec3* colors() { return m_Colors.data(); };
+            const ModelHandle* modelHandles() const { return m_ModelHandles.data(); };
+            const uint8_t* components() const { return m_Components.data(); };
+
+        private:
+
+            // m_Dirty values. Queued entities are in m_DirtySlots, scheduled ones in
+            // a level of the running updateWorldMatrices.
+            enum : uint8_t { CLEAN = 0, QUEUED = 1, SCHEDULED = 2 };
+
+            // Entities per chunk of a level in updateWorldMatrices.
+            static constexpr uint32_t UPDATE_GRAIN = 1024;
+
+            uint32_t m_MarkDirty(Entity entity) {
+                const uint32_t dense = denseIndex(entity);
+                m_QueueUpdate(dense);
+                return dense;
+            };
+            void m_QueueUpdate(uint32_t dense) {
+                if(m_Dirty[dense] != CLEAN) return;
+                m_Dirty[dense] = QUEUED;
+                m_DirtySlots.push_back(m_Entities[dense].index);
+            };
+            Entity m_EntityAt(uint32_t slot) const {
+                return slot == Entity::INVALID_INDEX ? Entity{} : m_Entities[m_Slots[slot].dense];
+            };
+            void m_Unlink(uint32_t dense);
+            void m_SetDepth(uint32_t dense, uint32_t depth);
+            bool m_IsDescendant(uint32_t slot, uint32_t ancestorSlot) const;
+            // Updates count entities of one level and appends the children that
+            // have to follow them to children.
+            void m_UpdateEntities(const uint32_t* dense, uint32_t count, uint64_t firstVersion, std::vector<uint32_t>& children);
+            // Returns the first of count new versions.
+            static uint64_t s_NextVersions(uint64_t count);
+
+            struct Slot {
+                uint32_t dense{Entity::INVALID_INDEX};
+                uint32_t generation{0};
+            };
+
+            // Links between entities are slot indices, which don't change when an
+            // entity moves to another dense index.
+            struct Node {
+                uint32_t parent{Entity::INVALID_INDEX};
+                uint32_t firstChild{Entity::INVALID_INDEX};
+                uint32_t nextSibling{Entity::INVALID_INDEX};
+                uint32_t previousSibling{Entity::INVALID_INDEX};
+                uint32_t depth{0};
+            };
+
+            std::vector<Slot> m_Slots;
+            std::vector<uint32_t> m_FreeSlots;
+
+            // Dense, all the same length.
+            std::vector<Entity> m_Entities;
+            std::vector<uint8_t> m_Components;
+            std::vector<glm::vec3> m_Translations;
+            std::vector<glm::vec3> m_Rotations;
+            std::vector<glm::vec3> m_Scales;
+            std::vector<glm::quat> m_Orientations;
+            std::vector<glm::vec3> m_Velocities;
+            std::vector<float> m_Masses;
+            std::vector<glm::vec3> m_Colors;
+            std::vector<ModelHandle> m_ModelHandles;
+            std::vector<Node> m_Nodes;
+            std::vector<uint8_t> m_Dirty;
+            std::vector<glm::mat4> m_WorldMatrices;
+            std::vector<glm::mat4> m_NormalMatrices; // mat4 so they can be copied to the GPU as they are.
+            std::vector<uint64_t> m_MatrixVersions;
+
+            // Slots of the entities changed since the last updateWorldMatrices.
+            std::vector<uint32_t> m_DirtySlots;
+            // updateWorldMatrices' dense indices per depth and children found per
+            // chunk, kept to reuse their memory.
+            std::vector<std::vector<uint32_t>> m_Levels;
+            std::vector<std::vector<uint32_t>> m_ChunkChildren;
+
+            std::vector<std::shared_ptr<Model>> m_Models;
+            std::unordered_map<const Model*, ModelHandle> m_ModelLookup;
+    };
+} // namespace teng
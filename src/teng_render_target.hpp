@@ -0,0 +1,56 @@
+#pragma once
+
+#include "teng_device.hpp"
+
+// vulkan headers
+#include <vulkan/vulkan.h>
+
+// std lib headers
+#include <cstdint>
+#include <functional>
+
+namespace teng {
+
+  // What the Renderer draws into each frame: swap chain images when there is
+  // a window, offscreen images when headless. Each image comes with a depth
+  // image, and a framebuffer unless dynamic rendering is used.
+  class RenderTarget {
+
+    public:
+
+      // Upper bound, PresentPolicy::framesInFlight picks how many are used.
+      static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+
+      virtual ~RenderTarget() = default;
+
+      virtual bool usesDynamicRendering() const = 0;
+      virtual uint32_t framesInFlight() const = 0;
+      virtual size_t imageCount() = 0;
+      virtual VkExtent2D getExtent() = 0;
+      virtual VkFormat getColorFormat() = 0;
+      virtual VkFormat getDepthFormat() = 0;
+      // Layout the color image is left in at the end of the frame.
+      virtual VkImageLayout getFinalColorLayout() const = 0;
+
+      virtual VkRenderPass getRenderPass() = 0;
+      virtual VkFramebuffer getFrameBuffer(int index) = 0;
+      virtual VkImage getImage(int index) = 0;
+      virtual VkImageView getImageView(int index) = 0;
+      virtual VkImage getDepthImage(int index) = 0;
+      virtual VkImageView getDepthImageView(int index) = 0;
+
+      // frameSlot picks the per-frame resources. The caller must have waited, see FrameScheduler,
+      // for the last frame that used the slot to retire.
+      virtual VkResult acquireNextImage(uint32_t frameSlot, uint32_t *imageIndex) = 0;
+      // timelineValue receives the graphics timeline value the submission signals.
+      // beforeSubmit, when set, runs as the last step before the queue submission.
+      virtual VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex, uint32_t frameSlot, uint64_t *timelineValue,
+                                            const std::function<void()> &beforeSubmit = nullptr) = 0;
+
+      float extentAspectRatio() {
+        const VkExtent2D extent = getExtent();
+        return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+      }
+  };
+
+}  // namespace teng
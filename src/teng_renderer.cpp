@@ -4,27 +4,64 @@
 #include <iostream>
 #include <stdexcept>
 
+#include <algorithm>
 #include <chrono>
 #include <array>
 
 
 namespace teng {
 
+    namespace {
+        // The primary monitor's, the window is assumed to be on it.
+        double s_RefreshPeriodMs() {
+            GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+            const GLFWvidmode* mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+            const int refreshRate = mode != nullptr && mode->refreshRate > 0 ? mode->refreshRate : 60;
+            return 1000.0 / refreshRate;
+        }
+    }
+
     // Public
-    Renderer::Renderer(Window& window, Device& device)
-        : mr_Window(window), mr_Device(device)
+    Renderer::Renderer(Window& window, Device& device, const PresentPolicy& presentPolicy, bool preferDynamicRendering)
+        : mp_Window(&window),
+          mr_Device(device),
+          m_PresentPolicy(presentPolicy),
+          m_UseDynamicRendering(preferDynamicRendering && device.features().dynamicRendering),
+          m_Scheduler(device,
+                      std::clamp<uint32_t>(presentPolicy.framesInFlight, 1, RenderTarget::MAX_FRAMES_IN_FLIGHT),
+                      presentPolicy.frameLatencyLimit),
+          m_Pacer(s_RefreshPeriodMs())
     {
         m_RecreateSwapChain();
         m_CreateCommandBuffers();
     }
 
+    Renderer::Renderer(Device& device, VkExtent2D extent, const PresentPolicy& presentPolicy, bool preferDynamicRendering)
+        : mr_Device(device),
+          m_OffscreenExtent(extent),
+          m_PresentPolicy(presentPolicy),
+          m_UseDynamicRendering(preferDynamicRendering && device.features().dynamicRendering),
+          m_Scheduler(device,
+                      std::clamp<uint32_t>(presentPolicy.framesInFlight, 1, RenderTarget::MAX_FRAMES_IN_FLIGHT),
+                      presentPolicy.frameLatencyLimit),
+          m_Pacer(1000.0 / 60.0)
+    {
+        assert(device.isHeadless() && "a headless renderer needs a headless device");
+        m_CreateOffscreenTarget();
+        m_CreateCommandBuffers();
+    }
+
     Renderer::~Renderer() {
+        // Retired swap chains may still be referenced by the last frames.
+        vkDeviceWaitIdle(mr_Device.device());
+        mr_Device.flushDeletions();
+
         // Renderer is responsible for command buffers.
         m_FreeCommandBuffers();
     };
 
     void Renderer::m_CreateCommandBuffers() {
-        mp_CommandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        mp_CommandBuffers.resize(m_Scheduler.framesInFlight());
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -48,23 +85,28 @@ namespace teng {
         mp_CommandBuffers.clear();
     }
 
+    void Renderer::m_CreateOffscreenTarget() {
+        mp_Offscreen = std::make_unique<OffscreenTarget>(
+            mr_Device, m_OffscreenExtent, m_Scheduler.framesInFlight(), m_UseDynamicRendering);
+        mp_Target = mp_Offscreen.get();
+    };
+
     void Renderer::m_RecreateSwapChain() {
         // Current window size.
-        auto extent = mr_Window.getExtent();
+        auto extent = mp_Window->getExtent();
 
         // Force program to halt while minimized for instance.
         while(extent.height == 0 || extent.width == 0) {
-            extent = mr_Window.getExtent();
+            extent = mp_Window->getExtent();
             glfwWaitEvents();
         };
 
-        // Wait for GPU finish its queue. Then the swap chain can be recreated and a new image drawn.
-        vkDeviceWaitIdle(mr_Device.device());
-
+        // No need to wait for the GPU here. The old swap chain is handed to the new one as
+        // oldSwapchain and destroyed once the frames that used it have retired.
         // Create new swap chain. The unique_ptr should ensure that previous swap chain is dropped.
         // mp_SwapChain = nullptr;
         if(mp_SwapChain == nullptr) {
-            mp_SwapChain = std::make_unique<SwapChain>(mr_Device, extent);
+            mp_SwapChain = std::make_unique<SwapChain>(mr_Device, extent, m_PresentPolicy, m_UseDynamicRendering);
         } else {
 
             std::shared_ptr<SwapChain> oldSwapChain = std::move(mp_SwapChain);
@@ -74,27 +116,96 @@ namespace teng {
                 extent,
                 oldSwapChain); // The old swap chain is moved so that the pipeline can decide to use it if can.
 
-            if(!mp_SwapChain->compareSwapFormats(*mp_SwapChain.get())) {
+            // Pipelines only depend on the formats. With a render pass they
+            // also need the new one to stay compatible, which equal formats ensure.
+            if(!mp_SwapChain->compareSwapFormats(*oldSwapChain)) {
                 throw std::runtime_error("m_RecreateSwapChain: incompatible swap chain formats");
             }
+
+            mr_Device.deferDeletion(mr_Device.lastSubmittedValue(), [retired = std::move(oldSwapChain)]() mutable { retired.reset(); });
+            m_SwapChainRecreateCount++;
+        }
+        mp_Target = mp_SwapChain.get();
+        m_Pacer.swapChainRecreated();
+    };
+
+    void Renderer::setPresentPolicy(const PresentPolicy& presentPolicy) {
+        assert(!m_IsFrameStarted && "can't change the present policy while a frame is in progress");
+
+        // A different number of frames in flight means new sync objects and command
+        // buffers, so nothing may be in flight anymore.
+        vkDeviceWaitIdle(mr_Device.device());
+        mr_Device.flushDeletions();
+        m_FreeCommandBuffers();
+
+        m_PresentPolicy = presentPolicy;
+        if(isHeadless()) {
+            m_Scheduler.setFramesInFlight(
+                std::clamp<uint32_t>(presentPolicy.framesInFlight, 1, RenderTarget::MAX_FRAMES_IN_FLIGHT));
+            m_CreateOffscreenTarget();
+        } else {
+            // The surface only accepts a new swap chain once the old one is gone.
+            mp_Target = nullptr;
+            mp_SwapChain = nullptr;
+            m_RecreateSwapChain();
+            m_Scheduler.setFramesInFlight(mp_SwapChain->framesInFlight());
+        }
+
+        m_Scheduler.setLatencyLimit(presentPolicy.frameLatencyLimit);
+        m_CreateCommandBuffers();
+
+        // Query pools are per frame slot.
+        if(mp_GpuProfiler) {
+            mp_GpuProfiler = std::make_unique<GpuProfiler>(mr_Device, m_Scheduler.framesInFlight());
+        }
+    };
+
+    void Renderer::setGpuProfiling(bool enabled) {
+        assert(!m_IsFrameStarted && "can't toggle GPU profiling while a frame is in progress");
+
+        if(!enabled) {
+            // Frames in flight may still write its queries.
+            if(mp_GpuProfiler) {
+                deferDeletion([profiler = std::shared_ptr<GpuProfiler>(std::move(mp_GpuProfiler))]() mutable { profiler.reset(); });
+            }
+        } else if(!mp_GpuProfiler) {
+            // Left off, so scopes do nothing and getGpuProfiler stays null.
+            if(!GpuProfiler::s_IsSupported(mr_Device)) {
+                std::cout << "GPU profiling: the graphics queue can't write timestamps, leaving it off" << std::endl;
+                return;
+            }
+            mp_GpuProfiler = std::make_unique<GpuProfiler>(mr_Device, m_Scheduler.framesInFlight());
+        }
+    };
+
+    void Renderer::waitForFrameLatency() {
+        m_Scheduler.waitForFrameStart();
+        if(mp_SwapChain) {
+            m_Pacer.waitForFrameStart(*mp_SwapChain);
+        }
+    };
+
+    void Renderer::deferDeletion(std::function<void()> deleter) {
+        if(m_IsFrameStarted) {
+            m_FrameDeletions.push_back(std::move(deleter));
+        } else {
+            mr_Device.deferDeletion(mr_Device.lastSubmittedValue(), std::move(deleter));
         }
     };
 
     VkCommandBuffer Renderer::beginFrame() {
 
         assert(!m_IsFrameStarted && "can call beginFrame only when a frame isn't already in progress");
-        static uint32_t frames = 0;
-        static auto previous = std::chrono::steady_clock::now();
-        const auto now = std::chrono::steady_clock::now();
-        if(std::chrono::duration_cast<std::chrono::milliseconds>(now - previous).count() >= 5000) {
-            std::cout << "ms per frame: " << 5000/static_cast<double_t>(frames) << "\n";
-            previous = now;
-            frames = 0;
-        };
-        frames = frames + 1;
+
+        // Frame N waits for frame N - k on the graphics timeline, after which its slot is free.
+        m_Scheduler.waitForFrameStart();
+        if(mp_SwapChain) {
+            m_Pacer.waitForFrameStart(*mp_SwapChain);
+        }
+        mr_Device.flushDeletions();
 
         // The swap chain knows where the data for the next image is to be stored in.
-        auto result = mp_SwapChain->acquireNextImage(&m_CurrentImageIndex);
+        auto result = mp_Target->acquireNextImage(m_Scheduler.frameSlot(), &m_CurrentImageIndex);
 
         // Here we can check whether the surface has changed and is now incompatible with current swap chain dimensions.
         // If so we must recreate the swapchain.
@@ -117,6 +228,11 @@ namespace teng {
             throw std::runtime_error("failed to begin recording command buffer");
         }
 
+        // The slot's previous frame has retired, so its queries can be read without waiting.
+        if(mp_GpuProfiler) {
+            mp_GpuProfiler->beginFrame(commandBuffer, m_Scheduler.frameSlot(), m_Scheduler.currentFrame());
+        }
+
         return commandBuffer;
     };
 
@@ -124,51 +240,181 @@ namespace teng {
         assert(m_IsFrameStarted && "can call endFrame only when there is a frame to end");
 
         auto commandBuffer = p_GetCurrentCommandBuffer();
+        if(mp_GpuProfiler) {
+            mp_GpuProfiler->endFrame(commandBuffer);
+        }
         if(vkEndCommandBuffer(p_GetCurrentCommandBuffer()) != VK_SUCCESS) {
             throw std::runtime_error("failed to record command buffer");
         }
 
-        auto result = mp_SwapChain->submitCommandBuffers(&commandBuffer, &m_CurrentImageIndex);
+        std::function<void()> beforeSubmit;
+        if(m_PreSubmitHook) {
+            const int frameIndex = getCurrentFrameIndex();
+            beforeSubmit = [this, frameIndex]() { m_PreSubmitHook(frameIndex); };
+        }
+
+        uint64_t timelineValue = 0;
+        auto result = mp_Target->submitCommandBuffers(&commandBuffer, &m_CurrentImageIndex, m_Scheduler.frameSlot(), &timelineValue, beforeSubmit);
+        m_Scheduler.frameSubmitted(timelineValue);
+        if(mp_SwapChain) {
+            m_Pacer.frameSubmitted(mp_SwapChain->lastPresentId());
+        }
+
+        for(auto& deleter : m_FrameDeletions) {
+            mr_Device.deferDeletion(timelineValue, std::move(deleter));
+        }
+        m_FrameDeletions.clear();
 
         // Not sure why this is necessary.
-        if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || mr_Window.wasFrameBufferResized()) {
-            mr_Window.resetFramebufferResized();
+        if(isHeadless()) {
+            // Offscreen targets are never out of date.
+        } else if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || mp_Window->wasFrameBufferResized()) {
+            mp_Window->resetFramebufferResized();
             m_RecreateSwapChain();
         } else if(result != VK_SUCCESS) {
             throw std::runtime_error("endFrame: failed to obtain next swap chain image");
         }
 
-        m_CurrentFrameIndex = (m_CurrentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
         m_IsFrameStarted = false;
     }
 
+    PipelineTarget Renderer::getPipelineTarget() const {
+        PipelineTarget target{};
+        if(m_UseDynamicRendering) {
+            target.colorFormat = mp_Target->getColorFormat();
+            target.depthFormat = mp_Target->getDepthFormat();
+        } else {
+            target.renderPass = mp_Target->getRenderPass();
+        }
+        return target;
+    };
+
+    // Without a render pass, the layout transitions it used to do are recorded by hand.
+    void Renderer::m_TransitionSwapChainImages(VkCommandBuffer p_CommandBuffer, bool toAttachment) {
+        VkImageMemoryBarrier colorBarrier{};
+        colorBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        colorBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        colorBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        colorBarrier.image = mp_Target->getImage(m_CurrentImageIndex);
+        colorBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        if(!toAttachment) {
+            // Present for the swap chain, a transfer source for the offscreen target so it can be read back.
+            const VkImageLayout finalLayout = mp_Target->getFinalColorLayout();
+            const bool forTransfer = finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            colorBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            colorBarrier.dstAccessMask = forTransfer ? VK_ACCESS_TRANSFER_READ_BIT : 0;
+            colorBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            colorBarrier.newLayout = finalLayout;
+            vkCmdPipelineBarrier(
+                p_CommandBuffer,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                forTransfer ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &colorBarrier);
+            return;
+        }
+
+        // Contents are cleared anyway, so the old layout can be discarded.
+        colorBarrier.srcAccessMask = 0;
+        colorBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        colorBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        const VkFormat depthFormat = mp_Target->getDepthFormat();
+        VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if(depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+            depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+
+        VkImageMemoryBarrier depthBarrier{};
+        depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.image = mp_Target->getDepthImage(m_CurrentImageIndex);
+        depthBarrier.subresourceRange = {depthAspect, 0, 1, 0, 1};
+        depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        vkCmdPipelineBarrier(
+            p_CommandBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &colorBarrier);
+        vkCmdPipelineBarrier(
+            p_CommandBuffer,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+    };
+
     void Renderer::beginSwapChainRenderPass(VkCommandBuffer p_CommandBuffer) {
         assert(m_IsFrameStarted && "can't call beginSwapChainRenderPass if frame is not in progress");
         assert(p_CommandBuffer == p_GetCurrentCommandBuffer() && "can't begin render pass on command buffer from a different frame");
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = mp_SwapChain->getRenderPass();
-        renderPassInfo.framebuffer = mp_SwapChain->getFrameBuffer(m_CurrentImageIndex);
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = mp_SwapChain->getSwapChainExtent();
-
         std::array<VkClearValue, 2> clearValues{};
         clearValues[0].color = {{0.01f, 0.01f, 0.01f, 1.0f}};
         // This was set to 0.1f instead of 1.0f, the depth of the volume to be cut to a tenth of what it should have been.
         clearValues[1].depthStencil = {1.f, 0};
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(p_CommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        // Begun outside the render pass, so it includes the layout transitions. Statistics are
+        // left to the scopes inside, which can't have them when an enclosing scope does.
+        if(mp_GpuProfiler) {
+            m_RenderPassScope = mp_GpuProfiler->beginScope(p_CommandBuffer, "render pass", false);
+        }
+
+        if(m_UseDynamicRendering) {
+            m_TransitionSwapChainImages(p_CommandBuffer, true);
+
+            VkRenderingAttachmentInfoKHR colorAttachment{};
+            colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+            colorAttachment.imageView = mp_Target->getImageView(m_CurrentImageIndex);
+            colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.clearValue = clearValues[0];
+
+            VkRenderingAttachmentInfoKHR depthAttachment{};
+            depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+            depthAttachment.imageView = mp_Target->getDepthImageView(m_CurrentImageIndex);
+            depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            // Offscreen depth may be read back, see FrameCapture.
+            depthAttachment.storeOp = isHeadless() ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            depthAttachment.clearValue = clearValues[1];
+
+            VkRenderingInfoKHR renderingInfo{};
+            renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+            renderingInfo.renderArea.offset = {0, 0};
+            renderingInfo.renderArea.extent = mp_Target->getExtent();
+            renderingInfo.layerCount = 1;
+            renderingInfo.colorAttachmentCount = 1;
+            renderingInfo.pColorAttachments = &colorAttachment;
+            renderingInfo.pDepthAttachment = &depthAttachment;
+
+            mr_Device.functions().cmdBeginRendering(p_CommandBuffer, &renderingInfo);
+        } else {
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = mp_Target->getRenderPass();
+            renderPassInfo.framebuffer = mp_Target->getFrameBuffer(m_CurrentImageIndex);
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = mp_Target->getExtent();
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+            renderPassInfo.pClearValues = clearValues.data();
+
+            vkCmdBeginRenderPass(p_CommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        }
+
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
-        viewport.width = static_cast<float>(mp_SwapChain->getSwapChainExtent().width);
-        viewport.height = static_cast<float>(mp_SwapChain->getSwapChainExtent().height);
+        viewport.width = static_cast<float>(mp_Target->getExtent().width);
+        viewport.height = static_cast<float>(mp_Target->getExtent().height);
         viewport.minDepth = 0.0f;
         viewport.maxDepth = 1.0f;
-        VkRect2D scissor{{0, 0}, mp_SwapChain->getSwapChainExtent()};
+        VkRect2D scissor{{0, 0}, mp_Target->getExtent()};
         vkCmdSetViewport(p_CommandBuffer, 0, 1, &viewport);
         vkCmdSetScissor(p_CommandBuffer, 0, 1, &scissor);
     };
@@ -177,6 +423,16 @@ namespace teng {
         assert(m_IsFrameStarted && "can't call endSwapChainRenderPass if frame is not in progress");
         assert(p_CommandBuffer == p_GetCurrentCommandBuffer() && "can't end render pass on command buffer from a different frame");
 
-        vkCmdEndRenderPass(p_CommandBuffer);
+        if(m_UseDynamicRendering) {
+            mr_Device.functions().cmdEndRendering(p_CommandBuffer);
+            m_TransitionSwapChainImages(p_CommandBuffer, false);
+        } else {
+            vkCmdEndRenderPass(p_CommandBuffer);
+        }
+
+        if(mp_GpuProfiler) {
+            mp_GpuProfiler->endScope(p_CommandBuffer, m_RenderPassScope);
+            m_RenderPassScope = GpuProfiler::NO_SCOPE;
+        }
     };
 } // namespace teng
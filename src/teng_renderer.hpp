@@ -1,10 +1,16 @@
 #pragma once
 
 #include "teng_swap_chain.hpp"
+#include "teng_offscreen_target.hpp"
+#include "teng_frame_scheduler.hpp"
+#include "teng_frame_pacer.hpp"
+#include "teng_gpu_profiler.hpp"
 #include "teng_window.hpp"
 #include "teng_model.hpp"
+#include "teng_pipeline.hpp"
 
 // std
+#include <functional>
 #include <memory>
 #include <vector>
 #include <cassert>
@@ -15,7 +21,11 @@ namespace teng {
 
                 public:
 
-                        Renderer(Window& window, Device& device);
+                        // Renders with VK_KHR_dynamic_rendering when preferDynamicRendering is set and the device supports it.
+                        Renderer(Window& window, Device& device, const PresentPolicy& presentPolicy = {}, bool preferDynamicRendering = true);
+                        // Headless, renders into an OffscreenTarget of the given size. Only framesInFlight and
+                        // frameLatencyLimit of the policy apply. Needs a headless Device.
+                        Renderer(Device& device, VkExtent2D extent, const PresentPolicy& presentPolicy = {}, bool preferDynamicRendering = true);
                         ~Renderer();
 
                         Renderer(const Renderer&) = delete;
@@ -23,22 +33,72 @@ namespace teng {
 
                         void run();
 
+                        // Blocks until the GPU is within the policy's frame latency limit and, with frame pacing,
+                        // until the frame should start. beginFrame does this too, calling it before sampling input
+                        // makes that input as fresh as the limits allow.
+                        void waitForFrameLatency();
+                        // Starts frames just in time for the display's next refresh, see FramePacer.
+                        void setFramePacing(bool enabled) { m_Pacer.setEnabled(enabled); };
                         VkCommandBuffer beginFrame();
                         void endFrame();
                         void beginSwapChainRenderPass(VkCommandBuffer p_CommandBuffer);
                         void endSwapChainRenderPass(VkCommandBuffer p_CommandBuffer);
-                        float getAspectRatio() { return mp_SwapChain->extentAspectRatio(); };
+                        float getAspectRatio() { return mp_Target->extentAspectRatio(); };
+                        VkExtent2D getExtent() const { return mp_Target->getExtent(); };
 
-                        VkRenderPass p_GetSwapChainRenderPass() const { return mp_SwapChain->getRenderPass(); };
+                        VkRenderPass p_GetSwapChainRenderPass() const { return mp_Target->getRenderPass(); };
+                        // What pipelines drawing into the swap chain, or the offscreen target, are created against.
+                        PipelineTarget getPipelineTarget() const;
+                        bool usesDynamicRendering() const { return m_UseDynamicRendering; };
                         bool isFrameInProgress() const { return m_IsFrameStarted; };
                         VkCommandBuffer p_GetCurrentCommandBuffer() const {
                                 assert(m_IsFrameStarted && "Cannot get command buffer when frame not in progress.");
-                                return mp_CommandBuffers[m_CurrentFrameIndex];
+                                return mp_CommandBuffers[m_Scheduler.frameSlot()];
                         };
 
+                        // Switching policies drains the GPU, it's meant for settings changes and not for every frame.
+                        void setPresentPolicy(const PresentPolicy& presentPolicy);
+                        const PresentPolicy& getPresentPolicy() const { return m_PresentPolicy; };
+                        // Headless rendering doesn't present, it reports IMMEDIATE.
+                        VkPresentModeKHR getPresentMode() const {
+                                return mp_SwapChain ? mp_SwapChain->getPresentMode() : VK_PRESENT_MODE_IMMEDIATE_KHR;
+                        };
+                        uint32_t getFramesInFlight() const { return m_Scheduler.framesInFlight(); };
+                        uint32_t getImageCount() const { return static_cast<uint32_t>(mp_Target->imageCount()); };
+
+                        bool isHeadless() const { return mp_Window == nullptr; };
+                        // Null unless headless. Image i belongs to frame slot i.
+                        OffscreenTarget* getOffscreenTarget() const { return mp_Offscreen.get(); };
+                        // Index of the image being rendered, valid while a frame is in progress.
+                        uint32_t getCurrentImageIndex() const { return m_CurrentImageIndex; };
+
+                        // Number of frames submitted so far.
+                        uint64_t getFrameCount() const { return m_Scheduler.currentFrame(); };
+                        // Whether the GPU has finished the frame numbered frame, counting submissions from 0.
+                        bool isFrameComplete(uint64_t frame) const { return m_Scheduler.hasRetired(frame); };
+                        // Blocks until that frame has finished on the GPU. It must have been submitted.
+                        void waitForFrame(uint64_t frame) { m_Scheduler.waitForFrame(frame); };
+                        const FrameScheduler& getFrameScheduler() const { return m_Scheduler; };
+                        // Number of recreations, for the resize benchmark.
+                        uint32_t getSwapChainRecreateCount() const { return m_SwapChainRecreateCount; };
+
+                        // Runs with the current frame index right before the frame's commands are submitted, after
+                        // recording. Late latching uses it to rewrite per-frame data with the freshest input.
+                        void setPreSubmitHook(std::function<void(int frameIndex)> hook) { m_PreSubmitHook = std::move(hook); };
+
+                        // Defers destroying something the GPU may still use until the current frame, or the
+                        // last one when none is being recorded, has retired.
+                        void deferDeletion(std::function<void()> deleter);
+
+                        // Times the frame, the render pass and the scopes recorded into them on the GPU, see GpuProfiler.
+                        // Takes effect with the next frame.
+                        void setGpuProfiling(bool enabled);
+                        // Null unless GPU profiling is on.
+                        GpuProfiler* getGpuProfiler() const { return mp_GpuProfiler.get(); };
+
                         int getCurrentFrameIndex() const {
                                 assert(m_IsFrameStarted && "Cannot get command buffer when frame not in progress.");
-                                return m_CurrentFrameIndex;
+                                return static_cast<int>(m_Scheduler.frameSlot());
                         };
 
                 private:
@@ -46,14 +106,28 @@ namespace teng {
                         void m_CreateCommandBuffers();
                         void m_FreeCommandBuffers();
                         void m_RecreateSwapChain(); // The swapchain needs to be recreated for example when the window is resized.
+                        void m_CreateOffscreenTarget();
+                        void m_TransitionSwapChainImages(VkCommandBuffer p_CommandBuffer, bool toAttachment);
 
-                        Window& mr_Window; // Window must outlive renderer!
+                        Window* mp_Window{nullptr}; // Window must outlive renderer! Null when headless.
                         Device& mr_Device; // Device must outlive renderer!
                         std::unique_ptr<SwapChain> mp_SwapChain;
+                        std::unique_ptr<OffscreenTarget> mp_Offscreen;
+                        RenderTarget* mp_Target{nullptr}; // Whichever of the two is in use.
+                        VkExtent2D m_OffscreenExtent{};
                         std::vector<VkCommandBuffer> mp_CommandBuffers;
+                        PresentPolicy m_PresentPolicy;
+                        bool m_UseDynamicRendering{false};
+
+                        FrameScheduler m_Scheduler;
+                        std::vector<std::function<void()>> m_FrameDeletions; // Deferred during the frame being recorded.
+                        std::function<void(int)> m_PreSubmitHook;
+                        FramePacer m_Pacer;
+                        uint32_t m_SwapChainRecreateCount{0};
+                        std::unique_ptr<GpuProfiler> mp_GpuProfiler;
+                        uint32_t m_RenderPassScope{GpuProfiler::NO_SCOPE};
 
                         uint32_t m_CurrentImageIndex{0};
-                        int m_CurrentFrameIndex{0};
                         bool m_IsFrameStarted{false};
 
         };
@@ -0,0 +1,107 @@
+#include "teng_simulation_loop.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+namespace teng {
+
+    // Public
+    SimulationLoop::SimulationLoop(float tickRate, StepFunction step, WriteFunction write)
+        : m_TickDuration{1.f / tickRate}, m_Step{std::move(step)}, m_Write{std::move(write)}
+    {
+        assert(tickRate > 0.f && "tick rate must be positive");
+    }
+
+    SimulationLoop::~SimulationLoop() {
+        stop();
+    };
+
+    void SimulationLoop::start() {
+        if(isRunning()) return;
+        m_Stop.store(false);
+
+        // A restart carries on from the last tick, as if it had been on time.
+        const uint64_t tick = m_TickCount.load();
+        m_Publish(tick);
+        {
+            std::lock_guard<std::mutex> lock{m_Mutex};
+            m_Start = Clock::now() - std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(m_TickDuration) * static_cast<double>(tick)));
+        }
+        m_Thread = std::thread([this]() { m_Run(); });
+    };
+
+    void SimulationLoop::stop() {
+        if(!isRunning()) return;
+        m_Stop.store(true);
+        m_Thread.join();
+    };
+
+    bool SimulationLoop::interpolate(glm::vec3* translations, uint32_t count, Clock::time_point time) const {
+        std::lock_guard<std::mutex> lock{m_Mutex};
+        if(m_Published == 0) return false;
+        const Snapshot& latest = m_Snapshots[m_Latest];
+        if(latest.translations.size() != count) return false;
+
+        const Snapshot& previous = m_Snapshots[m_Previous];
+        const double ticks = std::chrono::duration<double>(time - m_Start).count() / m_TickDuration;
+        if(m_Published == 1 || previous.translations.size() != count || ticks >= static_cast<double>(latest.tick)) {
+            std::copy(latest.translations.begin(), latest.translations.end(), translations);
+            return true;
+        }
+
+        const double span = static_cast<double>(latest.tick - previous.tick);
+        const float alpha = static_cast<float>(std::max(0.0, (ticks - static_cast<double>(previous.tick)) / span));
+        for(uint32_t i = 0; i < count; i++) {
+            translations[i] = glm::mix(previous.translations[i], latest.translations[i], alpha);
+        }
+        return true;
+    };
+
+    // Private
+    void SimulationLoop::m_Run() {
+        TENG_PROFILE_THREAD("simulation");
+        const auto tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_TickDuration));
+
+        uint64_t tick = m_TickCount.load();
+        while(!m_Stop.load()) {
+            // Tick t is published by m_Start + t ticks, the next one is computed after that.
+            Clock::time_point due;
+            {
+                std::lock_guard<std::mutex> lock{m_Mutex};
+                due = m_Start + tickDuration * tick;
+            }
+            const Clock::time_point now = Clock::now();
+            if(now > due + tickDuration * MAX_CATCH_UP_TICKS) {
+                const uint64_t behind = static_cast<uint64_t>((now - due) / tickDuration);
+                std::lock_guard<std::mutex> lock{m_Mutex};
+                m_Start += tickDuration * behind;
+                m_SkippedTicks.fetch_add(behind, std::memory_order_relaxed);
+            } else if(now < due) {
+                std::this_thread::sleep_until(due);
+            }
+
+            TENG_PROFILE_ZONE("SimulationLoop::tick");
+            m_Step(m_TickDuration);
+            tick++;
+            m_Publish(tick);
+            m_TickCount.store(tick, std::memory_order_relaxed);
+        }
+    };
+
+    void SimulationLoop::m_Publish(uint64_t tick) {
+        // Only this thread changes m_Back, and no reader looks at that snapshot.
+        Snapshot& back = m_Snapshots[m_Back];
+        back.tick = tick;
+        m_Write(back.translations);
+
+        std::lock_guard<std::mutex> lock{m_Mutex};
+        const uint32_t oldest = m_Previous;
+        m_Previous = m_Latest;
+        m_Latest = m_Back;
+        m_Back = oldest;
+        m_Published++;
+    };
+} // namespace teng
@@ -0,0 +1,95 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace teng {
+
+    // Runs a simulation at a fixed tick rate on a thread of its own, so its
+    // results don't depend on the frame rate and a slow step doesn't hold up a
+    // frame. After every tick the simulated positions are published as a
+    // snapshot; the renderer interpolates between the last two for the time
+    // it draws, so motion stays smooth at any frame rate.
+    //
+    // Snapshots are double-buffered with a third being written: publishing
+    // swaps indices under a mutex, and interpolating holds it while reading,
+    // so the simulation waits for at most one interpolation and never for a
+    // frame. Whatever the step functions touch belongs to the simulation
+    // thread while it runs.
+    class SimulationLoop {
+
+        public:
+
+            using Clock = std::chrono::steady_clock;
+            // Advances the simulation by dt.
+            using StepFunction = std::function<void(float dt)>;
+            // Writes the simulation's positions, resizing translations to their count.
+            using WriteFunction = std::function<void(std::vector<glm::vec3>& translations)>;
+
+            // Ticks the simulation may fall behind by before it skips ahead,
+            // so it can't fall further and further behind when steps take
+            // longer than a tick.
+            static constexpr uint32_t MAX_CATCH_UP_TICKS = 4;
+
+            SimulationLoop(float tickRate, StepFunction step, WriteFunction write);
+            ~SimulationLoop();
+
+            SimulationLoop(const SimulationLoop&) = delete;
+            SimulationLoop &operator=(const SimulationLoop&) = delete;
+
+            // Publishes the current state and starts ticking, carrying on from
+            // the last tick after a stop.
+            void start();
+            // Waits for the tick in progress. Does nothing when not running.
+            void stop();
+            bool isRunning() const { return m_Thread.joinable(); };
+
+            float getTickDuration() const { return m_TickDuration; };
+            uint64_t getTickCount() const { return m_TickCount.load(std::memory_order_relaxed); };
+            // Ticks skipped because the simulation fell too far behind.
+            uint64_t getSkippedTicks() const { return m_SkippedTicks.load(std::memory_order_relaxed); };
+
+            // Writes count positions interpolated for time into translations,
+            // between the two snapshots around it, or the latest when the
+            // simulation hasn't got there yet. Returns false, writing
+            // nothing, before the first snapshot or when count doesn't match it.
+            bool interpolate(glm::vec3* translations, uint32_t count, Clock::time_point time = Clock::now()) const;
+
+        private:
+
+            struct Snapshot {
+                uint64_t tick{0};
+                std::vector<glm::vec3> translations;
+            };
+
+            void m_Run();
+            void m_Publish(uint64_t tick);
+
+            float m_TickDuration;
+            StepFunction m_Step;
+            WriteFunction m_Write;
+
+            std::thread m_Thread;
+            std::atomic<bool> m_Stop{false};
+            std::atomic<uint64_t> m_TickCount{0};
+            std::atomic<uint64_t> m_SkippedTicks{0};
+
+            mutable std::mutex m_Mutex; // Guards the indices, the start and reading published snapshots.
+            std::array<Snapshot, 3> m_Snapshots;
+            uint32_t m_Previous{0};
+            uint32_t m_Latest{1};
+            uint32_t m_Back{2};    // Written by the simulation thread outside of the mutex.
+            uint32_t m_Published{0};
+            Clock::time_point m_Start; // When tick 0 was, moved forward by skipped ticks.
+    };
+} // namespace teng
@@ -0,0 +1,133 @@
+#pragma once
+
+// std
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace teng {
+
+    // Pool of values addressed by handles, with the values packed in one
+    // dense array. Creating and destroying are O(1): freed slots are reused
+    // from a free list, and destroying a value moves the last one into its
+    // place, so iterating touches only live values, in no particular order.
+    //
+    // Values move when others are destroyed or the array grows, so hold
+    // handles, not references or pointers, across those. A handle's
+    // generation tells it apart from handles to later values in the same slot,
+    // it is the same scheme as Registry's Entity.
+    template<typename T>
+    class SlotMap {
+
+        public:
+
+            struct Handle {
+                static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+                uint32_t index{INVALID_INDEX};
+                uint32_t generation{0};
+
+                bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; };
+                bool operator!=(const Handle& other) const { return !(*this == other); };
+            };
+
+            SlotMap() = default;
+
+            SlotMap(const SlotMap&) = delete;
+            SlotMap &operator=(const SlotMap&) = delete;
+            SlotMap(SlotMap&&) = default;
+            SlotMap &operator=(SlotMap&&) = default;
+
+            // Constructs a value in place from args.
+            template<typename... Args>
+            Handle create(Args&&... args) {
+                uint32_t slot;
+                if(!m_FreeSlots.empty()) {
+                    slot = m_FreeSlots.back();
+                    m_FreeSlots.pop_back();
+                } else {
+                    slot = static_cast<uint32_t>(m_Slots.size());
+                    m_Slots.emplace_back();
+                }
+
+                m_Values.emplace_back(std::forward<Args>(args)...);
+                m_Handles.push_back({slot, m_Slots[slot].generation});
+                m_Slots[slot].dense = size() - 1;
+                return m_Handles.back();
+            };
+
+            // Does nothing for handles that aren't alive.
+            void destroy(Handle handle) {
+                if(!isAlive(handle)) return;
+
+                // The last value moves into the hole.
+                const uint32_t dense = m_Slots[handle.index].dense;
+                const uint32_t last = size() - 1;
+                if(dense != last) {
+                    m_Values[dense] = std::move(m_Values[last]);
+                    m_Handles[dense] = m_Handles[last];
+                    m_Slots[m_Handles[dense].index].dense = dense;
+                }
+                m_Values.pop_back();
+                m_Handles.pop_back();
+
+                Slot& slot = m_Slots[handle.index];
+                slot.dense = Handle::INVALID_INDEX;
+                // A slot whose generation would wrap is retired, so no old handle comes back to life.
+                if(++slot.generation != 0) m_FreeSlots.push_back(handle.index);
+            };
+
+            bool isAlive(Handle handle) const {
+                return handle.index < m_Slots.size() && m_Slots[handle.index].generation == handle.generation &&
+                       m_Slots[handle.index].dense != Handle::INVALID_INDEX;
+            };
+
+            // nullptr for handles that aren't alive.
+            T* find(Handle handle) { return isAlive(handle) ? &m_Values[m_Slots[handle.index].dense] : nullptr; };
+            const T* find(Handle handle) const { return isAlive(handle) ? &m_Values[m_Slots[handle.index].dense] : nullptr; };
+
+            T& get(Handle handle) {
+                assert(isAlive(handle) && "handle to a destroyed value");
+                return m_Values[m_Slots[handle.index].dense];
+            };
+            const T& get(Handle handle) const {
+                assert(isAlive(handle) && "handle to a destroyed value");
+                return m_Values[m_Slots[handle.index].dense];
+            };
+
+            uint32_t size() const { return static_cast<uint32_t>(m_Values.size()); };
+            bool empty() const { return m_Values.empty(); };
+            void reserve(uint32_t count) {
+                m_Values.reserve(count);
+                m_Handles.reserve(count);
+                m_Slots.reserve(count);
+            };
+            // Destroys every value, their handles stay dead.
+            void clear() {
+                while(!empty()) destroy(m_Handles.back());
+            };
+
+            // The dense array, indices are only good until the next destroy.
+            T* data() { return m_Values.data(); };
+            const T* data() const { return m_Values.data(); };
+            Handle handleAt(uint32_t dense) const { return m_Handles[dense]; };
+
+            typename std::vector<T>::iterator begin() { return m_Values.begin(); };
+            typename std::vector<T>::iterator end() { return m_Values.end(); };
+            typename std::vector<T>::const_iterator begin() const { return m_Values.begin(); };
+            typename std::vector<T>::const_iterator end() const { return m_Values.end(); };
+
+        private:
+
+            struct Slot {
+                uint32_t dense{Handle::INVALID_INDEX};
+                uint32_t generation{0};
+            };
+
+            std::vector<T> m_Values;
+            std::vector<Handle> m_Handles; // Of each value, by dense index.
+            std::vector<Slot> m_Slots;
+            std::vector<uint32_t> m_FreeSlots;
+    };
+} // namespace teng
@@ -0,0 +1,57 @@
+#include "teng_spatial_index.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+
+namespace teng {
+
+    void SpatialIndex::update(const Registry& registry) {
+        TENG_PROFILE_ZONE("SpatialIndex::update");
+        m_Update++;
+
+        const glm::mat4* worldMatrices = registry.worldMatrices();
+        const uint64_t* versions = registry.matrixVersions();
+        const ModelHandle* models = registry.modelHandles();
+
+        for(uint32_t dense : registry.view(COMPONENT_MODEL)) {
+            const Entity entity = registry.entityAt(dense);
+            if(entity.index >= m_Tracked.size()) m_Tracked.resize(entity.index + 1);
+
+            Tracked& tracked = m_Tracked[entity.index];
+            tracked.seen = m_Update;
+            // Versions also change with the dense index, so the user data stays current.
+            if(tracked.proxy != Bvh::NO_PROXY && tracked.generation == entity.generation &&
+               tracked.version == versions[dense] && tracked.model == models[dense]) {
+                continue;
+            }
+
+            const Aabb box = registry.getModel(models[dense])->getBounds().transformed(worldMatrices[dense]);
+            if(tracked.proxy == Bvh::NO_PROXY) {
+                tracked.proxy = m_Bvh.insert(box, dense);
+            } else {
+                m_Bvh.update(tracked.proxy, box);
+                m_Bvh.setUserData(tracked.proxy, dense);
+            }
+            tracked.generation = entity.generation;
+            tracked.version = versions[dense];
+            tracked.model = models[dense];
+        }
+
+        // Destroyed, or lost their model.
+        for(Tracked& tracked : m_Tracked) {
+            if(tracked.proxy == Bvh::NO_PROXY || tracked.seen == m_Update) continue;
+            m_Bvh.remove(tracked.proxy);
+            tracked.proxy = Bvh::NO_PROXY;
+        }
+
+        m_Bvh.rebuildIfDegraded();
+    };
+
+    void SpatialIndex::cull(const Frustum& frustum, std::vector<uint32_t>& dense) const {
+        TENG_PROFILE_ZONE("SpatialIndex::cull");
+        dense.clear();
+        m_Bvh.queryFrustum(frustum, dense);
+        std::sort(dense.begin(), dense.end());
+    };
+} // namespace teng
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "teng_bvh.hpp"
+#include "teng_registry.hpp"
+
+// std
+#include <cstdint>
+#include <vector>
+
+namespace teng {
+
+    // A Bvh over the world bounds of a registry's entities with a model, so
+    // culling, picking and proximity queries don't visit every entity. Its
+    // user data are dense indices, valid until the registry next changes;
+    // Registry::entityAt turns them into handles.
+    class SpatialIndex {
+
+        public:
+
+            // Inserts, refits and removes boxes to match the registry's cached
+            // world matrices, so it belongs after updateWorldMatrices. Entities are
+            // compared by matrix version like RenderSystem's uploads, only those
+            // that changed are touched. Rebuilds the tree once it has degraded.
+            void update(const Registry& registry);
+
+            // Dense indices of the entities whose bounds intersect frustum, ascending.
+            void cull(const Frustum& frustum, std::vector<uint32_t>& dense) const;
+
+            // Overlap queries, ray picks and their batch forms.
+            const Bvh& getBvh() const { return m_Bvh; };
+
+        private:
+
+            struct Tracked {
+                uint32_t proxy{Bvh::NO_PROXY};
+                uint32_t generation{0};
+                uint64_t version{0};
+                ModelHandle model{NO_MODEL};
+                uint32_t seen{0}; // The update that last found the entity.
+            };
+
+            Bvh m_Bvh;
+            std::vector<Tracked> m_Tracked; // By registry slot.
+            uint32_t m_Update{0};
+    };
+} // namespace teng
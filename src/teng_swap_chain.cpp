@@ -1,6 +1,8 @@
 #include "teng_swap_chain.hpp"
+#include "teng_profiler.hpp"
 
 // std
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -11,15 +13,60 @@
 
 namespace teng {
 
-  SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent)
-    : device{deviceRef},
+  PresentPolicy PresentPolicy::s_LowLatency() {
+    PresentPolicy policy{};
+    policy.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    policy.framesInFlight = 2;
+    policy.frameLatencyLimit = 1;
+    return policy;
+  }
+
+  PresentPolicy PresentPolicy::s_Throughput() {
+    PresentPolicy policy{};
+    policy.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    policy.imageCount = 4;
+    policy.framesInFlight = 3;
+    return policy;
+  }
+
+  bool PresentPolicy::s_ParsePresentMode(const std::string &name, VkPresentModeKHR &mode) {
+    if (name == "fifo") {
+      mode = VK_PRESENT_MODE_FIFO_KHR;
+    } else if (name == "fifo-relaxed") {
+      mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    } else if (name == "mailbox") {
+      mode = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else if (name == "immediate") {
+      mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  const char *PresentPolicy::s_PresentModeName(VkPresentModeKHR mode) {
+    switch (mode) {
+      case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+      case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+      case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+      case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+      default: return "unknown";
+    }
+  }
+
+  SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent, const PresentPolicy &policy, bool useDynamicRendering)
+    : policy{policy},
+      useDynamicRendering{useDynamicRendering},
+      device{deviceRef},
       windowExtent{extent}
   {
     init();
   }
 
   SwapChain::SwapChain(Device &deviceRef, VkExtent2D extent, std::shared_ptr<SwapChain> previous)
-    : device{deviceRef},
+    : policy{previous->policy},
+      useDynamicRendering{previous->useDynamicRendering},
+      device{deviceRef},
       windowExtent{extent},
       mp_OldSwapChain{previous}
   {
@@ -33,10 +80,30 @@ namespace teng {
   void SwapChain::init() {
     createSwapChain();
     createImageViews();
-    createRenderPass();
+    if (!useDynamicRendering) {
+      createRenderPass();
+    }
     createDepthResources();
-    createFramebuffers();
-    createSyncObjects();
+    if (!useDynamicRendering) {
+      createFramebuffers();
+    }
+
+    // Frames still in flight on the old swap chain use its semaphores.
+    // Carrying them over lets those frames finish undisturbed, so the
+    // recreation doesn't need to wait for the GPU.
+    if (mp_OldSwapChain != nullptr) {
+      takeSyncObjects(*mp_OldSwapChain);
+    } else {
+      createSyncObjects();
+    }
+  }
+
+  void SwapChain::takeSyncObjects(SwapChain &previous) {
+    imageAvailableSemaphores = std::move(previous.imageAvailableSemaphores);
+    renderFinishedSemaphores = std::move(previous.renderFinishedSemaphores);
+
+    previous.imageAvailableSemaphores.clear();
+    previous.renderFinishedSemaphores.clear();
   }
 
   SwapChain::~SwapChain() {
@@ -62,27 +129,20 @@ namespace teng {
 
     vkDestroyRenderPass(device.device(), renderPass, nullptr);
 
-    // cleanup synchronization objects
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    // cleanup synchronization objects, unless a newer swap chain took them over.
+    for (size_t i = 0; i < imageAvailableSemaphores.size(); i++) {
       vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
       vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-      vkDestroyFence(device.device(), inFlightFences[i], nullptr);
     }
   }
 
-  VkResult SwapChain::acquireNextImage(uint32_t *imageIndex) {
-    vkWaitForFences(
-        device.device(),
-        1,
-        &inFlightFences[currentFrame],
-        VK_TRUE,
-        std::numeric_limits<uint64_t>::max());
-
+  VkResult SwapChain::acquireNextImage(uint32_t frameSlot, uint32_t *imageIndex) {
+    TENG_PROFILE_ZONE("SwapChain::acquireNextImage");
     VkResult result = vkAcquireNextImageKHR(
         device.device(),
         swapChain,
         std::numeric_limits<uint64_t>::max(),
-        imageAvailableSemaphores[currentFrame],  // must be a not signaled semaphore
+        imageAvailableSemaphores[frameSlot],  // must be a not signaled semaphore
         VK_NULL_HANDLE,
         imageIndex);
 
@@ -90,16 +150,15 @@ namespace teng {
   }
 
   VkResult SwapChain::submitCommandBuffers(
-      const VkCommandBuffer *buffers, uint32_t *imageIndex) {
-    if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-      vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-    }
-    imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
-
+      const VkCommandBuffer *buffers, uint32_t *imageIndex, uint32_t frameSlot, uint64_t *timelineValue,
+      const std::function<void()> &beforeSubmit) {
+    TENG_PROFILE_ZONE("SwapChain::submitCommandBuffers");
+    // The image could still be in use by an earlier frame only if it hadn't been
+    // presented yet, and then it couldn't have been acquired again.
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[frameSlot]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
@@ -108,16 +167,18 @@ namespace teng {
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = buffers;
 
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
+    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[frameSlot]};
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-    if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-        VK_SUCCESS) {
-      throw std::runtime_error("failed to submit draw command buffer!");
+    // Late latching: host writes made here are still visible to this submission.
+    if (beforeSubmit) {
+      beforeSubmit();
     }
 
+    // Also signals the graphics timeline, which is how frames are paced.
+    *timelineValue = device.submitGraphics(submitInfo);
+
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -130,21 +191,39 @@ namespace teng {
 
     presentInfo.pImageIndices = imageIndex;
 
-    auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
-
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    VkPresentIdKHR presentIdInfo = {};
+    const uint64_t nextPresentId = presentId + 1;
+    if (device.features().presentWait) {
+      presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+      presentIdInfo.swapchainCount = 1;
+      presentIdInfo.pPresentIds = &nextPresentId;
+      presentInfo.pNext = &presentIdInfo;
+    }
 
+    VkResult result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
+    if (device.features().presentWait) {
+      presentId = nextPresentId;
+    }
     return result;
   }
 
+  bool SwapChain::waitForPresent(uint64_t id, uint64_t timeoutNanoseconds) {
+    if (!device.features().presentWait || id == 0 || id > presentId) return false;
+
+    VkResult result = device.functions().waitForPresent(device.device(), swapChain, id, timeoutNanoseconds);
+    return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+  }
+
   void SwapChain::createSwapChain() {
     SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+    presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    uint32_t imageCount = policy.imageCount != 0
+        ? std::max(policy.imageCount, swapChainSupport.capabilities.minImageCount)
+        : swapChainSupport.capabilities.minImageCount + 1;
     if (swapChainSupport.capabilities.maxImageCount > 0 &&
         imageCount > swapChainSupport.capabilities.maxImageCount) {
       imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -355,24 +434,18 @@ namespace teng {
   }
 
   void SwapChain::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+    const size_t frameCount = std::clamp<uint32_t>(policy.framesInFlight, 1, MAX_FRAMES_IN_FLIGHT);
+    imageAvailableSemaphores.resize(frameCount);
+    renderFinishedSemaphores.resize(frameCount);
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (size_t i = 0; i < frameCount; i++) {
       if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
               VK_SUCCESS ||
           vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-              VK_SUCCESS ||
-          vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+              VK_SUCCESS) {
         throw std::runtime_error("failed to create synchronization objects for a frame!");
       }
     }
@@ -392,21 +465,26 @@ namespace teng {
 
   VkPresentModeKHR SwapChain::chooseSwapPresentMode(
       const std::vector<VkPresentModeKHR> &availablePresentModes) {
-    for (const auto &availablePresentMode : availablePresentModes) {
-      if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-        std::cout << "Present mode: Mailbox" << std::endl;
-        return availablePresentMode;
-      }
+    // Everything falls back to FIFO, which every surface supports. IMMEDIATE
+    // first tries the other modes that wait less for the display.
+    std::vector<VkPresentModeKHR> candidates{policy.presentMode};
+    switch (policy.presentMode) {
+      case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+        candidates.push_back(VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+        break;
+      default:
+        break;
     }
 
-    // for (const auto &availablePresentMode : availablePresentModes) {
-    //   if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-    //     std::cout << "Present mode: Immediate" << std::endl;
-    //     return availablePresentMode;
-    //   }
-    // }
+    for (auto candidate : candidates) {
+      if (std::find(availablePresentModes.begin(), availablePresentModes.end(), candidate) != availablePresentModes.end()) {
+        std::cout << "Present mode: " << PresentPolicy::s_PresentModeName(candidate) << std::endl;
+        return candidate;
+      }
+    }
 
-    std::cout << "Present mode: V-Sync" << std::endl;
+    std::cout << "Present mode: fifo" << std::endl;
     return VK_PRESENT_MODE_FIFO_KHR;
   }
 
@@ -1,46 +1,87 @@
 #pragma once
 
 #include "teng_device.hpp"
+#include "teng_render_target.hpp"
 
 // vulkan headers
 #include <vulkan/vulkan.h>
 
 // std lib headers
+#include <functional>
 #include <string>
 #include <vector>
 #include <memory>
 
 namespace teng {
 
-  class SwapChain {
+  // How frames are queued and presented. Lower latency and higher throughput
+  // pull in opposite directions, so this is picked at runtime per deployment.
+  struct PresentPolicy {
+    // Preferred mode. Falls back when the surface doesn't support it, see chooseSwapPresentMode.
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    // Requested swap chain images, clamped to what the surface allows. 0 asks for minImageCount + 1.
+    uint32_t imageCount = 0;
+    // Frames the CPU may record while the GPU works on earlier ones, 1 to SwapChain::MAX_FRAMES_IN_FLIGHT.
+    uint32_t framesInFlight = 2;
+    // CPU-side latency limiter. When set, a new frame only starts once frame N - frameLatencyLimit
+    // has finished on the GPU, so input is sampled closer to when the frame is shown.
+    // 0 or anything >= framesInFlight leaves the limit to the frames in flight.
+    uint32_t frameLatencyLimit = 0;
+
+    static PresentPolicy s_LowLatency();
+    static PresentPolicy s_Throughput();
+
+    // "fifo", "fifo-relaxed", "mailbox" or "immediate". Returns false for anything else.
+    static bool s_ParsePresentMode(const std::string &name, VkPresentModeKHR &mode);
+    static const char *s_PresentModeName(VkPresentModeKHR mode);
+  };
 
-    public:
+  class SwapChain : public RenderTarget {
 
-      static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+    public:
 
-      SwapChain(Device &deviceRef, VkExtent2D windowExtent);
+      // With useDynamicRendering the swap chain creates no render pass and no
+      // framebuffers, the Renderer renders straight into the image views.
+      SwapChain(Device &deviceRef, VkExtent2D windowExtent, const PresentPolicy &policy = {}, bool useDynamicRendering = false);
       SwapChain(Device &deviceRef, VkExtent2D windowExtent, std::shared_ptr<SwapChain> previous);
-      ~SwapChain();
+      ~SwapChain() override;
 
       SwapChain(const SwapChain &) = delete;
       SwapChain &operator=(const SwapChain &) = delete;
 
-      VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
-      VkRenderPass getRenderPass() { return renderPass; }
-      VkImageView getImageView(int index) { return swapChainImageViews[index]; }
-      size_t imageCount() { return swapChainImages.size(); }
+      bool usesDynamicRendering() const override { return useDynamicRendering; }
+      const PresentPolicy &getPresentPolicy() const { return policy; }
+      VkPresentModeKHR getPresentMode() const { return presentMode; }
+      uint32_t framesInFlight() const override { return static_cast<uint32_t>(imageAvailableSemaphores.size()); }
+      VkFramebuffer getFrameBuffer(int index) override { return swapChainFramebuffers[index]; }
+      VkRenderPass getRenderPass() override { return renderPass; }
+      VkImage getImage(int index) override { return swapChainImages[index]; }
+      VkImageView getImageView(int index) override { return swapChainImageViews[index]; }
+      VkImage getDepthImage(int index) override { return depthImages[index]; }
+      VkImageView getDepthImageView(int index) override { return depthImageViews[index]; }
+      VkFormat getSwapChainDepthFormat() { return swapChainDepthFormat; }
+      size_t imageCount() override { return swapChainImages.size(); }
       VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
       VkExtent2D getSwapChainExtent() { return swapChainExtent; }
       uint32_t width() { return swapChainExtent.width; }
       uint32_t height() { return swapChainExtent.height; }
 
-      float extentAspectRatio() {
-        return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
-      }
+      VkExtent2D getExtent() override { return swapChainExtent; }
+      VkFormat getColorFormat() override { return swapChainImageFormat; }
+      VkFormat getDepthFormat() override { return swapChainDepthFormat; }
+      VkImageLayout getFinalColorLayout() const override { return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; }
+
       VkFormat findDepthFormat();
 
-      VkResult acquireNextImage(uint32_t *imageIndex);
-      VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+      VkResult acquireNextImage(uint32_t frameSlot, uint32_t *imageIndex) override;
+      VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex, uint32_t frameSlot, uint64_t *timelineValue,
+                                    const std::function<void()> &beforeSubmit) override;
+
+      // With DeviceFeatures::presentWait every present gets the next id, starting at 1 for each swap chain.
+      uint64_t lastPresentId() const { return presentId; }
+      // Waits until the present with the given id has reached the display. False on timeout or
+      // when present wait is unsupported.
+      bool waitForPresent(uint64_t id, uint64_t timeoutNanoseconds);
       bool compareSwapFormats(const SwapChain& r_SwapChain) {
         return r_SwapChain.swapChainImageFormat == swapChainImageFormat &&
           r_SwapChain.swapChainDepthFormat == swapChainDepthFormat;
@@ -55,6 +96,7 @@ namespace teng {
       void createRenderPass();
       void createFramebuffers();
       void createSyncObjects();
+      void takeSyncObjects(SwapChain &previous);
 
       // Helper functions
       VkSurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -66,9 +108,12 @@ namespace teng {
       VkFormat swapChainImageFormat;
       VkFormat swapChainDepthFormat;
       VkExtent2D swapChainExtent;
+      VkPresentModeKHR presentMode;
 
+      PresentPolicy policy;
+      bool useDynamicRendering = false;
       std::vector<VkFramebuffer> swapChainFramebuffers;
-      VkRenderPass renderPass;
+      VkRenderPass renderPass = VK_NULL_HANDLE;
 
       std::vector<VkImage> depthImages;
       std::vector<VkDeviceMemory> depthImageMemorys;
@@ -82,11 +127,10 @@ namespace teng {
 
       VkSwapchainKHR swapChain;
 
+      // Binary, the presentation engine doesn't take timeline semaphores.
       std::vector<VkSemaphore> imageAvailableSemaphores;
       std::vector<VkSemaphore> renderFinishedSemaphores;
-      std::vector<VkFence> inFlightFences;
-      std::vector<VkFence> imagesInFlight;
-      size_t currentFrame = 0;
+      uint64_t presentId = 0;
   };
 
 }  // namespace teng
@@ -0,0 +1,108 @@
+#include "teng_thread_pool.hpp"
+#include "teng_profiler.hpp"
+
+// std
+#include <algorithm>
+#include <string>
+
+namespace teng {
+
+    ThreadPool::ThreadPool(uint32_t workerCount) {
+        if(workerCount == 0) {
+            workerCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+        }
+        for(uint32_t i = 0; i < workerCount; i++) {
+            m_Workers.emplace_back([this, i]() {
+                TENG_PROFILE_THREAD("worker " + std::to_string(i));
+                m_WorkerLoop();
+            });
+        }
+    };
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock{m_Mutex};
+            m_Stop = true;
+        }
+        m_WorkAvailable.notify_all();
+        for(auto& worker : m_Workers) {
+            worker.join();
+        }
+    };
+
+    void ThreadPool::parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& function) {
+        if(count == 0) return;
+        grain = std::max(grain, 1u);
+        const uint32_t chunkCount = (count - 1) / grain + 1;
+        if(chunkCount == 1 || m_Workers.empty()) {
+            function(0, count);
+            return;
+        }
+
+        std::lock_guard<std::mutex> call{m_CallMutex};
+        Job job{&function, count, grain, chunkCount};
+        {
+            std::unique_lock<std::mutex> lock{m_Mutex};
+            // A worker that woke too late for the previous job may still be leaving it.
+            m_WorkDone.wait(lock, [this]() { return m_Busy == 0; });
+            m_Job = job;
+            m_NextChunk.store(0, std::memory_order_relaxed);
+            m_Generation++;
+        }
+        m_WorkAvailable.notify_all();
+
+        m_RunChunks(job);
+
+        // Every chunk is taken, the ones still running belong to busy workers.
+        std::unique_lock<std::mutex> lock{m_Mutex};
+        m_WorkDone.wait(lock, [this]() { return m_Busy == 0; });
+        m_Job = Job{};
+    };
+
+    void ThreadPool::s_ForChunks(
+        ThreadPool* threadPool,
+        uint32_t count,
+        uint32_t grain,
+        const std::function<void(uint32_t, uint32_t)>& function) {
+        if(threadPool) {
+            threadPool->parallelFor(count, grain, function);
+            return;
+        }
+        grain = std::max(grain, 1u);
+        for(uint32_t begin = 0; begin < count; begin += grain) {
+            function(begin, std::min(begin + grain, count));
+        }
+    };
+
+    void ThreadPool::m_WorkerLoop() {
+        uint64_t seen = 0;
+        while(true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock{m_Mutex};
+                m_WorkAvailable.wait(lock, [&]() { return m_Stop || m_Generation != seen; });
+                if(m_Stop) return;
+                seen = m_Generation;
+                job = m_Job;
+                m_Busy++;
+            }
+
+            if(job.function) m_RunChunks(job);
+
+            {
+                std::lock_guard<std::mutex> lock{m_Mutex};
+                m_Busy--;
+            }
+            m_WorkDone.notify_all();
+        }
+    };
+
+    void ThreadPool::m_RunChunks(const Job& job) {
+        while(true) {
+            const uint32_t chunk = m_NextChunk.fetch_add(1, std::memory_order_relaxed);
+            if(chunk >= job.chunkCount) return;
+            const uint32_t begin = chunk * job.grain;
+            (*job.function)(begin, std::min(begin + job.grain, job.count));
+        }
+    };
+} // namespace teng
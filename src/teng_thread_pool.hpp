@@ -0,0 +1,71 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace teng {
+
+    // Worker threads for data-parallel passes over the scene. parallelFor
+    // splits a range into chunks that the workers and the calling thread take
+    // from a shared counter, and returns once all of them are done, so the
+    // range function can reference the caller's locals.
+    class ThreadPool {
+
+        public:
+
+            // workerCount = 0 uses one worker per hardware thread besides the caller's.
+            explicit ThreadPool(uint32_t workerCount = 0);
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool &operator=(const ThreadPool&) = delete;
+
+            // Workers plus the calling thread.
+            uint32_t getThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; };
+
+            // Calls function(begin, end) for chunks of at most grain items that
+            // together cover [0, count), in no particular order and on any thread.
+            // Runs inline when there is a single chunk. Calls from several threads
+            // are serialized, function must not call parallelFor itself or throw.
+            void parallelFor(uint32_t count, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& function);
+
+            // parallelFor on threadPool, or the same chunks in order on the calling
+            // thread when it is null. Chunks start at multiples of grain either way,
+            // so begin / grain can index per chunk data.
+            static void s_ForChunks(
+                ThreadPool* threadPool,
+                uint32_t count,
+                uint32_t grain,
+                const std::function<void(uint32_t, uint32_t)>& function);
+
+        private:
+
+            struct Job {
+                const std::function<void(uint32_t, uint32_t)>* function{nullptr};
+                uint32_t count{0};
+                uint32_t grain{1};
+                uint32_t chunkCount{0};
+            };
+
+            void m_WorkerLoop();
+            void m_RunChunks(const Job& job);
+
+            std::mutex m_CallMutex; // One parallelFor at a time.
+            std::mutex m_Mutex;
+            std::condition_variable m_WorkAvailable;
+            std::condition_variable m_WorkDone;
+            Job m_Job;
+            uint64_t m_Generation{0}; // Bumped for every job, workers join each one once.
+            uint32_t m_Busy{0};       // Workers inside m_RunChunks.
+            std::atomic<uint32_t> m_NextChunk{0};
+            bool m_Stop{false};
+
+            std::vector<std::thread> m_Workers;
+    };
+} // namespace teng
@@ -0,0 +1,68 @@
+#include "teng_trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace teng {
+
+    std::string escapeJson(const std::string& text) {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for(char c : text) {
+            switch(c) {
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\t': escaped += "\\t"; break;
+                default:
+                    if(static_cast<unsigned char>(c) < 0x20) {
+                        char code[8];
+                        std::snprintf(code, sizeof(code), "\\u%04x", c);
+                        escaped += code;
+                    } else {
+                        escaped += c;
+                    }
+            }
+        }
+        return escaped;
+    }
+
+    void writeChromeTrace(
+        std::ostream& out,
+        const std::vector<TraceEvent>& events,
+        const std::vector<std::pair<uint32_t, std::string>>& threadNames)
+    {
+        // Timestamps are microseconds, relative to the first event to keep them short.
+        int64_t originNs = 0;
+        if(!events.empty()) {
+            originNs = std::min_element(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+                return a.startNs < b.startNs;
+            })->startNs;
+        }
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for(const auto& [threadId, name] : threadNames) {
+            out << (first ? "" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+                << ",\"args\":{\"name\":\"" << escapeJson(name) << "\"}}";
+            first = false;
+        }
+
+        char times[96];
+        for(const TraceEvent& event : events) {
+            std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+                          static_cast<double>(event.startNs - originNs) / 1000.0,
+                          static_cast<double>(event.durationNs) / 1000.0);
+            out << (first ? "" : ",\n")
+                << "{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"" << event.category
+                << "\",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << event.threadId;
+            if(!event.args.empty()) {
+                out << ",\"args\":{" << event.args << "}";
+            }
+            out << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+    }
+} // namespace teng
@@ -0,0 +1,34 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace teng {
+
+    // One complete event of a Chrome trace (chrome://tracing, Perfetto).
+    // Times are std::chrono::steady_clock nanoseconds, GPU events are
+    // converted to that clock so CPU and GPU work line up.
+    struct TraceEvent {
+        std::string name;
+        const char* category{"cpu"};
+        int64_t startNs{0};
+        int64_t durationNs{0};
+        uint32_t threadId{0};
+        std::string args; // JSON object members without the braces, may be empty.
+    };
+
+    // Track the GPU profiler's events go to.
+    constexpr uint32_t GPU_TRACE_THREAD_ID = 0xFFFF;
+
+    // Writes a complete trace. threadNames label the tracks.
+    void writeChromeTrace(
+        std::ostream& out,
+        const std::vector<TraceEvent>& events,
+        const std::vector<std::pair<uint32_t, std::string>>& threadNames = {});
+
+    std::string escapeJson(const std::string& text);
+} // namespace teng
@@ -0,0 +1,399 @@
+#include "teng_transform_batch.hpp"
+
+// std
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define TENG_TRANSFORM_BATCH_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TENG_TRANSFORM_BATCH_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TENG_TRANSFORM_BATCH_NEON 1
+#endif
+
+namespace teng {
+
+    namespace {
+
+#if TENG_TRANSFORM_BATCH_AVX2
+        struct Lanes {
+            using F = __m256;
+            static constexpr uint32_t WIDTH = 8;
+            static constexpr const char* NAME = "avx2";
+
+            static F load(const float* p) { return _mm256_load_ps(p); }
+            static void store(float* p, F v) { _mm256_store_ps(p, v); }
+            static F set(float v) { return _mm256_set1_ps(v); }
+            static F add(F a, F b) { return _mm256_add_ps(a, b); }
+            static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+            static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+            // a * b + c
+            static F fma(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+            // Toward zero, for |a| < 2^31.
+            static F truncate(F a) { return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+            // All bits set where a < b, none elsewhere.
+            static F less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+            // a where mask is set, b elsewhere.
+            static F select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+            static F bitAnd(F a, F b) { return _mm256_and_ps(a, b); }
+            // ~a & b
+            static F bitAndNot(F a, F b) { return _mm256_andnot_ps(a, b); }
+            static F bitXor(F a, F b) { return _mm256_xor_ps(a, b); }
+            // Writes a, b, c and d of lane l to out[l] + offset, one 16 byte store per lane.
+            static void storeTransposed(F a, F b, F c, F d, float* const* out, uint32_t offset) {
+                const F ab0 = _mm256_unpacklo_ps(a, b);
+                const F ab1 = _mm256_unpackhi_ps(a, b);
+                const F cd0 = _mm256_unpacklo_ps(c, d);
+                const F cd1 = _mm256_unpackhi_ps(c, d);
+                // Lanes l and l + 4 of each.
+                const F lanes[4]{
+                    _mm256_shuffle_ps(ab0, cd0, 0x44),
+                    _mm256_shuffle_ps(ab0, cd0, 0xEE),
+                    _mm256_shuffle_ps(ab1, cd1, 0x44),
+                    _mm256_shuffle_ps(ab1, cd1, 0xEE)};
+                for(uint32_t l = 0; l < 4; l++) {
+                    _mm_storeu_ps(out[l] + offset, _mm256_castps256_ps128(lanes[l]));
+                    _mm_storeu_ps(out[l + 4] + offset, _mm256_extractf128_ps(lanes[l], 1));
+                }
+            }
+        };
+#elif TENG_TRANSFORM_BATCH_SSE2
+        struct Lanes {
+            using F = __m128;
+            static constexpr uint32_t WIDTH = 4;
+            static constexpr const char* NAME = "sse2";
+
+            static F load(const float* p) { return _mm_load_ps(p); }
+            static void store(float* p, F v) { _mm_store_ps(p, v); }
+            static F set(float v) { return _mm_set1_ps(v); }
+            static F add(F a, F b) { return _mm_add_ps(a, b); }
+            static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+            static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+            static F fma(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+            static F truncate(F a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+            static F less(F a, F b) { return _mm_cmplt_ps(a, b); }
+            static F select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+            static F bitAnd(F a, F b) { return _mm_and_ps(a, b); }
+            static F bitAndNot(F a, F b) { return _mm_andnot_ps(a, b); }
+            static F bitXor(F a, F b) { return _mm_xor_ps(a, b); }
+            static void storeTransposed(F a, F b, F c, F d, float* const* out, uint32_t offset) {
+                _MM_TRANSPOSE4_PS(a, b, c, d);
+                _mm_storeu_ps(out[0] + offset, a);
+                _mm_storeu_ps(out[1] + offset, b);
+                _mm_storeu_ps(out[2] + offset, c);
+                _mm_storeu_ps(out[3] + offset, d);
+            }
+        };
+#elif TENG_TRANSFORM_BATCH_NEON
+        struct Lanes {
+            using F = float32x4_t;
+            static constexpr uint32_t WIDTH = 4;
+            static constexpr const char* NAME = "neon";
+
+            static F load(const float* p) { return vld1q_f32(p); }
+            static void store(float* p, F v) { vst1q_f32(p, v); }
+            static F set(float v) { return vdupq_n_f32(v); }
+            static F add(F a, F b) { return vaddq_f32(a, b); }
+            static F sub(F a, F b) { return vsubq_f32(a, b); }
+            static F mul(F a, F b) { return vmulq_f32(a, b); }
+            static F fma(F a, F b, F c) { return vmlaq_f32(c, a, b); }
+            static F truncate(F a) { return vcvtq_f32_s32(vcvtq_s32_f32(a)); }
+            static F less(F a, F b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+            static F select(F mask, F a, F b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+            static F bitAnd(F a, F b) {
+                return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+            }
+            static F bitAndNot(F a, F b) {
+                return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(b), vreinterpretq_u32_f32(a)));
+            }
+            static F bitXor(F a, F b) {
+                return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+            }
+            static void storeTransposed(F a, F b, F c, F d, float* const* out, uint32_t offset) {
+                const float32x4x4_t columns{{a, b, c, d}};
+                vst4q_lane_f32(out[0] + offset, columns, 0);
+                vst4q_lane_f32(out[1] + offset, columns, 1);
+                vst4q_lane_f32(out[2] + offset, columns, 2);
+                vst4q_lane_f32(out[3] + offset, columns, 3);
+            }
+        };
+#else
+        // One lane, so the kernels below have a single implementation.
+        struct Lanes {
+            using F = float;
+            static constexpr uint32_t WIDTH = 1;
+            static constexpr const char* NAME = "scalar";
+
+            static F load(const float* p) { return *p; }
+            static void store(float* p, F v) { *p = v; }
+            static F set(float v) { return v; }
+            static F add(F a, F b) { return a + b; }
+            static F sub(F a, F b) { return a - b; }
+            static F mul(F a, F b) { return a * b; }
+            static F fma(F a, F b, F c) { return a * b + c; }
+            static F truncate(F a) { return static_cast<float>(static_cast<int32_t>(a)); }
+            static F less(F a, F b) { return s_Bits(a < b ? UINT32_MAX : 0u); }
+            static F select(F mask, F a, F b) { return s_Bits((s_Bits(mask) & s_Bits(a)) | (~s_Bits(mask) & s_Bits(b))); }
+            static F bitAnd(F a, F b) { return s_Bits(s_Bits(a) & s_Bits(b)); }
+            static F bitAndNot(F a, F b) { return s_Bits(~s_Bits(a) & s_Bits(b)); }
+            static F bitXor(F a, F b) { return s_Bits(s_Bits(a) ^ s_Bits(b)); }
+            static void storeTransposed(F a, F b, F c, F d, float* const* out, uint32_t offset) {
+                out[0][offset] = a;
+                out[0][offset + 1] = b;
+                out[0][offset + 2] = c;
+                out[0][offset + 3] = d;
+            }
+
+            static uint32_t s_Bits(float v) { uint32_t bits; std::memcpy(&bits, &v, sizeof(bits)); return bits; }
+            static float s_Bits(uint32_t bits) { float v; std::memcpy(&v, &bits, sizeof(v)); return v; }
+        };
+#endif
+
+        using F = Lanes::F;
+        constexpr uint32_t WIDTH = Lanes::WIDTH;
+
+        // Cephes' sinf and cosf. The angle is reduced to r in [-pi/4, pi/4]
+        // around the nearest multiple j of pi/4 with j even, then sine and
+        // cosine of r come from minimax polynomials and the octant picks which
+        // of the two is the result and its sign. Both are computed anyway, so
+        // there is no branch per lane.
+        void sinCos(F x, F& sine, F& cosine) {
+            constexpr float FOUR_OVER_PI = 1.27323954473516f;
+            // pi/4 split into three parts, so j * pi/4 is subtracted in extended precision.
+            constexpr float PI_OVER_FOUR_1 = .78515625f;
+            constexpr float PI_OVER_FOUR_2 = 2.4187564849853515625e-4f;
+            constexpr float PI_OVER_FOUR_3 = 3.77489497744594108e-8f;
+
+            const F signBit = Lanes::set(-0.f);
+            const F sign = Lanes::bitAnd(x, signBit);
+            const F absolute = Lanes::bitXor(x, sign);
+
+            // j rounded up to even, and j mod 8, which is 0, 2, 4 or 6.
+            F j = Lanes::truncate(Lanes::mul(absolute, Lanes::set(FOUR_OVER_PI)));
+            j = Lanes::add(j, Lanes::fma(Lanes::set(-2.f), Lanes::truncate(Lanes::mul(j, Lanes::set(.5f))), j));
+            const F octant = Lanes::fma(Lanes::set(-8.f), Lanes::truncate(Lanes::mul(j, Lanes::set(.125f))), j);
+
+            F r = Lanes::fma(j, Lanes::set(-PI_OVER_FOUR_1), absolute);
+            r = Lanes::fma(j, Lanes::set(-PI_OVER_FOUR_2), r);
+            r = Lanes::fma(j, Lanes::set(-PI_OVER_FOUR_3), r);
+            const F z = Lanes::mul(r, r);
+
+            F cosR = Lanes::fma(Lanes::set(2.443315711809948e-5f), z, Lanes::set(-1.388731625493765e-3f));
+            cosR = Lanes::fma(cosR, z, Lanes::set(4.166664568298827e-2f));
+            cosR = Lanes::mul(Lanes::mul(cosR, z), z);
+            cosR = Lanes::add(Lanes::fma(z, Lanes::set(-.5f), cosR), Lanes::set(1.f));
+
+            F sinR = Lanes::fma(Lanes::set(-1.9515295891e-4f), z, Lanes::set(8.3321608736e-3f));
+            sinR = Lanes::fma(sinR, z, Lanes::set(-1.6666654611e-1f));
+            sinR = Lanes::fma(Lanes::mul(sinR, z), r, r);
+
+            // Octants 0 and 4 are near a multiple of pi, in 2 and 6 sine and cosine swap.
+            const F octantMod4 = Lanes::fma(Lanes::set(-4.f), Lanes::truncate(Lanes::mul(octant, Lanes::set(.25f))), octant);
+            const F nearPi = Lanes::less(octantMod4, Lanes::set(1.f));
+            // Sine is negative in octants 4 and 6, cosine in 2 and 4.
+            const F sineNegative = Lanes::bitAndNot(Lanes::less(octant, Lanes::set(3.f)), signBit);
+            const F cosineNegative = Lanes::bitAnd(
+                Lanes::bitAnd(Lanes::less(Lanes::set(1.f), octant), Lanes::less(octant, Lanes::set(5.f))), signBit);
+
+            sine = Lanes::bitXor(Lanes::select(nearPi, sinR, cosR), Lanes::bitXor(sign, sineNegative));
+            cosine = Lanes::bitXor(Lanes::select(nearPi, cosR, sinR), cosineNegative);
+        }
+
+        // One batch of transforms, transposed so each field is a row of lanes.
+        enum Row : uint32_t {
+            TRANSLATION_X, TRANSLATION_Y, TRANSLATION_Z,
+            SCALE_X, SCALE_Y, SCALE_Z,
+            INVERSE_SCALE_X, INVERSE_SCALE_Y, INVERSE_SCALE_Z,
+            ROTATION_X, ROTATION_Y, ROTATION_Z, ROTATION_W,
+            ROW_COUNT,
+        };
+
+        struct alignas(32) Batch {
+            float rows[ROW_COUNT][WIDTH];
+
+            F load(Row row) const { return Lanes::load(rows[row]); }
+        };
+
+        void setRotation(Batch& batch, uint32_t lane, const glm::vec3& rotation) {
+            batch.rows[ROTATION_X][lane] = rotation.x;
+            batch.rows[ROTATION_Y][lane] = rotation.y;
+            batch.rows[ROTATION_Z][lane] = rotation.z;
+        }
+
+        void setRotation(Batch& batch, uint32_t lane, const glm::quat& rotation) {
+            batch.rows[ROTATION_X][lane] = rotation.x;
+            batch.rows[ROTATION_Y][lane] = rotation.y;
+            batch.rows[ROTATION_Z][lane] = rotation.z;
+            batch.rows[ROTATION_W][lane] = rotation.w;
+        }
+
+        // Rotation matrix columns, column c row r at c * 3 + r. Same terms as
+        // TransformComponent::s_Mat4, rotate.y * rotate.x * rotate.z.
+        void eulerColumns(const Batch& batch, F* columns) {
+            F s1, c1, s2, c2, s3, c3;
+            sinCos(batch.load(ROTATION_Y), s1, c1);
+            sinCos(batch.load(ROTATION_X), s2, c2);
+            sinCos(batch.load(ROTATION_Z), s3, c3);
+
+            const F s1s2 = Lanes::mul(s1, s2);
+            const F c1s2 = Lanes::mul(c1, s2);
+            columns[0] = Lanes::fma(s1s2, s3, Lanes::mul(c1, c3));
+            columns[1] = Lanes::mul(c2, s3);
+            columns[2] = Lanes::sub(Lanes::mul(c1s2, s3), Lanes::mul(c3, s1));
+            columns[3] = Lanes::sub(Lanes::mul(s1s2, c3), Lanes::mul(c1, s3));
+            columns[4] = Lanes::mul(c2, c3);
+            columns[5] = Lanes::fma(c1s2, c3, Lanes::mul(s1, s3));
+            columns[6] = Lanes::mul(c2, s1);
+            columns[7] = Lanes::bitXor(s2, Lanes::set(-0.f));
+            columns[8] = Lanes::mul(c1, c2);
+        }
+
+        // The same as glm::mat3_cast.
+        void quaternionColumns(const Batch& batch, F* columns) {
+            const F x = batch.load(ROTATION_X);
+            const F y = batch.load(ROTATION_Y);
+            const F z = batch.load(ROTATION_Z);
+            const F w = batch.load(ROTATION_W);
+            const F two = Lanes::set(2.f);
+            const F one = Lanes::set(1.f);
+
+            const F x2 = Lanes::mul(x, two);
+            const F y2 = Lanes::mul(y, two);
+            const F z2 = Lanes::mul(z, two);
+            const F xx = Lanes::mul(x, x2);
+            const F yy = Lanes::mul(y, y2);
+            const F zz = Lanes::mul(z, z2);
+            const F xy = Lanes::mul(x, y2);
+            const F xz = Lanes::mul(x, z2);
+            const F yz = Lanes::mul(y, z2);
+            const F wx = Lanes::mul(w, x2);
+            const F wy = Lanes::mul(w, y2);
+            const F wz = Lanes::mul(w, z2);
+
+            columns[0] = Lanes::sub(one, Lanes::add(yy, zz));
+            columns[1] = Lanes::add(xy, wz);
+            columns[2] = Lanes::sub(xz, wy);
+            columns[3] = Lanes::sub(xy, wz);
+            columns[4] = Lanes::sub(one, Lanes::add(xx, zz));
+            columns[5] = Lanes::add(yz, wx);
+            columns[6] = Lanes::add(xz, wy);
+            columns[7] = Lanes::sub(yz, wx);
+            columns[8] = Lanes::sub(one, Lanes::add(xx, yy));
+        }
+
+        // Transposes WIDTH transforms into a batch, computes their rotation
+        // columns and writes both matrices a column of every lane at a time.
+        template<typename Rotation, typename Columns>
+        void matrices(
+            const glm::vec3* translations,
+            const Rotation* rotations,
+            const glm::vec3* scales,
+            const uint32_t* indices,
+            uint32_t count,
+            glm::mat4* worldMatrices,
+            glm::mat4* normalMatrices,
+            Columns computeColumns)
+        {
+            auto entity = [indices](uint32_t i) { return indices ? indices[i] : i; };
+
+            Batch batch{};
+            // Where the spare lanes of the last batch are written.
+            glm::mat4 spare[2];
+            float* world[WIDTH];
+            float* normal[WIDTH];
+
+            const F zero = Lanes::set(0.f);
+            const F one = Lanes::set(1.f);
+
+            for(uint32_t base = 0; base < count; base += WIDTH) {
+                const uint32_t lanes = std::min(WIDTH, count - base);
+
+                for(uint32_t lane = 0; lane < WIDTH; lane++) {
+                    // Spare lanes repeat the last transform, their results are dropped.
+                    const uint32_t e = entity(base + std::min(lane, lanes - 1));
+                    batch.rows[TRANSLATION_X][lane] = translations[e].x;
+                    batch.rows[TRANSLATION_Y][lane] = translations[e].y;
+                    batch.rows[TRANSLATION_Z][lane] = translations[e].z;
+                    batch.rows[SCALE_X][lane] = scales[e].x;
+                    batch.rows[SCALE_Y][lane] = scales[e].y;
+                    batch.rows[SCALE_Z][lane] = scales[e].z;
+                    batch.rows[INVERSE_SCALE_X][lane] = 1.f / scales[e].x;
+                    batch.rows[INVERSE_SCALE_Y][lane] = 1.f / scales[e].y;
+                    batch.rows[INVERSE_SCALE_Z][lane] = 1.f / scales[e].z;
+                    setRotation(batch, lane, rotations[e]);
+
+                    world[lane] = lane < lanes ? &worldMatrices[e][0][0] : &spare[0][0][0];
+                    normal[lane] = lane < lanes ? &normalMatrices[e][0][0] : &spare[1][0][0];
+                }
+
+                F columns[9];
+                computeColumns(batch, columns);
+                for(uint32_t c = 0; c < 3; c++) {
+                    const F scale = batch.load(static_cast<Row>(SCALE_X + c));
+                    const F inverseScale = batch.load(static_cast<Row>(INVERSE_SCALE_X + c));
+                    const F* column = columns + c * 3;
+                    Lanes::storeTransposed(
+                        Lanes::mul(column[0], scale), Lanes::mul(column[1], scale), Lanes::mul(column[2], scale), zero,
+                        world, c * 4);
+                    Lanes::storeTransposed(
+                        Lanes::mul(column[0], inverseScale), Lanes::mul(column[1], inverseScale), Lanes::mul(column[2], inverseScale), zero,
+                        normal, c * 4);
+                }
+                Lanes::storeTransposed(
+                    batch.load(TRANSLATION_X), batch.load(TRANSLATION_Y), batch.load(TRANSLATION_Z), one,
+                    world, 12);
+                Lanes::storeTransposed(zero, zero, zero, one, normal, 12);
+            }
+        }
+    }
+
+    const char* TransformBatch::s_InstructionSet() {
+        return Lanes::NAME;
+    };
+
+    void TransformBatch::s_EulerMatrices(
+        const glm::vec3* translations,
+        const glm::vec3* rotations,
+        const glm::vec3* scales,
+        const uint32_t* indices,
+        uint32_t count,
+        glm::mat4* worldMatrices,
+        glm::mat4* normalMatrices)
+    {
+        matrices(translations, rotations, scales, indices, count, worldMatrices, normalMatrices, eulerColumns);
+    };
+
+    void TransformBatch::s_QuaternionMatrices(
+        const glm::vec3* translations,
+        const glm::quat* rotations,
+        const glm::vec3* scales,
+        const uint32_t* indices,
+        uint32_t count,
+        glm::mat4* worldMatrices,
+        glm::mat4* normalMatrices)
+    {
+        matrices(translations, rotations, scales, indices, count, worldMatrices, normalMatrices, quaternionColumns);
+    };
+
+    void TransformBatch::s_SinCos(const float* angles, uint32_t count, float* sines, float* cosines) {
+        alignas(32) float in[WIDTH];
+        alignas(32) float sineOut[WIDTH];
+        alignas(32) float cosineOut[WIDTH];
+        for(uint32_t base = 0; base < count; base += WIDTH) {
+            const uint32_t lanes = std::min(WIDTH, count - base);
+            for(uint32_t lane = 0; lane < WIDTH; lane++) {
+                in[lane] = lane < lanes ? angles[base + lane] : 0.f;
+            }
+            F sine, cosine;
+            sinCos(Lanes::load(in), sine, cosine);
+            Lanes::store(sineOut, sine);
+            Lanes::store(cosineOut, cosine);
+            std::copy(sineOut, sineOut + lanes, sines + base);
+            std::copy(cosineOut, cosineOut + lanes, cosines + base);
+        }
+    };
+} // namespace teng
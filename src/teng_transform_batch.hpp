@@ -0,0 +1,55 @@
+#pragma once
+
+// libs
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// std
+#include <cstdint>
+
+namespace teng {
+
+    // World and normal matrices for many transforms at once, the batch form of
+    // TransformComponent::s_Mat4 and s_NormalMatrix. Transforms are processed a
+    // vector register's worth at a time: AVX2 (8 wide) when built with -mavx2
+    // -mfma or -march=native, SSE2 (4 wide) on any other x86-64 build, NEON
+    // (4 wide) on ARM, and one at a time otherwise.
+    //
+    // Results agree with the scalar functions to a few ulp, not bit for bit.
+    // Normal matrices are written as mat4 with the 3x3 part in the upper left,
+    // like glm::mat4{TransformComponent::s_NormalMatrix(...)}.
+    class TransformBatch {
+
+        public:
+
+            // Backend compiled in: "avx2", "sse2", "neon" or "scalar".
+            static const char* s_InstructionSet();
+
+            // For each i < count, with e = indices ? indices[i] : i, writes the
+            // matrices of translations[e], rotations[e] and scales[e] to
+            // worldMatrices[e] and normalMatrices[e]. Rotations are Tait-Bryan
+            // angles in radians, as in TransformComponent.
+            static void s_EulerMatrices(
+                const glm::vec3* translations,
+                const glm::vec3* rotations,
+                const glm::vec3* scales,
+                const uint32_t* indices,
+                uint32_t count,
+                glm::mat4* worldMatrices,
+                glm::mat4* normalMatrices);
+
+            // The same with rotations as unit quaternions, which needs no trig.
+            static void s_QuaternionMatrices(
+                const glm::vec3* translations,
+                const glm::quat* rotations,
+                const glm::vec3* scales,
+                const uint32_t* indices,
+                uint32_t count,
+                glm::mat4* worldMatrices,
+                glm::mat4* normalMatrices);
+
+            // sines[i] and cosines[i] of angles[i]. Accurate to a few ulp for
+            // |angle| < 8192, precision degrades beyond.
+            static void s_SinCos(const float* angles, uint32_t count, float* sines, float* cosines);
+    };
+} // namespace teng